@@ -0,0 +1,67 @@
+/* File: arena.cc
+ * --------------
+ * Implementation of the Arena class.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "utility.h"
+
+// every allocation starts on this boundary, enough for a double
+static const size_t Alignment = 8;
+// the block header, rounded up so the first allocation is aligned
+static const size_t HeaderSize = (sizeof(Arena::Block) + Alignment - 1) & ~(Alignment - 1);
+
+Arena::Arena(size_t size)
+{
+    blocks = NULL;
+    blockSize = size;
+    bytesUsed = 0;
+}
+
+void *Arena::Alloc(size_t bytes)
+{
+    bytes = (bytes + Alignment - 1) & ~(Alignment - 1);
+    if (!blocks || blocks->used + bytes > blocks->size)
+    {
+        // a request bigger than a block gets a block of its own
+        size_t size = bytes > blockSize ? bytes : blockSize;
+        Block *b = (Block *)malloc(HeaderSize + size);
+        if (!b)
+            Failure("out of memory");
+        b->size = size;
+        b->used = 0;
+        b->next = blocks;
+        blocks = b;
+    }
+    void *result = (char *)blocks + HeaderSize + blocks->used;
+    blocks->used += bytes;
+    bytesUsed += bytes;
+    return result;
+}
+
+char *Arena::Strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    return (char *)memcpy(Alloc(len), s, len);
+}
+
+size_t Arena::BytesReserved() const
+{
+    size_t total = 0;
+    for (Block *b = blocks; b; b = b->next)
+        total += HeaderSize + b->size;
+    return total;
+}
+
+void Arena::Release()
+{
+    while (blocks)
+    {
+        Block *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    bytesUsed = 0;
+}
@@ -0,0 +1,49 @@
+/* File: arena.h
+ * -------------
+ * The Arena class is a bump allocator: memory is handed out from big
+ * blocks one after another and never given back piece by piece, only
+ * all at once when the arena is released. It suits the compiler's
+ * data that lives until the end of a phase, where a separate new per
+ * object costs a header and a trip through malloc each.
+ *
+ * Nothing allocated in an arena has its destructor run.
+ */
+
+#ifndef _H_arena
+#define _H_arena
+
+#include <stddef.h>
+
+class Arena
+{
+public:
+  // the header of each block, its memory follows
+  struct Block
+  {
+    Block *next;
+    size_t size, used;
+  };
+
+protected:
+  Block *blocks; // the current one first
+  size_t blockSize;
+  size_t bytesUsed;
+
+public:
+  Arena(size_t blockSize = 64 * 1024);
+  ~Arena() { Release(); }
+
+  // bytes of memory aligned for any type
+  void *Alloc(size_t bytes);
+  // a copy of s in the arena
+  char *Strdup(const char *s);
+
+  // the bytes handed out and the bytes taken from malloc for them
+  size_t BytesUsed() const { return bytesUsed; }
+  size_t BytesReserved() const;
+
+  // Frees everything allocated in the arena at once.
+  void Release();
+};
+
+#endif
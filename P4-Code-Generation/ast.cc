@@ -7,20 +7,89 @@
 #include "ast_decl.h"
 #include <string.h> // strdup
 #include <stdio.h>  // printf
+#include <vector>
 #include "errors.h"
 
 CodeGenerator *CodeGen = new CodeGenerator();
 
+// The location table is made of chunks in the arena, so an entry never
+// moves once GetLocation has handed out a pointer to it.
+static const int LocationChunk = 256;
+static std::vector<yyltype *> &LocationChunks()
+{
+    static std::vector<yyltype *> chunks;
+    return chunks;
+}
+static int numLocations = 0;
+static int numNodes = 0;
+
+static yyltype *GetLocationAt(int i)
+{
+    return &LocationChunks()[i / LocationChunk][i % LocationChunk];
+}
+
+Arena &Node::Pool()
+{
+    static Arena arena;
+    return arena;
+}
+
+void *Node::operator new(size_t size)
+{
+    numNodes++;
+    return Pool().Alloc(size);
+}
+
+char *Node::Strdup(const char *s)
+{
+    return Pool().Strdup(s);
+}
+
+static bool SameLocation(yyltype *a, yyltype *b)
+{
+    return a->first_line == b->first_line && a->first_column == b->first_column &&
+           a->last_line == b->last_line && a->last_column == b->last_column;
+}
+
 Node::Node(yyltype loc)
 {
-    location = new yyltype(loc);
+    std::vector<yyltype *> &chunks = LocationChunks();
+    yyltype *last = numLocations ? GetLocationAt(numLocations - 1) : NULL;
+    if (last && SameLocation(last, &loc))
+        location = numLocations - 1;
+    else
+    {
+        if (numLocations % LocationChunk == 0)
+            chunks.push_back((yyltype *)Pool().Alloc(LocationChunk * sizeof(yyltype)));
+        location = numLocations++;
+        *GetLocationAt(location) = loc;
+    }
     parent = NULL;
+    type_of_expr = NULL;
+    emit_loc = NULL;
 }
 
 Node::Node()
 {
-    location = NULL;
+    location = -1;
     parent = NULL;
+    type_of_expr = NULL;
+    emit_loc = NULL;
+}
+
+yyltype *Node::GetLocation()
+{
+    return location < 0 ? NULL : GetLocationAt(location);
+}
+
+void Node::FreeAll()
+{
+    PrintDebug("astmem", "%d nodes, %d locations, %lu bytes in the arena (%lu reserved)",
+               numNodes, numLocations, (unsigned long)Pool().BytesUsed(),
+               (unsigned long)Pool().BytesReserved());
+    Pool().Release();
+    LocationChunks().clear();
+    numNodes = numLocations = 0;
 }
 
 void Node::Print(int indentLevel, const char *label)
@@ -38,7 +107,8 @@ void Node::Print(int indentLevel, const char *label)
 
 Identifier::Identifier(yyltype loc, const char *n) : Node(loc)
 {
-    name = strdup(n);
+    name = Strdup(n);
+    cache = NULL;
 }
 
 void Identifier::ShowChildNodes(int indentLevel)
@@ -82,10 +152,3 @@ void Identifier::Emit()
     if (cache)
         emit_loc = cache->GetEmitLoc();
 }
-
-void Identifier::SetPrefix(const char *prefix)
-{
-    char *s = (char *)malloc(strlen(name) + strlen(prefix) + 1);
-    sprintf(s, "%s%s", prefix, name);
-    name = s;
-}
@@ -10,6 +10,9 @@
  * file), that location can be NULL for those nodes that don't care/use
  * locations. The location is typcially set by the node constructor.  The
  * location is used to provide the context when reporting semantic errors.
+ * The locations are kept in a table, a node just has the 32-bit index of
+ * its own, and a node made at the same location as the one made right
+ * before it (a Decl and its Identifier, say) shares the entry.
  *
  * Parent: Each node has a pointer to its parent. For a Program node, the
  * parent is NULL, for all other nodes it is the pointer to the node one level
@@ -18,6 +21,11 @@
  * instead we wait until assigning the children into the parent node and then
  * set up links in both directions. The parent link is typically not used
  * during parsing, but is more important in later phases.
+ *
+ * Memory: The nodes, the names they keep and the location table are all
+ * allocated in one arena (see arena.h) rather than one by one, and the
+ * whole tree is freed at once with Node::FreeAll when the compiler is
+ * done with it. Nodes are never deleted on their own.
 
  */
 
@@ -30,22 +38,35 @@
 #include "scope.h"
 #include "errors.h"
 #include "codegen.h"
+#include "arena.h"
 
 extern CodeGenerator *CodeGen;
 
 class Node
 {
 protected:
-  yyltype *location;
+  int location; // index in the location table, -1 for none
   Node *parent;
   Type *type_of_expr;
   Location *emit_loc;
 
+  // the arena of the tree, made on first use as the built-in types
+  // are nodes made by static initializers
+  static Arena &Pool();
+
 public:
   Node(yyltype loc);
   Node();
 
-  yyltype *GetLocation() { return location; }
+  static void *operator new(size_t size);
+  static void operator delete(void *p) {}
+  // a copy of s in the arena, for the names nodes keep
+  static char *Strdup(const char *s);
+  // Prints the number of nodes and locations and the bytes of the
+  // arena with -d astmem, then frees the whole tree.
+  static void FreeAll();
+
+  yyltype *GetLocation();
   void SetParent(Node *p) { parent = p; }
   Node *GetParent() { return parent; }
 
@@ -85,7 +106,6 @@ public:
   Decl *ReturnCache() { return cache; }
 
   void Emit();
-  void SetPrefix(const char *prefix);
   Location *ReturnEmitLocD() { return GetEmitLoc(); }
 };
 
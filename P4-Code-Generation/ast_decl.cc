@@ -5,8 +5,13 @@
 #include "ast_decl.h"
 #include "ast_type.h"
 #include "ast_stmt.h"
+#include "ast_expr.h"
 #include "errors.h"
 #include "list.h"
+#include "callgraph.h"
+#include "profile.h"
+#include "gc.h"
+#include "heapprof.h"
 
 Decl::Decl(Identifier *n) : Node(*n->GetLocation())
 {
@@ -20,7 +25,11 @@ VarDecl::VarDecl(Identifier *n, Type *t) : Decl(n)
 {
     Assert(n != NULL && t != NULL);
     (type = t)->SetParent(this);
+    is_global = false;
     class_member_offset = -1;
+    is_assigned = false;
+    const_bound = false;
+    const_value = 0;
 }
 
 void VarDecl::ShowChildNodes(int indentLevel)
@@ -72,29 +81,54 @@ void VarDecl::Check(checkT c)
     }
 }
 
+int VarDecl::ReturnSize()
+{
+    return type->ReturnTypeSize();
+}
+
+// a Location named after the variable, marked if it holds a double
+Location *VarDecl::NewLocation(Segment seg, int offset, Location *base)
+{
+    return Location::Get(seg, offset, id->ReturnIdenName(), base,
+                         type == Type::doubleType);
+}
+
 void VarDecl::OffsetAssign()
 {
     if (this->IsGlobalVar())
     {
-        emit_loc = new Location(gpRelative, CodeGen->GetNextGlobal(), id->ReturnIdenName());
+        emit_loc = this->NewLocation(gpRelative, CodeGen->GetNextGlobal(this->ReturnSize()));
     }
 }
 
 void VarDecl::OffsetForMember(bool inClass, int offset)
 {
     class_member_offset = offset;
-    emit_loc = new Location(fpRelative, offset, id->ReturnIdenName(), CodeGen->ptrThis);
+    emit_loc = this->NewLocation(fpRelative, offset, CodeGen->ptrThis);
 }
 
 void VarDecl::Emit()
 {
-    if (type == Type::doubleType)
+    // a local gets a fresh slot every time its function is emitted,
+    // specialized functions emit the same body more than once.
+    if (!this->IsGlobalVar() && !this->MemberOfClass())
     {
-        ReportError::Formatted(this->GetLocation(), "Double not supported");
-        Assert(false);
+        emit_loc = this->NewLocation(fpRelative, CodeGen->GetNextLocal(this->ReturnSize()));
+        gc_maps->AddRoot(emit_loc, type);
     }
-    if (!emit_loc)
-        emit_loc = new Location(fpRelative, CodeGen->GetNextLocal(), id->ReturnIdenName());
+}
+
+void VarDecl::BindConstant(int value)
+{
+    const_bound = true;
+    const_value = value;
+}
+
+bool VarDecl::ReturnConstValue(int *value)
+{
+    if (const_bound)
+        *value = const_value;
+    return const_bound;
 }
 
 ClassDecl::ClassDecl(Identifier *n, NamedType *ex, List<NamedType *> *imp, List<Decl *> *m) : Decl(n)
@@ -107,6 +141,11 @@ ClassDecl::ClassDecl(Identifier *n, NamedType *ex, List<NamedType *> *imp, List<
     (members = m)->SetParentAll(this);
     inst_size = 4;
     vtable_size = 0;
+    var_members = NULL;
+    fn_members = NULL;
+    itable = NULL;
+    is_instantiated = false;
+    label = -1;
 }
 
 void ClassDecl::ShowChildNodes(int indentLevel)
@@ -366,7 +405,9 @@ void ClassDecl::OffsetAssign()
         }
     }
 
-    inst_size = var_members->NumElements() * 4 + 4;
+    inst_size = 4;
+    for (int i = 0; i < var_members->NumElements(); i++)
+        inst_size += var_members->Nth(i)->ReturnSize();
     vtable_size = fn_members->NumElements() * 4;
 
     int temp = inst_size;
@@ -375,7 +416,7 @@ void ClassDecl::OffsetAssign()
         Decl *dec = members->Nth(i);
         if (dec->IsVarDecl())
         {
-            temp -= 4;
+            temp -= dynamic_cast<VarDecl *>(dec)->ReturnSize();
             dec->OffsetForMember(true, temp);
         }
         else if (dec->FnIsDecl())
@@ -390,8 +431,52 @@ void ClassDecl::OffsetAssign()
     }
 }
 
+FnDecl *ClassDecl::FindMethod(const char *name)
+{
+    for (int i = 0; i < fn_members->NumElements(); i++)
+    {
+        FnDecl *fn = fn_members->Nth(i);
+        if (!strcmp(fn->GetId()->ReturnIdenName(), name))
+            return fn;
+    }
+    return NULL;
+}
+
+// The method a receiver of this class runs for a dispatch offset,
+// negative offsets are interface slots.
+FnDecl *ClassDecl::MethodAtOffset(int offset)
+{
+    if (offset >= 0)
+        return offset / 4 < fn_members->NumElements() ? fn_members->Nth(offset / 4) : NULL;
+    int slot = (-offset - 4) / 4;
+    if (!itable || slot >= itable->NumElements())
+        return NULL;
+    return itable->Nth(slot);
+}
+
+void ClassDecl::InterfacesForList(List<InterfaceDecl *> *interfaces)
+{
+    for (int i = 0; i < implements->NumElements(); i++)
+    {
+        InterfaceDecl *d = dynamic_cast<InterfaceDecl *>(
+            implements->Nth(i)->GetId()->ReturnCache());
+        bool found = false;
+        for (int j = 0; j < interfaces->NumElements(); j++)
+            if (interfaces->Nth(j) == d)
+                found = true;
+        if (d && !found)
+            interfaces->Append(d);
+    }
+    if (extends)
+    {
+        ClassDecl *d = dynamic_cast<ClassDecl *>(extends->GetId()->ReturnCache());
+        d->InterfacesForList(interfaces);
+    }
+}
+
 void ClassDecl::PrefixForMember()
 {
+    label = Labels::Named(id->ReturnIdenName());
     for (int i = 0; i < members->NumElements(); ++i)
         members->Nth(i)->PrefixForMember();
 }
@@ -400,13 +485,28 @@ void ClassDecl::Emit()
 {
     members->EmitAll();
 
-    List<const char *> *method_l = new List<const char *>;
+    // a class nobody instantiates needs no vtable, and a slot whose
+    // method is never called is left empty.
+    if (!is_instantiated)
+        return;
+    List<int> *method_l = new List<int>;
     for (int i = 0; i < fn_members->NumElements(); ++i)
     {
         FnDecl *func = fn_members->Nth(i);
-        method_l->Append(func->GetId()->ReturnIdenName());
+        method_l->Append(func->IsReachable() ? func->GetLabel() : -1);
     }
-    CodeGen->GenVTable(id->ReturnIdenName(), method_l);
+    List<int> *itable_l = NULL;
+    if (itable)
+    {
+        itable_l = new List<int>;
+        for (int i = 0; i < itable->NumElements(); ++i)
+        {
+            FnDecl *func = itable->Nth(i);
+            itable_l->Append(func && func->IsReachable() ? func->GetLabel() : -1);
+        }
+    }
+    List<int> *gc_map = gc_maps->IsEnabled() ? GcMaps::ClassMap(this) : NULL;
+    CodeGen->GenVTable(label, method_l, itable_l, gc_map);
 }
 
 InterfaceDecl::InterfaceDecl(Identifier *n, List<Decl *> *m) : Decl(n)
@@ -461,9 +561,8 @@ void InterfaceDecl::Check(checkT c)
 
 void InterfaceDecl::Emit()
 {
-    ReportError::Formatted(this->GetLocation(),
-                           "Interface is not supported");
-    Assert(0);
+    // nothing to emit, the methods live in the interface tables of the
+    // implementing classes.
 }
 
 FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl *> *d) : Decl(n)
@@ -473,6 +572,9 @@ FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl *> *d) : Decl(n)
     (formals = d)->SetParentAll(this);
     body = NULL;
     vtable_ofst = -1;
+    versions = new List<FnVersion *>;
+    is_reachable = false;
+    label = -1;
 }
 
 void FnDecl::SetBodyOfFunction(Stmt *b)
@@ -591,19 +693,20 @@ bool FnDecl::Equivalent(Decl *other)
     return true;
 }
 
+// The label of a function is its name mangled once: _Class.name for
+// a method, _name for a global function, and main left alone.
 void FnDecl::PrefixForMember()
 {
     Decl *dec = dynamic_cast<Decl *>(this->GetParent());
+    const char *name = id->ReturnIdenName();
+    char buf[256];
     if (dec && dec->IsClassDecl())
-    {
-        id->SetPrefix(".");
-        id->SetPrefix(dec->GetId()->ReturnIdenName());
-        id->SetPrefix("_");
-    }
-    else if (strcmp(id->ReturnIdenName(), "main"))
-    {
-        id->SetPrefix("_");
-    }
+        snprintf(buf, sizeof(buf), "_%s.%s", dec->GetId()->ReturnIdenName(), name);
+    else if (strcmp(name, "main"))
+        snprintf(buf, sizeof(buf), "_%s", name);
+    else
+        snprintf(buf, sizeof(buf), "%s", name);
+    label = Labels::Named(buf);
 }
 
 void FnDecl::OffsetForMember(bool inClass, int offset)
@@ -611,30 +714,188 @@ void FnDecl::OffsetForMember(bool inClass, int offset)
     vtable_ofst = offset;
 }
 
+FnVersion *FnDecl::GetPrimaryVersion()
+{
+    return versions->NumElements() ? versions->Nth(0) : NULL;
+}
+
+void FnDecl::BindFormals(FnVersion *v)
+{
+    for (int i = 0; i < formals->NumElements(); i++)
+    {
+        if (v->IsBound(i))
+            formals->Nth(i)->BindConstant(v->GetValue(i));
+        else
+            formals->Nth(i)->UnbindConstant();
+    }
+}
+
+void FnDecl::UnbindFormals()
+{
+    for (int i = 0; i < formals->NumElements(); i++)
+        formals->Nth(i)->UnbindConstant();
+}
+
+bool FnDecl::IsMain()
+{
+    return !this->MemberOfClass() && !strcmp(id->ReturnIdenName(), "main");
+}
+
+void FnDecl::EmitExitHooks()
+{
+    if (!this->IsMain())
+        return;
+    if (CodeGen->IsOutputBuffered())
+        CodeGen->GenBuiltInCall(OutFlush);
+    if (profile->IsGenerating())
+        CodeGen->GenBuiltInCall(ProfileDump);
+    if (gc_maps->IsEnabled())
+        CodeGen->GenBuiltInCall(GcReport);
+    if (heap_profile->IsEnabled())
+        CodeGen->GenBuiltInCall(HeapDump);
+}
+
 void FnDecl::Emit()
+{
+    if (!is_reachable)
+        return;
+    if (versions->NumElements() == 0)
+    {
+        this->EmitVersion(label);
+        return;
+    }
+    for (int i = 0; i < versions->NumElements(); i++)
+    {
+        FnVersion *v = versions->Nth(i);
+        PrintDebug("tac+", "Emitting %s.", Labels::Name(v->GetLabel()));
+        this->BindFormals(v);
+        this->EmitVersion(v->GetLabel());
+        this->UnbindFormals();
+    }
+}
+
+void FnDecl::EmitVersion(int label)
 {
     Decl *dec = dynamic_cast<Decl *>(this->GetParent());
-    CodeGen->GenLabel(id->ReturnIdenName());
+    // the prologue and epilogue count for the line of the name
+    CodeGen->SetLocation(id->GetLocation());
+    CodeGen->GenLabel(label);
 
-    BeginFunc *func = CodeGen->GenBeginFunc();
+    int func = CodeGen->GenBeginFunc();
+    gc_maps->BeginFunction(label);
 
     if (dec && dec->IsClassDecl())
     {
         CodeGen->GetNextParam();
+        gc_maps->AddPointer(CodeGen->ptrThis, false);
     }
 
     for (int i = 0; i < formals->NumElements(); i++)
     {
         VarDecl *v = formals->Nth(i);
-        Location *l = new Location(fpRelative, CodeGen->GetNextParam(),
-                                   v->GetId()->ReturnIdenName());
+        Location *l = v->NewLocation(fpRelative, CodeGen->GetNextParam(v->ReturnSize()));
         v->SetEmitLoc(l);
+        gc_maps->AddRoot(l, v->ReturnType());
     }
 
+    if (profile->IsGenerating())
+        profile->GenIncrement(Profile::Key("fn", NULL, Labels::Name(this->label)));
+
     if (body)
         body->Emit();
 
-    func->SetFrameSize(CodeGen->GetFrameSize());
+    CodeGen->SetLocation(id->GetLocation());
+    this->EmitExitHooks();
+
+    CodeGen->SetFrameSize(func, CodeGen->GetFrameSize());
 
     CodeGen->GenEndFunc();
+    gc_maps->EndFunction(func);
+}
+
+// Small methods are inlined where a call gets devirtualized: an empty
+// body, returning a constant, this, a parameter or a field, or storing
+// a parameter or constant into a field. With self == NULL it only
+// tells whether the body qualifies, otherwise it emits the body for
+// receiver self and the evaluated args, *result gets the return value.
+bool FnDecl::EmitInline(Location *self, List<Location *> *args, Location **result)
+{
+    StmtBlock *b = dynamic_cast<StmtBlock *>(body);
+    if (!b || b->GetDecls()->NumElements() != 0 || b->GetStmts()->NumElements() > 1)
+        return false;
+    if (result)
+        *result = NULL;
+    if (b->GetStmts()->NumElements() == 0)
+        return true;
+
+    Stmt *s = b->GetStmts()->Nth(0);
+    Expr *value;
+    VarDecl *dst = NULL;
+    if (dynamic_cast<ReturnStmt *>(s))
+    {
+        value = dynamic_cast<ReturnStmt *>(s)->GetExpr();
+    }
+    else if (dynamic_cast<AssignExpr *>(s))
+    {
+        AssignExpr *a = dynamic_cast<AssignExpr *>(s);
+        FieldAccess *f = dynamic_cast<FieldAccess *>(a->GetLeft());
+        dst = f ? f->ReturnVarDecl() : NULL;
+        if (!dst || dst->GetMemberOffset() < 0)
+            return false;
+        value = a->GetRight();
+    }
+    else
+    {
+        return false;
+    }
+
+    Location *loc = NULL;
+    int c, formal = -1;
+    FieldAccess *f = dynamic_cast<FieldAccess *>(value);
+    VarDecl *v = f ? f->ReturnVarDecl() : NULL;
+    for (int i = 0; v && i < formals->NumElements(); i++)
+        if (formals->Nth(i) == v)
+            formal = i;
+    if (value->ExprIsEmpty())
+    {
+        if (dst)
+            return false;
+    }
+    else if (value->ReturnConstValue(&c))
+    {
+        if (self)
+            loc = CodeGen->GenLoadConstant(c);
+    }
+    else if (dynamic_cast<StringConstant *>(value) || dynamic_cast<NullConstant *>(value))
+    {
+        if (self)
+        {
+            value->Emit();
+            loc = value->GetEmitLoc();
+        }
+    }
+    else if (dynamic_cast<This *>(value))
+    {
+        loc = self;
+    }
+    else if (v && v->GetMemberOffset() >= 0 && !dst)
+    {
+        if (self)
+            loc = CodeGen->GenLoad(self, v->GetMemberOffset(), v->ReturnType() == Type::doubleType);
+    }
+    else if (formal >= 0)
+    {
+        if (self)
+            loc = args->Nth(formal);
+    }
+    else
+    {
+        return false;
+    }
+
+    if (self && dst)
+        CodeGen->GenStore(self, loc, dst->GetMemberOffset());
+    else if (self)
+        *result = loc;
+    return true;
 }
@@ -18,6 +18,8 @@ class NamedType;
 class Identifier;
 class Stmt;
 class FnDecl;
+class FnVersion;
+class InterfaceDecl;
 
 class Decl : public Node
 {
@@ -49,6 +51,9 @@ protected:
   Type *type;
   bool is_global;
   int class_member_offset;
+  bool is_assigned;
+  bool const_bound;
+  int const_value;
   void CheckDecl();
   bool IsGlobalVar() { return this->GetParent()->GetParent() == NULL; }
   bool MemberOfClass()
@@ -62,6 +67,7 @@ public:
   const char *ReturnNodeName() { return "VarDecl"; }
   void ShowChildNodes(int indentLevel);
   Type *ReturnType() { return type; }
+  int ReturnSize();
   bool IsVarDecl() { return true; }
   void GenerateST();
   void Check(checkT c);
@@ -69,6 +75,15 @@ public:
   void OffsetForMember(bool inClass, int offset);
   void Emit();
   void SetEmitLoc(Location *l) { emit_loc = l; }
+  Location *NewLocation(Segment seg, int offset, Location *base = NULL);
+
+  // constant propagation
+  void SetAssigned() { is_assigned = true; }
+  bool IsAssigned() { return is_assigned; }
+  void BindConstant(int value);
+  void UnbindConstant() { const_bound = false; }
+  bool ReturnConstValue(int *value);
+  int GetMemberOffset() { return class_member_offset; }
 };
 
 class ClassDecl : public Decl
@@ -81,6 +96,9 @@ protected:
   int vtable_size;
   List<VarDecl *> *var_members;
   List<FnDecl *> *fn_members;
+  List<FnDecl *> *itable; // by interface slot, NULL for an unused slot
+  bool is_instantiated;
+  int label; // of the vtable, see Labels in tac.h
   void CheckDecl();
   void CheckInherit();
 
@@ -102,6 +120,20 @@ public:
   int GetVTableSize() { return vtable_size; }
   void MembersForList(List<VarDecl *> *vars, List<FnDecl *> *fns);
   void PrefixForMember();
+  int GetLabel() { return label; }
+
+  // reachability
+  void SetInstantiated() { is_instantiated = true; }
+  bool IsInstantiated() { return is_instantiated; }
+  List<FnDecl *> *GetMethods() { return fn_members; }
+  List<VarDecl *> *GetFields() { return var_members; }
+  FnDecl *FindMethod(const char *name);
+  FnDecl *MethodAtOffset(int offset);
+
+  // interface dispatch
+  void InterfacesForList(List<InterfaceDecl *> *interfaces);
+  void SetITable(List<FnDecl *> *t) { itable = t; }
+  List<FnDecl *> *GetITable() { return itable; }
 };
 
 class InterfaceDecl : public Decl
@@ -129,7 +161,11 @@ protected:
   Type *returnType;
   Stmt *body;
   int vtable_ofst;
+  List<FnVersion *> *versions;
+  bool is_reachable;
+  int label; // the mangled name, see PrefixForMember
   void CheckDecl();
+  void EmitVersion(int label);
 
 public:
   FnDecl(Identifier *name, Type *returnType, List<VarDecl *> *formals);
@@ -147,10 +183,23 @@ public:
   void Check(checkT c);
 
   void PrefixForMember();
+  int GetLabel() { return label; }
   void OffsetForMember(bool inClass, int offset);
   void Emit();
   int ReturnVTableOfst() { return vtable_ofst; }
+  void AddVersion(FnVersion *v) { versions->Append(v); }
+  List<FnVersion *> *GetVersions() { return versions; }
+  FnVersion *GetPrimaryVersion();
+  void BindFormals(FnVersion *v);
+  void UnbindFormals();
+  void SetReachable() { is_reachable = true; }
+  bool IsReachable() { return is_reachable; }
+  bool CanInline() { return this->EmitInline(NULL, NULL, NULL); }
+  bool EmitInline(Location *self, List<Location *> *args, Location **result);
   bool HasReturnValue() { return returnType != Type::voidType; }
+  bool IsMain();
+  // calls made before main returns or falls off its end
+  void EmitExitHooks();
   bool MemberOfClass()
   {
     Decl *d = dynamic_cast<Decl *>(this->GetParent());
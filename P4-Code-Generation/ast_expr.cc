@@ -3,11 +3,32 @@
  * Implementation of expression node classes.
  */
 #include <iostream>
+#include <sstream>
 #include "ast_expr.h"
 #include "ast_type.h"
 #include "ast_decl.h"
 #include <string.h>
+#include <limits.h>
 #include "errors.h"
+#include "callgraph.h"
+#include "profile.h"
+#include "gc.h"
+#include "heapprof.h"
+
+Location *Expr::ReturnEmitLocD()
+{
+    gc_maps->AddRoot(emit_loc, type_of_expr);
+    return emit_loc;
+}
+
+bool Expr::EmitConstant()
+{
+    int value;
+    if (!this->ReturnConstValue(&value))
+        return false;
+    emit_loc = CodeGen->GenLoadConstant(value);
+    return true;
+}
 
 void EmptyExpr::ShowChildNodes(int indentLevel)
 {
@@ -51,6 +72,12 @@ void IntConstant::Emit()
     emit_loc = CodeGen->GenLoadConstant(value);
 }
 
+bool IntConstant::ReturnConstValue(int *v)
+{
+    *v = value;
+    return true;
+}
+
 DoubleConstant::DoubleConstant(yyltype loc, double val) : Expr(loc)
 {
     value = val;
@@ -75,9 +102,7 @@ void DoubleConstant::Check(checkT c)
 
 void DoubleConstant::Emit()
 {
-    ReportError::Formatted(this->GetLocation(),
-                           "Double is not supported");
-    Assert(0);
+    emit_loc = CodeGen->GenLoadConstant(value);
 }
 
 BoolConstant::BoolConstant(yyltype loc, bool val) : Expr(loc)
@@ -110,10 +135,16 @@ void BoolConstant::Emit()
     emit_loc = CodeGen->GenLoadConstant(temp);
 }
 
+bool BoolConstant::ReturnConstValue(int *v)
+{
+    *v = value ? 1 : 0;
+    return true;
+}
+
 StringConstant::StringConstant(yyltype loc, const char *val) : Expr(loc)
 {
     Assert(val != NULL);
-    value = strdup(val);
+    value = Strdup(val);
 }
 void StringConstant::ShowChildNodes(int indentLevel)
 {
@@ -268,8 +299,44 @@ void ArithmeticExpr::Check(checkT c)
     }
 }
 
+// folds with the wrap-around and truncation of the MIPS instructions,
+// division by zero is left for run time.
+bool ArithmeticExpr::ReturnConstValue(int *value)
+{
+    int l = 0, r;
+    if (type_of_expr != Type::intType)
+        return false;
+    if (left && !left->ReturnConstValue(&l))
+        return false;
+    if (!right->ReturnConstValue(&r))
+        return false;
+
+    unsigned int ul = l, ur = r;
+    switch (op->GetOpStr()[0])
+    {
+    case '+':
+        *value = (int)(ul + ur);
+        return true;
+    case '-':
+        *value = (int)(ul - ur);
+        return true;
+    case '*':
+        *value = (int)(ul * ur);
+        return true;
+    case '/':
+    case '%':
+        if (r == 0 || (l == INT_MIN && r == -1))
+            return false;
+        *value = op->GetOpStr()[0] == '/' ? l / r : l % r;
+        return true;
+    }
+    return false;
+}
+
 void ArithmeticExpr::Emit()
 {
+    if (this->EmitConstant())
+        return;
     bool left_exists = false;
     Location *loc;
     if (left != NULL)
@@ -280,6 +347,8 @@ void ArithmeticExpr::Emit()
     right->Emit();
     if (left_exists)
         loc = left->ReturnEmitLocD();
+    else if (type_of_expr == Type::doubleType)
+        loc = CodeGen->GenLoadConstant(0.0);
     else
         loc = CodeGen->GenLoadConstant(0);
 
@@ -326,8 +395,30 @@ void RelationalExpr::Check(checkT c)
     }
 }
 
+bool RelationalExpr::ReturnConstValue(int *value)
+{
+    int l, r;
+    if (!left->ReturnConstValue(&l) || !right->ReturnConstValue(&r))
+        return false;
+
+    const char *o = op->GetOpStr();
+    if (!strcmp(o, "<"))
+        *value = l < r;
+    else if (!strcmp(o, "<="))
+        *value = l <= r;
+    else if (!strcmp(o, ">"))
+        *value = l > r;
+    else if (!strcmp(o, ">="))
+        *value = l >= r;
+    else
+        return false;
+    return true;
+}
+
 void RelationalExpr::Emit()
 {
+    if (this->EmitConstant())
+        return;
     left->Emit();
     right->Emit();
     emit_loc = CodeGen->GenBinaryOp(op->GetOpStr(), left->ReturnEmitLocD(), right->ReturnEmitLocD());
@@ -372,8 +463,23 @@ void EqualityExpr::Check(checkT c)
     }
 }
 
+bool EqualityExpr::ReturnConstValue(int *value)
+{
+    int l, r;
+    if (!left->ReturnConstValue(&l) || !right->ReturnConstValue(&r))
+        return false;
+
+    if (!strcmp(op->GetOpStr(), "=="))
+        *value = l == r;
+    else
+        *value = l != r;
+    return true;
+}
+
 void EqualityExpr::Emit()
 {
+    if (this->EmitConstant())
+        return;
     const char *operator_type = op->GetOpStr(); // CHECK THIS LATER WHEN DEBUGGING
     left->Emit();
     right->Emit();
@@ -451,8 +557,28 @@ void LogicalExpr::Check(checkT c)
     }
 }
 
+bool LogicalExpr::ReturnConstValue(int *value)
+{
+    int l = 0, r;
+    if (left && !left->ReturnConstValue(&l))
+        return false;
+    if (!right->ReturnConstValue(&r))
+        return false;
+
+    const char *o = op->GetOpStr();
+    if (!strcmp(o, "!"))
+        *value = !r;
+    else if (!strcmp(o, "&&"))
+        *value = l && r;
+    else
+        *value = l || r;
+    return true;
+}
+
 void LogicalExpr::Emit()
 {
+    if (this->EmitConstant())
+        return;
     if (left != NULL)
         left->Emit();
     right->Emit();
@@ -469,6 +595,11 @@ void AssignExpr::ConfirmType()
     op->Check(enum_TypeCheck);
     right->Check(enum_TypeCheck);
 
+    // an assigned variable can never be bound to a constant.
+    FieldAccess *f = dynamic_cast<FieldAccess *>(left);
+    if (f && f->ReturnVarDecl())
+        f->ReturnVarDecl()->SetAssigned();
+
     Type *tl = left->ReturnType();
     Type *tr = right->ReturnType();
 
@@ -634,7 +765,7 @@ void ArrayAccess::Emit()
     t5 = CodeGen->GenBinaryOp("<", t0, t4);
     t6 = CodeGen->GenBinaryOp("==", t5, t1);
     t7 = CodeGen->GenBinaryOp("||", t2, t6);
-    const char *l = CodeGen->NewLabel();
+    int l = CodeGen->NewLabel();
     CodeGen->GenIfZ(t7, l);
     t8 = CodeGen->GenLoadConstant(err_arr_out_of_bounds);
     CodeGen->GenBuiltInCall(PrintString, t8);
@@ -648,7 +779,8 @@ void ArrayAccess::Emit()
 
 Location *ArrayAccess::ReturnEmitLocD()
 {
-    Location *t = CodeGen->GenLoad(emit_loc, 0);
+    Location *t = CodeGen->GenLoad(emit_loc, 0, type_of_expr == Type::doubleType);
+    gc_maps->AddRoot(t, type_of_expr);
     return t;
 }
 
@@ -776,15 +908,34 @@ void FieldAccess::Check(checkT c)
     }
 }
 
+VarDecl *FieldAccess::ReturnVarDecl()
+{
+    if (base || !field->ReturnCache() || !field->ReturnCache()->IsVarDecl())
+        return NULL;
+    return dynamic_cast<VarDecl *>(field->ReturnCache());
+}
+
+bool FieldAccess::ReturnConstValue(int *value)
+{
+    VarDecl *v = this->ReturnVarDecl();
+    return v ? v->ReturnConstValue(value) : false;
+}
+
 void FieldAccess::Emit()
 {
+    if (this->EmitConstant())
+        return;
     if (base)
         base->Emit();
     field->Emit();
     emit_loc = field->ReturnEmitLocD();
 
     if (base)
-        emit_loc = new Location(fpRelative, emit_loc->GetOffset(), emit_loc->GetName(), base->ReturnEmitLocD());
+    {
+        Location *field_loc = emit_loc;
+        emit_loc = Location::Get(fpRelative, field_loc->GetOffset(), field_loc->GetName(),
+                                 base->ReturnEmitLocD(), field_loc->IsDouble());
+    }
 }
 
 Location *FieldAccess::ReturnEmitLocD()
@@ -793,8 +944,9 @@ Location *FieldAccess::ReturnEmitLocD()
     if (t->GetBase() != NULL)
     {
         // this or some class instances.
-        t = CodeGen->GenLoad(t->GetBase(), t->GetOffset());
+        t = CodeGen->GenLoad(t->GetBase(), t->GetOffset(), t->IsDouble());
     }
+    gc_maps->AddRoot(t, type_of_expr);
     return t;
 }
 
@@ -806,6 +958,7 @@ Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr *> *a) : Expr(loc)
         base->SetParent(this);
     (field = f)->SetParent(this);
     (actuals = a)->SetParentAll(this);
+    target = -1;
 }
 
 void Call::ShowChildNodes(int indentLevel)
@@ -889,6 +1042,12 @@ void Call::ConfirmType()
     }
     actuals->CheckAll(enum_TypeCheck);
     this->CheckFuncArgs();
+
+    FnDecl *fn = dynamic_cast<FnDecl *>(field->ReturnCache());
+    if (!base && fn && !fn->MemberOfClass())
+        call_graph->AddCall(this, fn);
+    else if (fn)
+        call_graph->AddMethodCall(this, field->ReturnIdenName());
 }
 
 void Call::CheckFuncArgs()
@@ -954,6 +1113,8 @@ void Call::Emit()
     FnDecl *func = dynamic_cast<FnDecl *>(field->ReturnCache());
     Assert(func != NULL);
     bool isCall = (base) || (func->MemberOfClass());
+    if (profile->IsGenerating())
+        profile->GenIncrement(Profile::Key("call", GetLocation()));
 
     if (base)
         current_loc = base->ReturnEmitLocD();
@@ -963,26 +1124,102 @@ void Call::Emit()
     if (isCall)
     {
         t = CodeGen->GenLoad(current_loc, 0);
+        Decl *static_type = func->MemberOfClass() && !base
+                                ? dynamic_cast<Decl *>(func->GetParent())
+                                : dynamic_cast<NamedType *>(base->ReturnType())->GetId()->ReturnCache();
+        if (profile->IsGenerating())
+            this->EmitReceiverCounters(static_type, t);
+        ClassDecl *expected = call_graph->ExpectedReceiver(static_type, GetLocation());
+        FnDecl *callee = expected ? expected->MethodAtOffset(func->ReturnVTableOfst()) : NULL;
+        if (callee && callee->IsReachable() && callee->CanInline())
+        {
+            List<Location *> *args = new List<Location *>;
+            for (int i = 0; i < actuals->NumElements(); ++i)
+                args->Append(actuals->Nth(i)->ReturnEmitLocD());
+            PrintDebug("devirt", "line %d: %s speculated for class %s",
+                       GetLocation()->first_line, field->ReturnIdenName(),
+                       expected->GetId()->ReturnIdenName());
+            this->EmitGuardedCall(expected, callee, current_loc, t, args);
+            return;
+        }
         t = CodeGen->GenLoad(t, func->ReturnVTableOfst());
     }
 
+    int bytes = 0;
     for (int i = actuals->NumElements() - 1; i >= 0; --i)
     {
         Location *loc = actuals->Nth(i)->ReturnEmitLocD();
         CodeGen->GenPushParam(loc);
+        bytes += loc->IsDouble() ? CodeGenerator::DoubleSize : CodeGenerator::VarSize;
     }
 
+    bool returnsDouble = type_of_expr == Type::doubleType;
     if (isCall)
     {
         CodeGen->GenPushParam(current_loc);
-        emit_loc = CodeGen->GenACall(t, func->HasReturnValue());
-        CodeGen->GenPopParams(actuals->NumElements() * 4 + 4);
+        emit_loc = CodeGen->GenACall(t, func->HasReturnValue(), returnsDouble);
+        CodeGen->GenPopParams(bytes + 4);
     }
     else
     {
-        field->SetPrefix("_");
-        emit_loc = CodeGen->GenLCall(field->ReturnIdenName(), type_of_expr != Type::voidType);
-        CodeGen->GenPopParams(actuals->NumElements() * 4);
+        int label = target >= 0 ? target : func->GetLabel();
+        emit_loc = CodeGen->GenLCall(label, type_of_expr != Type::voidType, returnsDouble);
+        CodeGen->GenPopParams(bytes);
+    }
+}
+
+// Speculative devirtualization: if the vtable of the receiver is the
+// one of the class the call graph expects, run the inlined method of
+// that class, otherwise dispatch through the vtable as usual.
+void Call::EmitGuardedCall(ClassDecl *expected, FnDecl *callee, Location *self,
+                           Location *vtable, List<Location *> *args)
+{
+    FnDecl *func = dynamic_cast<FnDecl *>(field->ReturnCache());
+    bool returnsDouble = type_of_expr == Type::doubleType;
+    emit_loc = func->HasReturnValue() ? CodeGen->GenTempVar(returnsDouble) : NULL;
+
+    int slow = CodeGen->NewLabel();
+    int done = CodeGen->NewLabel();
+    Location *expected_vtable = CodeGen->GenLoadLabel(expected->GetLabel());
+    CodeGen->GenIfZ(CodeGen->GenBinaryOp("==", vtable, expected_vtable), slow);
+    Location *result;
+    callee->EmitInline(self, args, &result);
+    if (emit_loc)
+        CodeGen->GenAssign(emit_loc, result);
+    CodeGen->GenGoto(done);
+
+    CodeGen->GenLabel(slow);
+    Location *fn = CodeGen->GenLoad(vtable, func->ReturnVTableOfst());
+    int bytes = 0;
+    for (int i = args->NumElements() - 1; i >= 0; --i)
+    {
+        CodeGen->GenPushParam(args->Nth(i));
+        bytes += args->Nth(i)->IsDouble() ? CodeGenerator::DoubleSize : CodeGenerator::VarSize;
+    }
+    CodeGen->GenPushParam(self);
+    result = CodeGen->GenACall(fn, func->HasReturnValue(), returnsDouble);
+    CodeGen->GenPopParams(bytes + 4);
+    if (emit_loc)
+        CodeGen->GenAssign(emit_loc, result);
+    CodeGen->GenLabel(done);
+}
+
+// With -fprofile-generate, counts per live class the receiver could
+// have how often the call found it. ExpectedReceiver reads the counts
+// back to pick the class to speculate on.
+void Call::EmitReceiverCounters(Decl *staticType, Location *vtable)
+{
+    List<ClassDecl *> *classes = call_graph->GetLiveClasses();
+    for (int i = 0; i < classes->NumElements(); i++)
+    {
+        ClassDecl *c = classes->Nth(i);
+        if (!c->IsChildOf(staticType))
+            continue;
+        int next = CodeGen->NewLabel();
+        Location *class_vtable = CodeGen->GenLoadLabel(c->GetLabel());
+        CodeGen->GenIfZ(CodeGen->GenBinaryOp("==", vtable, class_vtable), next);
+        profile->GenIncrement(Profile::Key("recv", GetLocation(), c->GetId()->ReturnIdenName()));
+        CodeGen->GenLabel(next);
     }
 }
 
@@ -1012,6 +1249,9 @@ void NewExpr::ConfirmType()
     if (cType->ReturnType())
     {
         type_of_expr = cType;
+        ClassDecl *c = dynamic_cast<ClassDecl *>(cType->GetId()->ReturnCache());
+        if (c)
+            call_graph->AddNew(this, c);
     }
 }
 
@@ -1037,8 +1277,13 @@ void NewExpr::Emit()
     Assert(classdec != NULL);
     int size = classdec->GetInstanceSize();
     t = CodeGen->GenLoadConstant(size);
-    emit_loc = CodeGen->GenBuiltInCall(Alloc, t);
-    loc = CodeGen->GenLoadLabel(classdec->GetId()->ReturnIdenName());
+    int descriptor = -1;
+    if (gc_maps->IsEnabled())
+        descriptor = GcMaps::ClassDescriptor(classdec);
+    emit_loc = CodeGen->GenHeapAlloc(t, descriptor);
+    if (heap_profile->IsEnabled())
+        heap_profile->GenRecord(classdec->GetId()->ReturnIdenName(), GetLocation(), t);
+    loc = CodeGen->GenLoadLabel(classdec->GetLabel());
     CodeGen->GenStore(emit_loc, loc, 0);
 }
 
@@ -1081,7 +1326,7 @@ void NewArrayExpr::ConfirmType()
     }
     else
     {
-        type_of_expr = new ArrayType(*location, elemType);
+        type_of_expr = new ArrayType(*GetLocation(), elemType);
         type_of_expr->Check(enum_DeclCheck);
     }
 }
@@ -1106,19 +1351,29 @@ void NewArrayExpr::Emit()
     t0 = size->ReturnEmitLocD();
     t1 = CodeGen->GenLoadConstant(0);
     t2 = CodeGen->GenBinaryOp("<=", t0, t1);
-    const char *label = CodeGen->NewLabel();
+    int label = CodeGen->NewLabel();
     CodeGen->GenIfZ(t2, label);
     t3 = CodeGen->GenLoadConstant(err_arr_bad_size);
     CodeGen->GenBuiltInCall(PrintString, t3);
     CodeGen->GenBuiltInCall(Halt);
     CodeGen->GenLabel(label);
-    t4 = CodeGen->GenLoadConstant(1);
-    t5 = CodeGen->GenBinaryOp("+", t4, t0);
-    t6 = CodeGen->GenLoadConstant(elemType->ReturnTypeSize()); // May need to change?
-    t7 = CodeGen->GenBinaryOp("*", t5, t6);
-    t8 = CodeGen->GenBuiltInCall(Alloc, t7);
+    // the length word, then the elements
+    t4 = CodeGen->GenLoadConstant(CodeGenerator::VarSize);
+    t6 = CodeGen->GenLoadConstant(elemType->ReturnTypeSize());
+    t5 = CodeGen->GenBinaryOp("*", t0, t6);
+    t7 = CodeGen->GenBinaryOp("+", t5, t4);
+    int descriptor = -1;
+    if (gc_maps->IsEnabled())
+        descriptor = GcMaps::ArrayDescriptor(elemType);
+    t8 = CodeGen->GenHeapAlloc(t7, descriptor);
+    if (heap_profile->IsEnabled())
+    {
+        std::ostringstream name;
+        name << type_of_expr;
+        heap_profile->GenRecord(name.str().c_str(), GetLocation(), t7);
+    }
     CodeGen->GenStore(t8, t0);
-    t9 = CodeGen->GenBinaryOp("+", t8, t6);
+    t9 = CodeGen->GenBinaryOp("+", t8, t4);
     emit_loc = t9;
 }
 
@@ -1135,6 +1390,19 @@ void ReadIntegerExpr::Emit()
     emit_loc = CodeGen->GenBuiltInCall(ReadInteger);
 }
 
+void ReadDoubleExpr::Check(checkT c)
+{
+    if (c == enum_TypeCheck)
+    {
+        type_of_expr = Type::doubleType;
+    }
+}
+
+void ReadDoubleExpr::Emit()
+{
+    emit_loc = CodeGen->GenBuiltInCall(ReadDouble);
+}
+
 void ReadLineExpr::Check(checkT c)
 {
     if (c == enum_TypeCheck)
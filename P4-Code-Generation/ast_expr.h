@@ -16,6 +16,9 @@
 
 class NamedType;
 class Type;
+class VarDecl;
+class ClassDecl;
+class FnDecl;
 
 class Expr : public Stmt
 {
@@ -23,9 +26,16 @@ public:
   Expr(yyltype loc) : Stmt(loc) { type_of_expr = NULL; }
   Expr() : Stmt() { type_of_expr = NULL; }
 
-  virtual Location *ReturnEmitLocD() { return GetEmitLoc(); }
+  // The location of the value, loaded into a temp where needed. Also
+  // tells the collector the value lives there.
+  virtual Location *ReturnEmitLocD();
   virtual bool AccessibleArray() { return false; }
   virtual bool ExprIsEmpty() { return false; }
+
+  // constant folding: true if the value is known at compile time.
+  // int and bool only, bools fold to 0/1 as they are emitted.
+  virtual bool ReturnConstValue(int *value) { return false; }
+  bool EmitConstant();
 };
 
 class EmptyExpr : public Expr
@@ -51,6 +61,7 @@ public:
   void Check(checkT c);
 
   void Emit();
+  bool ReturnConstValue(int *value);
 };
 
 class DoubleConstant : public Expr
@@ -81,6 +92,7 @@ public:
   void Check(checkT c);
 
   void Emit();
+  bool ReturnConstValue(int *value);
 };
 
 class StringConstant : public Expr
@@ -92,6 +104,7 @@ public:
   StringConstant(yyltype loc, const char *val);
   const char *ReturnNodeName() { return "StringConstant"; }
   void ShowChildNodes(int indentLevel);
+  const char *GetValue() { return value; } // with the quotes
 
   void Check(checkT c);
 
@@ -136,6 +149,8 @@ public:
   CompoundExpr(Expr *lhs, Operator *op, Expr *rhs); // for binary
   CompoundExpr(Operator *op, Expr *rhs);            // for unary
   void ShowChildNodes(int indentLevel);
+  Expr *GetLeft() { return left; }
+  Expr *GetRight() { return right; }
 };
 
 class ArithmeticExpr : public CompoundExpr
@@ -150,6 +165,7 @@ public:
   void Check(checkT c);
 
   void Emit();
+  bool ReturnConstValue(int *value);
 };
 
 class RelationalExpr : public CompoundExpr
@@ -163,6 +179,7 @@ public:
   void Check(checkT c);
 
   void Emit();
+  bool ReturnConstValue(int *value);
 };
 
 class EqualityExpr : public CompoundExpr
@@ -176,6 +193,7 @@ public:
   void Check(checkT c);
 
   void Emit();
+  bool ReturnConstValue(int *value);
 };
 
 class LogicalExpr : public CompoundExpr
@@ -190,6 +208,7 @@ public:
   void Check(checkT c);
 
   void Emit();
+  bool ReturnConstValue(int *value);
 };
 
 class AssignExpr : public CompoundExpr
@@ -261,6 +280,8 @@ public:
   // code generation
   void Emit();
   Location *ReturnEmitLocD();
+  bool ReturnConstValue(int *value);
+  VarDecl *ReturnVarDecl();
 };
 
 class Call : public Expr
@@ -269,9 +290,13 @@ protected:
   Expr *base; // will be NULL if no explicit base
   Identifier *field;
   List<Expr *> *actuals;
+  int target; // label of the callee version, set by the call graph, -1 for none
   void CheckDecl();
   void ConfirmType();
   void CheckFuncArgs();
+  void EmitGuardedCall(ClassDecl *expected, FnDecl *callee, Location *self,
+                       Location *vtable, List<Location *> *args);
+  void EmitReceiverCounters(Decl *staticType, Location *vtable);
 
 public:
   Call(yyltype loc, Expr *base, Identifier *field, List<Expr *> *args);
@@ -279,6 +304,9 @@ public:
   void ShowChildNodes(int indentLevel);
 
   void Check(checkT c);
+  List<Expr *> *GetActuals() { return actuals; }
+  void SetTarget(int label) { target = label; }
+  int GetTarget() { return target; }
 
   void Emit();
 };
@@ -327,6 +355,16 @@ public:
   void Emit();
 };
 
+class ReadDoubleExpr : public Expr
+{
+public:
+  ReadDoubleExpr(yyltype loc) : Expr(loc) {}
+  const char *ReturnNodeName() { return "ReadDoubleExpr"; }
+  void Check(checkT c);
+
+  void Emit();
+};
+
 class ReadLineExpr : public Expr
 {
 public:
@@ -6,6 +6,9 @@
 #include "ast_type.h"
 #include "ast_decl.h"
 #include "ast_expr.h"
+#include "callgraph.h"
+#include "profile.h"
+#include "gc.h"
 
 Program::Program(List<Decl *> *d)
 {
@@ -89,6 +92,9 @@ void Program::Emit()
     {
         decls->Nth(i)->OffsetAssign();
     }
+    PrintDebug("tac+", "Find code reachable from main.");
+    call_graph->FindReachable(decls);
+    call_graph->AssignInterfaceSlots(decls);
     for (int i = 0; i < decls->NumElements(); i++)
     {
         decls->Nth(i)->PrefixForMember();
@@ -98,6 +104,16 @@ void Program::Emit()
         this->Print(0);
     }
 
+    for (int i = 0; i < decls->NumElements(); i++)
+    {
+        VarDecl *v = dynamic_cast<VarDecl *>(decls->Nth(i));
+        if (v)
+            gc_maps->AddRoot(v->GetEmitLoc(), v->ReturnType());
+    }
+
+    PrintDebug("tac+", "Propagate constants across calls.");
+    call_graph->PropagateConstants();
+
     PrintDebug("tac+", "Begin Emitting TAC for Program.");
     decls->EmitAll();
     if (IsDebugOn("tac+"))
@@ -140,7 +156,26 @@ void StmtBlock::Check(checkT c)
 void StmtBlock::Emit()
 {
     decls->EmitAll();
-    stmts->EmitAll();
+    for (int i = 0; i < stmts->NumElements(); i++)
+    {
+        CodeGen->SetLocation(stmts->Nth(i)->GetLocation());
+        PrintStmt *p = dynamic_cast<PrintStmt *>(stmts->Nth(i));
+        if (!p || !p->IsConstant())
+        {
+            stmts->Nth(i)->Emit();
+            continue;
+        }
+        std::string text;
+        for (; i < stmts->NumElements(); i++)
+        {
+            p = dynamic_cast<PrintStmt *>(stmts->Nth(i));
+            if (!p || !p->IsConstant())
+                break;
+            p->AppendText(&text);
+        }
+        i--;
+        PrintStmt::GenPrintText(text);
+    }
 }
 
 ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b)
@@ -203,22 +238,72 @@ void ForStmt::Check(checkT c)
     }
 }
 
-void ForStmt::Emit()
+// The test goes at the top of the loop, or, when the profile shows
+// the body runs at least once per entry, the loop is rotated to test
+// at the bottom so an iteration takes one branch instead of two.
+void LoopStmt::EmitLoop(Expr *step)
 {
-    init->Emit();
-    const char *label0 = CodeGen->NewLabel();
-    CodeGen->GenLabel(label0);
-    test->Emit();
-    Location *loc = test->ReturnEmitLocD();
-    const char *label1 = CodeGen->NewLabel();
+    int cond;
+    bool known = test->ReturnConstValue(&cond);
+    if (known && !cond)
+        return;
+
+    yyltype *at = test->GetLocation();
+    CodeGen->SetLocation(at);
+    if (profile->IsGenerating())
+        profile->GenIncrement(Profile::Key("enter", at));
+    int entries, iterations;
+    bool rotate = !known && profile->GetCount(Profile::Key("enter", at), &entries) &&
+                  profile->GetCount(Profile::Key("body", at), &iterations) &&
+                  iterations > 0 && iterations >= entries;
+
+    int label0 = CodeGen->NewLabel();
+    int label1 = CodeGen->NewLabel();
+    int label2 = -1;
     LoopEndLabel = label1;
-    CodeGen->GenIfZ(loc, label1);
+    if (rotate)
+    {
+        PrintDebug("pgo", "%s: loop rotated, %d iterations in %d entries",
+                   Profile::Key("loop", at), iterations, entries);
+        label2 = CodeGen->NewLabel();
+        CodeGen->GenGoto(label2);
+    }
+    CodeGen->GenLabel(label0);
+    if (!known && !rotate)
+    {
+        test->Emit();
+        CodeGen->GenIfZ(test->ReturnEmitLocD(), label1);
+    }
+
+    if (profile->IsGenerating())
+        profile->GenIncrement(Profile::Key("body", at));
+    CodeGen->SetLocation(body->GetLocation());
     body->Emit();
-    step->Emit();
-    CodeGen->GenGoto(label0);
+    if (step)
+    {
+        CodeGen->SetLocation(step->GetLocation());
+        step->Emit();
+    }
+
+    CodeGen->SetLocation(at);
+    if (rotate)
+    {
+        CodeGen->GenLabel(label2);
+        test->Emit();
+        CodeGen->GenIfNZ(test->ReturnEmitLocD(), label0);
+    }
+    else
+        CodeGen->GenGoto(label0);
     CodeGen->GenLabel(label1);
 }
 
+void ForStmt::Emit()
+{
+    CodeGen->SetLocation(init->GetLocation());
+    init->Emit();
+    this->EmitLoop(step);
+}
+
 void WhileStmt::ShowChildNodes(int indentLevel)
 {
     test->Print(indentLevel + 1, "(test) ");
@@ -261,19 +346,7 @@ void WhileStmt::Check(checkT c)
 
 void WhileStmt::Emit()
 {
-    const char *label0 = CodeGen->NewLabel();
-    CodeGen->GenLabel(label0);
-
-    test->Emit();
-    Location *loc = test->ReturnEmitLocD();
-    const char *label1 = CodeGen->NewLabel();
-    LoopEndLabel = label1;
-    CodeGen->GenIfZ(loc, label1);
-
-    body->Emit();
-    CodeGen->GenGoto(label0);
-
-    CodeGen->GenLabel(label1);
+    this->EmitLoop(NULL);
 }
 
 IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb) : ConditionalStmt(t, tb)
@@ -346,18 +419,69 @@ void IfStmt::Check(checkT c)
 
 void IfStmt::Emit()
 {
+    // only the branch a constant test selects is emitted.
+    int cond;
+    if (test->ReturnConstValue(&cond))
+    {
+        Stmt *taken = cond ? body : elseBody;
+        if (taken)
+        {
+            CodeGen->SetLocation(taken->GetLocation());
+            taken->Emit();
+        }
+        return;
+    }
+
+    CodeGen->SetLocation(test->GetLocation());
     test->Emit();
     Location *loc = test->ReturnEmitLocD();
-    const char *label0 = CodeGen->NewLabel();
+    yyltype *at = test->GetLocation();
+    const char *then_key = Profile::Key("then", at);
+    const char *else_key = Profile::Key("else", at);
+
+    // the branch the profile shows more often falls through.
+    int then_count, else_count;
+    if (elseBody && profile->GetCount(then_key, &then_count) &&
+        profile->GetCount(else_key, &else_count) && else_count > then_count)
+    {
+        PrintDebug("pgo", "%s: else branch laid out first, %d vs %d",
+                   Profile::Key("if", at), else_count, then_count);
+        int label0 = CodeGen->NewLabel();
+        CodeGen->GenIfNZ(loc, label0);
+        if (profile->IsGenerating())
+            profile->GenIncrement(else_key);
+        CodeGen->SetLocation(elseBody->GetLocation());
+        elseBody->Emit();
+        int label1 = CodeGen->NewLabel();
+        CodeGen->GenGoto(label1);
+
+        CodeGen->GenLabel(label0);
+        if (profile->IsGenerating())
+            profile->GenIncrement(then_key);
+        CodeGen->SetLocation(body->GetLocation());
+        body->Emit();
+        CodeGen->GenLabel(label1);
+        return;
+    }
+
+    int label0 = CodeGen->NewLabel();
     CodeGen->GenIfZ(loc, label0);
 
+    if (profile->IsGenerating())
+        profile->GenIncrement(then_key);
+    CodeGen->SetLocation(body->GetLocation());
     body->Emit();
-    const char *label1 = CodeGen->NewLabel();
+    int label1 = CodeGen->NewLabel();
     CodeGen->GenGoto(label1);
 
     CodeGen->GenLabel(label0);
+    if (profile->IsGenerating())
+        profile->GenIncrement(else_key);
     if (elseBody)
+    {
+        CodeGen->SetLocation(elseBody->GetLocation());
         elseBody->Emit();
+    }
     CodeGen->GenLabel(label1);
 }
 
@@ -383,7 +507,7 @@ void BreakStmt::Emit() // RECHECK THIS
     {
         if (node->IsLoop())
         {
-            const char *label = dynamic_cast<LoopStmt *>(node)->ReturnLoopLabel();
+            int label = dynamic_cast<LoopStmt *>(node)->ReturnLoopLabel();
             CodeGen->GenGoto(label);
             return;
         }
@@ -428,6 +552,11 @@ void ReturnStmt::Check(checkT c)
 
 void ReturnStmt::Emit()
 {
+    Node *n = this;
+    while (n->GetParent() && dynamic_cast<FnDecl *>(n) == NULL)
+        n = n->GetParent();
+    dynamic_cast<FnDecl *>(n)->EmitExitHooks();
+
     if (expr->ExprIsEmpty())
     {
         CodeGen->GenReturn();
@@ -439,7 +568,7 @@ void ReturnStmt::Emit()
     }
 }
 
-PrintStmt::PrintStmt(List<Expr *> *a)
+PrintStmt::PrintStmt(yyltype loc, List<Expr *> *a) : Stmt(loc)
 {
     Assert(a != NULL);
     (args = a)->SetParentAll(this);
@@ -458,7 +587,8 @@ void PrintStmt::Check(checkT c)
         for (int i = 0; i < args->NumElements(); i++)
         {
             Type *t = args->Nth(i)->ReturnType();
-            if (t != NULL && t != Type::stringType && t != Type::intType && t != Type::boolType)
+            if (t != NULL && t != Type::stringType && t != Type::intType && t != Type::boolType &&
+                t != Type::doubleType)
             {
                 ReportError::PrintArgMismatch(args->Nth(i), i + 1, t);
             }
@@ -466,10 +596,62 @@ void PrintStmt::Check(checkT c)
     }
 }
 
+bool PrintStmt::ConstantText(Expr *arg, std::string *text)
+{
+    StringConstant *s = dynamic_cast<StringConstant *>(arg);
+    if (s)
+    {
+        const char *value = s->GetValue();
+        text->append(value + 1, strlen(value) - 2);
+        return true;
+    }
+    int value;
+    if (!arg->ReturnConstValue(&value))
+        return false;
+    if (arg->ReturnType() == Type::boolType)
+        text->append(value ? "true" : "false");
+    else
+    {
+        char buf[16];
+        sprintf(buf, "%d", value);
+        text->append(buf);
+    }
+    return true;
+}
+
+bool PrintStmt::IsConstant()
+{
+    std::string text;
+    for (int i = 0; i < args->NumElements(); ++i)
+        if (!ConstantText(args->Nth(i), &text))
+            return false;
+    return true;
+}
+
+void PrintStmt::AppendText(std::string *text)
+{
+    for (int i = 0; i < args->NumElements(); ++i)
+        ConstantText(args->Nth(i), text);
+}
+
+void PrintStmt::GenPrintText(const std::string &text)
+{
+    if (text.empty())
+        return;
+    std::string literal = "\"" + text + "\"";
+    Location *loc = CodeGen->GenLoadConstant(strdup(literal.c_str()));
+    CodeGen->GenBuiltInCall(PrintString, loc);
+}
+
 void PrintStmt::Emit()
 {
+    std::string text;
     for (int i = 0; i < args->NumElements(); ++i)
     {
+        if (ConstantText(args->Nth(i), &text))
+            continue;
+        GenPrintText(text);
+        text.clear();
         args->Nth(i)->Emit();
         Type *type = args->Nth(i)->ReturnType();
         BuiltIn func;
@@ -479,10 +661,13 @@ void PrintStmt::Emit()
             func = PrintBool;
         else if (type == Type::stringType)
             func = PrintString;
+        else if (type == Type::doubleType)
+            func = PrintDouble;
         else
             func == PrintBool; // CHECK THIS
         Location *loc = args->Nth(i)->ReturnEmitLocD();
         Assert(loc);
         CodeGen->GenBuiltInCall(func, loc);
     }
+    GenPrintText(text);
 }
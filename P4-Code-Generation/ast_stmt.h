@@ -9,6 +9,7 @@
 #ifndef _H_ast_stmt
 #define _H_ast_stmt
 
+#include <string>
 #include "list.h"
 #include "ast.h"
 
@@ -53,6 +54,8 @@ public:
 
   void GenerateST();
   void Check(checkT c);
+  List<VarDecl *> *GetDecls() { return decls; }
+  List<Stmt *> *GetStmts() { return stmts; }
 
   void Emit();
 };
@@ -70,14 +73,17 @@ public:
 class LoopStmt : public ConditionalStmt
 {
 protected:
-  const char *LoopEndLabel;
+  int LoopEndLabel;
 
 public:
   LoopStmt(Expr *testExpr, Stmt *body)
-      : ConditionalStmt(testExpr, body) {}
+      : ConditionalStmt(testExpr, body) { LoopEndLabel = -1; }
   bool IsLoop() { return true; }
 
-  virtual const char *ReturnLoopLabel() { return LoopEndLabel; }
+  virtual int ReturnLoopLabel() { return LoopEndLabel; }
+
+protected:
+  void EmitLoop(Expr *step);
 };
 
 class ForStmt : public LoopStmt
@@ -151,6 +157,7 @@ public:
   void ShowChildNodes(int indentLevel);
 
   void Check(checkT c);
+  Expr *GetExpr() { return expr; }
 
   void Emit();
 };
@@ -160,13 +167,22 @@ class PrintStmt : public Stmt
 protected:
   List<Expr *> *args;
 
+  // appends what arg prints if it is known at compile time
+  static bool ConstantText(Expr *arg, std::string *text);
+
 public:
-  PrintStmt(List<Expr *> *arguments);
+  PrintStmt(yyltype loc, List<Expr *> *arguments);
   const char *ReturnNodeName() { return "PrintStmt"; }
   void ShowChildNodes(int indentLevel);
 
   void Check(checkT c);
 
+  // Adjacent arguments known at compile time are printed as one
+  // string, and so is a run of statements that print only constants
+  // (see StmtBlock::Emit).
+  bool IsConstant();
+  void AppendText(std::string *text);
+  static void GenPrintText(const std::string &text);
   void Emit();
 };
 
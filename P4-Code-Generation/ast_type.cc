@@ -26,7 +26,7 @@ Type *Type::errorType = new Type("error");
 Type::Type(const char *n)
 {
     Assert(n);
-    typeName = strdup(n);
+    typeName = Strdup(n);
     type_of_expr = NULL;
 }
 
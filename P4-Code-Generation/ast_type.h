@@ -22,7 +22,7 @@ public:
   static Type *intType, *doubleType, *boolType, *voidType,
       *nullType, *stringType, *errorType;
 
-  Type(yyltype loc) : Node(loc) { type_of_expr = NULL; }
+  Type(yyltype loc) : Node(loc) { typeName = NULL; }
   Type(const char *str);
 
   const char *ReturnNodeName() { return "Type"; }
@@ -47,7 +47,8 @@ public:
   virtual void Check(checkT c, reasonT r) { Check(c); }
   virtual void SetSelfType() { type_of_expr = this; }
 
-  virtual int ReturnTypeSize() { return 4; }
+  // bytes a value takes in a frame, an object or an array
+  virtual int ReturnTypeSize() { return this == doubleType ? 8 : 4; }
 };
 
 class NamedType : public Type
@@ -0,0 +1,144 @@
+/* File: bcformat.h
+ * ----------------
+ * The format of the register bytecode dcc writes with -emit-bc and
+ * dvm runs. It is shared by the two so they can't drift apart.
+ *
+ * A bytecode file is a header followed by the code words and the
+ * data bytes. Everything is a little-endian 32-bit word and nothing
+ * in the file is a pointer, so dvm can map it and run it in place.
+ *
+ * Each instruction is an opcode word followed by its operands, the
+ * number of which is fixed per opcode (see BcOperands). Operands are
+ * of four kinds:
+ *  - slot: a variable of the frame or a global. The value is the
+ *    byte offset of the variable from fp (or gp when bit 0 is set),
+ *    offsets are word aligned so bit 0 is free. A double names the
+ *    lower of its two words, as in the MIPS code.
+ *  - imm: a constant, a double constant takes two words (low first).
+ *  - addr: the address of data (a string or a vtable) in the address
+ *    space of the program, see below.
+ *  - target: the offset of an instruction in words from the start
+ *    of the code. Offset 0 holds BcExit, where main returns to, so 0
+ *    is never a function and the 0 entries of an interface table
+ *    stay null pointers.
+ *
+ * The program sees the same memory layout as the MIPS code: strings
+ * have their length in the word before the first character, arrays
+ * theirs before the first element, objects start with their vtable
+ * and a vtable's interface table is right below it. Function pointers
+ * in a vtable are targets. Addresses are 32 bits, the data bytes are
+ * loaded at BcDataBase and the globals (globalBytes of zeros) follow
+ * them at the next 8-byte boundary.
+ *
+ * The calling convention is the MIPS one as well: params are pushed
+ * right to left, BcEnter saves fp and the return address in the two
+ * words below the params, and the callee returns its value in a
+ * register that BcResult copies to a slot.
+ */
+
+#ifndef _H_bcformat
+#define _H_bcformat
+
+#include <stdint.h>
+
+static const uint32_t BcMagic = 0x42434444; // "DDCB"
+static const uint32_t BcVersion = 1;
+static const uint32_t BcDataBase = 0x10000;
+
+struct BcHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t codeWords;   // words of code after the header
+  uint32_t dataBytes;   // bytes of data after the code, a multiple of 4
+  uint32_t globalBytes; // size of the globals
+  uint32_t entry;       // target of main
+};
+
+// The binary ops are in the order of BinaryOp::OpCode, the double
+// ones stop at BcDGe as doubles have no && or ||.
+typedef enum
+{
+  BcExit,       //                       ends the program
+  BcLoadConst,  // slot imm
+  BcLoadDConst, // slot imm imm
+  BcLoadAddr,   // slot addr
+  BcCopy,       // slot slot
+  BcCopyD,      // slot slot
+  BcLoad,       // slot slot imm         dst = *(ref + imm)
+  BcLoadD,      // slot slot imm
+  BcStore,      // slot slot imm         *(ref + imm) = val
+  BcStoreD,     // slot slot imm
+  BcAdd,        // slot slot slot
+  BcSub,
+  BcMul,
+  BcDiv,
+  BcMod,
+  BcEq,
+  BcNe,
+  BcLt,
+  BcLe,
+  BcGt,
+  BcGe,
+  BcAnd,
+  BcOr,
+  BcDAdd, // slot slot slot
+  BcDSub,
+  BcDMul,
+  BcDDiv,
+  BcDMod,
+  BcDEq,
+  BcDNe,
+  BcDLt,
+  BcDLe,
+  BcDGt,
+  BcDGe,
+  BcGoto,      // target
+  BcIfZ,       // slot target
+  BcIfNZ,      // slot target
+  BcEnter,     // imm                   frame size in bytes
+  BcReturn,    //
+  BcReturnVal, // slot
+  BcReturnD,   // slot
+  BcParam,     // slot
+  BcParamD,    // slot
+  BcPopParams, // imm                   bytes
+  BcCall,      // target
+  BcCallPtr,   // slot                  holds a target
+  BcBuiltIn,   // imm                   a BcBuiltInId
+  BcResult,    // slot                  the value of the last call
+  BcResultD,   // slot
+  BcAlloc,     // slot slot             dst = new block of size bytes
+  NumBcOps
+} BcOp;
+
+static const int BcOperands[NumBcOps] = {
+    0, 2, 3, 2, 2, 2, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    1, 2, 2, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2};
+
+// The runtime routines dvm implements natively, by the label the
+// code calls them by. Their params are on the stack as usual.
+typedef enum
+{
+  BcAllocFn,
+  BcReadLine,
+  BcReadInteger,
+  BcReadDouble,
+  BcStringEqual,
+  BcPrintInt,
+  BcPrintString,
+  BcPrintBool,
+  BcPrintDouble,
+  BcHalt,
+  BcOutFlush,
+  NumBcBuiltIns
+} BcBuiltInId;
+
+static const char *const BcBuiltInLabels[NumBcBuiltIns] = {
+    "_Alloc", "_ReadLine", "_ReadInteger", "_ReadDouble", "_StringEqual",
+    "_PrintInt", "_PrintString", "_PrintBool", "_PrintDouble", "_Halt",
+    "_OutFlush"};
+
+#endif
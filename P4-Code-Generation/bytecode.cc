@@ -0,0 +1,308 @@
+/* File: bytecode.cc
+ * -----------------
+ * Implementation of the Bytecode class, translating Tac instructions
+ * to dvm's register bytecode.
+ */
+
+#include "bytecode.h"
+#include "utility.h"
+#include <string.h>
+
+Bytecode::Bytecode()
+{
+    globalBytes = 0;
+    Op(BcExit); // main returns here, and target 0 is never a function
+}
+
+/* Method: Slot
+ * ------------
+ * Encodes a variable as an operand: its offset from fp or gp, with
+ * bit 0 telling which. Also tracks how much room the globals need.
+ */
+uint32_t Bytecode::Slot(Location *loc)
+{
+    Assert(loc && loc->GetOffset() % 4 == 0);
+    if (loc->GetSegment() == fpRelative)
+        return (uint32_t)loc->GetOffset();
+    int end = loc->GetOffset() + (loc->IsDouble() ? 8 : 4);
+    if (end > globalBytes)
+        globalBytes = end;
+    return (uint32_t)loc->GetOffset() | 1;
+}
+
+void Bytecode::LabelRef(const char *label)
+{
+    Fixup f = {false, (uint32_t)code.size(), label};
+    fixups.push_back(f);
+    Word(0);
+}
+
+void Bytecode::DataWord(uint32_t w)
+{
+    for (int i = 0; i < 4; i++)
+        data.push_back((char)(w >> (8 * i)));
+}
+
+void Bytecode::DataLabelRef(const char *label)
+{
+    Fixup f = {true, (uint32_t)data.size(), label};
+    fixups.push_back(f);
+    DataWord(0);
+}
+
+void Bytecode::AlignData()
+{
+    while (data.size() % 4)
+        data.push_back(0);
+}
+
+uint32_t Bytecode::Resolve(const char *label)
+{
+    if (!strcmp(label, "0"))
+        return 0;
+    std::map<std::string, uint32_t>::iterator it = codeLabels.find(label);
+    if (it != codeLabels.end())
+        return it->second;
+    it = dataLabels.find(label);
+    if (it == dataLabels.end())
+        Failure("no bytecode for label %s", label);
+    return it->second;
+}
+
+void Bytecode::EmitLoadConstant(Location *dst, int val)
+{
+    Op(BcLoadConst);
+    Word(Slot(dst));
+    Word((uint32_t)val);
+}
+
+void Bytecode::EmitLoadConstant(Location *dst, double val)
+{
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    Op(BcLoadDConst);
+    Word(Slot(dst));
+    Word((uint32_t)bits);
+    Word((uint32_t)(bits >> 32));
+}
+
+/* Method: EmitLoadStringConstant
+ * ------------------------------
+ * Pools the literal like the Mips class does. str still has its
+ * quotes and the escapes .asciiz would have translated.
+ */
+void Bytecode::EmitLoadStringConstant(Location *dst, const char *str)
+{
+    std::map<std::string, const char *>::iterator it = stringLabels.find(str);
+    if (it == stringLabels.end())
+    {
+        std::string text;
+        for (const char *p = str + 1; *p && *p != '"'; p++)
+        {
+            if (*p == '\\' && p[1])
+            {
+                p++;
+                text += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+            }
+            else
+                text += *p;
+        }
+        char label[24];
+        sprintf(label, "_string%d", (int)stringLabels.size() + 1);
+        AlignData();
+        DataWord(text.size());
+        dataLabels[label] = BcDataBase + data.size();
+        data.insert(data.end(), text.begin(), text.end());
+        data.push_back('\0');
+        it = stringLabels.insert(std::make_pair(std::string(str), strdup(label))).first;
+    }
+    EmitLoadLabel(dst, it->second);
+}
+
+void Bytecode::EmitLoadLabel(Location *dst, const char *label)
+{
+    Op(BcLoadAddr);
+    Word(Slot(dst));
+    LabelRef(label);
+}
+
+void Bytecode::EmitCopy(Location *dst, Location *src)
+{
+    Op(src->IsDouble() ? BcCopyD : BcCopy);
+    Word(Slot(dst));
+    Word(Slot(src));
+}
+
+void Bytecode::EmitLoad(Location *dst, Location *reference, int offset)
+{
+    Op(dst->IsDouble() ? BcLoadD : BcLoad);
+    Word(Slot(dst));
+    Word(Slot(reference));
+    Word((uint32_t)offset);
+}
+
+void Bytecode::EmitStore(Location *reference, Location *value, int offset)
+{
+    Op(value->IsDouble() ? BcStoreD : BcStore);
+    Word(Slot(reference));
+    Word(Slot(value));
+    Word((uint32_t)offset);
+}
+
+void Bytecode::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                            Location *op1, Location *op2)
+{
+    if (op1->IsDouble())
+    {
+        Assert(code <= BinaryOp::Ge);
+        Op((BcOp)(BcDAdd + code));
+    }
+    else
+        Op((BcOp)(BcAdd + code));
+    Word(Slot(dst));
+    Word(Slot(op1));
+    Word(Slot(op2));
+}
+
+void Bytecode::EmitLabel(const char *label)
+{
+    Assert(codeLabels.find(label) == codeLabels.end());
+    codeLabels[label] = code.size();
+}
+
+void Bytecode::EmitGoto(const char *label)
+{
+    Op(BcGoto);
+    LabelRef(label);
+}
+
+void Bytecode::EmitIfZ(Location *test, const char *label)
+{
+    Op(BcIfZ);
+    Word(Slot(test));
+    LabelRef(label);
+}
+
+void Bytecode::EmitIfNZ(Location *test, const char *label)
+{
+    Op(BcIfNZ);
+    Word(Slot(test));
+    LabelRef(label);
+}
+
+void Bytecode::EmitReturn(Location *returnVal)
+{
+    if (returnVal == NULL)
+    {
+        Op(BcReturn);
+        return;
+    }
+    Op(returnVal->IsDouble() ? BcReturnD : BcReturnVal);
+    Word(Slot(returnVal));
+}
+
+// the frame is fresh memory or one a returned call left, there is no
+// collector to clear pointer slots for
+void Bytecode::EmitBeginFunction(int frameSize, List<int> *clearedSlots)
+{
+    Assert(frameSize >= 0);
+    Op(BcEnter);
+    Word(frameSize);
+}
+
+void Bytecode::EmitEndFunction()
+{
+    Op(BcReturn);
+}
+
+void Bytecode::EmitParam(Location *arg)
+{
+    Op(arg->IsDouble() ? BcParamD : BcParam);
+    Word(Slot(arg));
+}
+
+void Bytecode::EmitLCall(Location *result, const char *label)
+{
+    int builtIn = 0;
+    while (builtIn < NumBcBuiltIns && strcmp(BcBuiltInLabels[builtIn], label))
+        builtIn++;
+    if (builtIn < NumBcBuiltIns)
+    {
+        Op(BcBuiltIn);
+        Word(builtIn);
+    }
+    else
+    {
+        Op(BcCall);
+        LabelRef(label);
+    }
+    if (result)
+    {
+        Op(result->IsDouble() ? BcResultD : BcResult);
+        Word(Slot(result));
+    }
+}
+
+void Bytecode::EmitACall(Location *result, Location *fnAddr)
+{
+    Op(BcCallPtr);
+    Word(Slot(fnAddr));
+    if (result)
+    {
+        Op(result->IsDouble() ? BcResultD : BcResult);
+        Word(Slot(result));
+    }
+}
+
+void Bytecode::EmitPopParams(int bytes)
+{
+    if (bytes == 0)
+        return;
+    Op(BcPopParams);
+    Word(bytes);
+}
+
+void Bytecode::EmitHeapAlloc(Location *dst, Location *size, const char *descriptor)
+{
+    Op(BcAlloc);
+    Word(Slot(dst));
+    Word(Slot(size));
+}
+
+void Bytecode::EmitVTable(const char *label, List<const char *> *methodLabels,
+                          List<const char *> *itableLabels, List<int> *gcMap)
+{
+    AlignData();
+    for (int i = itableLabels ? itableLabels->NumElements() - 1 : -1; i >= 0; i--)
+        DataLabelRef(itableLabels->Nth(i));
+    dataLabels[label] = BcDataBase + data.size();
+    for (int i = 0; i < methodLabels->NumElements(); i++)
+        DataLabelRef(methodLabels->Nth(i));
+}
+
+void Bytecode::Write(FILE *fp)
+{
+    for (size_t i = 0; i < fixups.size(); i++)
+    {
+        uint32_t value = Resolve(fixups[i].label);
+        if (!fixups[i].inData)
+            code[fixups[i].pos] = value;
+        else
+            for (int b = 0; b < 4; b++)
+                data[fixups[i].pos + b] = (char)(value >> (8 * b));
+    }
+    AlignData();
+
+    BcHeader h;
+    h.magic = BcMagic;
+    h.version = BcVersion;
+    h.codeWords = code.size();
+    h.dataBytes = data.size();
+    h.globalBytes = (globalBytes + 7) & ~7;
+    h.entry = Resolve("main");
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(&code[0], sizeof(uint32_t), code.size(), fp);
+    if (!data.empty())
+        fwrite(&data[0], 1, data.size(), fp);
+    fflush(fp);
+}
@@ -0,0 +1,93 @@
+/* File: bytecode.h
+ * ----------------
+ * The Bytecode class is the other way the Tac instructions can be
+ * translated: instead of MIPS assembly it builds the register bytecode
+ * run by dvm (see bcformat.h) and writes it out with -emit-bc.
+ *
+ * Labels are resolved when the program is written, so jumps and calls
+ * to labels defined later (and the vtables, which reference methods)
+ * are recorded as fixups until then.
+ */
+
+#ifndef _H_bytecode
+#define _H_bytecode
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "tac.h"
+#include "list.h"
+#include "bcformat.h"
+#include "target.h"
+
+class Bytecode : public Target
+{
+private:
+  std::vector<uint32_t> code;
+  std::vector<char> data;
+  int globalBytes;
+
+  // where each label is, in the code or the data
+  std::map<std::string, uint32_t> codeLabels, dataLabels;
+  std::map<std::string, const char *> stringLabels;
+
+  // words to patch with a label's target or address once all are known
+  struct Fixup
+  {
+    bool inData;
+    uint32_t pos;
+    const char *label;
+  };
+  std::vector<Fixup> fixups;
+
+  uint32_t Slot(Location *loc);
+  void Op(BcOp op) { code.push_back(op); }
+  void Word(uint32_t w) { code.push_back(w); }
+  void LabelRef(const char *label);
+  void DataWord(uint32_t w);
+  void DataLabelRef(const char *label);
+  void AlignData();
+  uint32_t Resolve(const char *label);
+
+public:
+  Bytecode();
+
+  void EmitLoadConstant(Location *dst, int val);
+  void EmitLoadConstant(Location *dst, double val);
+  void EmitLoadStringConstant(Location *dst, const char *str);
+  void EmitLoadLabel(Location *dst, const char *label);
+
+  void EmitLoad(Location *dst, Location *reference, int offset);
+  void EmitStore(Location *reference, Location *value, int offset);
+  void EmitCopy(Location *dst, Location *src);
+
+  void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                    Location *op1, Location *op2);
+
+  void EmitLabel(const char *label);
+  void EmitGoto(const char *label);
+  void EmitIfZ(Location *test, const char *label);
+  void EmitIfNZ(Location *test, const char *label);
+  void EmitReturn(Location *returnVal);
+
+  void EmitBeginFunction(int frameSize, List<int> *clearedSlots = NULL);
+  void EmitEndFunction();
+
+  void EmitParam(Location *arg);
+  void EmitLCall(Location *result, const char *label);
+  void EmitACall(Location *result, Location *fnAddr);
+  void EmitPopParams(int bytes);
+
+  // dvm has no collector, the descriptor is dropped
+  void EmitHeapAlloc(Location *dst, Location *size, const char *descriptor = NULL);
+
+  void EmitVTable(const char *label, List<const char *> *methodLabels,
+                  List<const char *> *itableLabels = NULL, List<int> *gcMap = NULL);
+
+  // Resolves the labels and writes the file.
+  void Write(FILE *fp);
+  void EmitEnd() { Write(stdout); }
+};
+
+#endif
@@ -0,0 +1,75 @@
+/* File: cache.cc
+ * --------------
+ * Implementation of the Cache model used by the simulator.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "cache.h"
+#include "utility.h"
+
+static bool IsPowerOfTwo(int n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+Cache::Cache(const char *n, int sz, int ls, int a)
+    : name(n), size(sz), lineSize(ls), assoc(a), hits(0), misses(0), clock(0)
+{
+    Assert(IsPowerOfTwo(size) && IsPowerOfTwo(lineSize) && assoc > 0);
+    Assert(size % (lineSize * assoc) == 0);
+    numSets = size / (lineSize * assoc);
+    Line empty = {false, 0, 0};
+    lines.assign(numSets * assoc, empty);
+}
+
+Cache *Cache::FromSpec(const char *name, const char *spec)
+{
+    int sz, ls, a;
+    if (sscanf(spec, "%d:%d:%d", &sz, &ls, &a) != 3)
+        return NULL;
+    if (!IsPowerOfTwo(sz) || !IsPowerOfTwo(ls) || a <= 0 || sz % (ls * a) != 0)
+        return NULL;
+    return new Cache(name, sz, ls, a);
+}
+
+bool Cache::Access(unsigned int addr)
+{
+    unsigned int block = addr / lineSize;
+    int set = block % numSets;
+    unsigned int tag = block / numSets;
+    Line *ways = &lines[set * assoc];
+    clock++;
+
+    Line *victim = &ways[0];
+    for (int i = 0; i < assoc; i++)
+    {
+        if (ways[i].valid && ways[i].tag == tag)
+        {
+            ways[i].lastUse = clock;
+            hits++;
+            return true;
+        }
+        if (!ways[i].valid)
+            victim = &ways[i];
+        else if (victim->valid && ways[i].lastUse < victim->lastUse)
+            victim = &ways[i];
+    }
+    victim->valid = true;
+    victim->tag = tag;
+    victim->lastUse = clock;
+    misses++;
+    return false;
+}
+
+double Cache::HitRate() const
+{
+    long long total = hits + misses;
+    return total ? (100.0 * hits) / total : 100.0;
+}
+
+void Cache::PrintStats(FILE *fp)
+{
+    fprintf(fp, "  %-7s %6d bytes, %3d-byte lines, %d-way: %lld hits, %lld misses (%.2f%% hit rate)\n",
+            name, size, lineSize, assoc, hits, misses, HitRate());
+}
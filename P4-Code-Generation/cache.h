@@ -0,0 +1,52 @@
+/* File: cache.h
+ * -------------
+ * The Cache class is a small set-associative cache model used by the
+ * simulator to estimate hit rates of the generated code. It does not
+ * hold any data, it only tracks which lines would be resident so that
+ * each access can be classified as a hit or a miss.
+ *
+ * Replacement is true LRU within a set, writes allocate like reads.
+ */
+
+#ifndef _H_cache
+#define _H_cache
+
+#include <stdio.h>
+#include <vector>
+
+class Cache
+{
+protected:
+  const char *name;
+  int size, lineSize, assoc;
+  int numSets;
+  long long hits, misses;
+  unsigned int clock;
+
+  struct Line
+  {
+    bool valid;
+    unsigned int tag;
+    unsigned int lastUse;
+  };
+  std::vector<Line> lines; // numSets * assoc entries
+
+public:
+  // size and lineSize are in bytes, both must be powers of two,
+  // size must be a multiple of lineSize * assoc
+  Cache(const char *name, int size, int lineSize, int assoc);
+
+  // Parses a "size:line:assoc" triple as given on the command line.
+  // Returns NULL if the string is malformed.
+  static Cache *FromSpec(const char *name, const char *spec);
+
+  // Records an access to addr and returns true on a hit.
+  bool Access(unsigned int addr);
+
+  long long GetHits() const { return hits; }
+  long long GetMisses() const { return misses; }
+  double HitRate() const;
+  void PrintStats(FILE *fp);
+};
+
+#endif
@@ -0,0 +1,573 @@
+/* File: callgraph.cc
+ * ------------------
+ * Build the call graph, assign the interface slots and propagate
+ * constants across calls.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "callgraph.h"
+#include "ast.h"
+#include "ast_decl.h"
+#include "ast_expr.h"
+#include "profile.h"
+
+CallGraph *call_graph = new CallGraph();
+
+FnVersion::FnVersion(int l, int n)
+{
+    label = l;
+    num_formals = n;
+    bound = new bool[n];
+    values = new int[n];
+    for (int i = 0; i < n; i++)
+    {
+        bound[i] = false;
+        values[i] = 0;
+    }
+}
+
+void FnVersion::Bind(int i, int value)
+{
+    Assert(i >= 0 && i < num_formals);
+    bound[i] = true;
+    values[i] = value;
+}
+
+int FnVersion::NumBound()
+{
+    int n = 0;
+    for (int i = 0; i < num_formals; i++)
+        if (bound[i])
+            n++;
+    return n;
+}
+
+bool FnVersion::SameBindings(FnVersion *other)
+{
+    Assert(num_formals == other->num_formals);
+    for (int i = 0; i < num_formals; i++)
+    {
+        if (bound[i] != other->bound[i])
+            return false;
+        if (bound[i] && values[i] != other->values[i])
+            return false;
+    }
+    return true;
+}
+
+void FnVersion::Print()
+{
+    printf("%s (", Labels::Name(label));
+    for (int i = 0; i < num_formals; i++)
+    {
+        if (i)
+            printf(", ");
+        if (bound[i])
+            printf("%d", values[i]);
+        else
+            printf("_");
+    }
+    printf(")\n");
+}
+
+CallGraph::CallGraph()
+{
+    sites = new List<CallSite *>;
+    functions = new List<FnDecl *>;
+    method_uses = new List<MethodUse *>;
+    class_uses = new List<ClassUse *>;
+    selectors = new List<const char *>;
+    live_classes = new List<ClassDecl *>;
+}
+
+FnDecl *CallGraph::EnclosingFn(Node *n, bool *inLoop)
+{
+    while (n->GetParent())
+    {
+        if (n->IsLoop() && inLoop)
+            *inLoop = true;
+        if (dynamic_cast<FnDecl *>(n) != NULL)
+            return dynamic_cast<FnDecl *>(n);
+        n = n->GetParent();
+    }
+    return NULL;
+}
+
+void CallGraph::AddCall(Call *call, FnDecl *callee)
+{
+    if (registered.count(call))
+        return;
+    registered.insert(call);
+
+    CallSite *site = new CallSite;
+    site->call = call;
+    site->callee = callee;
+    site->hot = false;
+    site->caller = EnclosingFn(call, &site->hot);
+    if (site->caller == callee)
+        site->hot = true;
+    sites->Append(site);
+
+    for (int i = 0; i < functions->NumElements(); i++)
+        if (functions->Nth(i) == callee)
+            return;
+    functions->Append(callee);
+}
+
+void CallGraph::AddMethodCall(Call *call, const char *selector)
+{
+    if (registered.count(call))
+        return;
+    registered.insert(call);
+
+    MethodUse *use = new MethodUse;
+    use->caller = EnclosingFn(call, NULL);
+    use->selector = selector;
+    method_uses->Append(use);
+}
+
+void CallGraph::AddNew(NewExpr *expr, ClassDecl *cls)
+{
+    if (registered.count(expr))
+        return;
+    registered.insert(expr);
+
+    ClassUse *use = new ClassUse;
+    use->caller = EnclosingFn(expr, NULL);
+    use->cls = cls;
+    class_uses->Append(use);
+}
+
+void CallGraph::MarkFn(FnDecl *fn, List<FnDecl *> *worklist)
+{
+    if (fn->IsReachable())
+        return;
+    fn->SetReachable();
+    worklist->Append(fn);
+}
+
+void CallGraph::MarkSelector(const char *selector, List<FnDecl *> *worklist)
+{
+    for (int i = 0; i < selectors->NumElements(); i++)
+        if (!strcmp(selectors->Nth(i), selector))
+            return;
+    selectors->Append(selector);
+    for (int i = 0; i < live_classes->NumElements(); i++)
+    {
+        FnDecl *fn = live_classes->Nth(i)->FindMethod(selector);
+        if (fn)
+            this->MarkFn(fn, worklist);
+    }
+}
+
+void CallGraph::MarkClass(ClassDecl *cls, List<FnDecl *> *worklist)
+{
+    if (cls->IsInstantiated())
+        return;
+    cls->SetInstantiated();
+    live_classes->Append(cls);
+    for (int i = 0; i < selectors->NumElements(); i++)
+    {
+        FnDecl *fn = cls->FindMethod(selectors->Nth(i));
+        if (fn)
+            this->MarkFn(fn, worklist);
+    }
+}
+
+void CallGraph::FindReachable(List<Decl *> *decls)
+{
+    List<FnDecl *> *worklist = new List<FnDecl *>;
+    for (int i = 0; i < decls->NumElements(); i++)
+    {
+        Decl *d = decls->Nth(i);
+        if (d->FnIsDecl() && !strcmp(d->GetId()->ReturnIdenName(), "main"))
+            this->MarkFn(dynamic_cast<FnDecl *>(d), worklist);
+    }
+
+    while (worklist->NumElements())
+    {
+        FnDecl *fn = worklist->Nth(0);
+        worklist->RemoveAt(0);
+        for (int i = 0; i < sites->NumElements(); i++)
+            if (sites->Nth(i)->caller == fn)
+                this->MarkFn(sites->Nth(i)->callee, worklist);
+        for (int i = 0; i < class_uses->NumElements(); i++)
+            if (class_uses->Nth(i)->caller == fn)
+                this->MarkClass(class_uses->Nth(i)->cls, worklist);
+        for (int i = 0; i < method_uses->NumElements(); i++)
+            if (method_uses->Nth(i)->caller == fn)
+                this->MarkSelector(method_uses->Nth(i)->selector, worklist);
+    }
+
+    if (IsDebugOn("reach"))
+        this->PrintReachable(decls);
+}
+
+void CallGraph::PrintReachable(List<Decl *> *decls)
+{
+    for (int i = 0; i < decls->NumElements(); i++)
+    {
+        Decl *d = decls->Nth(i);
+        if (d->FnIsDecl())
+        {
+            printf("+++ (reach): %s %s\n", d->GetId()->ReturnIdenName(),
+                   dynamic_cast<FnDecl *>(d)->IsReachable() ? "live" : "dead");
+        }
+        else if (d->IsClassDecl())
+        {
+            ClassDecl *c = dynamic_cast<ClassDecl *>(d);
+            printf("+++ (reach): class %s %s\n", d->GetId()->ReturnIdenName(),
+                   c->IsInstantiated() ? "live" : "dead");
+            List<FnDecl *> *methods = c->GetMethods();
+            for (int j = 0; j < methods->NumElements(); j++)
+                printf("+++ (reach):     %s %s\n",
+                       methods->Nth(j)->GetId()->ReturnIdenName(),
+                       methods->Nth(j)->IsReachable() ? "live" : "dead");
+        }
+    }
+}
+
+// Methods called through an interface are dispatched with interface
+// tables laid out right before each vtable. Every interface method
+// name (selector) gets a slot, and two selectors implemented by the
+// same live class never share one (greedy coloring), so each table
+// only has the slots of its class and a call through an interface is
+// a single load at a fixed offset, just like a virtual call.
+void CallGraph::AssignInterfaceSlots(List<Decl *> *decls)
+{
+    // the selectors, numbered in the order the interfaces declare them
+    std::vector<const char *> names;
+    std::map<std::string, int> numbers;
+    for (int i = 0; i < decls->NumElements(); i++)
+    {
+        InterfaceDecl *d = dynamic_cast<InterfaceDecl *>(decls->Nth(i));
+        if (!d)
+            continue;
+        for (int j = 0; j < d->GetMembers()->NumElements(); j++)
+        {
+            const char *name = d->GetMembers()->Nth(j)->GetId()->ReturnIdenName();
+            if (numbers.insert(std::make_pair(std::string(name), (int)names.size())).second)
+                names.push_back(name);
+        }
+    }
+    if (names.empty())
+        return;
+
+    // selectors each live class has to answer through an interface
+    std::vector<ClassDecl *> classes;
+    std::vector<std::set<int> > classSelectors;
+    for (int i = 0; i < decls->NumElements(); i++)
+    {
+        ClassDecl *c = dynamic_cast<ClassDecl *>(decls->Nth(i));
+        if (!c || !c->IsInstantiated())
+            continue;
+        List<InterfaceDecl *> interfaces;
+        c->InterfacesForList(&interfaces);
+        std::set<int> sel;
+        for (int j = 0; j < interfaces.NumElements(); j++)
+        {
+            List<Decl *> *m = interfaces.Nth(j)->GetMembers();
+            for (int k = 0; k < m->NumElements(); k++)
+                sel.insert(numbers[m->Nth(k)->GetId()->ReturnIdenName()]);
+        }
+        classes.push_back(c);
+        classSelectors.push_back(sel);
+    }
+
+    // each selector takes the lowest slot no selector sharing a class
+    // with it has
+    std::vector<int> slots(names.size(), -1);
+    int numSlots = 0;
+    for (int s = 0; s < (int)names.size(); s++)
+    {
+        std::set<int> taken;
+        for (size_t i = 0; i < classSelectors.size(); i++)
+        {
+            if (!classSelectors[i].count(s))
+                continue;
+            std::set<int>::iterator t;
+            for (t = classSelectors[i].begin(); t != classSelectors[i].end(); ++t)
+                if (slots[*t] != -1)
+                    taken.insert(slots[*t]);
+        }
+        int slot = 0;
+        while (taken.count(slot))
+            slot++;
+        slots[s] = slot;
+        if (slot + 1 > numSlots)
+            numSlots = slot + 1;
+    }
+
+    for (int i = 0; i < decls->NumElements(); i++)
+    {
+        InterfaceDecl *d = dynamic_cast<InterfaceDecl *>(decls->Nth(i));
+        if (!d)
+            continue;
+        List<Decl *> *m = d->GetMembers();
+        for (int j = 0; j < m->NumElements(); j++)
+        {
+            int s = numbers[m->Nth(j)->GetId()->ReturnIdenName()];
+            m->Nth(j)->OffsetForMember(false, -4 - 4 * slots[s]);
+        }
+    }
+
+    int vtableWords = 0, itableWords = 0, holes = 0;
+    for (size_t i = 0; i < classes.size(); i++)
+    {
+        ClassDecl *c = classes[i];
+        std::set<int> &sel = classSelectors[i];
+        vtableWords += c->GetVTableSize() / 4;
+        if (sel.empty())
+            continue;
+        int size = 0;
+        std::set<int>::iterator t;
+        for (t = sel.begin(); t != sel.end(); ++t)
+            if (slots[*t] + 1 > size)
+                size = slots[*t] + 1;
+        List<FnDecl *> *itable = new List<FnDecl *>;
+        for (int k = 0; k < size; k++)
+            itable->Append(NULL);
+        for (t = sel.begin(); t != sel.end(); ++t)
+        {
+            itable->RemoveAt(slots[*t]);
+            itable->InsertAt(c->FindMethod(names[*t]), slots[*t]);
+        }
+        c->SetITable(itable);
+        itableWords += size;
+        holes += size - (int)sel.size();
+        PrintDebug("dispatch", "class %s: %d vtable slots, %d interface slots (%d unused)",
+                   c->GetId()->ReturnIdenName(), c->GetVTableSize() / 4, size,
+                   size - (int)sel.size());
+    }
+    PrintDebug("dispatch", "%d selectors in %d slots, tables take %d bytes (%d vtable, %d interface, %d unused)",
+               (int)names.size(), numSlots,
+               (vtableWords + itableWords) * 4, vtableWords * 4, itableWords * 4,
+               holes * 4);
+}
+
+// Evaluates actual i of the site with the formals of the caller bound
+// as in its primary version, every version of the caller binds at
+// least those.
+bool CallGraph::ConstActual(CallSite *site, int i, int *value)
+{
+    FnDecl *caller = site->caller;
+    FnVersion *v = caller ? caller->GetPrimaryVersion() : NULL;
+    if (v)
+        caller->BindFormals(v);
+    bool is_const = site->call->GetActuals()->Nth(i)->ReturnConstValue(value);
+    if (v)
+        caller->UnbindFormals();
+    return is_const;
+}
+
+// Binds the formals every call site agrees on. Returns true if any new
+// formal got bound.
+bool CallGraph::BindUniformFormals(FnDecl *fn)
+{
+    FnVersion *primary = fn->GetPrimaryVersion();
+    List<VarDecl *> *formals = fn->GetFormals();
+    bool changed = false;
+
+    for (int i = 0; i < formals->NumElements(); i++)
+    {
+        if (primary->IsBound(i) || formals->Nth(i)->IsAssigned())
+            continue;
+
+        bool uniform = true;
+        int value = 0, n = 0;
+        for (int j = 0; j < sites->NumElements() && uniform; j++)
+        {
+            CallSite *site = sites->Nth(j);
+            if (site->callee != fn)
+                continue;
+            int v;
+            if (!this->ConstActual(site, i, &v) || (n && v != value))
+                uniform = false;
+            value = v;
+            n++;
+        }
+        if (uniform && n)
+        {
+            primary->Bind(i, value);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Picks the version of the callee a site calls, cloning the callee
+// for a hot site that passes more constants than the primary binds.
+FnVersion *CallGraph::ChooseVersion(CallSite *site)
+{
+    FnDecl *fn = site->callee;
+    FnVersion *primary = fn->GetPrimaryVersion();
+    if (!site->hot)
+        return primary;
+
+    List<VarDecl *> *formals = fn->GetFormals();
+    FnVersion *wanted = new FnVersion(-1, formals->NumElements());
+    for (int i = 0; i < formals->NumElements(); i++)
+    {
+        int v;
+        if (!formals->Nth(i)->IsAssigned() && this->ConstActual(site, i, &v))
+            wanted->Bind(i, v);
+    }
+    if (wanted->NumBound() <= primary->NumBound())
+        return primary;
+
+    List<FnVersion *> *versions = fn->GetVersions();
+    for (int i = 1; i < versions->NumElements(); i++)
+        if (versions->Nth(i)->SameBindings(wanted))
+            return versions->Nth(i);
+    if (versions->NumElements() - 1 >= MaxClones)
+        return primary;
+
+    char label[256];
+    snprintf(label, sizeof(label), "%s.%d", Labels::Name(fn->GetLabel()),
+             versions->NumElements());
+    FnVersion *clone = new FnVersion(Labels::Named(label), formals->NumElements());
+    for (int i = 0; i < formals->NumElements(); i++)
+        if (wanted->IsBound(i))
+            clone->Bind(i, wanted->GetValue(i));
+    fn->AddVersion(clone);
+    return clone;
+}
+
+void CallGraph::PropagateConstants()
+{
+    // call sites in dead code are ignored, they are never emitted.
+    for (int i = 0; i < sites->NumElements(); i++)
+    {
+        if (!sites->Nth(i)->caller->IsReachable())
+            sites->RemoveAt(i--);
+    }
+    for (int i = 0; i < functions->NumElements(); i++)
+    {
+        if (!functions->Nth(i)->IsReachable())
+            functions->RemoveAt(i--);
+    }
+
+    // measured frequencies replace the guess made from the loop nesting.
+    for (int i = 0; i < sites->NumElements(); i++)
+    {
+        CallSite *site = sites->Nth(i);
+        int count;
+        if (profile->GetCount(Profile::Key("call", site->call->GetLocation()), &count))
+            site->hot = count >= Profile::HotCount;
+    }
+
+    for (int i = 0; i < functions->NumElements(); i++)
+    {
+        FnDecl *fn = functions->Nth(i);
+        fn->AddVersion(new FnVersion(fn->GetLabel(), fn->GetFormals()->NumElements()));
+    }
+
+    // binding a formal can only make more actuals constant, so this
+    // settles once nothing changes.
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < functions->NumElements(); i++)
+            if (this->BindUniformFormals(functions->Nth(i)))
+                changed = true;
+    }
+
+    for (int i = 0; i < sites->NumElements(); i++)
+    {
+        CallSite *site = sites->Nth(i);
+        site->call->SetTarget(this->ChooseVersion(site)->GetLabel());
+    }
+
+    if (IsDebugOn("ipcp"))
+        this->Print();
+}
+
+void CallGraph::Print()
+{
+    for (int i = 0; i < functions->NumElements(); i++)
+    {
+        FnDecl *fn = functions->Nth(i);
+        List<FnVersion *> *versions = fn->GetVersions();
+        for (int j = 0; j < versions->NumElements(); j++)
+        {
+            printf("+++ (ipcp): ");
+            versions->Nth(j)->Print();
+        }
+        for (int j = 0; j < sites->NumElements(); j++)
+        {
+            CallSite *site = sites->Nth(j);
+            if (site->callee != fn)
+                continue;
+            printf("+++ (ipcp):     line %d in %s%s -> %s\n",
+                   site->call->GetLocation()->first_line,
+                   site->caller ? Labels::Name(site->caller->GetLabel()) : "?",
+                   site->hot ? " (hot)" : "",
+                   Labels::Name(site->call->GetTarget()));
+        }
+    }
+}
+
+// The likely class of a receiver of static type staticType: the class
+// itself if live code instantiates it, otherwise the live subclass (or
+// implementer) instantiated at the most New() sites. The profile of
+// the call site, if there is one, takes precedence.
+ClassDecl *CallGraph::ExpectedReceiver(Decl *staticType, yyltype *site)
+{
+    int calls;
+    if (site && profile->GetCount(Profile::Key("call", site), &calls))
+        return this->MeasuredReceiver(staticType, site, calls);
+
+    ClassDecl *best = NULL;
+    int best_count = 0;
+    for (int i = 0; i < live_classes->NumElements(); i++)
+    {
+        ClassDecl *c = live_classes->Nth(i);
+        if (!c->IsChildOf(staticType))
+            continue;
+        if (c == staticType)
+            return c;
+        int count = 0;
+        for (int j = 0; j < class_uses->NumElements(); j++)
+        {
+            ClassUse *use = class_uses->Nth(j);
+            if (use->cls == c && use->caller->IsReachable())
+                count++;
+        }
+        if (!best || count > best_count)
+        {
+            best = c;
+            best_count = count;
+        }
+    }
+    return best;
+}
+
+ClassDecl *CallGraph::MeasuredReceiver(Decl *staticType, yyltype *site, int calls)
+{
+    ClassDecl *best = NULL;
+    int best_count = 0;
+    for (int i = 0; i < live_classes->NumElements(); i++)
+    {
+        ClassDecl *c = live_classes->Nth(i);
+        int count;
+        if (!c->IsChildOf(staticType) ||
+            !profile->GetCount(Profile::Key("recv", site, c->GetId()->ReturnIdenName()), &count))
+            continue;
+        if (count > best_count)
+        {
+            best = c;
+            best_count = count;
+        }
+    }
+    if (best && 2 * best_count < calls)
+        best = NULL;
+    PrintDebug("pgo", "line %d: %d calls, receiver %s", site->first_line, calls,
+               best ? best->GetId()->ReturnIdenName() : "not predicted");
+    return best;
+}
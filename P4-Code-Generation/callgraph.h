@@ -0,0 +1,133 @@
+/* File: callgraph.h
+ * -----------------
+ * The CallGraph records every direct call to a global function. It
+ * is filled in during type checking (Call::ConfirmType registers each
+ * call once its callee is resolved) and is used right before emission
+ * to propagate constant actuals into the formals of the callee.
+ *
+ * A formal is bound to a constant when every call site passes that
+ * same constant and the function never assigns to it. When the call
+ * sites disagree, the hot ones (inside a loop, or a function calling
+ * itself) get a specialized clone of the callee, emitted under the
+ * mangled label "_name.N" with the formals the site passes as
+ * constants bound. While a version of a function is emitted its bound
+ * formals read as constants, so expression folding and branch removal
+ * apply to the body.
+ *
+ * Method calls (by selector name) and class instantiations are
+ * recorded as well, which lets FindReachable walk the program from
+ * main: a function is live if it is called directly from live code, a
+ * class is live if live code instantiates it, and a method is live if
+ * it implements a selector called from live code in a live class.
+ * Everything else is left out of the output. The live classes are
+ * then given their interface tables by AssignInterfaceSlots.
+ *
+ * The live classes also drive speculative devirtualization: for a
+ * call through a vtable, ExpectedReceiver guesses the class the
+ * receiver most likely has, and Call::Emit tests for it and runs an
+ * inlined copy of that class's method when the guess is right.
+ *
+ * With -fprofile-use the measured counts replace the guesses: a call
+ * site is hot if it ran at least Profile::HotCount times, and the
+ * expected receiver is the class the site saw in at least half of its
+ * calls (none for a site that never ran).
+ */
+
+#ifndef _H_callgraph
+#define _H_callgraph
+
+#include <set>
+#include "list.h"
+#include "location.h"
+
+class Node;
+class Decl;
+class FnDecl;
+class ClassDecl;
+class Call;
+class NewExpr;
+
+// One emitted copy of a function: its label and the constant bound to
+// each formal (if any).
+class FnVersion
+{
+protected:
+  int label; // -1 for none
+  int num_formals;
+  bool *bound;
+  int *values;
+
+public:
+  FnVersion(int label, int numFormals);
+
+  int GetLabel() { return label; }
+  bool IsBound(int i) { return bound[i]; }
+  int GetValue(int i) { return values[i]; }
+  void Bind(int i, int value);
+  int NumBound();
+  bool SameBindings(FnVersion *other);
+  void Print();
+};
+
+class CallGraph
+{
+protected:
+  struct CallSite
+  {
+    Call *call;
+    FnDecl *caller, *callee;
+    bool hot;
+  };
+  struct MethodUse
+  {
+    FnDecl *caller;
+    const char *selector;
+  };
+  struct ClassUse
+  {
+    FnDecl *caller;
+    ClassDecl *cls;
+  };
+  List<CallSite *> *sites;
+  List<FnDecl *> *functions; // callees, in order of first call
+  List<MethodUse *> *method_uses;
+  List<ClassUse *> *class_uses;
+  std::set<Node *> registered;
+  List<const char *> *selectors;   // called from live code
+  List<ClassDecl *> *live_classes; // instantiated from live code
+
+  static FnDecl *EnclosingFn(Node *n, bool *inLoop);
+  ClassDecl *MeasuredReceiver(Decl *staticType, yyltype *site, int calls);
+  bool ConstActual(CallSite *site, int i, int *value);
+  bool BindUniformFormals(FnDecl *fn);
+  FnVersion *ChooseVersion(CallSite *site);
+  void MarkFn(FnDecl *fn, List<FnDecl *> *worklist);
+  void MarkSelector(const char *selector, List<FnDecl *> *worklist);
+  void MarkClass(ClassDecl *cls, List<FnDecl *> *worklist);
+  void PrintReachable(List<Decl *> *decls);
+
+public:
+  // upper bound on specialized clones emitted for a single function
+  static const int MaxClones = 4;
+
+  CallGraph();
+
+  void AddCall(Call *call, FnDecl *callee);
+  void AddMethodCall(Call *call, const char *selector);
+  void AddNew(NewExpr *expr, ClassDecl *cls);
+
+  // must run after class offsets are assigned and before member
+  // labels are prefixed, it matches methods by their plain name.
+  void FindReachable(List<Decl *> *decls);
+  // gives every interface method a dispatch slot and builds the
+  // interface tables of the live classes, after FindReachable
+  void AssignInterfaceSlots(List<Decl *> *decls);
+  void PropagateConstants();
+  ClassDecl *ExpectedReceiver(Decl *staticType, yyltype *site = NULL);
+  List<ClassDecl *> *GetLiveClasses() { return live_classes; }
+  void Print();
+};
+
+extern CallGraph *call_graph;
+
+#endif
@@ -1,21 +1,26 @@
 /* File: codegen.cc
  * ----------------
  * Implementation for the CodeGenerator class. The methods don't do anything
- * too fancy, mostly just create objects of the various Tac instruction
- * classes and append them to the list.
+ * too fancy, mostly just fill in Tac instructions of the various kinds
+ * and append them to the array.
  */
 
 #include "codegen.h"
 #include <string.h>
+#include <string>
 #include "tac.h"
 #include "mips.h"
+#include "mipself.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "x86.h"
+#include "csource.h"
+#include "scanner.h" // for GetLineNumbered
 
-Location *CodeGenerator::ptrThis = new Location(fpRelative, 4, "this");
+Location *CodeGenerator::ptrThis = Location::Get(fpRelative, 4, "this");
 
 CodeGenerator::CodeGenerator()
 {
-    // code = new List<Instruction*>();
-
     // global starts at 0, +4 every time
     globalLocation = OffsetToFirstGlobal;
 
@@ -24,26 +29,42 @@ CodeGenerator::CodeGenerator()
 
     // parameters start at 4, +4 every time
     paramLocation = OffsetToFirstParam;
+
+    for (int i = 0; i < NumBuiltIns; i++)
+        usedBuiltIns[i] = false;
+    curLine = 0;
+}
+
+void CodeGenerator::SetLocation(yyltype *loc)
+{
+    if (loc)
+        curLine = loc->first_line;
+}
+
+int CodeGenerator::Append(Instruction::Op op, int a, int b, int c, int opCode)
+{
+    return code.Add(op, curLine, a, b, c, opCode);
 }
 
-int CodeGenerator::GetNextGlobal()
+int CodeGenerator::GetNextGlobal(int size)
 {
     int g = globalLocation;
-    globalLocation += VarSize; // globalLocation + 4
+    globalLocation += size; // globalLocation + 4 (or 8)
     return g;
 }
 
-int CodeGenerator::GetNextLocal()
+// locals grow down but a double is addressed by its lower word
+int CodeGenerator::GetNextLocal(int size)
 {
-    int l = localLocation;
-    localLocation -= VarSize; // localLocation - 4
+    int l = localLocation - (size - VarSize);
+    localLocation -= size; // localLocation - 4 (or 8)
     return l;
 }
 
-int CodeGenerator::GetNextParam()
+int CodeGenerator::GetNextParam(int size)
 {
     int p = paramLocation;
-    paramLocation += VarSize; // paramLocation + 4
+    paramLocation += size; // paramLocation + 4 (or 8)
     return p;
 }
 
@@ -58,127 +79,161 @@ void CodeGenerator::ResetFrame()
     paramLocation = OffsetToFirstParam;
 }
 
-char *CodeGenerator::NewLabel()
+int CodeGenerator::NewLabel()
 {
-    static int nextLabelNum = 0;
-    char temp[10];
-    sprintf(temp, "_L%d", nextLabelNum++);
-    return strdup(temp);
+    return Labels::New();
 }
 
-Location *CodeGenerator::GenTempVar()
+Location *CodeGenerator::GenTempVar(bool isDouble)
 {
     static int nextTempNum;
-    char temp[10];
-    Location *result = NULL;
-    sprintf(temp, "_tmp%d", nextTempNum++);
-    result = new Location(fpRelative, GetNextLocal(), temp);
-    Assert(result != NULL);
-    return result;
+    return Location::NewTemp(nextTempNum++, GetNextLocal(isDouble ? DoubleSize : VarSize),
+                             isDouble);
 }
 
 Location *CodeGenerator::GenLoadConstant(int value)
 {
     Location *result = GenTempVar();
-    code.push_back(new LoadConstant(result, value));
+    Append(Instruction::LoadConstant, result->GetId(), value);
+    return result;
+}
+
+Location *CodeGenerator::GenLoadConstant(double value)
+{
+    Location *result = GenTempVar(true);
+    Append(Instruction::LoadDoubleConstant, result->GetId(), code.AddDouble(value));
     return result;
 }
 
 Location *CodeGenerator::GenLoadConstant(const char *s)
 {
+    Assert(s != NULL);
     Location *result = GenTempVar();
-    code.push_back(new LoadStringConstant(result, s));
+    // the literal keeps its quotes, one without gets them added
+    if (*s == '"')
+        Append(Instruction::LoadStringConstant, result->GetId(), code.AddString(s));
+    else
+    {
+        string quoted = string("\"") + s + "\"";
+        Append(Instruction::LoadStringConstant, result->GetId(), code.AddString(quoted.c_str()));
+    }
     return result;
 }
 
-Location *CodeGenerator::GenLoadLabel(const char *label)
+Location *CodeGenerator::GenLoadLabel(int label)
 {
     Location *result = GenTempVar();
-    code.push_back(new LoadLabel(result, label));
+    Append(Instruction::LoadLabel, result->GetId(), label);
     return result;
 }
 
 void CodeGenerator::GenAssign(Location *dst, Location *src)
 {
-    code.push_back(new Assign(dst, src));
+    Assert(dst != NULL && src != NULL);
+    Append(Instruction::Assign, dst->GetId(), src->GetId());
 }
 
-Location *CodeGenerator::GenLoad(Location *ref, int offset)
+Location *CodeGenerator::GenLoad(Location *ref, int offset, bool isDouble)
 {
-    Location *result = GenTempVar();
-    code.push_back(new Load(result, ref, offset));
+    Location *result = GenTempVar(isDouble);
+    Assert(ref != NULL);
+    Append(Instruction::Load, result->GetId(), ref->GetId(), offset);
     return result;
 }
 
 void CodeGenerator::GenStore(Location *dst, Location *src, int offset)
 {
-    code.push_back(new Store(dst, src, offset));
+    Assert(dst != NULL && src != NULL);
+    Append(Instruction::Store, dst->GetId(), src->GetId(), offset);
 }
 
 Location *CodeGenerator::GenBinaryOp(const char *opName, Location *op1,
                                      Location *op2)
 {
-    Location *result = GenTempVar();
-    code.push_back(new BinaryOp(BinaryOp::OpCodeForName(opName), result, op1, op2));
+    BinaryOp::OpCode op = BinaryOp::OpCodeForName(opName);
+    Location *result = GenTempVar(op1->IsDouble() && op <= BinaryOp::Mod);
+    Assert(op2 != NULL);
+    Append(Instruction::Binary, result->GetId(), op1->GetId(), op2->GetId(), op);
     return result;
 }
 
-void CodeGenerator::GenLabel(const char *label)
+void CodeGenerator::GenLabel(int label)
 {
-    code.push_back(new Label(label));
+    Append(Instruction::Label, label);
 }
 
-void CodeGenerator::GenIfZ(Location *test, const char *label)
+void CodeGenerator::GenIfZ(Location *test, int label)
 {
-    code.push_back(new IfZ(test, label));
+    Assert(test != NULL);
+    Append(Instruction::IfZ, test->GetId(), label);
 }
 
-void CodeGenerator::GenGoto(const char *label)
+void CodeGenerator::GenIfNZ(Location *test, int label)
 {
-    code.push_back(new Goto(label));
+    Assert(test != NULL);
+    Append(Instruction::IfNZ, test->GetId(), label);
+}
+
+void CodeGenerator::GenGoto(int label)
+{
+    Append(Instruction::Goto, label);
 }
 
 void CodeGenerator::GenReturn(Location *val)
 {
-    code.push_back(new Return(val));
+    Append(Instruction::Return, Location::IdOf(val));
 }
 
-BeginFunc *CodeGenerator::GenBeginFunc()
+int CodeGenerator::GenBeginFunc()
 {
     ResetFrame();
-    BeginFunc *result = new BeginFunc;
-    code.push_back(result);
-    return result;
+    // -555 is the sentinel of a frame size not yet backpatched
+    Append(Instruction::BeginFunc, -555);
+    return code.NumFunctions() - 1;
 }
 
 void CodeGenerator::GenEndFunc()
 {
-    code.push_back(new EndFunc());
+    Append(Instruction::EndFunc);
+}
+
+void CodeGenerator::SetFrameSize(int function, int numBytesForAllLocalsAndTemps)
+{
+    code.SetFrameSize(function, numBytesForAllLocalsAndTemps);
+}
+
+void CodeGenerator::SetClearedSlots(int function, List<int> *offsets)
+{
+    code.SetClearedSlots(function, offsets);
 }
 
 void CodeGenerator::GenPushParam(Location *param)
 {
-    code.push_back(new PushParam(param));
+    Assert(param != NULL);
+    Append(Instruction::PushParam, param->GetId());
 }
 
 void CodeGenerator::GenPopParams(int numBytesOfParams)
 {
     Assert(numBytesOfParams >= 0 && numBytesOfParams % VarSize == 0);
     if (numBytesOfParams > 0)
-        code.push_back(new PopParams(numBytesOfParams));
+        Append(Instruction::PopParams, numBytesOfParams);
 }
 
-Location *CodeGenerator::GenLCall(const char *label, bool fnHasReturnValue)
+Location *CodeGenerator::GenLCall(int label, bool fnHasReturnValue,
+                                  bool returnsDouble)
 {
-    Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-    code.push_back(new LCall(label, result));
+    Location *result = fnHasReturnValue ? GenTempVar(returnsDouble) : NULL;
+    Append(Instruction::LCall, Location::IdOf(result), label);
     return result;
 }
 
-Location *CodeGenerator::GenACall(Location *fnAddr, bool fnHasReturnValue)
+Location *CodeGenerator::GenACall(Location *fnAddr, bool fnHasReturnValue,
+                                  bool returnsDouble)
 {
-    Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-    code.push_back(new ACall(fnAddr, result));
+    Location *result = fnHasReturnValue ? GenTempVar(returnsDouble) : NULL;
+    Assert(fnAddr != NULL);
+    Append(Instruction::ACall, Location::IdOf(result), fnAddr->GetId());
     return result;
 }
 
@@ -191,11 +246,24 @@ static struct _builtin
     {"_Alloc", 1, true},
     {"_ReadLine", 0, true},
     {"_ReadInteger", 0, true},
+    {"_ReadDouble", 0, true}, // result in $f0
     {"_StringEqual", 2, true},
     {"_PrintInt", 1, false},
     {"_PrintString", 1, false},
     {"_PrintBool", 1, false},
-    {"_Halt", 0, false}};
+    {"_PrintDouble", 1, false},
+    {"_Halt", 0, false},
+    {"_ProfileDump", 0, false},
+    {"_AllocChunk", 1, true}, // only reached from HeapAlloc, size in $a0
+    {"_GcReport", 0, false},
+    {"_OutFlush", 0, false},
+    {"_HeapRecord", 2, false},
+    {"_HeapDump", 0, false}};
+
+bool CodeGenerator::IsOutputBuffered()
+{
+    return GetOption("fno-buffered-output") == NULL;
+}
 
 Location *CodeGenerator::GenBuiltInCall(BuiltIn bn, Location *arg1,
                                         Location *arg2)
@@ -203,45 +271,99 @@ Location *CodeGenerator::GenBuiltInCall(BuiltIn bn, Location *arg1,
     Assert(bn >= 0 && bn < NumBuiltIns);
     struct _builtin *b = &builtins[bn];
     Location *result = NULL;
+    usedBuiltIns[bn] = true;
 
     if (b->hasReturn)
-        result = GenTempVar();
+        result = GenTempVar(bn == ReadDouble);
     // verify appropriate number of non-NULL arguments given
     Assert((b->numArgs == 0 && !arg1 && !arg2) || (b->numArgs == 1 && arg1 && !arg2) || (b->numArgs == 2 && arg1 && arg2));
     if (arg2)
-        code.push_back(new PushParam(arg2));
+        Append(Instruction::PushParam, arg2->GetId());
+    if (arg1)
+        Append(Instruction::PushParam, arg1->GetId());
+    Append(Instruction::LCall, Location::IdOf(result), Labels::Named(b->label));
+    // a double argument takes two words
+    int argBytes = 0;
     if (arg1)
-        code.push_back(new PushParam(arg1));
-    code.push_back(new LCall(b->label, result));
-    GenPopParams(VarSize * b->numArgs);
+        argBytes += arg1->IsDouble() ? DoubleSize : VarSize;
+    if (arg2)
+        argBytes += arg2->IsDouble() ? DoubleSize : VarSize;
+    GenPopParams(argBytes);
     return result;
 }
 
-void CodeGenerator::GenVTable(const char *className,
-                              List<const char *> *methodLabels)
+Location *CodeGenerator::GenHeapAlloc(Location *size, int descriptor)
 {
-    code.push_back(new VTable(className, methodLabels));
+    Location *result = GenTempVar();
+    // running out of memory is reported and halts
+    usedBuiltIns[AllocChunk] = usedBuiltIns[PrintString] = usedBuiltIns[Halt] = true;
+    Assert(size != NULL);
+    Append(Instruction::HeapAlloc, result->GetId(), size->GetId(), descriptor);
+    return result;
+}
+
+void CodeGenerator::GenVTable(int classLabel, List<int> *methodLabels,
+                              List<int> *itableLabels, List<int> *gcMap)
+{
+    Append(Instruction::VTable, code.AddVTable(classLabel, methodLabels, itableLabels, gcMap));
 }
 
 void CodeGenerator::DoFinalCodeGen()
 {
     if (IsDebugOn("tac"))
     {
-        std::list<Instruction *>::iterator p;
-        for (p = code.begin(); p != code.end(); ++p)
-        {
-            (*p)->Print();
-        }
+        for (int i = 0; i < code.NumInstructions(); i++)
+            code.Print(i);
     }
     else
     {
-        Mips mips;
-        mips.EmitPreamble();
+        Target *target = NewTarget();
+        target->EmitPreamble();
 
-        std::list<Instruction *>::iterator p;
-        for (p = code.begin(); p != code.end(); ++p)
+        // -g gives the target each change of source line
+        bool lines = GetOption("g") != NULL;
+        int line = 0;
+        for (int i = 0; i < code.NumInstructions(); i++)
         {
-            (*p)->Emit(&mips);
+            if (lines && code.Nth(i).line != line)
+            {
+                line = code.Nth(i).line;
+                target->EmitLine(line, line ? GetLineNumbered(line) : NULL);
+            }
+            code.Emit(i, target);
         }
+        if (line)
+            target->EmitLine(0, NULL);
+        target->EmitEnd();
+        delete target;
     }
 }
+
+const char *TargetName()
+{
+    if (GetOption("emit-bc"))
+        return "bytecode";
+    if (GetOption("run"))
+        return "jit";
+    const char *name = GetOption("target");
+    return name ? name : "mips";
+}
+
+Target *NewTarget()
+{
+    const char *name = TargetName();
+    if (!strcmp(name, "mips"))
+        return new Mips;
+    if (!strcmp(name, "mips-elf"))
+        return new MipsElf;
+    if (!strcmp(name, "x86-64"))
+        return new X86;
+    if (!strcmp(name, "c"))
+        return new CSource;
+    if (!strcmp(name, "bytecode"))
+        return new Bytecode;
+    if (!strcmp(name, "jit"))
+        return new Jit;
+    Failure("unknown target %s (mips, mips-elf, x86-64 or c)", name);
+    return NULL;
+}
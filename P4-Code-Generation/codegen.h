@@ -1,9 +1,9 @@
 /* File: codegen.h
  * ---------------
  * The CodeGenerator class defines an object that will build Tac
- * instructions (using the Tac class and its subclasses) and store the
- * instructions in a sequential list, ready for further processing or
- * translation to MIPS as part of final code generation.
+ * instructions (see tac.h) and store the instructions in a sequential
+ * array, ready for further processing or translation to MIPS as part
+ * of final code generation.
  *
  * pp5:  The class as given supports the basic Tac instructions,
  *       you will need to extend it to handle the more complex
@@ -15,8 +15,8 @@
 #define _H_codegen
 
 #include <cstdlib>
-#include <list>
 #include "tac.h"
+#include "location.h"
 
 using namespace std;
 
@@ -26,23 +26,38 @@ typedef enum
   Alloc,
   ReadLine,
   ReadInteger,
+  ReadDouble,
   StringEqual,
   PrintInt,
   PrintString,
   PrintBool,
+  PrintDouble,
   Halt,
+  ProfileDump,
+  AllocChunk,
+  GcReport,
+  OutFlush,
+  HeapRecord,
+  HeapDump,
   NumBuiltIns
 } BuiltIn;
 
 class CodeGenerator
 {
 private:
-  // std::list<Instruction *> code;
-  list<Instruction *> code;
+  TacCode code;
   // stores current locations of given scopes in frame
   int globalLocation;
   int localLocation;
   int paramLocation;
+  // which runtime routines the generated code calls
+  bool usedBuiltIns[NumBuiltIns];
+  // the source line new instructions are generated for
+  int curLine;
+
+  // adds an instruction for the current line, returns its index
+  int Append(Instruction::Op op, int a = -1, int b = -1, int c = -1,
+             int opCode = 0);
 
 public:
   // Here are some class constants to remind you of the offsets
@@ -54,44 +69,56 @@ public:
   // "this" passed in first param slot at fp+4, all normal params
   // are shifted up by 4.)  First global is at offset 0 from global
   // pointer, all subsequent at +4, +8, etc.
-  // Conveniently, all vars are 4 bytes in size for code generation
+  // All vars are 4 bytes in size for code generation except doubles,
+  // which take 8 and are addressed by their lower word.
   static const int OffsetToFirstLocal = -8,
                    OffsetToFirstParam = 4,
                    OffsetToFirstGlobal = 0;
   static const int VarSize = 4;
+  static const int DoubleSize = 8;
 
   // just for new setup
   static Location *ptrThis;
 
   // location stuff
-  int GetNextGlobal();
-  int GetNextLocal();
-  int GetNextParam();
+  int GetNextGlobal(int size = VarSize);
+  int GetNextLocal(int size = VarSize);
+  int GetNextParam(int size = VarSize);
   int GetFrameSize();
   void ResetFrame();
 
   CodeGenerator();
 
-  // Assigns a new unique label name and returns it. Does not
-  // generate any Tac instructions (see GenLabel below if needed)
-  char *NewLabel();
+  // Instructions generated from here on belong to the source line of
+  // loc, for the line table -g writes (see target.h). A NULL loc
+  // leaves the line as it is.
+  void SetLocation(yyltype *loc);
+
+  // Assigns a new unique label and returns its number (see Labels in
+  // tac.h). Does not generate any Tac instructions (see GenLabel
+  // below if needed). The label of a name is Labels::Named.
+  int NewLabel();
 
-  // Creates and returns a Location for a new uniquely named
+  // Creates and returns a Location for a new uniquely numbered
   // temp variable. Does not generate any Tac instructions
-  Location *GenTempVar();
+  // A double temp gets an 8-byte slot. The temp's name is only
+  // made up if it is printed (see Location::NewTemp).
+  Location *GenTempVar(bool isDouble = false);
 
   // Generates Tac instructions to load a constant value. Creates
   // a new temp var to hold the result. The constant
   // value is passed as an integer, it can be 0 for integer zero,
   // false for bool, NULL for null object, etc. All are just 4-byte
   // zero in the code generation world.
-  // The second overloaded version is used for string constants.
+  // The second overloaded version is used for double constants, the
+  // third for string constants.
   // The LoadLabel method loads a label into a temporary.
   // Each of the methods returns a Location for the temp var
   // where the constant was loaded.
   Location *GenLoadConstant(int value);
+  Location *GenLoadConstant(double value);
   Location *GenLoadConstant(const char *str);
-  Location *GenLoadLabel(const char *label);
+  Location *GenLoadLabel(int label);
 
   // Generates Tac instructions to copy value from one location to another
   void GenAssign(Location *dst, Location *src);
@@ -110,12 +137,14 @@ public:
   // temporary variable where the result was stored. The optional
   // offset argument can be used to offset the addr by a positive or
   // negative number of bytes. If not given, 0 is assumed.
-  Location *GenLoad(Location *addr, int offset = 0);
+  // isDouble loads a double into a double temp.
+  Location *GenLoad(Location *addr, int offset = 0, bool isDouble = false);
 
   // Generates Tac instructions to perform one of the binary ops
   // identified by string name, such as "+" or "==".  Returns a
   // Location object for the new temporary where the result
-  // was stored.
+  // was stored. Arithmetic on doubles gives a double, comparing
+  // them gives an int.
   Location *GenBinaryOp(const char *opName, Location *op1, Location *op2);
 
   // Generates the Tac instruction for pushing a single
@@ -134,15 +163,17 @@ public:
   // should already have been pushed. If hasReturnValue is
   // true,  a new temp var is created, the fn result is stored
   // there and that Location is returned. If false, no temp is
-  // created and NULL is returned
-  Location *GenLCall(const char *label, bool fnHasReturnValue);
+  // created and NULL is returned. A double result comes back in $f0.
+  Location *GenLCall(int label, bool fnHasReturnValue,
+                     bool returnsDouble = false);
 
   // Generates the Tac instructions for ACall, a jump to an
   // address computed at runtime. Works similarly to LCall,
   // described above, in terms of return type.
   // The fnAddr Location is expected to hold the address of
   // the code to jump to (typically it was read from the vtable)
-  Location *GenACall(Location *fnAddr, bool fnHasReturnValue);
+  Location *GenACall(Location *fnAddr, bool fnHasReturnValue,
+                     bool returnsDouble = false);
 
   // Generates the Tac instructions to call one of
   // the built-in functions (Read, Print, Alloc, etc.) Although
@@ -156,27 +187,54 @@ public:
   Location *GenBuiltInCall(BuiltIn b, Location *arg1 = NULL,
                            Location *arg2 = NULL);
 
+  // Generates the Tac instruction to allocate size bytes of heap
+  // memory inline, falling back on the AllocChunk runtime routine
+  // when the current chunk is used up. Returns the Location of the
+  // new temp var holding the address of the memory.
+  // With the garbage collector on, descriptor is the label of the
+  // type descriptor to put in the header of the block, -1 for none.
+  Location *GenHeapAlloc(Location *size, int descriptor = -1);
+
+  // True if GenBuiltInCall was used for the built-in. Only the
+  // runtime routines that are called get printed with the program.
+  bool IsBuiltInUsed(BuiltIn b) { return usedBuiltIns[b]; }
+
+  // Print goes through an output buffer in the runtime unless
+  // -fno-buffered-output asks for a syscall per argument.
+  bool IsOutputBuffered();
+
   // These methods generate the Tac instructions for various
   // control flow (branches, jumps, returns, labels)
   // One minor detail to mention is that you can pass NULL
   // (or omit arg) to GenReturn for a return that does not
   // return a value
-  void GenIfZ(Location *test, const char *label);
-  void GenGoto(const char *label);
+  void GenIfZ(Location *test, int label);
+  void GenIfNZ(Location *test, int label);
+  void GenGoto(int label);
   void GenReturn(Location *val = NULL);
-  void GenLabel(const char *label);
+  void GenLabel(int label);
 
   // These methods generate the Tac instructions that mark the start
-  // and end of a function/method definition.
-  BeginFunc *GenBeginFunc();
+  // and end of a function/method definition. GenBeginFunc returns the
+  // number of the function, used to backpatch the BeginFunc with the
+  // frame size and the slots to clear once they are known.
+  int GenBeginFunc();
   void GenEndFunc();
+  void SetFrameSize(int function, int numBytesForAllLocalsAndTemps);
+  void SetClearedSlots(int function, List<int> *offsets);
 
   // Generates the Tac instructions for defining vtable for a
-  // The methods parameter is expected to contain the vtable
-  // methods in the order they should be laid out.  The vtable
-  // is tagged with a label of the class name, so when you later
-  // need access to the vtable, you use LoadLabel of class name.
-  void GenVTable(const char *className, List<const char *> *methodLabels);
+  // The methods parameter is expected to contain the labels of the
+  // vtable methods in the order they should be laid out, -1 for an
+  // empty slot.  The vtable is tagged with the label of the class
+  // name, so when you later need access to the vtable, you use
+  // LoadLabel of the class label.
+  // Methods called through an interface are found in the optional
+  // interface table laid out right before the vtable, slot i at
+  // offset -4-4*i from the class label. The optional gcMap is the
+  // class's type descriptor for the garbage collector.
+  void GenVTable(int classLabel, List<int> *methodLabels,
+                 List<int> *itableLabels = NULL, List<int> *gcMap = NULL);
 
   // Emits the final "object code" for the program by
   // translating the sequence of Tac instructions into their mips
@@ -184,6 +242,9 @@ public:
   // flag tac is on (-d tac), it will not translate to MIPS,
   // but instead just print the untranslated Tac. It may be
   // useful in debugging to first make sure your Tac is correct.
+  // The options can pick another target instead (see target.h):
+  // x86-64 assembly, C, dvm bytecode, or running the program in
+  // memory. With -g the target also gets the source lines.
   void DoFinalCodeGen();
 };
 
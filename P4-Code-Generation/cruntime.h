@@ -0,0 +1,287 @@
+/* File: cruntime.h
+ * ----------------
+ * The Decaf runtime for programs compiled with -target=c (see
+ * csource.h). The C file dcc writes includes it, so a program is
+ * built with
+ *
+ *     dcc -target=c < prog.decaf > prog.c
+ *     cc -O2 -I<this directory> -o prog prog.c
+ *
+ * Decaf pointers are 32 bits, as the Tac lays out objects and arrays
+ * in words, so they are offsets into a 4GB reservation (decaf_mem)
+ * rather than C pointers: the low 64KB stay unmapped so a null pointer
+ * faults, the strings and vtables the program starts with go right
+ * above, and the heap after them is only ever bumped; there is no
+ * collector. Loads and stores go through memcpy, which the compiler
+ * turns into plain moves without any aliasing worries.
+ *
+ * The builtins behave as the MIPS ones SysCallCodeGen prints: input
+ * is parsed the same way and errors print an "Exception:" line.
+ */
+
+#ifndef _H_cruntime
+#define _H_cruntime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+// what a Decaf function returns, its params are the words at a[0]...
+typedef union
+{
+    int32_t i;
+    double d;
+} decaf_Value;
+
+typedef decaf_Value (*decaf_Function)(const uint32_t *a);
+
+#define DECAF_DATA_BASE 0x10000u
+#define DECAF_RESERVED (((size_t)1 << 32) + 4096)
+
+static uint8_t *decaf_mem;
+static uint32_t decaf_heap, decaf_heapLimit;
+
+static void decaf_Error(const char *message)
+{
+    fflush(stdout);
+    fprintf(stderr, "Exception: %s\n", message);
+    exit(1);
+}
+
+static void decaf_BadAccess(int sig)
+{
+    decaf_Error("bad memory access (null pointer?)");
+}
+
+// Maps the memory and copies in the strings and vtables.
+static void decaf_Init(const uint8_t *data, uint32_t size)
+{
+    decaf_mem = (uint8_t *)mmap(NULL, DECAF_RESERVED, PROT_NONE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (decaf_mem == MAP_FAILED)
+        decaf_Error("cannot reserve memory for the program");
+    // the top 64MB are left unmapped, like the stack's place on MIPS
+    decaf_heapLimit = 0xfc000000u;
+    if (mprotect(decaf_mem + DECAF_DATA_BASE, decaf_heapLimit - DECAF_DATA_BASE,
+                 PROT_READ | PROT_WRITE))
+        decaf_Error("cannot reserve memory for the program");
+    memcpy(decaf_mem + DECAF_DATA_BASE, data, size);
+    decaf_heap = (DECAF_DATA_BASE + size + 4095) & ~4095u;
+    signal(SIGSEGV, decaf_BadAccess);
+    signal(SIGBUS, decaf_BadAccess);
+}
+
+static inline int32_t decaf_LoadWord(uint32_t addr)
+{
+    int32_t w;
+    memcpy(&w, decaf_mem + addr, sizeof(w));
+    return w;
+}
+
+static inline double decaf_LoadDouble(uint32_t addr)
+{
+    double d;
+    memcpy(&d, decaf_mem + addr, sizeof(d));
+    return d;
+}
+
+static inline void decaf_StoreWord(uint32_t addr, int32_t w)
+{
+    memcpy(decaf_mem + addr, &w, sizeof(w));
+}
+
+static inline void decaf_StoreDouble(uint32_t addr, double d)
+{
+    memcpy(decaf_mem + addr, &d, sizeof(d));
+}
+
+// a double param, which takes two words
+static inline double decaf_Arg(const uint32_t *a)
+{
+    double d;
+    memcpy(&d, a, sizeof(d));
+    return d;
+}
+
+static inline void decaf_PushDouble(uint32_t *sp, double d)
+{
+    memcpy(sp, &d, sizeof(d));
+}
+
+// int arithmetic wraps, as on MIPS
+static inline int32_t decaf_Add(int32_t a, int32_t b) { return (int32_t)((uint32_t)a + (uint32_t)b); }
+static inline int32_t decaf_Sub(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+static inline int32_t decaf_Mul(int32_t a, int32_t b) { return (int32_t)((uint32_t)a * (uint32_t)b); }
+
+static inline int32_t decaf_Div(int32_t a, int32_t b)
+{
+    if (b == 0)
+        decaf_Error("division by zero");
+    return b == -1 ? decaf_Sub(0, a) : a / b;
+}
+
+static inline int32_t decaf_Mod(int32_t a, int32_t b)
+{
+    if (b == 0)
+        decaf_Error("division by zero");
+    return b == -1 ? 0 : a % b;
+}
+
+// the quotient truncated to a word as trunc.w.d does, INT_MIN when it
+// doesn't fit
+static inline double decaf_DMod(double a, double b)
+{
+    double q = a / b;
+    int32_t t = q > -2147483649.0 && q < 2147483648.0 ? (int32_t)q : INT32_MIN;
+    return a - t * b;
+}
+
+static decaf_Value decaf_NullCall(const uint32_t *a)
+{
+    decaf_Error("call through a null function pointer");
+    return (decaf_Value){0};
+}
+
+static int32_t decaf_Alloc(int32_t size)
+{
+    uint32_t bytes = ((uint32_t)size + 7) & ~7u;
+    if (size < 0 || bytes > decaf_heapLimit - decaf_heap)
+        decaf_Error("out of heap memory");
+    uint32_t block = decaf_heap;
+    decaf_heap += bytes;
+    return block;
+}
+
+static int32_t decaf_ReadLine(void)
+{
+    size_t length = 0, capacity = 64;
+    char *line = (char *)malloc(capacity);
+    int c;
+    fflush(stdout);
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (length == capacity)
+            line = (char *)realloc(line, capacity *= 2);
+        line[length++] = c;
+    }
+    uint32_t s = decaf_Alloc(length + 5);
+    decaf_StoreWord(s, length);
+    memcpy(decaf_mem + s + 4, line, length);
+    decaf_mem[s + 4 + length] = '\0';
+    free(line);
+    return s + 4;
+}
+
+// blanks, a sign and digits, the rest of the line is ignored
+static int32_t decaf_ReadInteger(void)
+{
+    uint32_t value = 0;
+    int negative = 0, state = 0, c;
+    fflush(stdout);
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (state == 2)
+            continue;
+        if (c >= '0' && c <= '9')
+            value = value * 10 + (c - '0'), state = 1;
+        else if (state == 0 && (c == ' ' || c == '\t'))
+            continue;
+        else if (state == 0 && (c == '+' || c == '-'))
+            negative = c == '-', state = 1;
+        else
+            state = 2;
+    }
+    return negative ? -value : value;
+}
+
+// see _ReadDouble in main.cc for the states
+static double decaf_ReadDouble(void)
+{
+    double digits = 0;
+    int negative = 0, negExponent = 0, state = 0, c;
+    uint32_t afterPoint = 0, exponent = 0;
+    fflush(stdout);
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (state == 3)
+            continue;
+        if (c >= '0' && c <= '9')
+        {
+            if (state >= 4)
+                exponent = exponent * 10 + (c - '0'), state = 5;
+            else
+            {
+                digits = digits * 10 + (c - '0');
+                if (state == 2)
+                    afterPoint++;
+                else
+                    state = 1;
+            }
+        }
+        else if (c == '.')
+            state = state < 2 ? 2 : 3;
+        else if (state == 0)
+        {
+            if (c == ' ' || c == '\t')
+                continue;
+            if (c == '+' || c == '-')
+                negative = c == '-', state = 1;
+            else
+                state = 3;
+        }
+        else if ((c | 32) == 'e')
+            state = state < 3 ? 4 : 3;
+        else if (state == 4 && (c == '+' || c == '-'))
+            negExponent = c == '-', state = 5;
+        else
+            state = 3;
+    }
+    int32_t power = (negExponent ? -exponent : exponent) - afterPoint;
+    double scale = 1.0;
+    for (uint32_t i = power < 0 ? -(uint32_t)power : power; i && !isinf(scale); i--)
+        scale *= 10.0;
+    digits = power < 0 ? digits / scale : digits * scale;
+    return negative ? -digits : digits;
+}
+
+static int32_t decaf_StringEqual(uint32_t a, uint32_t b)
+{
+    int32_t length = decaf_LoadWord(a - 4);
+    return length == decaf_LoadWord(b - 4) && !memcmp(decaf_mem + a, decaf_mem + b, length);
+}
+
+static void decaf_PrintInt(int32_t n)
+{
+    printf("%d", n);
+}
+
+static void decaf_PrintString(uint32_t s)
+{
+    fputs((const char *)decaf_mem + s, stdout);
+}
+
+static void decaf_PrintBool(int32_t b)
+{
+    fputs(b ? "true" : "false", stdout);
+}
+
+static void decaf_PrintDouble(double d)
+{
+    printf("%.*g", 16, d);
+}
+
+static void decaf_Halt(void)
+{
+    exit(0);
+}
+
+static void decaf_OutFlush(void)
+{
+    fflush(stdout);
+}
+
+#endif
@@ -0,0 +1,428 @@
+/* File: csource.cc
+ * ----------------
+ * Implementation of the CSource class, which turns the Tac into C.
+ */
+
+#include "csource.h"
+#include "utility.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+
+static const uint32_t DataBase = 0x10000;
+
+// the runtime routines the Tac calls: their C names, how many word
+// params they take and whether they take a double
+static const struct
+{
+    const char *label, *name;
+    int numWords;
+    bool takesDouble;
+} builtIns[] = {
+    {"_Alloc", "decaf_Alloc", 1, false},
+    {"_ReadLine", "decaf_ReadLine", 0, false},
+    {"_ReadInteger", "decaf_ReadInteger", 0, false},
+    {"_ReadDouble", "decaf_ReadDouble", 0, false},
+    {"_StringEqual", "decaf_StringEqual", 2, false},
+    {"_PrintInt", "decaf_PrintInt", 1, false},
+    {"_PrintString", "decaf_PrintString", 1, false},
+    {"_PrintBool", "decaf_PrintBool", 1, false},
+    {"_PrintDouble", "decaf_PrintDouble", 0, true},
+    {"_Halt", "decaf_Halt", 0, false},
+    {"_OutFlush", "decaf_OutFlush", 0, false},
+    {NULL, NULL, 0, false}};
+
+CSource::CSource()
+{
+    outWords = maxOutWords = 0;
+    inFunction = false;
+    functionLabel = NULL;
+    functionNames.push_back("decaf_NullCall");
+}
+
+// Appends a line (indented for a function body) to the current function.
+void CSource::Line(const char *fmt, ...)
+{
+    va_list args;
+    char buf[1024];
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    body += "    ";
+    body += buf;
+    body += "\n";
+}
+
+/* Method: NewName
+ * ---------------
+ * A C identifier for a label, not used before: the label with what C
+ * doesn't allow turned into underscores (so _Node.Init is f_Node_Init),
+ * and a number added if that clashes.
+ */
+std::string CSource::NewName(const char *prefix, const char *label)
+{
+    std::string name = prefix;
+    if (*label != '_')
+        name += '_';
+    for (const char *p = label; *p; p++)
+        name += isalnum(*p) ? *p : '_';
+    std::string unique = name;
+    for (int i = 2; usedNames.count(unique); i++)
+    {
+        char suffix[16];
+        sprintf(suffix, "_%d", i);
+        unique = name + suffix;
+    }
+    usedNames.insert(unique);
+    return unique;
+}
+
+/* Method: Var
+ * -----------
+ * The C variable for a location, named for its offset: l8 for fp-8,
+ * p4 for the param at fp+4, g0 for the first global, with a d added
+ * for a double.
+ */
+const char *CSource::Var(Location *loc)
+{
+    char name[32];
+    int offset = loc->GetOffset();
+    const char *suffix = loc->IsDouble() ? "d" : "";
+    if (loc->GetSegment() == gpRelative)
+    {
+        sprintf(name, "g%d%s", offset, suffix);
+        return globals.insert(std::make_pair(std::string(name), loc->IsDouble())).first->first.c_str();
+    }
+    Assert(inFunction);
+    if (offset > 0)
+    {
+        sprintf(name, "p%d%s", offset, suffix);
+        params[offset] = loc->IsDouble();
+    }
+    else
+        sprintf(name, "l%d%s", -offset, suffix);
+    return locals.insert(std::make_pair(std::string(name), loc->IsDouble())).first->first.c_str();
+}
+
+std::string CSource::FunctionName(const char *label)
+{
+    return functionNames[FunctionIndex(label)];
+}
+
+int CSource::FunctionIndex(const char *label)
+{
+    if (!strcmp(label, "0"))
+        return 0;
+    std::map<std::string, int>::iterator it = functionIndex.find(label);
+    if (it != functionIndex.end())
+        return it->second;
+    functionNames.push_back(NewName("f", label));
+    return functionIndex[label] = functionNames.size() - 1;
+}
+
+void CSource::DataWord(uint32_t w)
+{
+    data.insert(data.end(), (uint8_t *)&w, (uint8_t *)&w + 4);
+}
+
+void CSource::EmitLoadConstant(Location *dst, int val)
+{
+    Line("%s = %d;", Var(dst), val);
+}
+
+void CSource::EmitLoadConstant(Location *dst, double val)
+{
+    Line("%s = %.17g;", Var(dst), val);
+}
+
+/* Method: EmitLoadStringConstant
+ * ------------------------------
+ * Pools the literal in the data as the Mips class does, with the
+ * escapes .asciiz would have translated. The word before it holds
+ * its length.
+ */
+void CSource::EmitLoadStringConstant(Location *dst, const char *str)
+{
+    std::map<std::string, uint32_t>::iterator it = stringLabels.find(str);
+    if (it == stringLabels.end())
+    {
+        std::string text;
+        for (const char *p = str + 1; *p && *p != '"'; p++)
+        {
+            if (*p == '\\' && p[1])
+            {
+                p++;
+                text += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+            }
+            else
+                text += *p;
+        }
+        data.resize((data.size() + 3) & ~3);
+        DataWord(text.size());
+        uint32_t addr = DataBase + data.size();
+        data.insert(data.end(), text.begin(), text.end());
+        data.push_back('\0');
+        it = stringLabels.insert(std::make_pair(std::string(str), addr)).first;
+    }
+    std::string comment = str; // which mustn't end the comment early
+    for (size_t star; (star = comment.find("*/")) != std::string::npos;)
+        comment.insert(star + 1, " ");
+    Line("%s = 0x%x; /* %s */", Var(dst), it->second, comment.c_str());
+}
+
+// a vtable's address is only known once it is out, so it goes by a
+// macro defined at the top of the file
+void CSource::EmitLoadLabel(Location *dst, const char *label)
+{
+    std::map<std::string, std::string>::iterator it = dataNames.find(label);
+    if (it == dataNames.end())
+        it = dataNames.insert(std::make_pair(std::string(label), NewName("V", label))).first;
+    Line("%s = %s;", Var(dst), it->second.c_str());
+}
+
+void CSource::EmitCopy(Location *dst, Location *src)
+{
+    Line("%s = %s;", Var(dst), Var(src));
+}
+
+void CSource::EmitLoad(Location *dst, Location *reference, int offset)
+{
+    Line("%s = decaf_Load%s((uint32_t)%s + %d);", Var(dst),
+         dst->IsDouble() ? "Double" : "Word", Var(reference), offset);
+}
+
+void CSource::EmitStore(Location *reference, Location *value, int offset)
+{
+    Line("decaf_Store%s((uint32_t)%s + %d, %s);", value->IsDouble() ? "Double" : "Word",
+         Var(reference), offset, Var(value));
+}
+
+void CSource::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                           Location *op1, Location *op2)
+{
+    static const char *intFns[] = {"decaf_Add", "decaf_Sub", "decaf_Mul", "decaf_Div", "decaf_Mod"};
+    static const char *ops[] = {"+", "-", "*", "/", "%", "==", "!=", "<", "<=", ">", ">=", "&", "|"};
+
+    const char *a = Var(op1), *b = Var(op2), *result = Var(dst);
+    if (op1->IsDouble() && code == BinaryOp::Mod)
+        Line("%s = decaf_DMod(%s, %s);", result, a, b);
+    else if (!op1->IsDouble() && code <= BinaryOp::Mod)
+        Line("%s = %s(%s, %s);", result, intFns[code], a, b);
+    else
+        Line("%s = %s %s %s;", result, a, ops[code], b);
+}
+
+void CSource::EmitLabel(const char *label)
+{
+    if (!inFunction)
+    {
+        functionLabel = label;
+        return;
+    }
+    body += label;
+    body += ":;\n";
+}
+
+void CSource::EmitGoto(const char *label)
+{
+    Line("goto %s;", label);
+}
+
+void CSource::EmitIfZ(Location *test, const char *label)
+{
+    Line("if (!%s) goto %s;", Var(test), label);
+}
+
+void CSource::EmitIfNZ(Location *test, const char *label)
+{
+    Line("if (%s) goto %s;", Var(test), label);
+}
+
+void CSource::EmitReturn(Location *returnVal)
+{
+    if (returnVal == NULL)
+        Line("return (decaf_Value){0};");
+    else
+        Line("return (decaf_Value){.%c = %s};", returnVal->IsDouble() ? 'd' : 'i',
+             Var(returnVal));
+}
+
+void CSource::EmitBeginFunction(int frameSize, List<int> *clearedSlots)
+{
+    Assert(functionLabel && !inFunction);
+    inFunction = true;
+    body.clear();
+    locals.clear();
+    params.clear();
+    outWords = maxOutWords = 0;
+}
+
+/* Method: EmitEndFunction
+ * -----------------------
+ * Puts the function together now that its variables are known. The
+ * locals start out zero rather than whatever was on the MIPS stack.
+ */
+void CSource::EmitEndFunction()
+{
+    EmitReturn(NULL);
+    inFunction = false;
+
+    std::string head;
+    char line[256];
+    sprintf(line, "static decaf_Value %s(const uint32_t *a)\n{\n", FunctionName(functionLabel).c_str());
+    head += line;
+    for (std::map<int, bool>::iterator it = params.begin(); it != params.end(); ++it)
+    {
+        int word = (it->first - 4) / 4;
+        if (it->second)
+            sprintf(line, "    double p%dd = decaf_Arg(a + %d);\n", it->first, word);
+        else
+            sprintf(line, "    int32_t p%d = (int32_t)a[%d];\n", it->first, word);
+        head += line;
+    }
+    for (std::map<std::string, bool>::iterator it = locals.begin(); it != locals.end(); ++it)
+    {
+        if (it->first[0] == 'p')
+            continue;
+        sprintf(line, "    %s %s = 0;\n", it->second ? "double" : "int32_t", it->first.c_str());
+        head += line;
+    }
+    if (maxOutWords > 0)
+    {
+        sprintf(line, "    uint32_t out[%d], *sp = out + %d;\n", maxOutWords, maxOutWords);
+        head += line;
+    }
+    functions += head + "\n" + body + "}\n\n";
+}
+
+// Params go on the function's own out array, from the top down as on
+// the MIPS stack, so the first param ends up at sp[0].
+void CSource::EmitParam(Location *arg)
+{
+    if (arg->IsDouble())
+    {
+        outWords += 2;
+        Line("sp -= 2;");
+        Line("decaf_PushDouble(sp, %s);", Var(arg));
+    }
+    else
+    {
+        outWords++;
+        Line("*--sp = %s;", Var(arg));
+    }
+    if (outWords > maxOutWords)
+        maxOutWords = outWords;
+}
+
+std::string CSource::CallResult(Location *result)
+{
+    if (result == NULL)
+        return "";
+    return std::string(Var(result)) + " = ";
+}
+
+void CSource::EmitLCall(Location *result, const char *label)
+{
+    int i = 0;
+    while (builtIns[i].label && strcmp(builtIns[i].label, label))
+        i++;
+    std::string call;
+    if (builtIns[i].label)
+    {
+        call = std::string(builtIns[i].name) + "(";
+        for (int w = 0; w < builtIns[i].numWords; w++)
+        {
+            char arg[16];
+            sprintf(arg, "%ssp[%d]", w ? ", " : "", w);
+            call += arg;
+        }
+        if (builtIns[i].takesDouble)
+            call += "decaf_Arg(sp)";
+        call += ")";
+    }
+    else
+    {
+        call = FunctionName(label) + (outWords ? "(sp)" : "(NULL)");
+        if (result)
+            call += result->IsDouble() ? ".d" : ".i";
+    }
+    Line("%s%s;", CallResult(result).c_str(), call.c_str());
+}
+
+void CSource::EmitACall(Location *result, Location *fnAddr)
+{
+    const char *field = result == NULL ? "" : result->IsDouble() ? ".d" : ".i";
+    Line("%sdecaf_functions[(uint32_t)%s](%s)%s;", CallResult(result).c_str(),
+         Var(fnAddr), outWords ? "sp" : "NULL", field);
+}
+
+void CSource::EmitPopParams(int bytes)
+{
+    if (bytes == 0)
+        return;
+    outWords -= bytes / 4;
+    Line("sp += %d;", bytes / 4);
+}
+
+void CSource::EmitHeapAlloc(Location *dst, Location *size, const char *descriptor)
+{
+    Line("%s = decaf_Alloc(%s);", Var(dst), Var(size));
+}
+
+/* Method: EmitVTable
+ * ------------------
+ * As on MIPS: the method entries from the class label up, and the
+ * interface tables (if any) in the words just below it.
+ */
+void CSource::EmitVTable(const char *label, List<const char *> *methodLabels,
+                         List<const char *> *itableLabels, List<int> *gcMap)
+{
+    data.resize((data.size() + 3) & ~3);
+    for (int i = itableLabels ? itableLabels->NumElements() - 1 : -1; i >= 0; i--)
+        DataWord(FunctionIndex(itableLabels->Nth(i)));
+    dataLabels[label] = DataBase + data.size();
+    for (int i = 0; i < methodLabels->NumElements(); i++)
+        DataWord(FunctionIndex(methodLabels->Nth(i)));
+}
+
+/* Method: EmitEnd
+ * ---------------
+ * Writes out the file: the prototypes and globals, the vtable
+ * addresses, the initial memory, the table of functions the vtables
+ * index, the functions and a C main to start it all.
+ */
+void CSource::EmitEnd()
+{
+    printf("/* Generated by dcc -target=c, build with cc -O2 (see cruntime.h) */\n\n");
+    printf("#include \"cruntime.h\"\n\n");
+
+    for (size_t i = 1; i < functionNames.size(); i++)
+        printf("static decaf_Value %s(const uint32_t *a);\n", functionNames[i].c_str());
+    printf("\n");
+    for (std::map<std::string, bool>::iterator it = globals.begin(); it != globals.end(); ++it)
+        printf("static %s %s;\n", it->second ? "double" : "int32_t", it->first.c_str());
+    for (std::map<std::string, std::string>::iterator it = dataNames.begin(); it != dataNames.end(); ++it)
+    {
+        if (dataLabels.find(it->first) == dataLabels.end())
+            Failure("no data for label %s", it->first.c_str());
+        printf("#define %s 0x%x\n", it->second.c_str(), dataLabels[it->first]);
+    }
+
+    printf("\nstatic const uint8_t decaf_data[] = {");
+    for (size_t i = 0; i < data.size(); i++)
+        printf("%s%d,", i % 16 ? " " : "\n    ", data[i]);
+    printf("%s};\n\n", data.empty() ? "0" : "\n");
+
+    printf("static const decaf_Function decaf_functions[] = {");
+    for (size_t i = 0; i < functionNames.size(); i++)
+        printf("%s\n    %s", i ? "," : "", functionNames[i].c_str());
+    printf("};\n\n");
+
+    printf("%s", functions.c_str());
+    printf("int main(void)\n{\n");
+    printf("    decaf_Init(decaf_data, %u);\n", (unsigned)data.size());
+    printf("    %s(NULL);\n", FunctionName("main").c_str());
+    printf("    return 0;\n}\n");
+}
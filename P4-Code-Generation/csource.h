@@ -0,0 +1,109 @@
+/* File: csource.h
+ * ---------------
+ * The CSource class translates the Tac instructions to one C
+ * translation unit, for -target=c, so that a C compiler's optimizer
+ * gets to work on the program (see cruntime.h for how to build it).
+ *
+ * Each Decaf function becomes a C function, its locals and temps C
+ * locals (named for their frame offset, l8 for the one at fp-8) and
+ * the globals C statics, so the C compiler can keep them in registers.
+ * The labels and branches stay as they are, as labels and gotos.
+ *
+ * All functions have the same C type so that they can be called
+ * through the vtables: they take a pointer to their params, the words
+ * the caller pushed on a little array of its own, and return a union
+ * of an int and a double. Memory is a range of 32-bit addresses (see
+ * cruntime.h), with the strings and vtables at its start; a vtable
+ * entry is the function's index in a table of C function pointers.
+ *
+ * The whole file is held back until EmitEnd, since a function's
+ * locals are only known once its body has been translated.
+ */
+
+#ifndef _H_csource
+#define _H_csource
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "tac.h"
+#include "list.h"
+#include "target.h"
+
+class CSource : public Target
+{
+private:
+  // the finished functions, and the one being translated
+  std::string functions, body;
+
+  // the C variables the function uses (declared at its top), by name,
+  // with whether each is a double, and the params it reads by offset
+  std::map<std::string, bool> locals;
+  std::map<int, bool> params;
+  // words pushed for the call being set up, at most
+  int outWords, maxOutWords;
+  bool inFunction;
+  const char *functionLabel;
+
+  std::map<std::string, bool> globals;
+  std::set<std::string> usedNames;
+
+  // index of each function in decaf_functions (0 is the null pointer)
+  std::map<std::string, int> functionIndex;
+  std::vector<std::string> functionNames;
+
+  std::vector<uint8_t> data;
+  std::map<std::string, uint32_t> dataLabels;
+  std::map<std::string, uint32_t> stringLabels;
+  // vtable labels a LoadLabel referred to, by C macro name
+  std::map<std::string, std::string> dataNames;
+
+  void Line(const char *fmt, ...);
+  std::string NewName(const char *prefix, const char *label);
+  const char *Var(Location *loc);
+  std::string FunctionName(const char *label);
+  int FunctionIndex(const char *label);
+  void DataWord(uint32_t w);
+  std::string CallResult(Location *result);
+
+public:
+  CSource();
+
+  void EmitEnd();
+
+  void EmitLoadConstant(Location *dst, int val);
+  void EmitLoadConstant(Location *dst, double val);
+  void EmitLoadStringConstant(Location *dst, const char *str);
+  void EmitLoadLabel(Location *dst, const char *label);
+
+  void EmitLoad(Location *dst, Location *reference, int offset);
+  void EmitStore(Location *reference, Location *value, int offset);
+  void EmitCopy(Location *dst, Location *src);
+
+  void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                    Location *op1, Location *op2);
+
+  void EmitLabel(const char *label);
+  void EmitGoto(const char *label);
+  void EmitIfZ(Location *test, const char *label);
+  void EmitIfNZ(Location *test, const char *label);
+  void EmitReturn(Location *returnVal);
+
+  void EmitBeginFunction(int frameSize, List<int> *clearedSlots = NULL);
+  void EmitEndFunction();
+
+  void EmitParam(Location *arg);
+  void EmitLCall(Location *result, const char *label);
+  void EmitACall(Location *result, Location *fnAddr);
+  void EmitPopParams(int bytes);
+
+  // the runtime has no collector, the descriptor is dropped
+  void EmitHeapAlloc(Location *dst, Location *size, const char *descriptor = NULL);
+
+  void EmitVTable(const char *label, List<const char *> *methodLabels,
+                  List<const char *> *itableLabels = NULL, List<int> *gcMap = NULL);
+};
+
+#endif
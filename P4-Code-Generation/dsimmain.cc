@@ -0,0 +1,93 @@
+/* File: dsimmain.cc
+ * -----------------
+ * This file defines the main() routine for dsim, the MIPS simulator
+ * used to run and measure the code dcc generates.
+ *
+ * Usage: dsim [-stats] [-profile] [-icache size:line:assoc]
+ *             [-dcache size:line:assoc] [-penalty cycles] [-limit n] file
+ *
+ * The file is the assembly dcc writes, or the ELF image it writes
+ * for -target=mips-elf. -profile reports where the instructions were
+ * spent, by source line too when the program was compiled with -g.
+ *
+ * The program reads its input from stdin and writes its output to
+ * stdout, statistics go to stderr so they never mix with the output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "simulator.h"
+#include "cache.h"
+#include "utility.h"
+
+static void Usage()
+{
+    fprintf(stderr, "Usage:   dsim [-stats] [-profile] [-icache size:line:assoc] "
+                    "[-dcache size:line:assoc] [-penalty cycles] [-limit n] file\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    Simulator sim;
+    bool stats = false, profiling = false;
+    const char *file = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-stats"))
+            stats = true;
+        else if (!strcmp(argv[i], "-profile"))
+            profiling = true;
+        else if (!strcmp(argv[i], "-icache") || !strcmp(argv[i], "-dcache"))
+        {
+            if (i + 1 == argc)
+                Usage();
+            Cache *c = Cache::FromSpec(argv[i] + 1, argv[i + 1]);
+            if (!c)
+                Usage();
+            if (argv[i][1] == 'i')
+                sim.SetICache(c);
+            else
+                sim.SetDCache(c);
+            stats = true;
+            i++;
+        }
+        else if (!strcmp(argv[i], "-penalty") && i + 1 < argc)
+            sim.SetMissPenalty(atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-limit") && i + 1 < argc)
+            sim.SetInstructionLimit(atoll(argv[++i]));
+        else if (argv[i][0] == '-' || file)
+            Usage();
+        else
+            file = argv[i];
+    }
+    if (!file)
+        Usage();
+
+    FILE *fp = fopen(file, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "dsim: cannot open %s\n", file);
+        return 2;
+    }
+    // an ELF image from dcc -target=mips-elf, or assembly
+    char magic[SELFMAG];
+    bool isImage = fread(magic, 1, SELFMAG, fp) == SELFMAG && !memcmp(magic, ELFMAG, SELFMAG);
+    rewind(fp);
+    if (isImage)
+        sim.LoadImage(fp, file);
+    else
+        sim.Load(fp, file);
+    fclose(fp);
+
+    sim.SetProfiling(profiling);
+    int status = sim.Run();
+    if (stats)
+        sim.PrintStats(stderr);
+    if (profiling)
+        sim.PrintProfile(stderr);
+    return status;
+}
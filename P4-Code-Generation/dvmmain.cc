@@ -0,0 +1,52 @@
+/* File: dvmmain.cc
+ * ----------------
+ * This file defines the main() routine for dvm, the virtual machine
+ * that runs the bytecode dcc writes with -emit-bc.
+ *
+ * Usage: dvm [-stats] file.bc
+ *
+ * The program reads its input from stdin and writes its output to
+ * stdout, statistics go to stderr so they never mix with the output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vm.h"
+#include "utility.h"
+
+static void Usage()
+{
+    fprintf(stderr, "Usage:   dvm [-stats] file.bc\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    VM vm;
+    bool stats = false;
+    const char *file = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-stats"))
+            stats = true;
+        else if (argv[i][0] == '-' || file)
+            Usage();
+        else
+            file = argv[i];
+    }
+    if (!file)
+        Usage();
+
+    vm.Load(file);
+    clock_t start = clock();
+    int status = vm.Run(stats);
+    if (stats)
+    {
+        vm.PrintStats(stderr);
+        fprintf(stderr, "  run time: %.3f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+    }
+    return status;
+}
@@ -193,7 +193,7 @@ void ReportError::PrintArgMismatch(Expr *arg, int argIndex, Type *given)
 {
     ostringstream s;
     s << "Incompatible argument " << argIndex << ": " << given
-      << " given, int/bool/string expected";
+      << " given, int/bool/string/double expected";
     OutputError(arg->GetLocation(), s.str());
 }
 
@@ -0,0 +1,193 @@
+/* File: gc.cc
+ * -----------
+ * Implementation of the GcMaps class: building the maps the collector
+ * uses to find pointers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gc.h"
+#include "ast.h"
+#include "ast_type.h"
+#include "ast_decl.h"
+#include "codegen.h"
+#include "utility.h"
+#include "target.h"
+#include "mips.h"
+
+GcMaps *gc_maps = new GcMaps();
+
+GcMaps::GcMaps()
+{
+    enabled = false;
+    frames = new List<Frame *>;
+    globals = new List<int>;
+    current = NULL;
+}
+
+// the targets whose runtime has no collector to read the maps
+static const char *const withoutCollector[] = {"bytecode", "jit", "x86-64", "c", NULL};
+
+void GcMaps::Init()
+{
+    enabled = GetOption("fgc") != NULL;
+    for (int i = 0; enabled && withoutCollector[i]; i++)
+    {
+        if (!strcmp(TargetName(), withoutCollector[i]))
+        {
+            fprintf(stderr, "Warning: -fgc is ignored for the %s target\n", TargetName());
+            enabled = false;
+        }
+    }
+}
+
+bool GcMaps::IsPointerType(Type *t)
+{
+    return t && (t->Type_NamedType() || t->Type_ArrayType());
+}
+
+int GcMaps::EntryFor(int offset, Type *t)
+{
+    return t->Type_ArrayType() ? offset | 1 : offset;
+}
+
+void GcMaps::AddEntry(List<int> *map, int entry)
+{
+    for (int i = 0; i < map->NumElements(); i++)
+        if (map->Nth(i) == entry)
+            return;
+    map->Append(entry);
+}
+
+void GcMaps::AddRoot(Location *loc, Type *t)
+{
+    if (IsPointerType(t))
+        this->AddPointer(loc, t->Type_ArrayType());
+}
+
+void GcMaps::AddPointer(Location *loc, bool isArray)
+{
+    if (!enabled || !loc || loc->GetBase())
+        return;
+    int entry = isArray ? loc->GetOffset() | 1 : loc->GetOffset();
+    if (loc->GetSegment() == gpRelative)
+        AddEntry(globals, entry);
+    else if (current)
+        AddEntry(current->slots, entry);
+}
+
+void GcMaps::BeginFunction(int label)
+{
+    if (!enabled)
+        return;
+    current = new Frame;
+    current->start = label;
+    char end[256];
+    snprintf(end, sizeof(end), "%s.end", Labels::Name(label));
+    current->end = Labels::Named(end);
+    current->slots = new List<int>;
+    frames->Append(current);
+}
+
+void GcMaps::EndFunction(int function)
+{
+    if (!enabled)
+        return;
+    // locals and temps start out as whatever the last frame there
+    // left behind, params are set by the caller.
+    List<int> *cleared = new List<int>;
+    for (int i = 0; i < current->slots->NumElements(); i++)
+    {
+        int offset = current->slots->Nth(i) & ~1;
+        if (offset < 0)
+            cleared->Append(offset);
+    }
+    CodeGen->SetClearedSlots(function, cleared);
+    CodeGen->GenLabel(current->end);
+    current = NULL;
+}
+
+int GcMaps::ClassDescriptor(ClassDecl *c)
+{
+    char label[256];
+    snprintf(label, sizeof(label), "%s.gc", c->GetId()->ReturnIdenName());
+    return Labels::Named(label);
+}
+
+int GcMaps::ArrayDescriptor(Type *elemType)
+{
+    if (elemType->Type_ArrayType())
+        return Labels::Named("_gc_arrays");
+    if (elemType->Type_NamedType())
+        return Labels::Named("_gc_objects");
+    if (elemType == Type::doubleType)
+        return Labels::Named("_gc_doubles");
+    return Labels::Named("_gc_scalars");
+}
+
+List<int> *GcMaps::ClassMap(ClassDecl *c)
+{
+    List<int> *map = new List<int>;
+    map->Append(c->GetInstanceSize());
+    List<VarDecl *> *fields = c->GetFields();
+    for (int i = 0; i < fields->NumElements(); i++)
+    {
+        VarDecl *v = fields->Nth(i);
+        if (IsPointerType(v->ReturnType()))
+            map->Append(EntryFor(v->GetMemberOffset(), v->ReturnType()));
+    }
+    return map;
+}
+
+// ", n" for each of the values, to follow the count on a .word line
+static std::string WordList(List<int> *values)
+{
+    std::string text;
+    char buf[16];
+    for (int i = 0; i < values->NumElements(); i++)
+    {
+        snprintf(buf, sizeof(buf), ", %d", values->Nth(i));
+        text += buf;
+    }
+    return text;
+}
+
+void GcMaps::EmitData(Mips *mips)
+{
+    mips->Runtime("      .data\n");
+    mips->Runtime("      .align 2\n");
+    mips->Runtime("  _gc_scalars: .word %d\n", ScalarArray);
+    mips->Runtime("  _gc_objects: .word %d\n", ObjectArray);
+    mips->Runtime("  _gc_arrays: .word %d\n", ArrayArray);
+    mips->Runtime("  _gc_doubles: .word %d\n", DoubleArray);
+    mips->Runtime("  _gc_globals: .word %d%s\n", globals->NumElements(),
+                  WordList(globals).c_str());
+    for (int i = 0; i < frames->NumElements(); i++)
+    {
+        List<int> *slots = frames->Nth(i)->slots;
+        mips->Runtime("  %s.map: .word %d%s\n", Labels::Name(frames->Nth(i)->start),
+                      slots->NumElements(), WordList(slots).c_str());
+    }
+    // start, end and map of every function, for the stack walk
+    mips->Runtime("  _gc_frames: .word %d\n", frames->NumElements());
+    for (int i = 0; i < frames->NumElements(); i++)
+    {
+        Frame *f = frames->Nth(i);
+        const char *start = Labels::Name(f->start);
+        mips->Runtime("      .word %s, %s, %s.map\n", start, Labels::Name(f->end), start);
+    }
+    mips->Runtime("  _gc_free: .word 0\n");
+    mips->Runtime("  _gc_chunks: .word 0\n");
+    mips->Runtime("  _gc_heap: .word 0\n");
+    mips->Runtime("  _gc_limit: .word 262144\n");
+    mips->Runtime("  _gc_count: .word 0\n");
+    mips->Runtime("  _gc_reclaimed: .word 0\n");
+    mips->Runtime("  _gc_msg1: .asciiz \"#gc: \"\n");
+    mips->Runtime("  _gc_msg2: .asciiz \" collections, \"\n");
+    mips->Runtime("  _gc_msg3: .asciiz \" bytes reclaimed\\n\"\n");
+    mips->Runtime("  _gc_buf: .space 12\n");
+    mips->Runtime("      .text\n");
+    mips->Runtime("\n");
+}
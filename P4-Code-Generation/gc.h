@@ -0,0 +1,99 @@
+/* File: gc.h
+ * ----------
+ * Support for the optional garbage collector (-fgc), a non-moving
+ * mark-sweep collector that runs when the allocator has used up the
+ * heap it is allowed before growing it.
+ *
+ * The collector is precise, it only follows words the compiler knows
+ * to hold an object or an array:
+ *  - each heap block starts with a header word pointing at a type
+ *    descriptor. A class's descriptor ("Class.gc") is emitted beside
+ *    its vtable and lists the offsets of the fields of class or array
+ *    type, arrays share one descriptor per kind of element.
+ *  - each function gets a frame map listing the frame slots (params,
+ *    locals and temps) of class or array type, and the collector finds
+ *    the map of a frame by looking its return address up in a table of
+ *    function ranges. Temps are never reused within a function, so a
+ *    slot holds the same kind of value at every call site, and the
+ *    pointer slots are cleared on entry so they never hold garbage.
+ *  - globals of class or array type are listed in one map too.
+ *
+ * An offset in a map has bit 0 set when the value is an array: array
+ * values point past the length word, 8 bytes into their block, objects
+ * 4 bytes into theirs.
+ */
+
+#ifndef _H_gc
+#define _H_gc
+
+#include "list.h"
+
+class Type;
+class Location;
+class ClassDecl;
+class Mips;
+
+class GcMaps
+{
+protected:
+  bool enabled;
+  struct Frame
+  {
+    int start, end; // labels
+    List<int> *slots;
+  };
+  List<Frame *> *frames;
+  List<int> *globals;
+  Frame *current;
+
+  static void AddEntry(List<int> *map, int entry);
+
+public:
+  // descriptor kinds, the first word of a descriptor
+  typedef enum
+  {
+    Object,
+    ScalarArray,
+    ObjectArray,
+    ArrayArray,
+    DoubleArray
+  } Kind;
+
+  GcMaps();
+
+  // reads the compiler options, to be called after ParseCommandLine
+  void Init();
+  bool IsEnabled() { return enabled; }
+
+  static bool IsPointerType(Type *t);
+  static int EntryFor(int offset, Type *t);
+
+  // Records loc as holding a value of type t: a slot of the function
+  // being emitted or a global. Does nothing unless t is a class or
+  // array type.
+  void AddRoot(Location *loc, Type *t);
+  // Same for an object (or array) whose type is known without a Type.
+  void AddPointer(Location *loc, bool isArray);
+
+  // Bracket the emission of a function: EndFunction labels its end and
+  // backpatches the prologue of function (the number GenBeginFunc
+  // returned) to clear the pointer slots.
+  void BeginFunction(int label);
+  void EndFunction(int function);
+
+  // Labels of the descriptors New and NewArray put in the header.
+  static int ClassDescriptor(ClassDecl *c);
+  static int ArrayDescriptor(Type *elemType);
+
+  // The descriptor of a class: its instance size followed by the
+  // entries of its fields of class or array type.
+  static List<int> *ClassMap(ClassDecl *c);
+
+  // Emits the frame and global maps and the array descriptors with
+  // the runtime routines.
+  void EmitData(Mips *mips);
+};
+
+extern GcMaps *gc_maps;
+
+#endif
@@ -0,0 +1,81 @@
+/* File: heapprof.cc
+ * -----------------
+ * Implementation of the HeapProfile class: numbering the allocation
+ * sites and laying out the counters _HeapRecord adds to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heapprof.h"
+#include "ast.h"
+#include "codegen.h"
+#include "utility.h"
+#include "target.h"
+#include "mips.h"
+
+HeapProfile *heap_profile = new HeapProfile();
+
+static const char *HeapHead = "#dcc-heap-profile";
+static const char *HeapTail = "#end";
+
+HeapProfile::HeapProfile()
+{
+    enabled = false;
+    sites = new List<const char *>;
+}
+
+void HeapProfile::Init()
+{
+    enabled = GetOption("fheap-profile") != NULL;
+    // only the MIPS runtime has the routines to count and write out
+    if (enabled && strcmp(TargetName(), "mips") && strcmp(TargetName(), "mips-elf"))
+    {
+        fprintf(stderr, "Warning: -fheap-profile is ignored for the %s target\n",
+                TargetName());
+        enabled = false;
+    }
+}
+
+void HeapProfile::GenRecord(const char *what, yyltype *loc, Location *size)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s line %d", what, loc ? loc->first_line : 0);
+
+    int site;
+    std::map<std::string, int>::iterator it = index.find(buf);
+    if (it != index.end())
+        site = it->second;
+    else
+    {
+        site = sites->NumElements();
+        index[buf] = site;
+        sites->Append(strdup(buf));
+    }
+    CodeGen->GenBuiltInCall(HeapRecord, CodeGen->GenLoadConstant(site), size);
+}
+
+void HeapProfile::EmitData(Mips *mips)
+{
+    int n = sites->NumElements();
+    mips->Runtime("      .data\n");
+    mips->Runtime("      .align 2\n");
+    mips->Runtime("  _heap_counts:\n");
+    mips->Runtime("      .space %d\n", n * CodeGenerator::VarSize);
+    mips->Runtime("  _heap_bytes:\n");
+    mips->Runtime("      .space %d\n", n * CodeGenerator::VarSize);
+    mips->Runtime("  _heap_num: .word %d\n", n);
+    // each name is written as "name\n" after the two numbers
+    mips->Runtime("  _heap_keys:\n");
+    for (int i = 0; i < n; i++)
+        mips->Runtime("      .word _heap_key%d, %d\n", i, (int)strlen(sites->Nth(i)) + 1);
+    for (int i = 0; i < n; i++)
+        mips->Runtime("  _heap_key%d: .asciiz \"%s\\n\"\n", i, sites->Nth(i));
+    mips->Runtime("  _heap_head: .asciiz \"%s\\n\"\n", HeapHead);
+    mips->Runtime("  _heap_tail: .asciiz \"%s\\n\"\n", HeapTail);
+    // the digits go in front of the space at the end
+    mips->Runtime("  _heap_buf: .ascii \"            \"\n");
+    mips->Runtime("      .text\n");
+    mips->Runtime("\n");
+}
@@ -0,0 +1,55 @@
+/* File: heapprof.h
+ * ----------------
+ * Support for the allocation-site heap profiler (-fheap-profile).
+ *
+ * Every new and NewArray in the program is an allocation site, named
+ * by the class or the array's element type and the source line, such
+ * as "Node line 27" or "int[] line 30". With the profiler on, each
+ * allocation also calls _HeapRecord with the number of its site and
+ * the bytes it took, which adds them up per site in the data segment.
+ * When the program halts or main returns, _HeapDump writes one
+ * "objects bytes site" line per site that allocated anything to
+ * stderr, the most bytes first, between a "#dcc-heap-profile" and an
+ * "#end" line.
+ *
+ * Like -fprofile-generate it needs the MIPS runtime.
+ */
+
+#ifndef _H_heapprof
+#define _H_heapprof
+
+#include <map>
+#include <string>
+#include "list.h"
+#include "location.h"
+
+class Location;
+class Mips;
+
+class HeapProfile
+{
+protected:
+  bool enabled;
+  List<const char *> *sites;        // name of site i
+  std::map<std::string, int> index; // name -> site number
+
+public:
+  HeapProfile();
+
+  // reads the compiler options, to be called after ParseCommandLine
+  void Init();
+  bool IsEnabled() { return enabled; }
+
+  // Generates the Tac instructions that record an allocation of size
+  // bytes at the site of what (a class name or an array type) on the
+  // line of loc. Allocations of the same thing on a line share a site.
+  void GenRecord(const char *what, yyltype *loc, Location *size);
+
+  // Emits the counters and the tables _HeapDump walks with the
+  // runtime routines.
+  void EmitData(Mips *mips);
+};
+
+extern HeapProfile *heap_profile;
+
+#endif
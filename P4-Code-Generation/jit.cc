@@ -0,0 +1,800 @@
+/* File: jit.cc
+ * ------------
+ * Implementation of the Jit class: encoding the x86-64 instructions
+ * each Tac instruction turns into, and running the result.
+ */
+
+#include "jit.h"
+#include "utility.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+// the program being run, for the runtime routines and the profiler
+static Jit *active;
+static Runtime *runtime;
+static long runtimeSamples;
+
+/* The runtime routines as the generated code calls them: with the
+ * Decaf sp, so that param i is the word at sp + 4 + 4 * i.
+ */
+static int32_t Arg(uint8_t *sp, int i)
+{
+    return *(int32_t *)(sp + 4 + 4 * i);
+}
+
+static int32_t CallAlloc(uint8_t *sp) { return runtime->Allocate(Arg(sp, 0)); }
+static int32_t CallReadLine(uint8_t *sp) { return runtime->ReadLine(); }
+static int32_t CallReadInteger(uint8_t *sp) { return runtime->ReadInteger(); }
+static double CallReadDouble(uint8_t *sp) { return runtime->ReadDouble(); }
+static int32_t CallStringEqual(uint8_t *sp) { return runtime->StringEqual(Arg(sp, 0), Arg(sp, 1)); }
+static void CallPrintInt(uint8_t *sp) { runtime->PrintInt(Arg(sp, 0)); }
+static void CallPrintString(uint8_t *sp) { runtime->PrintString(Arg(sp, 0)); }
+static void CallPrintBool(uint8_t *sp) { runtime->PrintBool(Arg(sp, 0)); }
+static void CallOutFlush(uint8_t *sp) { runtime->OutFlush(); }
+
+static void CallPrintDouble(uint8_t *sp)
+{
+    double d;
+    memcpy(&d, sp + 4, sizeof(d));
+    runtime->PrintDouble(d);
+}
+
+static void CallHalt(uint8_t *sp)
+{
+    active->Finish();
+    runtime->Halt();
+}
+
+// called by the code HeapAlloc turns into, with the size in edi
+static int32_t HeapAllocate(int32_t size)
+{
+    return runtime->Allocate(size);
+}
+
+static void DivideByZero()
+{
+    Runtime::Error("division by zero");
+}
+
+static void BadCall()
+{
+    Runtime::Error("call through a null function pointer");
+}
+
+static const struct
+{
+    const char *label;
+    const void *fn;
+} builtIns[] = {
+    {"_Alloc", (const void *)CallAlloc},
+    {"_ReadLine", (const void *)CallReadLine},
+    {"_ReadInteger", (const void *)CallReadInteger},
+    {"_ReadDouble", (const void *)CallReadDouble},
+    {"_StringEqual", (const void *)CallStringEqual},
+    {"_PrintInt", (const void *)CallPrintInt},
+    {"_PrintString", (const void *)CallPrintString},
+    {"_PrintBool", (const void *)CallPrintBool},
+    {"_PrintDouble", (const void *)CallPrintDouble},
+    {"_Halt", (const void *)CallHalt},
+    {"_OutFlush", (const void *)CallOutFlush},
+    {NULL, NULL}};
+
+Jit::Jit()
+{
+    globalBytes = 0;
+    lastLabel = NULL;
+    functionStart = 0;
+    runStart = 0;
+    text = NULL;
+    textSize = 0;
+    machineStack = NULL;
+    Byte(0xcc); // so that no function is at offset 0, a null pointer
+}
+
+double Jit::Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void Jit::Dword(uint32_t d)
+{
+    for (int i = 0; i < 4; i++)
+        Byte(d >> (8 * i));
+}
+
+void Jit::Qword(uint64_t q)
+{
+    Dword((uint32_t)q);
+    Dword((uint32_t)(q >> 32));
+}
+
+void Jit::PatchDword(uint32_t pos, uint32_t d)
+{
+    for (int i = 0; i < 4; i++)
+        code[pos + i] = d >> (8 * i);
+}
+
+/* Method: SlotAddr
+ * ----------------
+ * Where a variable is: off fp, or at a fixed address for a global.
+ */
+Jit::Addr Jit::SlotAddr(Location *loc)
+{
+    Assert(loc && loc->GetOffset() % 4 == 0);
+    Addr a = {FP, NoReg, loc->GetOffset()};
+    if (loc->GetSegment() == gpRelative)
+    {
+        int end = loc->GetOffset() + (loc->IsDouble() ? 8 : 4);
+        if (end > globalBytes)
+            globalBytes = end;
+        a.base = MemBase;
+        a.disp = GlobalBase + loc->GetOffset();
+    }
+    return a;
+}
+
+/* Methods: Rex, Operand, OpMem, OpReg
+ * -----------------------------------
+ * The encoding of an instruction with a register operand (reg, which
+ * may also be an opcode extension) and a memory or register one. All
+ * memory operands get a 32-bit displacement, which also sidesteps the
+ * special cases of r12 and r13 as a base.
+ */
+void Jit::Rex(bool wide, int reg, Addr a)
+{
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) |
+                  (a.index != NoReg && (a.index & 8) ? 2 : 0) | (a.base & 8 ? 1 : 0);
+    if (rex != 0x40)
+        Byte(rex);
+}
+
+void Jit::Operand(int reg, Addr a)
+{
+    if (a.index == NoReg && (a.base & 7) != rsp)
+        Byte(0x80 | (reg & 7) << 3 | (a.base & 7));
+    else
+    {
+        Byte(0x80 | (reg & 7) << 3 | rsp);
+        Byte(((a.index == NoReg ? rsp : a.index) & 7) << 3 | (a.base & 7));
+    }
+    Dword(a.disp);
+}
+
+void Jit::OpMem(uint8_t prefix, const char *opcode, bool wide, int reg, Addr a)
+{
+    if (prefix)
+        Byte(prefix);
+    Rex(wide, reg, a);
+    for (const char *p = opcode; *p; p++)
+        Byte(*p);
+    Operand(reg, a);
+}
+
+void Jit::OpReg(uint8_t prefix, const char *opcode, bool wide, int reg, int rm)
+{
+    if (prefix)
+        Byte(prefix);
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0);
+    if (rex != 0x40)
+        Byte(rex);
+    for (const char *p = opcode; *p; p++)
+        Byte(*p);
+    Byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+void Jit::MoveImm64(Register reg, uint64_t imm)
+{
+    Byte(0x48 | (reg & 8 ? 1 : 0));
+    Byte(0xb8 + (reg & 7));
+    Qword(imm);
+}
+
+void Jit::AddImm64(Register reg, int32_t imm)
+{
+    OpReg(0, "\x81", true, 0, reg);
+    Dword(imm);
+}
+
+/* Methods: JumpTo, JumpForward, Land
+ * ----------------------------------
+ * Jumps (conditional unless cond is -1) with a 32-bit displacement:
+ * to a label, or forward to a spot in the same instruction that Land
+ * marks later.
+ */
+void Jit::JumpTo(const char *label, int cond)
+{
+    if (cond < 0)
+        Byte(0xe9);
+    else
+    {
+        Byte(0x0f);
+        Byte(0x80 + cond);
+    }
+    LabelRef(label, true);
+}
+
+uint32_t Jit::JumpForward(int cond)
+{
+    if (cond < 0)
+        Byte(0xe9);
+    else
+    {
+        Byte(0x0f);
+        Byte(0x80 + cond);
+    }
+    Dword(0);
+    return code.size() - 4;
+}
+
+void Jit::Land(uint32_t jump)
+{
+    PatchDword(jump, code.size() - (jump + 4));
+}
+
+// eax = cond ? 1 : 0
+void Jit::SetCond(Cond cond)
+{
+    Byte(0x0f);
+    Byte(0x90 + cond);
+    Byte(0xc0);
+    Byte(0x0f); // movzx eax, al
+    Byte(0xb6);
+    Byte(0xc0);
+}
+
+// The machine stack is 16-byte aligned in the body of a function
+// (see EmitBeginFunction), as the C++ calling convention wants it.
+void Jit::CallNative(const void *fn, bool passSp)
+{
+    if (passSp)
+        OpReg(0, "\x89", true, SP, rdi);
+    MoveImm64(rax, (uint64_t)fn);
+    Byte(0xff); // call rax
+    Byte(0xd0);
+}
+
+void Jit::LabelRef(const char *label, bool relative)
+{
+    Fixup f = {false, relative, (uint32_t)code.size(), label};
+    fixups.push_back(f);
+    Dword(0);
+}
+
+uint32_t Jit::Resolve(const char *label)
+{
+    if (!strcmp(label, "0"))
+        return 0;
+    std::map<std::string, uint32_t>::iterator it = codeLabels.find(label);
+    if (it != codeLabels.end())
+        return it->second;
+    it = dataLabels.find(label);
+    if (it == dataLabels.end())
+        Failure("no code for label %s", label);
+    return it->second;
+}
+
+void Jit::EmitLoadConstant(Location *dst, int val)
+{
+    OpMem(0, "\xc7", false, 0, SlotAddr(dst));
+    Dword(val);
+}
+
+void Jit::EmitLoadConstant(Location *dst, double val)
+{
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    MoveImm64(rax, bits);
+    Store64(SlotAddr(dst), rax);
+}
+
+/* Method: EmitLoadStringConstant
+ * ------------------------------
+ * Pools the literal in the data like the Mips class does, with the
+ * escapes .asciiz would have translated.
+ */
+void Jit::EmitLoadStringConstant(Location *dst, const char *str)
+{
+    std::map<std::string, const char *>::iterator it = stringLabels.find(str);
+    if (it == stringLabels.end())
+    {
+        std::string text;
+        for (const char *p = str + 1; *p && *p != '"'; p++)
+        {
+            if (*p == '\\' && p[1])
+            {
+                p++;
+                text += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+            }
+            else
+                text += *p;
+        }
+        char label[24];
+        sprintf(label, "_string%d", (int)stringLabels.size() + 1);
+        data.resize((data.size() + 3) & ~3);
+        uint32_t length = text.size();
+        data.insert(data.end(), (uint8_t *)&length, (uint8_t *)&length + 4);
+        dataLabels[label] = DataBase + data.size();
+        data.insert(data.end(), text.begin(), text.end());
+        data.push_back('\0');
+        it = stringLabels.insert(std::make_pair(std::string(str), strdup(label))).first;
+    }
+    EmitLoadLabel(dst, it->second);
+}
+
+void Jit::EmitLoadLabel(Location *dst, const char *label)
+{
+    OpMem(0, "\xc7", false, 0, SlotAddr(dst));
+    LabelRef(label, false);
+}
+
+void Jit::EmitCopy(Location *dst, Location *src)
+{
+    if (src->IsDouble())
+    {
+        Load64(rax, SlotAddr(src));
+        Store64(SlotAddr(dst), rax);
+    }
+    else
+    {
+        Load32(rax, SlotAddr(src));
+        Store32(SlotAddr(dst), rax);
+    }
+}
+
+void Jit::EmitLoad(Location *dst, Location *reference, int offset)
+{
+    Addr a = {MemBase, rax, offset};
+    Load32(rax, SlotAddr(reference));
+    if (dst->IsDouble())
+    {
+        Load64(rcx, a);
+        Store64(SlotAddr(dst), rcx);
+    }
+    else
+    {
+        Load32(rax, a);
+        Store32(SlotAddr(dst), rax);
+    }
+}
+
+void Jit::EmitStore(Location *reference, Location *value, int offset)
+{
+    Addr a = {MemBase, rax, offset};
+    Load32(rax, SlotAddr(reference));
+    if (value->IsDouble())
+    {
+        Load64(rcx, SlotAddr(value));
+        Store64(a, rcx);
+    }
+    else
+    {
+        Load32(rcx, SlotAddr(value));
+        Store32(a, rcx);
+    }
+}
+
+void Jit::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                       Location *op1, Location *op2)
+{
+    static const char *const aluOps[] = {"\x03", "\x2b", "\x0f\xaf"};
+    static const Cond intConds[] = {CondE, CondNE, CondL, CondLE, CondG, CondGE};
+    static const char *const sseOps[] = {"\x0f\x58", "\x0f\x5c", "\x0f\x59", "\x0f\x5e"};
+
+    if (op1->IsDouble() && code <= BinaryOp::Div)
+    {
+        LoadDouble(0, SlotAddr(op1));
+        OpMem(0xf2, sseOps[code], false, 0, SlotAddr(op2));
+        StoreDouble(SlotAddr(dst), 0);
+        return;
+    }
+    if (op1->IsDouble() && code == BinaryOp::Mod)
+    {
+        // a - trunc(a / b) * b, the quotient truncated to a word as
+        // trunc.w.d does in the MIPS code
+        LoadDouble(0, SlotAddr(op1));
+        LoadDouble(1, SlotAddr(op2));
+        OpReg(0x66, "\x0f\x28", false, 2, 0); // movapd xmm2, xmm0
+        OpReg(0xf2, "\x0f\x5e", false, 2, 1); // divsd xmm2, xmm1
+        OpReg(0xf2, "\x0f\x2c", false, rax, 2); // cvttsd2si eax, xmm2
+        OpReg(0xf2, "\x0f\x2a", false, 2, rax); // cvtsi2sd xmm2, eax
+        OpReg(0xf2, "\x0f\x59", false, 2, 1); // mulsd xmm2, xmm1
+        OpReg(0xf2, "\x0f\x5c", false, 0, 2); // subsd xmm0, xmm2
+        StoreDouble(SlotAddr(dst), 0);
+        return;
+    }
+    if (op1->IsDouble())
+    {
+        // ucomisd sets CF and ZF (and PF) when unordered, so seta and
+        // setae with the operands swapped give < and <=, false on NaN
+        LoadDouble(0, SlotAddr(op1));
+        LoadDouble(1, SlotAddr(op2));
+        bool swapped = code == BinaryOp::Lt || code == BinaryOp::Le;
+        OpReg(0x66, "\x0f\x2e", false, swapped ? 1 : 0, swapped ? 0 : 1);
+        switch (code)
+        {
+        case BinaryOp::Eq:
+        case BinaryOp::Ne:
+            Byte(0x0f); // sete/setne al
+            Byte(code == BinaryOp::Eq ? 0x94 : 0x95);
+            Byte(0xc0);
+            Byte(0x0f); // setnp/setp cl
+            Byte(code == BinaryOp::Eq ? 0x9b : 0x9a);
+            Byte(0xc1);
+            Byte(code == BinaryOp::Eq ? 0x20 : 0x08); // and/or al, cl
+            Byte(0xc8);
+            Byte(0x0f); // movzx eax, al
+            Byte(0xb6);
+            Byte(0xc0);
+            break;
+        case BinaryOp::Lt:
+        case BinaryOp::Gt:
+            SetCond(CondA);
+            break;
+        default:
+            SetCond(CondAE);
+            break;
+        }
+        Store32(SlotAddr(dst), rax);
+        return;
+    }
+
+    Load32(rax, SlotAddr(op1));
+    switch (code)
+    {
+    case BinaryOp::Add:
+    case BinaryOp::Sub:
+    case BinaryOp::Mul:
+        OpMem(0, aluOps[code], false, rax, SlotAddr(op2));
+        break;
+    case BinaryOp::And:
+        OpMem(0, "\x23", false, rax, SlotAddr(op2));
+        break;
+    case BinaryOp::Or:
+        OpMem(0, "\x0b", false, rax, SlotAddr(op2));
+        break;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+    {
+        // INT_MIN / -1 traps on x86, wraps on MIPS
+        Load32(rcx, SlotAddr(op2));
+        OpReg(0, "\x85", false, rcx, rcx); // test ecx, ecx
+        uint32_t nonZero = JumpForward(CondNE);
+        CallNative((const void *)DivideByZero, false);
+        Land(nonZero);
+        OpReg(0, "\x83", false, 7, rcx); // cmp ecx, -1
+        Byte(0xff);
+        uint32_t minusOne = JumpForward(CondE);
+        Byte(0x99); // cdq
+        OpReg(0, "\xf7", false, 7, rcx); // idiv ecx
+        if (code == BinaryOp::Mod)
+            OpReg(0, "\x89", false, rdx, rax);
+        uint32_t done = JumpForward();
+        Land(minusOne);
+        if (code == BinaryOp::Div)
+            OpReg(0, "\xf7", false, 3, rax); // neg eax
+        else
+            OpReg(0, "\x31", false, rax, rax);
+        Land(done);
+        break;
+    }
+    default:
+        OpMem(0, "\x3b", false, rax, SlotAddr(op2)); // cmp eax, op2
+        SetCond(intConds[code - BinaryOp::Eq]);
+        break;
+    }
+    Store32(SlotAddr(dst), rax);
+}
+
+void Jit::EmitLabel(const char *label)
+{
+    Assert(codeLabels.find(label) == codeLabels.end());
+    codeLabels[label] = code.size();
+    lastLabel = label;
+}
+
+void Jit::EmitGoto(const char *label)
+{
+    JumpTo(label);
+}
+
+void Jit::EmitIfZ(Location *test, const char *label)
+{
+    OpMem(0, "\x83", false, 7, SlotAddr(test)); // cmp dword, 0
+    Byte(0);
+    JumpTo(label, CondE);
+}
+
+void Jit::EmitIfNZ(Location *test, const char *label)
+{
+    OpMem(0, "\x83", false, 7, SlotAddr(test));
+    Byte(0);
+    JumpTo(label, CondNE);
+}
+
+void Jit::EmitReturn(Location *returnVal)
+{
+    if (returnVal != NULL && returnVal->IsDouble())
+        LoadDouble(0, SlotAddr(returnVal));
+    else if (returnVal != NULL)
+        Load32(rax, SlotAddr(returnVal));
+    Addr savedFp = {FP, NoReg, -4};
+    OpReg(0, "\x89", true, FP, SP); // pop the frame
+    Load64(FP, savedFp);
+    AddImm64(rsp, 8);
+    Byte(0xc3); // ret
+}
+
+/* Method: EmitBeginFunction
+ * -------------------------
+ * The call pushed the return address on the machine stack, taking
+ * 8 more bytes there keeps it aligned for calls out of the body.
+ * The saved fp goes in the two words below the params.
+ */
+void Jit::EmitBeginFunction(int frameSize, List<int> *clearedSlots)
+{
+    Assert(frameSize >= 0 && lastLabel);
+    Function f = {lastLabel, codeLabels[lastLabel], 0, 0, 0};
+    functions.push_back(f);
+    functionStart = Now();
+
+    Addr savedFp = {SP, NoReg, -4};
+    AddImm64(rsp, -8);
+    Store64(savedFp, FP);
+    OpReg(0, "\x89", true, SP, FP); // mov r12, r13
+    AddImm64(SP, -(8 + frameSize));
+}
+
+void Jit::EmitEndFunction()
+{
+    EmitReturn(NULL);
+    Function &f = functions.back();
+    f.end = code.size();
+    f.compileSeconds = Now() - functionStart;
+}
+
+void Jit::EmitParam(Location *arg)
+{
+    if (arg->IsDouble())
+    {
+        Addr top = {SP, NoReg, -4};
+        Load64(rax, SlotAddr(arg));
+        Store64(top, rax);
+        AddImm64(SP, -8);
+    }
+    else
+    {
+        Addr top = {SP, NoReg, 0};
+        Load32(rax, SlotAddr(arg));
+        Store32(top, rax);
+        AddImm64(SP, -4);
+    }
+}
+
+void Jit::EmitLCall(Location *result, const char *label)
+{
+    int i = 0;
+    while (builtIns[i].label && strcmp(builtIns[i].label, label))
+        i++;
+    if (builtIns[i].label)
+        CallNative(builtIns[i].fn, true);
+    else
+    {
+        Byte(0xe8); // call rel32
+        LabelRef(label, true);
+    }
+    if (result != NULL && result->IsDouble())
+        StoreDouble(SlotAddr(result), 0);
+    else if (result != NULL)
+        Store32(SlotAddr(result), rax);
+}
+
+void Jit::EmitACall(Location *result, Location *fnAddr)
+{
+    Load32(rax, SlotAddr(fnAddr));
+    OpReg(0, "\x85", false, rax, rax); // test eax, eax
+    uint32_t nonNull = JumpForward(CondNE);
+    CallNative((const void *)BadCall, false);
+    Land(nonNull);
+    OpReg(0, "\x01", true, CodeBase, rax); // add rax, r14
+    Byte(0xff); // call rax
+    Byte(0xd0);
+    if (result != NULL && result->IsDouble())
+        StoreDouble(SlotAddr(result), 0);
+    else if (result != NULL)
+        Store32(SlotAddr(result), rax);
+}
+
+void Jit::EmitPopParams(int bytes)
+{
+    if (bytes != 0)
+        AddImm64(SP, bytes);
+}
+
+void Jit::EmitHeapAlloc(Location *dst, Location *size, const char *descriptor)
+{
+    Load32(rdi, SlotAddr(size));
+    CallNative((const void *)HeapAllocate, false);
+    Store32(SlotAddr(dst), rax);
+}
+
+void Jit::EmitVTable(const char *label, List<const char *> *methodLabels,
+                     List<const char *> *itableLabels, List<int> *gcMap)
+{
+    data.resize((data.size() + 3) & ~3);
+    for (int i = itableLabels ? itableLabels->NumElements() - 1 : -1; i >= 0; i--)
+    {
+        Fixup f = {true, false, (uint32_t)data.size(), itableLabels->Nth(i)};
+        fixups.push_back(f);
+        data.resize(data.size() + 4);
+    }
+    dataLabels[label] = DataBase + data.size();
+    for (int i = 0; i < methodLabels->NumElements(); i++)
+    {
+        Fixup f = {true, false, (uint32_t)data.size(), methodLabels->Nth(i)};
+        fixups.push_back(f);
+        data.resize(data.size() + 4);
+    }
+}
+
+// Counts a tick of the profiling timer against the function it hit.
+void Jit::Sample(int sig, void *info, void *context)
+{
+    uint8_t *pc = (uint8_t *)((ucontext_t *)context)->uc_mcontext.gregs[REG_RIP];
+    if (pc < active->text || pc >= active->text + active->textSize)
+    {
+        runtimeSamples++;
+        return;
+    }
+    uint32_t offset = pc - active->text;
+    std::vector<Function> &fns = active->functions;
+    int lo = 0, hi = (int)fns.size() - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (offset < fns[mid].start)
+            hi = mid - 1;
+        else if (offset >= fns[mid].end)
+            lo = mid + 1;
+        else
+        {
+            fns[mid].samples++;
+            return;
+        }
+    }
+}
+
+void Jit::Finish()
+{
+    double runSeconds = Now() - runStart;
+    fflush(stdout);
+    if (!IsDebugOn("jit"))
+        return;
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+
+    // the timer ticks at the kernel's rate, so the samples only give
+    // each function's share of the run time
+    long samples = runtimeSamples;
+    for (size_t i = 0; i < functions.size(); i++)
+        samples += functions[i].samples;
+    double msPerSample = samples ? runSeconds * 1e3 / samples : 0;
+
+    double compileSeconds = 0;
+    fprintf(stderr, "\n--- dcc -run ---\n");
+    fprintf(stderr, "  %-32s %8s %12s %10s\n", "function", "bytes", "compile us", "run ms");
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        Function &f = functions[i];
+        compileSeconds += f.compileSeconds;
+        fprintf(stderr, "  %-32s %8u %12.1f %10.1f\n", f.name, f.end - f.start,
+                f.compileSeconds * 1e6, f.samples * msPerSample);
+    }
+    fprintf(stderr, "  %-32s %8s %12s %10.1f\n", "(runtime routines)", "", "",
+            runtimeSamples * msPerSample);
+    fprintf(stderr, "  compile: %.3f ms for %u bytes, run: %.3f ms\n",
+            compileSeconds * 1e3, (unsigned)code.size(), runSeconds * 1e3);
+}
+
+void Jit::Run()
+{
+    // the way in from C++: save the registers the generated code
+    // takes over, set them up, switch to the machine stack of the
+    // program (its old top saved on it) and call main
+    uint32_t entry = code.size();
+    static const uint8_t enter[] = {
+        0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, // push rbx..r15
+        0x49, 0x89, 0xff,                                           // mov r15, rdi
+        0x49, 0x89, 0xf6,                                           // mov r14, rsi
+        0x49, 0x89, 0xd4,                                           // mov r12, rdx
+        0x49, 0x89, 0xd5,                                           // mov r13, rdx
+        0x48, 0x89, 0xe0,                                           // mov rax, rsp
+        0x48, 0x89, 0xcc,                                           // mov rsp, rcx
+        0x50,                                                       // push rax
+        0x48, 0x83, 0xec, 0x08};                                    // sub rsp, 8
+    static const uint8_t leave[] = {
+        0x48, 0x83, 0xc4, 0x08,                                     // add rsp, 8
+        0x5c,                                                       // pop rsp
+        0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5d, 0x5b, // pop r15..rbx
+        0xc3};
+    code.insert(code.end(), enter, enter + sizeof(enter));
+    Byte(0xe8);
+    LabelRef("main", true);
+    code.insert(code.end(), leave, leave + sizeof(leave));
+
+    for (size_t i = 0; i < fixups.size(); i++)
+    {
+        Fixup &f = fixups[i];
+        uint32_t value = Resolve(f.label);
+        if (f.relative)
+        {
+            if (codeLabels.find(f.label) == codeLabels.end())
+                Failure("no code for label %s", f.label);
+            PatchDword(f.pos, value - (f.pos + 4));
+        }
+        else if (f.inData)
+            memcpy(&data[f.pos], &value, 4);
+        else
+            PatchDword(f.pos, value);
+    }
+
+    textSize = code.size();
+    text = (uint8_t *)mmap(NULL, textSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (text == MAP_FAILED)
+        Failure("cannot map memory for the code");
+    memcpy(text, &code[0], textSize);
+    if (mprotect(text, textSize, PROT_READ | PROT_EXEC))
+        Failure("cannot make the code executable");
+
+    Assert(GlobalBase + globalBytes <= DataBase);
+    uint8_t *mem = rt.ReserveMemory();
+    if (!data.empty())
+        memcpy(mem + DataBase, &data[0], data.size());
+    // the lowest page of the Decaf stack is left unmapped, so running
+    // off its end faults instead of writing over the heap
+    rt.SetHeap((DataBase + data.size() + 4095) & ~4095, StackTop - StackSize);
+    if (mprotect(mem + StackTop - StackSize, 4096, PROT_NONE))
+        Failure("cannot reserve memory for the program");
+
+    // The return addresses go on a machine stack of the same size
+    // rather than the compiler's own, with an unmapped page below it
+    // too. Either overflowing faults and is reported by the runtime.
+    machineStack = (uint8_t *)mmap(NULL, StackSize + 4096, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (machineStack == MAP_FAILED || mprotect(machineStack, 4096, PROT_NONE))
+        Failure("cannot map memory for the stack");
+    runtime = &rt;
+    active = this;
+
+    const char *input = GetOption("input");
+    if (input && !freopen(input, "r", stdin))
+        Failure("cannot open %s", input);
+    static char outBuf[1 << 16];
+    setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+
+    if (IsDebugOn("jit"))
+    {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = (void (*)(int, siginfo_t *, void *))Sample;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+        sigaction(SIGPROF, &sa, NULL);
+        struct itimerval every = {{0, 1000}, {0, 1000}};
+        setitimer(ITIMER_PROF, &every, NULL);
+    }
+
+    typedef void (*EntryFn)(uint8_t *mem, uint8_t *code, uint8_t *stackTop,
+                            uint8_t *machineStackTop);
+    EntryFn run = (EntryFn)(text + entry);
+    runStart = Now();
+    run(mem, text, mem + StackTop, machineStack + 4096 + StackSize);
+    Finish();
+}
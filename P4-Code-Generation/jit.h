@@ -0,0 +1,182 @@
+/* File: jit.h
+ * -----------
+ * The Jit class translates the Tac instructions to x86-64 machine code
+ * in memory and runs the program in the compiler (dcc -run), with no
+ * assembler or simulator involved.
+ *
+ * The generated code keeps the MIPS memory layout and calling
+ * convention, so the rest of the compiler doesn't know the difference:
+ * Decaf pointers stay 32 bits, offsets into a 4GB reservation (see
+ * runtime.h) whose base lives in r15, and frames live on a Decaf stack
+ * in that memory with fp in r12 and sp in r13 (as real pointers). A
+ * frame is laid out as in the MIPS code except that the return
+ * address goes on the machine stack (call/ret), which leaves the two
+ * words below the params for the saved fp. The machine stack is one
+ * of the program's own, as deep as the Decaf stack, so a deep
+ * recursion that runs under dsim runs here too. Function pointers in the
+ * vtables are offsets from the start of the code, which lives in r14.
+ *
+ * The runtime routines are the C++ ones in runtime.h, called with the
+ * Decaf sp so they find their params as the MIPS ones do. Values are
+ * returned in eax, or xmm0 for a double.
+ *
+ * With -d jit the compile time and size of each function are reported
+ * on stderr, along with where the run spent its time, sampled with a
+ * profiling timer.
+ */
+
+#ifndef _H_jit
+#define _H_jit
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "tac.h"
+#include "list.h"
+#include "runtime.h"
+#include "target.h"
+
+class Jit : public Target
+{
+private:
+  typedef enum
+  {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15,
+    NoReg = -1
+  } Register;
+
+  // registers the generated code keeps for itself
+  static const Register FP = r12, SP = r13, CodeBase = r14, MemBase = r15;
+
+  // condition codes, for jcc and setcc
+  typedef enum
+  {
+    CondB = 2, CondAE, CondE, CondNE, CondBE, CondA,
+    CondP = 10, CondNP, CondL, CondGE, CondLE, CondG
+  } Cond;
+
+  // a memory operand: [base + index + disp]
+  struct Addr
+  {
+    Register base, index;
+    int32_t disp;
+  };
+
+  static const uint32_t GlobalBase = 0x10000,
+                        DataBase = 0x1000000,
+                        StackTop = 0xfffff000,
+                        StackSize = 64 << 20;
+
+  std::vector<uint8_t> code;
+  std::vector<uint8_t> data;
+  int globalBytes;
+
+  std::map<std::string, uint32_t> codeLabels, dataLabels;
+  std::map<std::string, const char *> stringLabels;
+
+  // rel32 operands to point at a label, and 32-bit words (in the code
+  // or the data) to set to a label's code offset or data address
+  struct Fixup
+  {
+    bool inData, relative;
+    uint32_t pos;
+    const char *label;
+  };
+  std::vector<Fixup> fixups;
+
+  struct Function
+  {
+    const char *name;
+    uint32_t start, end;
+    double compileSeconds;
+    long samples;
+  };
+  std::vector<Function> functions;
+  const char *lastLabel;
+  double functionStart, runStart;
+
+  Runtime rt;
+  uint8_t *text;
+  size_t textSize;
+  uint8_t *machineStack; // for call and ret, StackSize above a guard page
+
+  void Byte(uint8_t b) { code.push_back(b); }
+  void Dword(uint32_t d);
+  void Qword(uint64_t q);
+  void PatchDword(uint32_t pos, uint32_t d);
+
+  Addr SlotAddr(Location *loc);
+  void Rex(bool wide, int reg, Addr a);
+  void Operand(int reg, Addr a);
+  void OpMem(uint8_t prefix, const char *opcode, bool wide, int reg, Addr a);
+  void OpReg(uint8_t prefix, const char *opcode, bool wide, int reg, int rm);
+
+  void Load32(Register reg, Addr a) { OpMem(0, "\x8b", false, reg, a); }
+  void Store32(Addr a, Register reg) { OpMem(0, "\x89", false, reg, a); }
+  void Load64(Register reg, Addr a) { OpMem(0, "\x8b", true, reg, a); }
+  void Store64(Addr a, Register reg) { OpMem(0, "\x89", true, reg, a); }
+  void LoadDouble(int xmm, Addr a) { OpMem(0xf2, "\x0f\x10", false, xmm, a); }
+  void StoreDouble(Addr a, int xmm) { OpMem(0xf2, "\x0f\x11", false, xmm, a); }
+  void MoveImm64(Register reg, uint64_t imm);
+  void AddImm64(Register reg, int32_t imm);
+
+  void JumpTo(const char *label, int cond = -1);
+  uint32_t JumpForward(int cond = -1);
+  void Land(uint32_t jump);
+  void SetCond(Cond cond);
+  void CallNative(const void *fn, bool passSp);
+
+  void LabelRef(const char *label, bool relative);
+  uint32_t Resolve(const char *label);
+
+  static double Now();
+  static void Sample(int sig, void *info, void *context);
+
+public:
+  Jit();
+
+  void EmitLoadConstant(Location *dst, int val);
+  void EmitLoadConstant(Location *dst, double val);
+  void EmitLoadStringConstant(Location *dst, const char *str);
+  void EmitLoadLabel(Location *dst, const char *label);
+
+  void EmitLoad(Location *dst, Location *reference, int offset);
+  void EmitStore(Location *reference, Location *value, int offset);
+  void EmitCopy(Location *dst, Location *src);
+
+  void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                    Location *op1, Location *op2);
+
+  void EmitLabel(const char *label);
+  void EmitGoto(const char *label);
+  void EmitIfZ(Location *test, const char *label);
+  void EmitIfNZ(Location *test, const char *label);
+  void EmitReturn(Location *returnVal);
+
+  void EmitBeginFunction(int frameSize, List<int> *clearedSlots = NULL);
+  void EmitEndFunction();
+
+  void EmitParam(Location *arg);
+  void EmitLCall(Location *result, const char *label);
+  void EmitACall(Location *result, Location *fnAddr);
+  void EmitPopParams(int bytes);
+
+  // there is no collector, the descriptor is dropped
+  void EmitHeapAlloc(Location *dst, Location *size, const char *descriptor = NULL);
+
+  void EmitVTable(const char *label, List<const char *> *methodLabels,
+                  List<const char *> *itableLabels = NULL, List<int> *gcMap = NULL);
+
+  // Resolves the labels, maps the code and runs main. Exits like the
+  // program does when it calls Halt.
+  void Run();
+  void EmitEnd() { Run(); }
+
+  // Flushes the output when the program ends, and reports on it
+  // with -d jit.
+  void Finish();
+};
+
+#endif
@@ -9,8 +9,13 @@
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "profile.h"
+#include "gc.h"
+#include "heapprof.h"
+#include "mips.h"
 
-void SysCallCodeGen();
+void OutputCodeGen(Mips *mips);
+void GcCodeGen(Mips *mips);
 
 /* Function: main()
  * ----------------
@@ -23,182 +28,1261 @@ void SysCallCodeGen();
 int main(int argc, char *argv[])
 {
     ParseCommandLine(argc, argv);
+    profile->Init();
+    gc_maps->Init();
+    heap_profile->Init();
 
     InitScanner();
     InitParser();
     yyparse();
-    if (ReportError::NumErrors() == 0)
-        SysCallCodeGen();
+    Node::FreeAll();
     return (ReportError::NumErrors() == 0 ? 0 : -1);
 }
 
-void SysCallCodeGen()
+/* Function: SysCallCodeGen()
+ * --------------------------
+ * Hands the runtime routines to mips a line at a time, from its
+ * EmitEnd: the assembly target prints them, MipsElf assembles them.
+ */
+void SysCallCodeGen(Mips *mips)
+{
+    // only the routines the generated code calls are printed.
+    bool buffered = CodeGen->IsOutputBuffered();
+    if (buffered)
+        OutputCodeGen(mips);
+    if (CodeGen->IsBuiltInUsed(PrintInt) && !buffered)
+    {
+        mips->Runtime("  _PrintInt:\n");
+        mips->Runtime("      subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
+        mips->Runtime("      sw $fp, 8($sp)	# save fp\n");
+        mips->Runtime("      sw $ra, 4($sp)	# save ra\n");
+        mips->Runtime("      addiu $fp, $sp, 8	# set up new fp\n");
+        mips->Runtime("      lw $a0, 4($fp)	# fill a to $t0 from $fp+4\n");
+        mips->Runtime("    # LCall _PrintInt\n");
+        mips->Runtime("      li $v0, 1\n");
+        mips->Runtime("      syscall\n");
+        mips->Runtime("    # EndFunc\n");
+        mips->Runtime("    # (below handles reaching end of fn body with no explicit return)\n");
+        mips->Runtime("      move $sp, $fp		# pop callee frame off stack\n");
+        mips->Runtime("      lw $ra, -4($fp)	# restore saved ra\n");
+        mips->Runtime("      lw $fp, 0($fp)	# restore saved fp\n");
+        mips->Runtime("      jr $ra		# return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(ReadInteger))
+    {
+        // reads a line and converts it like atoi: blanks, a sign and
+        // digits, the rest of the line is ignored
+        mips->Runtime("  _ReadInteger:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          li $t0, 0             # value\n");
+        mips->Runtime("          li $t1, 0             # 1 if negative\n");
+        mips->Runtime("          li $t2, 0             # 0 before the number, 1 in it, 2 after it\n");
+        mips->Runtime("  Lrunt40:\n");
+        mips->Runtime("          jal _InByte\n");
+        mips->Runtime("          bltz $v0, Lrunt41\n");
+        mips->Runtime("          li $t3, 10\n");
+        mips->Runtime("          beq $v0, $t3, Lrunt41\n");
+        mips->Runtime("          li $t3, 2\n");
+        mips->Runtime("          beq $t2, $t3, Lrunt40\n");
+        mips->Runtime("          addiu $t3, $v0, -48\n");
+        mips->Runtime("          li $t4, 10\n");
+        mips->Runtime("          bgeu $t3, $t4, Lrunt42\n");
+        mips->Runtime("          mul $t0, $t0, $t4\n");
+        mips->Runtime("          addu $t0, $t0, $t3\n");
+        mips->Runtime("          li $t2, 1\n");
+        mips->Runtime("          b Lrunt40\n");
+        mips->Runtime("  Lrunt42:\n");
+        mips->Runtime("          bnez $t2, Lrunt43\n");
+        mips->Runtime("          li $t3, 32\n");
+        mips->Runtime("          beq $v0, $t3, Lrunt40\n");
+        mips->Runtime("          li $t3, 9\n");
+        mips->Runtime("          beq $v0, $t3, Lrunt40\n");
+        mips->Runtime("          li $t3, 43\n");
+        mips->Runtime("          beq $v0, $t3, Lrunt44\n");
+        mips->Runtime("          li $t3, 45\n");
+        mips->Runtime("          bne $v0, $t3, Lrunt43\n");
+        mips->Runtime("          li $t1, 1\n");
+        mips->Runtime("  Lrunt44:\n");
+        mips->Runtime("          li $t2, 1\n");
+        mips->Runtime("          b Lrunt40\n");
+        mips->Runtime("  Lrunt43:\n");
+        mips->Runtime("          li $t2, 2\n");
+        mips->Runtime("          b Lrunt40\n");
+        mips->Runtime("  Lrunt41:\n");
+        mips->Runtime("          move $v0, $t0\n");
+        mips->Runtime("          beqz $t1, Lrunt45\n");
+        mips->Runtime("          negu $v0, $t0\n");
+        mips->Runtime("  Lrunt45:\n");
+        mips->Runtime("          # EndFunc\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(ReadDouble))
+    {
+        // reads a line and converts it like atof: blanks, a sign,
+        // digits with an optional point and an optional exponent. The
+        // digits are gathered as a whole number, then scaled by the
+        // power of ten the point and the exponent make. $t2 is 0
+        // before the number, 1 in the digits before the point, 2 in
+        // those after it, 4 right after the e, 5 in the exponent and 3
+        // after the number.
+        mips->Runtime("  _ReadDouble:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          li.d $f0, 0.0         # digits\n");
+        mips->Runtime("          li.d $f2, 10.0\n");
+        mips->Runtime("          li $t1, 0             # 1 if negative\n");
+        mips->Runtime("          li $t2, 0\n");
+        mips->Runtime("          li $t3, 0             # digits after the point\n");
+        mips->Runtime("          li $t4, 0             # exponent\n");
+        mips->Runtime("          li $t5, 0             # 1 if the exponent is negative\n");
+        mips->Runtime("  Lrunt50:\n");
+        mips->Runtime("          jal _InByte\n");
+        mips->Runtime("          bltz $v0, Lrunt51\n");
+        mips->Runtime("          li $t6, 10\n");
+        mips->Runtime("          beq $v0, $t6, Lrunt51\n");
+        mips->Runtime("          li $t6, 3\n");
+        mips->Runtime("          beq $t2, $t6, Lrunt50\n");
+        mips->Runtime("          addiu $t6, $v0, -48\n");
+        mips->Runtime("          li $t7, 10\n");
+        mips->Runtime("          bgeu $t6, $t7, Lrunt52\n");
+        mips->Runtime("          li $t7, 4\n");
+        mips->Runtime("          bgeu $t2, $t7, Lrunt53\n");
+        mips->Runtime("          mtc1 $t6, $f4\n");
+        mips->Runtime("          cvt.d.w $f4, $f4\n");
+        mips->Runtime("          mul.d $f0, $f0, $f2\n");
+        mips->Runtime("          add.d $f0, $f0, $f4\n");
+        mips->Runtime("          li $t7, 2\n");
+        mips->Runtime("          bne $t2, $t7, Lrunt54\n");
+        mips->Runtime("          addiu $t3, $t3, 1\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt54:\n");
+        mips->Runtime("          li $t2, 1\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt53:\n");
+        mips->Runtime("          li $t7, 10\n");
+        mips->Runtime("          mul $t4, $t4, $t7\n");
+        mips->Runtime("          addu $t4, $t4, $t6\n");
+        mips->Runtime("          li $t2, 5\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt52:\n");
+        mips->Runtime("          li $t6, 46\n");
+        mips->Runtime("          bne $v0, $t6, Lrunt55\n");
+        mips->Runtime("          li $t6, 2\n");
+        mips->Runtime("          bgeu $t2, $t6, Lrunt57\n");
+        mips->Runtime("          li $t2, 2\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt55:\n");
+        mips->Runtime("          bnez $t2, Lrunt58\n");
+        mips->Runtime("          li $t6, 32\n");
+        mips->Runtime("          beq $v0, $t6, Lrunt50\n");
+        mips->Runtime("          li $t6, 9\n");
+        mips->Runtime("          beq $v0, $t6, Lrunt50\n");
+        mips->Runtime("          li $t6, 43\n");
+        mips->Runtime("          beq $v0, $t6, Lrunt56\n");
+        mips->Runtime("          li $t6, 45\n");
+        mips->Runtime("          bne $v0, $t6, Lrunt57\n");
+        mips->Runtime("          li $t1, 1\n");
+        mips->Runtime("  Lrunt56:\n");
+        mips->Runtime("          li $t2, 1\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt58:\n");
+        mips->Runtime("          ori $t6, $v0, 32      # e or E\n");
+        mips->Runtime("          li $t7, 101\n");
+        mips->Runtime("          bne $t6, $t7, Lrunt59\n");
+        mips->Runtime("          li $t7, 3\n");
+        mips->Runtime("          bgeu $t2, $t7, Lrunt57\n");
+        mips->Runtime("          li $t2, 4\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt59:\n");
+        mips->Runtime("          li $t7, 4\n");
+        mips->Runtime("          bne $t2, $t7, Lrunt57\n");
+        mips->Runtime("          li $t6, 43\n");
+        mips->Runtime("          beq $v0, $t6, Lrunt60\n");
+        mips->Runtime("          li $t6, 45\n");
+        mips->Runtime("          bne $v0, $t6, Lrunt57\n");
+        mips->Runtime("          li $t5, 1\n");
+        mips->Runtime("  Lrunt60:\n");
+        mips->Runtime("          li $t2, 5\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt57:\n");
+        mips->Runtime("          li $t2, 3\n");
+        mips->Runtime("          b Lrunt50\n");
+        mips->Runtime("  Lrunt51:\n");
+        mips->Runtime("          beqz $t5, Lrunt61\n");
+        mips->Runtime("          negu $t4, $t4\n");
+        mips->Runtime("  Lrunt61:\n");
+        mips->Runtime("          subu $t4, $t4, $t3    # power of ten to scale by\n");
+        mips->Runtime("          li.d $f4, 1.0\n");
+        mips->Runtime("          move $t6, $t4\n");
+        mips->Runtime("          bgez $t6, Lrunt62\n");
+        mips->Runtime("          negu $t6, $t6\n");
+        mips->Runtime("  Lrunt62:\n");
+        mips->Runtime("          beqz $t6, Lrunt63\n");
+        mips->Runtime("          mul.d $f4, $f4, $f2\n");
+        mips->Runtime("          addiu $t6, $t6, -1\n");
+        mips->Runtime("          b Lrunt62\n");
+        mips->Runtime("  Lrunt63:\n");
+        mips->Runtime("          bltz $t4, Lrunt64\n");
+        mips->Runtime("          mul.d $f0, $f0, $f4\n");
+        mips->Runtime("          b Lrunt65\n");
+        mips->Runtime("  Lrunt64:\n");
+        mips->Runtime("          div.d $f0, $f0, $f4\n");
+        mips->Runtime("  Lrunt65:\n");
+        mips->Runtime("          beqz $t1, Lrunt66\n");
+        mips->Runtime("          neg.d $f0, $f0\n");
+        mips->Runtime("  Lrunt66:\n");
+        mips->Runtime("          # EndFunc\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(PrintDouble))
+    {
+        // the print syscall formats the double, buffered output is
+        // written out first to keep the order
+        mips->Runtime("  _PrintDouble:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        if (buffered)
+            mips->Runtime("          jal _OutFlush\n");
+        mips->Runtime("          l.d $f12, 4($fp)      # fill a from $fp+4\n");
+        mips->Runtime("          li $v0, 3\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          # EndFunc\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(PrintBool) && !buffered)
+    {
+        mips->Runtime("  _PrintBool:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          lw $t1, 4($fp)        # fill a from $fp+4\n");
+        mips->Runtime("      li $t2, 0\n");
+        mips->Runtime("          li $v0, 4\n");
+        mips->Runtime("      beq $t1, $t2, _PrintBoolFalse\n");
+        mips->Runtime("      la $a0, _PrintBoolTrueString\n");
+        mips->Runtime("      j _PrintBoolEnd\n");
+        mips->Runtime("    _PrintBoolFalse:\n");
+        mips->Runtime("    	  la $a0, _PrintBoolFalseString\n");
+        mips->Runtime("    _PrintBoolEnd:\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("        # EndFunc\n");
+        mips->Runtime("        # (below handles reaching end of fn body with no explicit return)\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+        mips->Runtime("      .data			# create string constant marked with label\n");
+        mips->Runtime("      _PrintBoolTrueString: .asciiz \"true\"\n");
+        mips->Runtime("      .text\n");
+        mips->Runtime("\n");
+        mips->Runtime("      .data			# create string constant marked with label\n");
+        mips->Runtime("      _PrintBoolFalseString: .asciiz \"false\"\n");
+        mips->Runtime("      .text\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(PrintString) && !buffered)
+    {
+        mips->Runtime("  _PrintString:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          lw $a0, 4($fp)        # fill a from $fp+4\n");
+        mips->Runtime("          li $v0, 4\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("        # EndFunc\n");
+        mips->Runtime("        # (below handles reaching end of fn body with no explicit return)\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(Alloc))
+    {
+        mips->Runtime("  _Alloc:\n");
+        mips->Runtime("    subu $sp, $sp, 8      # decrement sp to make space to save ra,fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          lw $a0, 4($fp)        # fill a from $fp+4\n");
+        mips->Runtime("          li $v0, 9\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("        # EndFunc\n");
+        mips->Runtime("        # (below handles reaching end of fn body with no explicit return)\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(AllocChunk) && gc_maps->IsEnabled())
+        GcCodeGen(mips);
+    else if (CodeGen->IsBuiltInUsed(AllocChunk))
+    {
+        // called with the size in $a0 when the heap pointer ($s7)
+        // went past the end of the chunk ($s6)
+        mips->Runtime("  _AllocChunk:\n");
+        mips->Runtime("          subu $s7, $s7, $a0    # undo the bump\n");
+        mips->Runtime("          move $t0, $a0\n");
+        mips->Runtime("          li $t1, 65536         # chunk size\n");
+        mips->Runtime("          addu $a0, $a0, $t1\n");
+        mips->Runtime("          bltu $a0, $t1, _AllocFail # the size wrapped around\n");
+        mips->Runtime("          li $v0, 9\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          li $t1, -1\n");
+        mips->Runtime("          beq $v0, $t1, _AllocFail # sbrk could not grow the heap\n");
+        mips->Runtime("          beq $v0, $s6, _AllocChunk1 # contiguous with the old chunk, go on from $s7\n");
+        mips->Runtime("          move $s7, $v0\n");
+        mips->Runtime("  _AllocChunk1:\n");
+        mips->Runtime("          addu $s6, $v0, $a0    # new end of chunk\n");
+        mips->Runtime("          move $v0, $s7\n");
+        mips->Runtime("          addu $s7, $s7, $t0\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(AllocChunk))
+    {
+        // reached from _AllocChunk when the heap cannot grow, reports
+        // it like the other runtime errors
+        mips->Runtime("  _AllocFail:\n");
+        mips->Runtime("          la $t0, _alloc_msg\n");
+        mips->Runtime("          subu $sp, $sp, 4\n");
+        mips->Runtime("          sw $t0, 4($sp)\n");
+        mips->Runtime("          jal _PrintString\n");
+        mips->Runtime("          jal _Halt\n");
+        mips->Runtime("      .data\n");
+        mips->Runtime("      .align 2\n");
+        mips->Runtime("      .word 35\n");
+        mips->Runtime("  _alloc_msg: .asciiz \"Decaf runtime error: Out of memory\\n\"\n");
+        mips->Runtime("      .text\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(Halt))
+    {
+        mips->Runtime("  _Halt:\n");
+        // the program's output goes out before the reports on stderr,
+        // in the order main returning has them
+        if (CodeGen->IsBuiltInUsed(OutFlush))
+            mips->Runtime("          jal _OutFlush         # write what is left of the output\n");
+        if (CodeGen->IsBuiltInUsed(ProfileDump))
+            mips->Runtime("          jal _ProfileDump      # then the counters\n");
+        if (CodeGen->IsBuiltInUsed(GcReport))
+            mips->Runtime("          jal _GcReport         # and the collector's statistics\n");
+        if (CodeGen->IsBuiltInUsed(HeapDump))
+            mips->Runtime("          jal _HeapDump         # and the allocation sites\n");
+        mips->Runtime("          li $v0, 10\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("        # EndFunc\n");
+        mips->Runtime("\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(StringEqual))
+    {
+        // the same string, or the same length and contents. Strings
+        // are word aligned with their length in the word before, the
+        // contents are compared a word at a time.
+        mips->Runtime("  _StringEqual:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          lw $a0, 4($fp)        # fill a from $fp+4\n");
+        mips->Runtime("          lw $a1, 8($fp)        # fill a from $fp+8\n");
+        mips->Runtime("          beq $a0, $a1, Lrunt10\n");
+        mips->Runtime("          lw $a2, -4($a0)       # lengths\n");
+        mips->Runtime("          lw $a3, -4($a1)\n");
+        mips->Runtime("          bne $a2, $a3, Lrunt13\n");
+        mips->Runtime("          li $t2, 4\n");
+        mips->Runtime("  Lrunt11:\n");
+        mips->Runtime("          bltu $a2, $t2, Lrunt12\n");
+        mips->Runtime("          lw $t0, 0($a0)\n");
+        mips->Runtime("          lw $t1, 0($a1)\n");
+        mips->Runtime("          bne $t0, $t1, Lrunt13\n");
+        mips->Runtime("          addiu $a0, $a0, 4\n");
+        mips->Runtime("          addiu $a1, $a1, 4\n");
+        mips->Runtime("          addiu $a2, $a2, -4\n");
+        mips->Runtime("          b Lrunt11\n");
+        mips->Runtime("  Lrunt12:\n");
+        mips->Runtime("          beqz $a2, Lrunt10     # the last bytes\n");
+        mips->Runtime("          lbu $t0, 0($a0)\n");
+        mips->Runtime("          lbu $t1, 0($a1)\n");
+        mips->Runtime("          bne $t0, $t1, Lrunt13\n");
+        mips->Runtime("          addiu $a0, $a0, 1\n");
+        mips->Runtime("          addiu $a1, $a1, 1\n");
+        mips->Runtime("          addiu $a2, $a2, -1\n");
+        mips->Runtime("          b Lrunt12\n");
+        mips->Runtime("  Lrunt13:\n");
+        mips->Runtime("          li $v0, 0\n");
+        mips->Runtime("          b Lrunt14\n");
+        mips->Runtime("  Lrunt10:\n");
+        mips->Runtime("          li $v0, 1\n");
+        mips->Runtime("  Lrunt14:\n");
+        mips->Runtime("        # EndFunc\n");
+        mips->Runtime("        # (below handles reaching end of fn body with no explicit return)\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(ReadLine))
+    {
+        // collects the line in the line buffer, which grows as needed,
+        // then copies it to a string of its exact size. Strings come
+        // from an arena got from sbrk 4K at a time.
+        mips->Runtime("  _ReadLine:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          la $t0, _in_line\n");
+        mips->Runtime("          lw $t1, 0($t0)        # line buffer\n");
+        mips->Runtime("          lw $t2, 4($t0)        # and its size\n");
+        mips->Runtime("          li $t3, 0             # length\n");
+        mips->Runtime("  Lrunt21:\n");
+        mips->Runtime("          jal _InByte\n");
+        mips->Runtime("          bltz $v0, Lrunt22\n");
+        mips->Runtime("          li $t4, 10\n");
+        mips->Runtime("          beq $v0, $t4, Lrunt22\n");
+        mips->Runtime("          move $t7, $v0\n");
+        mips->Runtime("          bltu $t3, $t2, Lrunt23\n");
+        mips->Runtime("          sll $t5, $t2, 1       # grow the line buffer\n");
+        mips->Runtime("          addiu $t5, $t5, 128\n");
+        mips->Runtime("          move $a0, $t5\n");
+        mips->Runtime("          li $v0, 9\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          li $t4, 0\n");
+        mips->Runtime("  Lrunt28:\n");
+        mips->Runtime("          beq $t4, $t3, Lrunt29\n");
+        mips->Runtime("          addu $t6, $t1, $t4\n");
+        mips->Runtime("          lbu $t6, 0($t6)\n");
+        mips->Runtime("          addu $a0, $v0, $t4\n");
+        mips->Runtime("          sb $t6, 0($a0)\n");
+        mips->Runtime("          addiu $t4, $t4, 1\n");
+        mips->Runtime("          b Lrunt28\n");
+        mips->Runtime("  Lrunt29:\n");
+        mips->Runtime("          move $t1, $v0\n");
+        mips->Runtime("          move $t2, $t5\n");
+        mips->Runtime("          la $t0, _in_line\n");
+        mips->Runtime("          sw $t1, 0($t0)\n");
+        mips->Runtime("          sw $t2, 4($t0)\n");
+        mips->Runtime("  Lrunt23:\n");
+        mips->Runtime("          addu $t4, $t1, $t3\n");
+        mips->Runtime("          sb $t7, 0($t4)\n");
+        mips->Runtime("          addiu $t3, $t3, 1\n");
+        mips->Runtime("          b Lrunt21\n");
+        mips->Runtime("  Lrunt22:\n");
+        mips->Runtime("          addiu $t5, $t3, 8\n");
+        mips->Runtime("          li $t4, -4\n");
+        mips->Runtime("          and $t5, $t5, $t4     # length word, string and nul in whole words\n");
+        mips->Runtime("          la $t6, _in_heap\n");
+        mips->Runtime("          lw $v1, 0($t6)\n");
+        mips->Runtime("          lw $t4, 4($t6)\n");
+        mips->Runtime("          addu $t7, $v1, $t5\n");
+        mips->Runtime("          bleu $t7, $t4, Lrunt24\n");
+        mips->Runtime("          li $a0, 4096          # a new arena\n");
+        mips->Runtime("          bgeu $a0, $t5, Lrunt25\n");
+        mips->Runtime("          move $a0, $t5\n");
+        mips->Runtime("  Lrunt25:\n");
+        mips->Runtime("          li $v0, 9\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          move $v1, $v0\n");
+        mips->Runtime("          addu $t4, $v0, $a0\n");
+        mips->Runtime("          sw $t4, 4($t6)\n");
+        mips->Runtime("          addu $t7, $v1, $t5\n");
+        mips->Runtime("  Lrunt24:\n");
+        mips->Runtime("          sw $t7, 0($t6)\n");
+        mips->Runtime("          sw $t3, 0($v1)        # length\n");
+        mips->Runtime("          addiu $v1, $v1, 4\n");
+        mips->Runtime("          li $t4, 0\n");
+        mips->Runtime("  Lrunt26:\n");
+        mips->Runtime("          beq $t4, $t3, Lrunt27\n");
+        mips->Runtime("          addu $t5, $t1, $t4\n");
+        mips->Runtime("          lbu $t7, 0($t5)\n");
+        mips->Runtime("          addu $t5, $v1, $t4\n");
+        mips->Runtime("          sb $t7, 0($t5)\n");
+        mips->Runtime("          addiu $t4, $t4, 1\n");
+        mips->Runtime("          b Lrunt26\n");
+        mips->Runtime("  Lrunt27:\n");
+        mips->Runtime("          addu $t5, $v1, $t3\n");
+        mips->Runtime("          sb $zero, 0($t5)\n");
+        mips->Runtime("          move $v0, $v1\n");
+        mips->Runtime("          # EndFunc\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(ReadLine) || CodeGen->IsBuiltInUsed(ReadInteger) ||
+        CodeGen->IsBuiltInUsed(ReadDouble))
+    {
+        // the next byte of input in $v0, -1 at the end. Input is read
+        // into _in_buf as much as the system gives at once. Changes
+        // $a0-$a2, $t8 and $t9 only.
+        mips->Runtime("  _InByte:\n");
+        mips->Runtime("          la $t8, _in_pos\n");
+        mips->Runtime("          lw $t9, 0($t8)\n");
+        mips->Runtime("          lw $t8, 4($t8)        # _in_end\n");
+        mips->Runtime("          bltu $t9, $t8, Lrunt30\n");
+        if (CodeGen->IsBuiltInUsed(OutFlush))
+        {
+            // the output so far goes out before waiting for input
+            mips->Runtime("          subu $sp, $sp, 4\n");
+            mips->Runtime("          sw $ra, 0($sp)\n");
+            mips->Runtime("          jal _OutFlush\n");
+            mips->Runtime("          lw $ra, 0($sp)\n");
+            mips->Runtime("          addiu $sp, $sp, 4\n");
+        }
+        mips->Runtime("          li $a0, 0\n");
+        mips->Runtime("          la $a1, _in_buf\n");
+        mips->Runtime("          li $a2, 4096\n");
+        mips->Runtime("          li $v0, 14\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          la $t8, _in_pos\n");
+        mips->Runtime("          sw $zero, 0($t8)\n");
+        mips->Runtime("          sw $zero, 4($t8)\n");
+        mips->Runtime("          bgtz $v0, Lrunt31\n");
+        mips->Runtime("          li $v0, -1\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("  Lrunt31:\n");
+        mips->Runtime("          sw $v0, 4($t8)\n");
+        mips->Runtime("          li $t9, 0\n");
+        mips->Runtime("  Lrunt30:\n");
+        mips->Runtime("          la $t8, _in_buf\n");
+        mips->Runtime("          addu $t8, $t8, $t9\n");
+        mips->Runtime("          lbu $v0, 0($t8)\n");
+        mips->Runtime("          addiu $t9, $t9, 1\n");
+        mips->Runtime("          la $t8, _in_pos\n");
+        mips->Runtime("          sw $t9, 0($t8)\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+        mips->Runtime("      .data\n");
+        mips->Runtime("      .align 2\n");
+        mips->Runtime("  _in_pos: .word 0\n");
+        mips->Runtime("  _in_end: .word 0\n");
+        mips->Runtime("  _in_line: .word 0, 0\n");
+        mips->Runtime("  _in_heap: .word 0, 0\n");
+        mips->Runtime("  _in_buf: .space 4096\n");
+        mips->Runtime("      .text\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(ProfileDump))
+    {
+        // writes "count key" lines to stderr, the counts in decimal
+        mips->Runtime("  _ProfileDump:\n");
+        mips->Runtime("          la $t0, _prof_counts\n");
+        mips->Runtime("          la $t1, _prof_keys\n");
+        mips->Runtime("          la $t2, _prof_num\n");
+        mips->Runtime("          lw $t2, 0($t2)\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          la $a1, _prof_head\n");
+        mips->Runtime("          li $a2, 13\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("  Lprof0:\n");
+        mips->Runtime("          beqz $t2, Lprof2\n");
+        mips->Runtime("          lw $t3, 0($t0)        # count to print\n");
+        mips->Runtime("          la $a1, _prof_buf\n");
+        mips->Runtime("          addiu $a1, $a1, 12    # digits are stored backwards from the end\n");
+        mips->Runtime("          li $t5, 10\n");
+        mips->Runtime("  Lprof1:\n");
+        mips->Runtime("          remu $t4, $t3, $t5\n");
+        mips->Runtime("          addiu $t4, $t4, 48\n");
+        mips->Runtime("          addiu $a1, $a1, -1\n");
+        mips->Runtime("          sb $t4, 0($a1)\n");
+        mips->Runtime("          divu $t3, $t3, $t5\n");
+        mips->Runtime("          bnez $t3, Lprof1\n");
+        mips->Runtime("          la $a2, _prof_buf\n");
+        mips->Runtime("          addiu $a2, $a2, 12\n");
+        mips->Runtime("          subu $a2, $a2, $a1\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          lw $a1, 0($t1)        # key\n");
+        mips->Runtime("          lw $a2, 4($t1)\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          addiu $t0, $t0, 4\n");
+        mips->Runtime("          addiu $t1, $t1, 8\n");
+        mips->Runtime("          addiu $t2, $t2, -1\n");
+        mips->Runtime("          b Lprof0\n");
+        mips->Runtime("  Lprof2:\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          la $a1, _prof_tail\n");
+        mips->Runtime("          li $a2, 5\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+        profile->EmitData(mips);
+    }
+    if (CodeGen->IsBuiltInUsed(GcReport))
+    {
+        // writes "#gc: N collections, M bytes reclaimed" to stderr
+        mips->Runtime("  _GcReport:\n");
+        mips->Runtime("          subu $sp, $sp, 4\n");
+        mips->Runtime("          sw $ra, 0($sp)\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          la $a1, _gc_msg1\n");
+        mips->Runtime("          li $a2, 5\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          la $t0, _gc_count\n");
+        mips->Runtime("          lw $t0, 0($t0)\n");
+        mips->Runtime("          jal _GcDecimal\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          la $a1, _gc_msg2\n");
+        mips->Runtime("          li $a2, 14\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          la $t0, _gc_reclaimed\n");
+        mips->Runtime("          lw $t0, 0($t0)\n");
+        mips->Runtime("          jal _GcDecimal\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          la $a1, _gc_msg3\n");
+        mips->Runtime("          li $a2, 17\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          lw $ra, 0($sp)\n");
+        mips->Runtime("          addiu $sp, $sp, 4\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+        // writes $t0 in decimal to stderr
+        mips->Runtime("  _GcDecimal:\n");
+        mips->Runtime("          la $a1, _gc_buf\n");
+        mips->Runtime("          addiu $a1, $a1, 12    # digits are stored backwards from the end\n");
+        mips->Runtime("          li $t2, 10\n");
+        mips->Runtime("  Lgcdec0:\n");
+        mips->Runtime("          remu $t1, $t0, $t2\n");
+        mips->Runtime("          addiu $t1, $t1, 48\n");
+        mips->Runtime("          addiu $a1, $a1, -1\n");
+        mips->Runtime("          sb $t1, 0($a1)\n");
+        mips->Runtime("          divu $t0, $t0, $t2\n");
+        mips->Runtime("          bnez $t0, Lgcdec0\n");
+        mips->Runtime("          la $a2, _gc_buf\n");
+        mips->Runtime("          addiu $a2, $a2, 12\n");
+        mips->Runtime("          subu $a2, $a2, $a1\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(HeapRecord))
+    {
+        // adds an allocation to its site: the site number at 4($sp),
+        // the bytes at 8($sp)
+        mips->Runtime("  _HeapRecord:\n");
+        mips->Runtime("          lw $t0, 4($sp)\n");
+        mips->Runtime("          lw $t1, 8($sp)\n");
+        mips->Runtime("          sll $t0, $t0, 2\n");
+        mips->Runtime("          la $t2, _heap_counts\n");
+        mips->Runtime("          addu $t2, $t2, $t0\n");
+        mips->Runtime("          lw $t3, 0($t2)\n");
+        mips->Runtime("          addiu $t3, $t3, 1\n");
+        mips->Runtime("          sw $t3, 0($t2)\n");
+        mips->Runtime("          la $t2, _heap_bytes\n");
+        mips->Runtime("          addu $t2, $t2, $t0\n");
+        mips->Runtime("          lw $t3, 0($t2)\n");
+        mips->Runtime("          addu $t3, $t3, $t1\n");
+        mips->Runtime("          sw $t3, 0($t2)\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(HeapDump))
+    {
+        // writes "objects bytes site" lines to stderr, picking the
+        // site with the most bytes left each time and zeroing them
+        mips->Runtime("  _HeapDump:\n");
+        mips->Runtime("          subu $sp, $sp, 4\n");
+        mips->Runtime("          sw $ra, 0($sp)\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          la $a1, _heap_head\n");
+        mips->Runtime("          li $a2, 18\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("  Lheap0:\n");
+        mips->Runtime("          la $t0, _heap_bytes\n");
+        mips->Runtime("          la $t1, _heap_num\n");
+        mips->Runtime("          lw $t1, 0($t1)\n");
+        mips->Runtime("          li $t2, -1            # the site with the most bytes\n");
+        mips->Runtime("          li $t3, 0             # and its bytes\n");
+        mips->Runtime("          li $t4, 0\n");
+        mips->Runtime("  Lheap1:\n");
+        mips->Runtime("          beq $t4, $t1, Lheap3\n");
+        mips->Runtime("          lw $t5, 0($t0)\n");
+        mips->Runtime("          bleu $t5, $t3, Lheap2\n");
+        mips->Runtime("          move $t2, $t4\n");
+        mips->Runtime("          move $t3, $t5\n");
+        mips->Runtime("  Lheap2:\n");
+        mips->Runtime("          addiu $t0, $t0, 4\n");
+        mips->Runtime("          addiu $t4, $t4, 1\n");
+        mips->Runtime("          b Lheap1\n");
+        mips->Runtime("  Lheap3:\n");
+        mips->Runtime("          bltz $t2, Lheap4      # none left\n");
+        mips->Runtime("          sll $t7, $t2, 2\n");
+        mips->Runtime("          la $t0, _heap_counts\n");
+        mips->Runtime("          addu $t0, $t0, $t7\n");
+        mips->Runtime("          lw $t0, 0($t0)\n");
+        mips->Runtime("          jal _HeapDecimal\n");
+        mips->Runtime("          move $t0, $t3\n");
+        mips->Runtime("          jal _HeapDecimal\n");
+        mips->Runtime("          la $t1, _heap_keys    # 8 bytes per site\n");
+        mips->Runtime("          addu $t1, $t1, $t7\n");
+        mips->Runtime("          addu $t1, $t1, $t7\n");
+        mips->Runtime("          lw $a1, 0($t1)\n");
+        mips->Runtime("          lw $a2, 4($t1)\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          la $t0, _heap_bytes\n");
+        mips->Runtime("          addu $t0, $t0, $t7\n");
+        mips->Runtime("          sw $zero, 0($t0)\n");
+        mips->Runtime("          b Lheap0\n");
+        mips->Runtime("  Lheap4:\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          la $a1, _heap_tail\n");
+        mips->Runtime("          li $a2, 5\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          lw $ra, 0($sp)\n");
+        mips->Runtime("          addiu $sp, $sp, 4\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+        // writes $t0 in decimal and a space to stderr
+        mips->Runtime("  _HeapDecimal:\n");
+        mips->Runtime("          la $a1, _heap_buf\n");
+        mips->Runtime("          addiu $a1, $a1, 11    # digits are stored backwards from the space\n");
+        mips->Runtime("          li $t6, 10\n");
+        mips->Runtime("  Lheap5:\n");
+        mips->Runtime("          remu $t5, $t0, $t6\n");
+        mips->Runtime("          addiu $t5, $t5, 48\n");
+        mips->Runtime("          addiu $a1, $a1, -1\n");
+        mips->Runtime("          sb $t5, 0($a1)\n");
+        mips->Runtime("          divu $t0, $t0, $t6\n");
+        mips->Runtime("          bnez $t0, Lheap5\n");
+        mips->Runtime("          la $a2, _heap_buf\n");
+        mips->Runtime("          addiu $a2, $a2, 12\n");
+        mips->Runtime("          subu $a2, $a2, $a1\n");
+        mips->Runtime("          li $a0, 2\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+        heap_profile->EmitData(mips);
+    }
+    if (gc_maps->IsEnabled())
+        gc_maps->EmitData(mips);
+}
+
+/* Function: OutputCodeGen()
+ * -------------------------
+ * Prints the Print routines used with buffered output. They append
+ * to _out_buf through _OutWrite, which writes the buffer out when the
+ * next piece does not fit. _OutFlush writes out the rest, it is
+ * called when main returns, at _Halt and before reading input.
+ */
+void OutputCodeGen(Mips *mips)
+{
+    if (CodeGen->IsBuiltInUsed(PrintInt))
+    {
+        // the digits are formatted backwards from the end of _out_dec,
+        // dividing by 10 as a multiply by 2^35/10 rounded up
+        mips->Runtime("  _PrintInt:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          lw $t0, 4($fp)\n");
+        mips->Runtime("          la $a1, _out_dec\n");
+        mips->Runtime("          addiu $a1, $a1, 12\n");
+        mips->Runtime("          li $t2, 0xcccccccd\n");
+        mips->Runtime("          move $t1, $t0\n");
+        mips->Runtime("          bgez $t0, Lout10\n");
+        mips->Runtime("          negu $t1, $t0         # unsigned from here on, so -2^31 works too\n");
+        mips->Runtime("  Lout10:\n");
+        mips->Runtime("          multu $t1, $t2\n");
+        mips->Runtime("          mfhi $t4\n");
+        mips->Runtime("          srl $t4, $t4, 3       # $t1 / 10\n");
+        mips->Runtime("          sll $t3, $t4, 3\n");
+        mips->Runtime("          sll $t5, $t4, 1\n");
+        mips->Runtime("          addu $t3, $t3, $t5\n");
+        mips->Runtime("          subu $t3, $t1, $t3    # $t1 %% 10\n");
+        mips->Runtime("          addiu $t3, $t3, 48\n");
+        mips->Runtime("          addiu $a1, $a1, -1\n");
+        mips->Runtime("          sb $t3, 0($a1)\n");
+        mips->Runtime("          move $t1, $t4\n");
+        mips->Runtime("          bnez $t1, Lout10\n");
+        mips->Runtime("          bgez $t0, Lout11\n");
+        mips->Runtime("          li $t3, 45\n");
+        mips->Runtime("          addiu $a1, $a1, -1\n");
+        mips->Runtime("          sb $t3, 0($a1)\n");
+        mips->Runtime("  Lout11:\n");
+        mips->Runtime("          la $a2, _out_dec\n");
+        mips->Runtime("          addiu $a2, $a2, 12\n");
+        mips->Runtime("          subu $a2, $a2, $a1\n");
+        mips->Runtime("          jal _OutWrite\n");
+        mips->Runtime("          # EndFunc\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(PrintString))
+    {
+        mips->Runtime("  _PrintString:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          lw $a1, 4($fp)\n");
+        mips->Runtime("          lw $a2, -4($a1)       # length\n");
+        mips->Runtime("          jal _OutWrite\n");
+        mips->Runtime("          # EndFunc\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(PrintBool))
+    {
+        mips->Runtime("  _PrintBool:\n");
+        mips->Runtime("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+        mips->Runtime("          sw $fp, 8($sp)        # save fp\n");
+        mips->Runtime("          sw $ra, 4($sp)        # save ra\n");
+        mips->Runtime("          addiu $fp, $sp, 8     # set up new fp\n");
+        mips->Runtime("          lw $t0, 4($fp)\n");
+        mips->Runtime("          la $a1, _out_true\n");
+        mips->Runtime("          li $a2, 4\n");
+        mips->Runtime("          bnez $t0, Lout20\n");
+        mips->Runtime("          la $a1, _out_false\n");
+        mips->Runtime("          li $a2, 5\n");
+        mips->Runtime("  Lout20:\n");
+        mips->Runtime("          jal _OutWrite\n");
+        mips->Runtime("          # EndFunc\n");
+        mips->Runtime("          move $sp, $fp         # pop callee frame off stack\n");
+        mips->Runtime("          lw $ra, -4($fp)       # restore saved ra\n");
+        mips->Runtime("          lw $fp, 0($fp)        # restore saved fp\n");
+        mips->Runtime("          jr $ra                # return from function\n");
+        mips->Runtime("\n");
+    }
+    if (CodeGen->IsBuiltInUsed(PrintInt) || CodeGen->IsBuiltInUsed(PrintString) ||
+        CodeGen->IsBuiltInUsed(PrintBool))
+    {
+        // appends the $a2 bytes at $a1 to the buffer. Changes $a0-$a3,
+        // $v0, $t6-$t9.
+        mips->Runtime("  _OutWrite:\n");
+        mips->Runtime("          la $t8, _out_pos\n");
+        mips->Runtime("          lw $t9, 0($t8)\n");
+        mips->Runtime("          addu $a3, $t9, $a2\n");
+        mips->Runtime("          li $a0, 4096\n");
+        mips->Runtime("          bleu $a3, $a0, Lout31\n");
+        mips->Runtime("          move $t6, $a1         # it does not fit, write the buffer out\n");
+        mips->Runtime("          move $t7, $a2\n");
+        mips->Runtime("          li $a0, 1\n");
+        mips->Runtime("          la $a1, _out_buf\n");
+        mips->Runtime("          move $a2, $t9\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          li $t9, 0\n");
+        mips->Runtime("          move $a1, $t6\n");
+        mips->Runtime("          move $a2, $t7\n");
+        mips->Runtime("          li $a0, 4096\n");
+        mips->Runtime("          bleu $a2, $a0, Lout31\n");
+        mips->Runtime("          li $a0, 1             # more than the buffer holds, write it as it is\n");
+        mips->Runtime("          li $v0, 15\n");
+        mips->Runtime("          syscall\n");
+        mips->Runtime("          sw $zero, 0($t8)\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("  Lout31:\n");
+        mips->Runtime("          la $a0, _out_buf\n");
+        mips->Runtime("          addu $a0, $a0, $t9\n");
+        mips->Runtime("          addu $t9, $t9, $a2\n");
+        mips->Runtime("          sw $t9, 0($t8)\n");
+        mips->Runtime("  Lout32:\n");
+        mips->Runtime("          beqz $a2, Lout33\n");
+        mips->Runtime("          lbu $a3, 0($a1)\n");
+        mips->Runtime("          sb $a3, 0($a0)\n");
+        mips->Runtime("          addiu $a0, $a0, 1\n");
+        mips->Runtime("          addiu $a1, $a1, 1\n");
+        mips->Runtime("          addiu $a2, $a2, -1\n");
+        mips->Runtime("          b Lout32\n");
+        mips->Runtime("  Lout33:\n");
+        mips->Runtime("          jr $ra\n");
+        mips->Runtime("\n");
+    }
+    // changes $a0-$a2, $v0, $t8 and $t9
+    mips->Runtime("  _OutFlush:\n");
+    mips->Runtime("          la $t8, _out_pos\n");
+    mips->Runtime("          lw $a2, 0($t8)\n");
+    mips->Runtime("          beqz $a2, Lout40\n");
+    mips->Runtime("          li $a0, 1\n");
+    mips->Runtime("          la $a1, _out_buf\n");
+    mips->Runtime("          li $v0, 15\n");
+    mips->Runtime("          syscall\n");
+    mips->Runtime("          sw $zero, 0($t8)\n");
+    mips->Runtime("  Lout40:\n");
+    mips->Runtime("          jr $ra\n");
+    mips->Runtime("\n");
+    mips->Runtime("      .data\n");
+    mips->Runtime("      .align 2\n");
+    mips->Runtime("  _out_pos: .word 0\n");
+    mips->Runtime("  _out_dec: .space 12\n");
+    mips->Runtime("  _out_true: .asciiz \"true\"\n");
+    mips->Runtime("  _out_false: .asciiz \"false\"\n");
+    mips->Runtime("      .align 2\n");
+    mips->Runtime("  _out_buf: .space 4096\n");
+    mips->Runtime("      .text\n");
+    mips->Runtime("\n");
+}
+
+/* Function: GcCodeGen()
+ * ---------------------
+ * Prints the allocator and the mark-sweep collector used with -fgc,
+ * see gc.h for the maps they work from. A block is a header word
+ * followed by the object or array; the header holds the address of
+ * the type descriptor, bit 0 set while the block is marked, or the
+ * size of a free block with bit 1 set. Blocks live in chunks got from
+ * sbrk, each chunk starts with the address of the next one and its
+ * end. Free blocks of at least 8 bytes are linked through their second
+ * word from _gc_free and are all zeroes past that, as is the part of
+ * the chunk beyond the heap pointer.
+ */
+void GcCodeGen(Mips *mips)
 {
-    printf("  _PrintInt:\n");
-    printf("      subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
-    printf("      sw $fp, 8($sp)	# save fp\n");
-    printf("      sw $ra, 4($sp)	# save ra\n");
-    printf("      addiu $fp, $sp, 8	# set up new fp\n");
-    printf("      lw $a0, 4($fp)	# fill a to $t0 from $fp+4\n");
-    printf("    # LCall _PrintInt\n");
-    printf("      li $v0, 1\n");
-    printf("      syscall\n");
-    printf("    # EndFunc\n");
-    printf("    # (below handles reaching end of fn body with no explicit return)\n");
-    printf("      move $sp, $fp		# pop callee frame off stack\n");
-    printf("      lw $ra, -4($fp)	# restore saved ra\n");
-    printf("      lw $fp, 0($fp)	# restore saved fp\n");
-    printf("      jr $ra		# return from function\n");
-    printf("\n");
-    printf("  _ReadInteger:\n");
-    printf("      subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
-    printf("      sw $fp, 8($sp)	# save fp\n");
-    printf("      sw $ra, 4($sp)	# save ra\n");
-    printf("      addiu $fp, $sp, 8	# set up new fp\n");
-    printf("      li $v0, 5\n");
-    printf("      syscall\n");
-    printf("    # EndFunc\n");
-    printf("    # (below handles reaching end of fn body with no explicit return)\n");
-    printf("      move $sp, $fp		# pop callee frame off stack\n");
-    printf("      lw $ra, -4($fp)	# restore saved ra\n");
-    printf("      lw $fp, 0($fp)	# restore saved fp\n");
-    printf("      jr $ra		# return from function\n");
-    printf("\n");
-    printf("\n");
-    printf("  _PrintBool:\n");
-    printf("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("          sw $fp, 8($sp)        # save fp\n");
-    printf("          sw $ra, 4($sp)        # save ra\n");
-    printf("          addiu $fp, $sp, 8     # set up new fp\n");
-    printf("          lw $t1, 4($fp)        # fill a from $fp+4\n");
-    printf("      li $t2, 0\n");
-    printf("          li $v0, 4\n");
-    printf("      beq $t1, $t2, _PrintBoolFalse\n");
-    printf("      la $a0, _PrintBoolTrueString\n");
-    printf("      j _PrintBoolEnd\n");
-    printf("    _PrintBoolFalse:\n");
-    printf("    	  la $a0, _PrintBoolFalseString\n");
-    printf("    _PrintBoolEnd:\n");
-    printf("          syscall\n");
-    printf("        # EndFunc\n");
-    printf("        # (below handles reaching end of fn body with no explicit return)\n");
-    printf("          move $sp, $fp         # pop callee frame off stack\n");
-    printf("          lw $ra, -4($fp)       # restore saved ra\n");
-    printf("          lw $fp, 0($fp)        # restore saved fp\n");
-    printf("          jr $ra                # return from function\n");
-    printf("\n");
-    printf("      .data			# create string constant marked with label\n");
-    printf("      _PrintBoolTrueString: .asciiz \"true\"\n");
-    printf("      .text\n");
-    printf("\n");
-    printf("      .data			# create string constant marked with label\n");
-    printf("      _PrintBoolFalseString: .asciiz \"false\"\n");
-    printf("      .text\n");
-    printf("\n");
-    printf("  _PrintString:\n");
-    printf("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("          sw $fp, 8($sp)        # save fp\n");
-    printf("          sw $ra, 4($sp)        # save ra\n");
-    printf("          addiu $fp, $sp, 8     # set up new fp\n");
-    printf("          lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("          li $v0, 4\n");
-    printf("          syscall\n");
-    printf("        # EndFunc\n");
-    printf("        # (below handles reaching end of fn body with no explicit return)\n");
-    printf("          move $sp, $fp         # pop callee frame off stack\n");
-    printf("          lw $ra, -4($fp)       # restore saved ra\n");
-    printf("          lw $fp, 0($fp)        # restore saved fp\n");
-    printf("          jr $ra                # return from function\n");
-    printf("\n");
-    printf("  _Alloc:\n");
-    printf("    subu $sp, $sp, 8      # decrement sp to make space to save ra,fp\n");
-    printf("          sw $fp, 8($sp)        # save fp\n");
-    printf("          sw $ra, 4($sp)        # save ra\n");
-    printf("          addiu $fp, $sp, 8     # set up new fp\n");
-    printf("          lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("          li $v0, 9\n");
-    printf("          syscall\n");
-    printf("        # EndFunc\n");
-    printf("        # (below handles reaching end of fn body with no explicit return)\n");
-    printf("          move $sp, $fp         # pop callee frame off stack\n");
-    printf("          lw $ra, -4($fp)       # restore saved ra\n");
-    printf("          lw $fp, 0($fp)        # restore saved fp\n");
-    printf("          jr $ra                # return from function\n");
-    printf("\n");
-    printf("  _Halt:\n");
-    printf("          li $v0, 10\n");
-    printf("          syscall\n");
-    printf("        # EndFunc\n");
-    printf("\n");
-    printf("\n");
-    printf("  _StringEqual:\n");
-    printf("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("          sw $fp, 8($sp)        # save fp\n");
-    printf("          sw $ra, 4($sp)        # save ra\n");
-    printf("          addiu $fp, $sp, 8     # set up new fp\n");
-    printf("          lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("          lw $a1, 8($fp)        # fill a from $fp+8\n");
-    printf("        beq $a0,$a1,Lrunt10\n");
-    printf("        lbu  $a2,($a0)\n");
-    printf("        lbu  $a3,($a1)\n");
-    printf("        #addiu $a0,$a0,4\n");
-    printf("        #addiu $a1,$a1,4\n");
-    printf("        beq $a2,$a3,Lrunt11\n");
-    printf("  Lrunt13:\n");
-    printf("        li  $v0,0\n");
-    printf("        # EndFunc\n");
-    printf("        # (below handles reaching end of fn body with no explicit return)\n");
-    printf("          move $sp, $fp         # pop callee frame off stack\n");
-    printf("          lw $ra, -4($fp)       # restore saved ra\n");
-    printf("          lw $fp, 0($fp)        # restore saved fp\n");
-    printf("        j $ra\n");
-    printf("  Lrunt12:\n");
-    printf("        lbu  $t0,($a0)\n");
-    printf("        lbu  $t1,($a1)\n");
-    printf("        bne  $t0,$t1,Lrunt13\n");
-    printf("        beqz  $t0,Lrunt10\n");
-    printf("        addiu $a0,$a0,1\n");
-    printf("        addiu $a1,$a1,1\n");
-    printf("        addiu $a2,$a2,-1\n");
-    printf("  Lrunt11:\n");
-    printf("        bgez $a2,Lrunt12\n");
-    printf("  Lrunt10:\n");
-    printf("        li $v0,1\n");
-    printf("        # EndFunc\n");
-    printf("        # (below handles reaching end of fn body with no explicit return)\n");
-    printf("          move $sp, $fp         # pop callee frame off stack\n");
-    printf("          lw $ra, -4($fp)       # restore saved ra\n");
-    printf("          lw $fp, 0($fp)        # restore saved fp\n");
-    printf("          jr $ra                # return from function\n");
-    printf("\n");
-    printf("\n");
-    printf("\n");
-    printf("  _ReadLine:\n");
-    printf("          subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("          sw $fp, 8($sp)        # save fp\n");
-    printf("          sw $ra, 4($sp)        # save ra\n");
-    printf("          addiu $fp, $sp, 8     # set up new fp\n");
-    printf("          li $a0, 100\n");
-    printf("          li $v0, 9\n");
-    printf("          syscall\n");
-    printf("          addi $a0, $v0, 0\n");
-    printf("          li $v0, 8\n");
-    printf("          li $a1,100 \n");
-    printf("          syscall\n");
-    printf("          li $t0,0              # Set index to 0\n");
-    printf("  Lrunt21:\n");
-    printf("          addu $t1,$a0,$t0      # Load character at index\n");
-    printf("          lb $a3,($t1)          # Load character at index\n");
-    printf("          addi $t0,$t0,1        # Increment index\n");
-    printf("          bnez $a3,Lrunt21      # Loop until the end of string is reached\n");
-    printf("          beq $a1,$t0,Lrunt20   # Do not remove \\n when string = maxlength\n");
-    printf("          sb $0,-1($t1)         # Add the terminating character in its place\n");
-    printf("  Lrunt20:\n");
-    printf("          addi $v0, $a0, 0\n");
-    printf("        # EndFunc\n");
-    printf("        # (below handles reaching end of fn body with no explicit return)\n");
-    printf("          move $sp, $fp         # pop callee frame off stack\n");
-    printf("          lw $ra, -4($fp)       # restore saved ra\n");
-    printf("          lw $fp, 0($fp)        # restore saved fp\n");
-    printf("          jr $ra                # return from function\n");
+    // called with the size in $a0 when the heap pointer ($s7) went
+    // past the end of the chunk ($s6). The rest of the chunk becomes a
+    // free block, then the first free block big enough is used for
+    // bump allocation. When there is none and the heap has reached
+    // its limit the collector runs, once; otherwise the heap grows.
+    mips->Runtime("  _AllocChunk:\n");
+    mips->Runtime("          subu $s7, $s7, $a0    # undo the bump\n");
+    mips->Runtime("          subu $t0, $s6, $s7\n");
+    mips->Runtime("          blez $t0, Lgca0\n");
+    mips->Runtime("          ori $t1, $t0, 2\n");
+    mips->Runtime("          sw $t1, 0($s7)        # retire the rest of the chunk\n");
+    mips->Runtime("          li $t1, 8\n");
+    mips->Runtime("          bltu $t0, $t1, Lgca0\n");
+    mips->Runtime("          la $t1, _gc_free\n");
+    mips->Runtime("          lw $t2, 0($t1)\n");
+    mips->Runtime("          sw $t2, 4($s7)\n");
+    mips->Runtime("          sw $s7, 0($t1)\n");
+    mips->Runtime("  Lgca0:\n");
+    mips->Runtime("          li $s7, 0\n");
+    mips->Runtime("          li $s6, 0\n");
+    mips->Runtime("          subu $sp, $sp, 12\n");
+    mips->Runtime("          sw $ra, 0($sp)\n");
+    mips->Runtime("          sw $a0, 4($sp)\n");
+    mips->Runtime("          sw $zero, 8($sp)      # not collected yet\n");
+    mips->Runtime("  Lgca1:\n");
+    mips->Runtime("          lw $a0, 4($sp)\n");
+    mips->Runtime("          la $t0, _gc_free      # $t0 is the link to the block\n");
+    mips->Runtime("  Lgca2:\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          beqz $t1, Lgca4\n");
+    mips->Runtime("          lw $t2, 0($t1)\n");
+    mips->Runtime("          subu $t2, $t2, 2      # size of the free block\n");
+    mips->Runtime("          bgeu $t2, $a0, Lgca3\n");
+    mips->Runtime("          addiu $t0, $t1, 4\n");
+    mips->Runtime("          b Lgca2\n");
+    mips->Runtime("  Lgca3:\n");
+    mips->Runtime("          lw $t3, 4($t1)        # unlink it\n");
+    mips->Runtime("          sw $t3, 0($t0)\n");
+    mips->Runtime("          sw $zero, 0($t1)\n");
+    mips->Runtime("          sw $zero, 4($t1)\n");
+    mips->Runtime("          move $s7, $t1\n");
+    mips->Runtime("          addu $s6, $t1, $t2\n");
+    mips->Runtime("          b Lgca6\n");
+    mips->Runtime("  Lgca4:\n");
+    mips->Runtime("          lw $t0, 8($sp)\n");
+    mips->Runtime("          bnez $t0, Lgca5\n");
+    mips->Runtime("          la $t1, _gc_heap\n");
+    mips->Runtime("          lw $t1, 0($t1)\n");
+    mips->Runtime("          la $t2, _gc_limit\n");
+    mips->Runtime("          lw $t2, 0($t2)\n");
+    mips->Runtime("          bltu $t1, $t2, Lgca5\n");
+    mips->Runtime("          li $t0, 1\n");
+    mips->Runtime("          sw $t0, 8($sp)\n");
+    mips->Runtime("          lw $a0, 0($sp)        # the stack walk starts at the allocation\n");
+    mips->Runtime("          move $a1, $fp\n");
+    mips->Runtime("          jal _GcCollect\n");
+    mips->Runtime("          b Lgca1\n");
+    mips->Runtime("  Lgca5:\n");
+    mips->Runtime("          lw $a0, 4($sp)\n");
+    mips->Runtime("          addiu $a0, $a0, 8     # room for the chunk links\n");
+    mips->Runtime("          li $t0, 8\n");
+    mips->Runtime("          bltu $a0, $t0, _AllocFail # the size wrapped around\n");
+    mips->Runtime("          li $t0, 65536         # chunk size\n");
+    mips->Runtime("          bgeu $a0, $t0, Lgca7\n");
+    mips->Runtime("          move $a0, $t0\n");
+    mips->Runtime("  Lgca7:\n");
+    mips->Runtime("          move $t3, $a0\n");
+    mips->Runtime("          li $v0, 9\n");
+    mips->Runtime("          syscall\n");
+    mips->Runtime("          li $t0, -1\n");
+    mips->Runtime("          beq $v0, $t0, _AllocFail # sbrk could not grow the heap\n");
+    mips->Runtime("          la $t0, _gc_chunks\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          sw $t1, 0($v0)\n");
+    mips->Runtime("          addu $s6, $v0, $t3\n");
+    mips->Runtime("          sw $s6, 4($v0)\n");
+    mips->Runtime("          sw $v0, 0($t0)\n");
+    mips->Runtime("          la $t0, _gc_heap\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          addu $t1, $t1, $t3\n");
+    mips->Runtime("          sw $t1, 0($t0)\n");
+    mips->Runtime("          addiu $s7, $v0, 8\n");
+    mips->Runtime("  Lgca6:\n");
+    mips->Runtime("          lw $a0, 4($sp)\n");
+    mips->Runtime("          lw $ra, 0($sp)\n");
+    mips->Runtime("          addiu $sp, $sp, 12\n");
+    mips->Runtime("          move $v0, $s7\n");
+    mips->Runtime("          addu $s7, $s7, $a0\n");
+    mips->Runtime("          jr $ra\n");
+    mips->Runtime("\n");
+
+    // $a0 is the return address into the function that allocates and
+    // $a1 its frame pointer. Marks from the globals and the frames,
+    // using the stack below $sp (down to $t9) for the blocks still to
+    // scan, then sweeps every chunk.
+    mips->Runtime("  _GcCollect:\n");
+    mips->Runtime("          subu $sp, $sp, 4\n");
+    mips->Runtime("          sw $ra, 0($sp)\n");
+    mips->Runtime("          move $t9, $sp\n");
+    mips->Runtime("          la $t7, _gc_globals\n");
+    mips->Runtime("          lw $t8, 0($t7)\n");
+    mips->Runtime("          addiu $t7, $t7, 4\n");
+    mips->Runtime("  Lgcc0:\n");
+    mips->Runtime("          beqz $t8, Lgcc1\n");
+    mips->Runtime("          lw $t2, 0($t7)\n");
+    mips->Runtime("          andi $t3, $t2, 1\n");
+    mips->Runtime("          subu $t2, $t2, $t3\n");
+    mips->Runtime("          addu $t2, $t2, $gp\n");
+    mips->Runtime("          lw $t2, 0($t2)\n");
+    mips->Runtime("          jal _GcPush\n");
+    mips->Runtime("          addiu $t7, $t7, 4\n");
+    mips->Runtime("          addiu $t8, $t8, -1\n");
+    mips->Runtime("          b Lgcc0\n");
+    mips->Runtime("  Lgcc1:\n");
+    mips->Runtime("          move $t5, $a0         # return address into the frame\n");
+    mips->Runtime("          move $t6, $a1         # and its fp\n");
+    mips->Runtime("  Lgcc2:\n");
+    mips->Runtime("          la $t0, _gc_frames\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          addiu $t0, $t0, 4\n");
+    mips->Runtime("  Lgcc3:\n");
+    mips->Runtime("          beqz $t1, Lgcc6       # not generated code, the walk is done\n");
+    mips->Runtime("          lw $t2, 0($t0)\n");
+    mips->Runtime("          bltu $t5, $t2, Lgcc4\n");
+    mips->Runtime("          lw $t2, 4($t0)\n");
+    mips->Runtime("          bgeu $t5, $t2, Lgcc4\n");
+    mips->Runtime("          lw $t7, 8($t0)\n");
+    mips->Runtime("          b Lgcc5\n");
+    mips->Runtime("  Lgcc4:\n");
+    mips->Runtime("          addiu $t0, $t0, 12\n");
+    mips->Runtime("          addiu $t1, $t1, -1\n");
+    mips->Runtime("          b Lgcc3\n");
+    mips->Runtime("  Lgcc5:\n");
+    mips->Runtime("          lw $t8, 0($t7)\n");
+    mips->Runtime("          addiu $t7, $t7, 4\n");
+    mips->Runtime("  Lgcc7:\n");
+    mips->Runtime("          beqz $t8, Lgcc8\n");
+    mips->Runtime("          lw $t2, 0($t7)\n");
+    mips->Runtime("          andi $t3, $t2, 1\n");
+    mips->Runtime("          subu $t2, $t2, $t3\n");
+    mips->Runtime("          addu $t2, $t2, $t6\n");
+    mips->Runtime("          lw $t2, 0($t2)\n");
+    mips->Runtime("          jal _GcPush\n");
+    mips->Runtime("          addiu $t7, $t7, 4\n");
+    mips->Runtime("          addiu $t8, $t8, -1\n");
+    mips->Runtime("          b Lgcc7\n");
+    mips->Runtime("  Lgcc8:\n");
+    mips->Runtime("          lw $t5, -4($t6)       # on to the caller\n");
+    mips->Runtime("          lw $t6, 0($t6)\n");
+    mips->Runtime("          b Lgcc2\n");
+    mips->Runtime("  Lgcc6:\n");
+    mips->Runtime("          beq $sp, $t9, Lgcs0   # nothing left to mark\n");
+    mips->Runtime("          lw $t0, 0($sp)\n");
+    mips->Runtime("          addiu $sp, $sp, 4\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          andi $t2, $t1, 1\n");
+    mips->Runtime("          bnez $t2, Lgcc6       # already marked\n");
+    mips->Runtime("          ori $t2, $t1, 1\n");
+    mips->Runtime("          sw $t2, 0($t0)\n");
+    mips->Runtime("          lw $t2, 0($t1)        # kind of block\n");
+    mips->Runtime("          bnez $t2, Lgcc10\n");
+    mips->Runtime("          lw $t5, 8($t1)        # object, scan the fields in the map\n");
+    mips->Runtime("          addiu $t6, $t1, 12\n");
+    mips->Runtime("  Lgcc9:\n");
+    mips->Runtime("          beqz $t5, Lgcc6\n");
+    mips->Runtime("          lw $t2, 0($t6)\n");
+    mips->Runtime("          andi $t3, $t2, 1\n");
+    mips->Runtime("          subu $t2, $t2, $t3\n");
+    mips->Runtime("          addu $t2, $t2, $t0\n");
+    mips->Runtime("          lw $t2, 4($t2)\n");
+    mips->Runtime("          jal _GcPush\n");
+    mips->Runtime("          addiu $t6, $t6, 4\n");
+    mips->Runtime("          addiu $t5, $t5, -1\n");
+    mips->Runtime("          b Lgcc9\n");
+    mips->Runtime("  Lgcc10:\n");
+    mips->Runtime("          li $t3, %d\n", GcMaps::ScalarArray);
+    mips->Runtime("          beq $t2, $t3, Lgcc6\n");
+    mips->Runtime("          li $t3, %d\n", GcMaps::DoubleArray);
+    mips->Runtime("          beq $t2, $t3, Lgcc6\n");
+    mips->Runtime("          addiu $t3, $t2, -%d   # 1 for arrays of arrays\n", GcMaps::ObjectArray);
+    mips->Runtime("          lw $t5, 4($t0)        # length\n");
+    mips->Runtime("          addiu $t6, $t0, 8\n");
+    mips->Runtime("  Lgcc11:\n");
+    mips->Runtime("          beqz $t5, Lgcc6\n");
+    mips->Runtime("          lw $t2, 0($t6)\n");
+    mips->Runtime("          jal _GcPush\n");
+    mips->Runtime("          addiu $t6, $t6, 4\n");
+    mips->Runtime("          addiu $t5, $t5, -1\n");
+    mips->Runtime("          b Lgcc11\n");
+    // sweep: $t0 chunk, $t1 block, $t2 end of chunk, $t3 start of the
+    // run of dead and free blocks, $v1 live bytes, $a3 reclaimed bytes
+    mips->Runtime("  Lgcs0:\n");
+    mips->Runtime("          la $t0, _gc_free\n");
+    mips->Runtime("          sw $zero, 0($t0)      # the free list is rebuilt\n");
+    mips->Runtime("          li $v1, 0\n");
+    mips->Runtime("          li $a3, 0\n");
+    mips->Runtime("          la $t0, _gc_chunks\n");
+    mips->Runtime("          lw $t0, 0($t0)\n");
+    mips->Runtime("  Lgcs1:\n");
+    mips->Runtime("          beqz $t0, Lgcs9\n");
+    mips->Runtime("          addiu $t1, $t0, 8\n");
+    mips->Runtime("          lw $t2, 4($t0)\n");
+    mips->Runtime("          li $t3, 0\n");
+    mips->Runtime("  Lgcs2:\n");
+    mips->Runtime("          bgeu $t1, $t2, Lgcs7\n");
+    mips->Runtime("          lw $t5, 0($t1)\n");
+    mips->Runtime("          andi $t4, $t5, 2\n");
+    mips->Runtime("          beqz $t4, Lgcs3\n");
+    mips->Runtime("          subu $t6, $t5, 2      # free block\n");
+    mips->Runtime("          b Lgcs6\n");
+    mips->Runtime("  Lgcs3:\n");
+    mips->Runtime("          andi $t4, $t5, 1\n");
+    mips->Runtime("          subu $t7, $t5, $t4    # descriptor\n");
+    mips->Runtime("          lw $t8, 0($t7)\n");
+    mips->Runtime("          bnez $t8, Lgcs4\n");
+    mips->Runtime("          lw $t6, 4($t7)        # object size\n");
+    mips->Runtime("          addiu $t6, $t6, 4\n");
+    mips->Runtime("          b Lgcs5\n");
+    mips->Runtime("  Lgcs4:\n");
+    mips->Runtime("          lw $t6, 4($t1)        # array size\n");
+    mips->Runtime("          addiu $t8, $t8, -%d\n", GcMaps::DoubleArray);
+    mips->Runtime("          bnez $t8, Lgcs14\n");
+    mips->Runtime("          sll $t6, $t6, 1       # 8-byte elements\n");
+    mips->Runtime("  Lgcs14:\n");
+    mips->Runtime("          sll $t6, $t6, 2\n");
+    mips->Runtime("          addiu $t6, $t6, 8\n");
+    mips->Runtime("  Lgcs5:\n");
+    mips->Runtime("          beqz $t4, Lgcs10\n");
+    mips->Runtime("          sw $t7, 0($t1)        # live, unmark it\n");
+    mips->Runtime("          addu $v1, $v1, $t6\n");
+    mips->Runtime("          beqz $t3, Lgcs11\n");
+    mips->Runtime("          move $a0, $t3\n");
+    mips->Runtime("          move $a1, $t1\n");
+    mips->Runtime("          jal _GcFreeRun\n");
+    mips->Runtime("          li $t3, 0\n");
+    mips->Runtime("  Lgcs11:\n");
+    mips->Runtime("          addu $t1, $t1, $t6\n");
+    mips->Runtime("          b Lgcs2\n");
+    mips->Runtime("  Lgcs10:\n");
+    mips->Runtime("          addu $a3, $a3, $t6    # garbage\n");
+    mips->Runtime("  Lgcs6:\n");
+    mips->Runtime("          bnez $t3, Lgcs12\n");
+    mips->Runtime("          move $t3, $t1\n");
+    mips->Runtime("  Lgcs12:\n");
+    mips->Runtime("          addu $t1, $t1, $t6\n");
+    mips->Runtime("          b Lgcs2\n");
+    mips->Runtime("  Lgcs7:\n");
+    mips->Runtime("          beqz $t3, Lgcs8\n");
+    mips->Runtime("          move $a0, $t3\n");
+    mips->Runtime("          move $a1, $t2\n");
+    mips->Runtime("          jal _GcFreeRun\n");
+    mips->Runtime("  Lgcs8:\n");
+    mips->Runtime("          lw $t0, 0($t0)\n");
+    mips->Runtime("          b Lgcs1\n");
+    mips->Runtime("  Lgcs9:\n");
+    mips->Runtime("          la $t0, _gc_count\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          addiu $t1, $t1, 1\n");
+    mips->Runtime("          sw $t1, 0($t0)\n");
+    mips->Runtime("          la $t0, _gc_reclaimed\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          addu $t1, $t1, $a3\n");
+    mips->Runtime("          sw $t1, 0($t0)\n");
+    mips->Runtime("          sll $v1, $v1, 1       # let the heap grow to twice what is live\n");
+    mips->Runtime("          la $t0, _gc_limit\n");
+    mips->Runtime("          lw $t1, 0($t0)\n");
+    mips->Runtime("          bgeu $t1, $v1, Lgcs13\n");
+    mips->Runtime("          sw $v1, 0($t0)\n");
+    mips->Runtime("  Lgcs13:\n");
+    mips->Runtime("          lw $ra, 0($sp)\n");
+    mips->Runtime("          addiu $sp, $sp, 4\n");
+    mips->Runtime("          jr $ra\n");
+    mips->Runtime("\n");
+
+    // pushes the block of the value in $t2 for marking, $t3 is 1 if it
+    // is an array. Changes $t2 and $t4.
+    mips->Runtime("  _GcPush:\n");
+    mips->Runtime("          beqz $t2, Lgcp0\n");
+    mips->Runtime("          sll $t4, $t3, 2\n");
+    mips->Runtime("          subu $t2, $t2, $t4\n");
+    mips->Runtime("          subu $t2, $t2, 4\n");
+    mips->Runtime("          subu $sp, $sp, 4\n");
+    mips->Runtime("          sw $t2, 0($sp)\n");
+    mips->Runtime("  Lgcp0:\n");
+    mips->Runtime("          jr $ra\n");
+    mips->Runtime("\n");
+
+    // makes [$a0, $a1) a free block. Changes $t7 and $t8.
+    mips->Runtime("  _GcFreeRun:\n");
+    mips->Runtime("          move $t7, $a0\n");
+    mips->Runtime("  Lgcf0:\n");
+    mips->Runtime("          bgeu $t7, $a1, Lgcf1\n");
+    mips->Runtime("          sw $zero, 0($t7)\n");
+    mips->Runtime("          addiu $t7, $t7, 4\n");
+    mips->Runtime("          b Lgcf0\n");
+    mips->Runtime("  Lgcf1:\n");
+    mips->Runtime("          subu $t7, $a1, $a0\n");
+    mips->Runtime("          ori $t8, $t7, 2\n");
+    mips->Runtime("          sw $t8, 0($a0)\n");
+    mips->Runtime("          li $t8, 8\n");
+    mips->Runtime("          bltu $t7, $t8, Lgcf2\n");
+    mips->Runtime("          la $t8, _gc_free\n");
+    mips->Runtime("          lw $t7, 0($t8)\n");
+    mips->Runtime("          sw $t7, 4($a0)\n");
+    mips->Runtime("          sw $a0, 0($t8)\n");
+    mips->Runtime("  Lgcf2:\n");
+    mips->Runtime("          jr $ra\n");
+    mips->Runtime("\n");
 }
@@ -24,12 +24,19 @@
 #include <stdarg.h>
 #include <string.h>
 
+typedef MipsEncoder E;
+
+// the hardware number of an fp register, doubles use even pairs
+static int FNum(int reg)
+{
+    return 2 * reg;
+}
+
 // Helper to check if two variable locations are one and the same
-// (same name, segment, and offset)
+// (Locations are interned, see tac.h, so the same id)
 static bool LocationsAreSame(Location *var1, Location *var2)
 {
-    return (var1 == var2 ||
-            (var1 && var2 && !strcmp(var1->GetName(), var2->GetName()) && var1->GetSegment() == var2->GetSegment() && var1->GetOffset() == var2->GetOffset()));
+    return var1 == var2 || (var1 && var1->IsSameAs(var2));
 }
 
 /* Method: SpillRegister
@@ -42,9 +49,9 @@ void Mips::SpillRegister(Location *dst, Register reg)
     Assert(dst);
     const char *offsetFromWhere = dst->GetSegment() == fpRelative ? regs[fp].name : regs[gp].name;
     Assert(dst->GetOffset() % 4 == 0); // all variables are 4 bytes in size
-    Emit("sw %s, %d(%s)\t# spill %s from %s to %s%+d", regs[reg].name,
-         dst->GetOffset(), offsetFromWhere, dst->GetName(), regs[reg].name,
-         offsetFromWhere, dst->GetOffset());
+    Instr(E::Sw, reg, dst->GetOffset(), dst->GetSegment() == fpRelative ? fp : gp,
+          dst, "\t# spill %s from %s to %s%+d", regs[reg].name,
+          offsetFromWhere, dst->GetOffset());
 }
 
 /* Method: FillRegister
@@ -57,9 +64,34 @@ void Mips::FillRegister(Location *src, Register reg)
     Assert(src);
     const char *offsetFromWhere = src->GetSegment() == fpRelative ? regs[fp].name : regs[gp].name;
     Assert(src->GetOffset() % 4 == 0); // all variables are 4 bytes in size
-    Emit("lw %s, %d(%s)\t# fill %s to %s from %s%+d", regs[reg].name,
-         src->GetOffset(), offsetFromWhere, src->GetName(), regs[reg].name,
-         offsetFromWhere, src->GetOffset());
+    Instr(E::Lw, reg, src->GetOffset(), src->GetSegment() == fpRelative ? fp : gp,
+          src, "\t# fill %s to %s from %s%+d", regs[reg].name,
+          offsetFromWhere, src->GetOffset());
+}
+
+/* Method: SpillRegister, FillRegister
+ * ------------------------------------
+ * The same for a double, which takes the two words from the offset
+ * up. l.d and s.d only need them word aligned.
+ */
+void Mips::SpillRegister(Location *dst, FRegister reg)
+{
+    Assert(dst && dst->IsDouble());
+    const char *offsetFromWhere = dst->GetSegment() == fpRelative ? regs[fp].name : regs[gp].name;
+    Assert(dst->GetOffset() % 4 == 0);
+    Instr(E::StoreD, FNum(reg), dst->GetOffset(), dst->GetSegment() == fpRelative ? fp : gp,
+          dst, "\t# spill %s from $f%d to %s%+d", FNum(reg),
+          offsetFromWhere, dst->GetOffset());
+}
+
+void Mips::FillRegister(Location *src, FRegister reg)
+{
+    Assert(src && src->IsDouble());
+    const char *offsetFromWhere = src->GetSegment() == fpRelative ? regs[fp].name : regs[gp].name;
+    Assert(src->GetOffset() % 4 == 0);
+    Instr(E::LoadD, FNum(reg), src->GetOffset(), src->GetSegment() == fpRelative ? fp : gp,
+          src, "\t# fill %s to $f%d from %s%+d", FNum(reg),
+          offsetFromWhere, src->GetOffset());
 }
 
 /* Method: Emit
@@ -85,6 +117,140 @@ void Mips::Emit(const char *fmt, ...)
         printf("\n"); // end with a newline
 }
 
+/* Method: Instr, InstrLabel, InstrDouble
+ * --------------------------------------
+ * Hand an instruction to the output sink, see mips.h. The operands
+ * an op doesn't take are left 0.
+ */
+void Mips::Instr(E::Op op, int a, int b, int c, const char *note, ...)
+{
+    va_list args;
+    va_start(args, note);
+    OutInstr(op, a, b, c, NULL, 0, NULL, note, args);
+    va_end(args);
+}
+
+void Mips::Instr(E::Op op, int a, int b, int c, const Location *var, const char *note, ...)
+{
+    va_list args;
+    va_start(args, note);
+    OutInstr(op, a, b, c, NULL, 0, var, note, args);
+    va_end(args);
+}
+
+void Mips::InstrLabel(E::Op op, const char *label, int a, int b, const char *note, ...)
+{
+    va_list args;
+    va_start(args, note);
+    OutInstr(op, a, b, 0, label, 0, NULL, note, args);
+    va_end(args);
+}
+
+void Mips::InstrLabel(E::Op op, const char *label, int a, int b, const Location *var,
+                      const char *note, ...)
+{
+    va_list args;
+    va_start(args, note);
+    OutInstr(op, a, b, 0, label, 0, var, note, args);
+    va_end(args);
+}
+
+void Mips::InstrDouble(int fd, double value, const char *note, ...)
+{
+    va_list args;
+    va_start(args, note);
+    OutInstr(E::LiD, fd, 0, 0, NULL, value, NULL, note, args);
+    va_end(args);
+}
+
+// The text of a printf-style format and its arguments.
+static std::string Format(const char *fmt, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    std::string text(length + 1, '\0');
+    vsnprintf(&text[0], length + 1, fmt, args);
+    text.resize(length);
+    return text;
+}
+
+/* Method: Directive, Runtime
+ * --------------------------
+ * Format a data directive (or a data label) for OutDirective, and a
+ * line of the runtime routines for OutRuntime. There are only a few
+ * per class, string literal and builtin.
+ */
+void Mips::Directive(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    std::string text = Format(fmt, args);
+    va_end(args);
+    OutDirective(text.c_str());
+}
+
+void Mips::Runtime(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    std::string text = Format(fmt, args);
+    va_end(args);
+    OutRuntime(text.c_str());
+}
+
+/* Method: OutInstr
+ * ----------------
+ * The assembly sink: writes the instruction in the SPIM syntax, the
+ * operands by the letters MipsEncoder::Operands gives for op, then
+ * the note, with the name of var in place of its first %s.
+ */
+void Mips::OutInstr(E::Op op, int a, int b, int c, const char *label,
+                    double value, const Location *var, const char *note,
+                    va_list args)
+{
+    char buf[1024];
+    const int values[] = {a, b, c};
+    int n = 0;
+    char *p = buf + sprintf(buf, "%s", E::Name(op));
+    for (const char *f = E::Operands(op); *f; f++)
+    {
+        p += sprintf(p, f == E::Operands(op) ? " " : ", ");
+        switch (*f)
+        {
+        case 'd': case 's': case 't': case 'h':
+            p += sprintf(p, "%s", regs[values[n++]].name);
+            break;
+        case 'D': case 'S': case 'T':
+            p += sprintf(p, "$f%d", values[n++]);
+            break;
+        case 'i':
+            p += sprintf(p, "%d", values[n++]);
+            break;
+        case 'm':
+            p += sprintf(p, "%d(%s)", values[n], regs[values[n + 1]].name);
+            n += 2;
+            break;
+        case 'l':
+            p += sprintf(p, "%s", label);
+            break;
+        case 'f':
+            p += sprintf(p, "%.17g", value);
+            break;
+        }
+    }
+    if (var)
+    {
+        const char *name = strstr(note, "%s");
+        Assert(name != NULL);
+        p += sprintf(p, "%.*s%s", (int)(name - note), note, var->GetName());
+        note = name + 2;
+    }
+    vsprintf(p, note, args);
+    Emit("%s", buf);
+}
+
 /* Method: EmitLoadConstant
  * ------------------------
  * Used to assign variable an integer constant value.  Slaves dst into
@@ -93,28 +259,81 @@ void Mips::Emit(const char *fmt, ...)
  */
 void Mips::EmitLoadConstant(Location *dst, int val)
 {
-    Register reg = rd;
-    Emit("li %s, %d\t\t# load constant value %d into %s", regs[reg].name,
-         val, val, regs[reg].name);
+    Instr(E::Li, rd, val, 0, "\t\t# load constant value %d into %s", val,
+          regs[rd].name);
     SpillRegister(dst, rd);
 }
 
+// The double version loads the constant with li.d.
+void Mips::EmitLoadConstant(Location *dst, double val)
+{
+    InstrDouble(FNum(frd), val, "\t# load constant value %g into $f%d", val,
+                FNum(frd));
+    SpillRegister(dst, frd);
+}
+
+/* Method: StringLength
+ * ---------------------
+ * Length of the string a literal (quotes included) assembles to.
+ */
+int Mips::StringLength(const char *str)
+{
+    int length = 0;
+    for (const char *p = str + 1; *p && *p != '"'; p++, length++)
+        if (*p == '\\' && p[1])
+            p++;
+    return length;
+}
+
 /* Method: EmitLoadStringConstant
  * ------------------------------
- * Used to assign a variable a pointer to string constant. Emits
- * assembly directives to create a new null-terminated string in the
- * data segment and assigns it a unique label. Slaves dst into a register
- * and loads that label address into the register.
+ * Used to assign a variable a pointer to string constant. Adds the
+ * string to the pool of literals unless an equal one is there, so
+ * equal literals share one string and compare equal by address.
+ * Slaves dst into a register and loads the label address of the
+ * string into the register.
  */
 void Mips::EmitLoadStringConstant(Location *dst, const char *str)
 {
-    static int strNum = 1;
-    char label[16];
-    sprintf(label, "_string%d", strNum++);
-    Emit(".data\t\t\t# create string constant marked with label");
-    Emit("%s: .asciiz %s", label, str);
-    Emit(".text");
-    EmitLoadLabel(dst, label);
+    std::map<std::string, const char *>::iterator it = stringLabels.find(str);
+    if (it == stringLabels.end())
+    {
+        char label[24];
+        sprintf(label, "_string%d", stringPool.NumElements() + 1);
+        it = stringLabels.insert(std::make_pair(std::string(str), strdup(label))).first;
+        stringPool.Append(strdup(str));
+    }
+    EmitLoadLabel(dst, it->second);
+}
+
+/* Method: EmitStringPool
+ * ----------------------
+ * Emits the pooled string literals into the data segment, once each,
+ * after all the code. The word before each string holds its length.
+ */
+void Mips::EmitStringPool()
+{
+    if (stringPool.NumElements() == 0)
+        return;
+    Directive(".data\t\t\t# string constants");
+    for (int i = 0; i < stringPool.NumElements(); i++)
+    {
+        const char *str = stringPool.Nth(i);
+        Directive(".align 2");
+        Directive(".word %d\t\t# length", StringLength(str));
+        Directive("%s: .asciiz %s", stringLabels[str], str);
+    }
+    Directive(".text");
+}
+
+/* Method: EmitEnd
+ * ---------------
+ * The string literals and the runtime routines go after all the code.
+ */
+void Mips::EmitEnd()
+{
+    EmitStringPool();
+    SysCallCodeGen(this);
 }
 
 /* Method: EmitLoadLabel
@@ -124,7 +343,7 @@ void Mips::EmitLoadStringConstant(Location *dst, const char *str)
  */
 void Mips::EmitLoadLabel(Location *dst, const char *label)
 {
-    Emit("la %s, %s\t# load label", regs[rd].name, label);
+    InstrLabel(E::La, label, rd, 0, "\t# load label");
     SpillRegister(dst, rd);
 }
 
@@ -136,6 +355,12 @@ void Mips::EmitLoadLabel(Location *dst, const char *label)
  */
 void Mips::EmitCopy(Location *dst, Location *src)
 {
+    if (src->IsDouble())
+    {
+        FillRegister(src, frd);
+        SpillRegister(dst, frd);
+        return;
+    }
     FillRegister(src, rd);
     SpillRegister(dst, rd);
 }
@@ -151,8 +376,13 @@ void Mips::EmitCopy(Location *dst, Location *src)
 void Mips::EmitLoad(Location *dst, Location *reference, int offset)
 {
     FillRegister(reference, rs);
-    Emit("lw %s, %d(%s) \t# load with offset", regs[rd].name,
-         offset, regs[rs].name);
+    if (dst->IsDouble())
+    {
+        Instr(E::LoadD, FNum(frd), offset, rs, " \t# load with offset");
+        SpillRegister(dst, frd);
+        return;
+    }
+    Instr(E::Lw, rd, offset, rs, " \t# load with offset");
     SpillRegister(dst, rd);
 }
 
@@ -166,10 +396,16 @@ void Mips::EmitLoad(Location *dst, Location *reference, int offset)
  */
 void Mips::EmitStore(Location *reference, Location *value, int offset)
 {
+    if (value->IsDouble())
+    {
+        FillRegister(value, frs);
+        FillRegister(reference, rd);
+        Instr(E::StoreD, FNum(frs), offset, rd, " \t# store with offset");
+        return;
+    }
     FillRegister(value, rs);
     FillRegister(reference, rd);
-    Emit("sw %s, %d(%s) \t# store with offset",
-         regs[rs].name, offset, regs[rd].name);
+    Instr(E::Sw, rs, offset, rd, " \t# store with offset");
 }
 
 /* Method: EmitBinaryOp
@@ -183,10 +419,81 @@ void Mips::EmitStore(Location *reference, Location *value, int offset)
 void Mips::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
                         Location *op1, Location *op2)
 {
+    if (op1->IsDouble())
+    {
+        EmitDoubleOp(code, dst, op1, op2);
+        return;
+    }
     FillRegister(op1, rs);
     FillRegister(op2, rt);
-    Emit("%s %s, %s, %s\t", NameForTac(code), regs[rd].name,
-         regs[rs].name, regs[rt].name);
+    Instr(OpForTac(code), rd, rs, rt, "\t");
+    SpillRegister(dst, rd);
+}
+
+/* Method: EmitDoubleOp
+ * --------------------
+ * The binary ops on doubles. Arithmetic leaves a double in dst, with
+ * % computed as op1 - trunc(op1/op2)*op2 like fmod. A comparison sets
+ * the FPU condition flag, which only the branches read, so dst gets 1
+ * or 0 depending on which way bc1t goes. The FPU only has ==, < and
+ * <=: > and >= swap the operands and != tests == the other way round.
+ */
+void Mips::EmitDoubleOp(BinaryOp::OpCode code, Location *dst,
+                        Location *op1, Location *op2)
+{
+    static int compareNum = 0;
+    int d = FNum(frd), s = FNum(frs), t = FNum(frt);
+    FillRegister(op1, frs);
+    FillRegister(op2, frt);
+    switch (code)
+    {
+    case BinaryOp::Add:
+    case BinaryOp::Sub:
+    case BinaryOp::Mul:
+    case BinaryOp::Div:
+        Instr(code == BinaryOp::Add ? E::AddD : code == BinaryOp::Sub ? E::SubD
+              : code == BinaryOp::Mul ? E::MulD : E::DivD, d, s, t, "\t");
+        SpillRegister(dst, frd);
+        return;
+    case BinaryOp::Mod:
+        Instr(E::DivD, d, s, t, "");
+        Instr(E::TruncWD, d, d, 0, "");
+        Instr(E::CvtDW, d, d, 0, "");
+        Instr(E::MulD, d, d, t, "");
+        Instr(E::SubD, d, s, d, "\t# remainder");
+        SpillRegister(dst, frd);
+        return;
+    default:;
+    }
+
+    bool swap = code == BinaryOp::Gt || code == BinaryOp::Ge;
+    E::Op test;
+    switch (code)
+    {
+    case BinaryOp::Eq:
+    case BinaryOp::Ne:
+        test = E::CeqD;
+        break;
+    case BinaryOp::Lt:
+    case BinaryOp::Gt:
+        test = E::CltD;
+        break;
+    case BinaryOp::Le:
+    case BinaryOp::Ge:
+        test = E::CleD;
+        break;
+    default:
+        Failure("Bad double operator %s", BinaryOp::opName[code]);
+        return;
+    }
+    char label[20];
+    sprintf(label, "_dcmp%d", compareNum++);
+    int whenTrue = code == BinaryOp::Ne ? 0 : 1;
+    Instr(E::Li, rd, whenTrue, 0, "");
+    Instr(test, swap ? t : s, swap ? s : t, 0, "");
+    InstrLabel(E::Bc1t, label, 0, 0, "");
+    Instr(E::Li, rd, 1 - whenTrue, 0, "");
+    EmitLabel(label);
     SpillRegister(dst, rd);
 }
 
@@ -211,7 +518,7 @@ void Mips::EmitLabel(const char *label)
  */
 void Mips::EmitGoto(const char *label)
 {
-    Emit("b %s\t\t# unconditional branch", label);
+    InstrLabel(E::B, label, 0, 0, "\t\t# unconditional branch");
 }
 
 /* Method: EmitIfZ
@@ -224,8 +531,15 @@ void Mips::EmitGoto(const char *label)
 void Mips::EmitIfZ(Location *test, const char *label)
 {
     FillRegister(test, rs);
-    Emit("beqz %s, %s\t# branch if %s is zero ", regs[rs].name, label,
-         test->GetName());
+    InstrLabel(E::Beqz, label, rs, 0, test, "\t# branch if %s is zero ");
+}
+
+// The converse of IfZ, used where the hot path of a loop or if is
+// laid out as the fall-through.
+void Mips::EmitIfNZ(Location *test, const char *label)
+{
+    FillRegister(test, rs);
+    InstrLabel(E::Bnez, label, rs, 0, test, "\t# branch if %s is not zero ");
 }
 
 /* Method: EmitParam
@@ -237,43 +551,57 @@ void Mips::EmitIfZ(Location *test, const char *label)
  */
 void Mips::EmitParam(Location *arg)
 {
-    Emit("subu $sp, $sp, 4\t# decrement sp to make space for param");
+    if (arg->IsDouble())
+    {
+        Instr(E::Addiu, sp, sp, -8, "\t# decrement sp to make space for param");
+        FillRegister(arg, frs);
+        Instr(E::StoreD, FNum(frs), 4, sp, "\t# copy param value to stack");
+        return;
+    }
+    Instr(E::Addiu, sp, sp, -4, "\t# decrement sp to make space for param");
     FillRegister(arg, rs);
-    Emit("sw %s, 4($sp)\t# copy param value to stack", regs[rs].name);
+    Instr(E::Sw, rs, 4, sp, "\t# copy param value to stack");
 }
 
-/* Method: EmitCallInstr
- * ---------------------
+/* Method: EmitLCall, EmitACall
+ * -----------------------------
  * Used to effect a function call. All necessary arguments should have
  * already been pushed on the stack, this is the last step that
  * transfers control from caller to callee.  See comments on Goto method
  * above for why we spill all registers before making the jump. We issue
  * jal for a label, a jalr if address in register. Both will save the
- * return address in $ra. If there is an expected result passed, we slave
- * the var to a register and copy function return value from $v0 into that
- * register.
+ * return address in $ra.
  */
-void Mips::EmitCallInstr(Location *result, const char *fn, bool isLabel)
-{
-    Emit("%s %-15s\t# jump to function", isLabel ? "jal" : "jalr", fn);
-    if (result != NULL)
-    {
-        Emit("move %s, %s\t\t# copy function return value from $v0",
-             regs[rd].name, regs[v0].name);
-        SpillRegister(result, rd);
-    }
-}
-
-// Two covers for the above method for specific LCall/ACall variants
 void Mips::EmitLCall(Location *dst, const char *label)
 {
-    EmitCallInstr(dst, label, true);
+    InstrLabel(E::Jal, label, 0, 0, "\t# jump to function");
+    EmitCallResult(dst);
 }
 
 void Mips::EmitACall(Location *dst, Location *fn)
 {
     FillRegister(fn, rs);
-    EmitCallInstr(dst, regs[rs].name, false);
+    Instr(E::Jalr, rs, 0, 0, "\t# jump to function");
+    EmitCallResult(dst);
+}
+
+/* Method: EmitCallResult
+ * ----------------------
+ * If there is an expected result passed, we slave the var to a register
+ * and copy function return value from $v0 (or $f0 for a double) into
+ * that register.
+ */
+void Mips::EmitCallResult(Location *result)
+{
+    if (result != NULL && result->IsDouble())
+    {
+        SpillRegister(result, f0);
+    }
+    else if (result != NULL)
+    {
+        Instr(E::Move, rd, v0, 0, "\t\t# copy function return value from $v0");
+        SpillRegister(result, rd);
+    }
 }
 
 /*
@@ -283,7 +611,45 @@ void Mips::EmitACall(Location *dst, Location *fn)
 void Mips::EmitPopParams(int bytes)
 {
     if (bytes != 0)
-        Emit("add $sp, $sp, %d\t# pop params off stack", bytes);
+        Instr(E::Addiu, sp, sp, bytes, "\t# pop params off stack");
+}
+
+/* Method: EmitHeapAlloc
+ * ----------------------
+ * Used to allocate size bytes on the heap. The runtime hands out
+ * memory from a chunk it got from sbrk: the object goes where the
+ * heap pointer $s7 points, and the pointer moves past it. Only when
+ * that crosses the end of the chunk ($s6) do we call _AllocChunk,
+ * which takes the size in $a0, gets a fresh chunk and returns the
+ * object in $v0. Both start out 0, so the first allocation always
+ * takes the slow path, as does a size big enough to wrap the heap
+ * pointer around. For the garbage collector a header word in
+ * front of the object points at its type descriptor.
+ */
+void Mips::EmitHeapAlloc(Location *dst, Location *size, const char *descriptor)
+{
+    const char *slow = Labels::Name(Labels::New());
+    const char *done = Labels::Name(Labels::New());
+
+    FillRegister(size, rs);
+    if (descriptor)
+        Instr(E::Addiu, rs, rs, 4, "\t# room for the header");
+    Instr(E::Move, rd, s7, 0, "\t\t# new object goes at the heap pointer");
+    Instr(E::Addu, s7, s7, rs, "\t# bump the heap pointer");
+    InstrLabel(E::Bltu, slow, s7, rd, "\t# the bump wrapped around");
+    InstrLabel(E::Bleu, done, s7, s6, "\t# fast path if it still fits in the chunk");
+    EmitLabel(slow);
+    Instr(E::Move, a0, rs, 0, "");
+    InstrLabel(E::Jal, "_AllocChunk", 0, 0, "\t\t# slow path, get a new chunk");
+    Instr(E::Move, rd, v0, 0, "");
+    EmitLabel(done);
+    if (descriptor)
+    {
+        InstrLabel(E::La, descriptor, rt, 0, "");
+        Instr(E::Sw, rt, 0, rd, "\t# header");
+        Instr(E::Addiu, rd, rd, 4, "");
+    }
+    SpillRegister(dst, rd);
 }
 
 /* Method: EmitReturn
@@ -303,16 +669,19 @@ void Mips::EmitPopParams(int bytes)
  */
 void Mips::EmitReturn(Location *returnVal)
 {
-    if (returnVal != NULL)
+    if (returnVal != NULL && returnVal->IsDouble())
+    {
+        FillRegister(returnVal, f0);
+    }
+    else if (returnVal != NULL)
     {
         FillRegister(returnVal, rd);
-        Emit("move $v0, %s\t\t# assign return value into $v0",
-             regs[rd].name);
+        Instr(E::Move, v0, rd, 0, "\t\t# assign return value into $v0");
     }
-    Emit("move $sp, $fp\t\t# pop callee frame off stack");
-    Emit("lw $ra, -4($fp)\t# restore saved ra");
-    Emit("lw $fp, 0($fp)\t# restore saved fp");
-    Emit("jr $ra\t\t# return from function");
+    Instr(E::Move, sp, fp, 0, "\t\t# pop callee frame off stack");
+    Instr(E::Lw, ra, -4, fp, "\t# restore saved ra");
+    Instr(E::Lw, fp, 0, fp, "\t# restore saved fp");
+    Instr(E::Jr, ra, 0, 0, "\t\t# return from function");
 }
 
 /* Method: EmitBeginFunction
@@ -323,17 +692,20 @@ void Mips::EmitReturn(Location *returnVal)
  * going to change them), then set up the $fp and bump the $sp down
  * to make space for all our locals/temps.
  */
-void Mips::EmitBeginFunction(int stackFrameSize)
+void Mips::EmitBeginFunction(int stackFrameSize, List<int> *clearedSlots)
 {
     Assert(stackFrameSize >= 0);
-    Emit("subu $sp, $sp, 8\t# decrement sp to make space to save ra, fp");
-    Emit("sw $fp, 8($sp)\t# save fp");
-    Emit("sw $ra, 4($sp)\t# save ra");
-    Emit("addiu $fp, $sp, 8\t# set up new fp");
+    Instr(E::Addiu, sp, sp, -8, "\t# decrement sp to make space to save ra, fp");
+    Instr(E::Sw, fp, 8, sp, "\t# save fp");
+    Instr(E::Sw, ra, 4, sp, "\t# save ra");
+    Instr(E::Addiu, fp, sp, 8, "\t# set up new fp");
 
     if (stackFrameSize != 0)
-        Emit("subu $sp, $sp, %d\t# decrement sp to make space for locals/temps",
-             stackFrameSize);
+        Instr(E::Addiu, sp, sp, -stackFrameSize,
+              "\t# decrement sp to make space for locals/temps");
+    for (int i = 0; clearedSlots && i < clearedSlots->NumElements(); i++)
+        Instr(E::Sw, zero, clearedSlots->Nth(i), fp,
+              "\t# clear pointer slot for the collector");
 }
 
 /* Method: EmitEndFunction
@@ -344,7 +716,7 @@ void Mips::EmitBeginFunction(int stackFrameSize)
  */
 void Mips::EmitEndFunction()
 {
-    Emit("# (below handles reaching end of fn body with no explicit return)");
+    EmitComment("(below handles reaching end of fn body with no explicit return)");
     EmitReturn(NULL);
 }
 
@@ -352,16 +724,45 @@ void Mips::EmitEndFunction()
  * ------------------
  * Used to layout a vtable. Uses assembly directives to set up new
  * entry in data segment, emits label, and lays out the function
- * labels one after another.
+ * labels one after another. The interface table, if any, goes right
+ * before the label so that slot i is found at label-4-4*i.
  */
-void Mips::EmitVTable(const char *label, List<const char *> *methodLabels)
+void Mips::EmitVTable(const char *label, List<const char *> *methodLabels,
+                      List<const char *> *itableLabels, List<int> *gcMap)
 {
-    Emit(".data");
-    Emit(".align 2");
-    Emit("%s:\t\t# label for class %s vtable", label, label);
+    Directive(".data");
+    Directive(".align 2");
+    if (itableLabels)
+    {
+        for (int i = itableLabels->NumElements() - 1; i >= 0; i--)
+            Directive(".word %s\t# interface slot %d", itableLabels->Nth(i), i);
+    }
+    Directive("%s:\t\t# label for class %s vtable", label, label);
     for (int i = 0; i < methodLabels->NumElements(); i++)
-        Emit(".word %s\n", methodLabels->Nth(i));
-    Emit(".text");
+        Directive(".word %s\n", methodLabels->Nth(i));
+    if (gcMap)
+    {
+        // size, then the offsets of the fields the collector follows
+        Directive("%s.gc:\t\t# type descriptor for class %s", label, label);
+        Directive(".word 0, %d, %d", gcMap->Nth(0), gcMap->NumElements() - 1);
+        for (int i = 1; i < gcMap->NumElements(); i++)
+            Directive(".word %d", gcMap->Nth(i));
+    }
+    Directive(".text");
+}
+
+/* Method: EmitLine
+ * ----------------
+ * The line table for -g is a comment line "#line n: text" before the
+ * instructions generated for source line n, which spim skips and
+ * dsim -profile reads. "#line 0" ends the last one.
+ */
+void Mips::EmitLine(int line, const char *text)
+{
+    if (line)
+        printf("#line %d: %s\n", line, text ? text : "");
+    else
+        printf("#line 0\n");
 }
 
 /* Method: EmitPreamble
@@ -378,40 +779,42 @@ void Mips::EmitPreamble()
     Emit(".globl main");
 }
 
-/* Method: NameForTac
- * ------------------
+/* Method: OpForTac
+ * ----------------
  * Returns the appropriate MIPS instruction (add, seq, etc.) for
  * a given BinaryOp:OpCode (BinaryOp::Add, BinaryOp:Equals, etc.).
- * Asserts if asked for name of an unset/out of bounds code.
+ * Fails if asked for an unset/out of bounds code.
  */
-const char *Mips::NameForTac(BinaryOp::OpCode code)
+E::Op Mips::OpForTac(BinaryOp::OpCode code)
 {
-    Assert(code >= 0 && code < BinaryOp::NumOps);
-    const char *name = mipsName[code];
-    Assert(name != NULL);
-    return name;
+    switch (code)
+    {
+    case BinaryOp::Add: return E::Add;
+    case BinaryOp::Sub: return E::Sub;
+    case BinaryOp::Mul: return E::Mul;
+    case BinaryOp::Div: return E::Div;
+    case BinaryOp::Mod: return E::Rem;
+    case BinaryOp::Eq: return E::Seq;
+    case BinaryOp::Ne: return E::Sne;
+    case BinaryOp::Lt: return E::Slt;
+    case BinaryOp::Le: return E::Sle;
+    case BinaryOp::Gt: return E::Sgt;
+    case BinaryOp::Ge: return E::Sge;
+    case BinaryOp::And: return E::And;
+    case BinaryOp::Or: return E::Or;
+    default:
+        Failure("Bad operator %s", BinaryOp::opName[code]);
+        return E::Add;
+    }
 }
 
 /* Constructor
  * ----------
- * Constructor sets up the mips names and register descriptors to
+ * Constructor sets up the register descriptors to
  * the initial starting state.
  */
 Mips::Mips()
 {
-    mipsName[BinaryOp::Add] = "add";
-    mipsName[BinaryOp::Sub] = "sub";
-    mipsName[BinaryOp::Mul] = "mul";
-    mipsName[BinaryOp::Div] = "div";
-    mipsName[BinaryOp::Mod] = "rem";
-    mipsName[BinaryOp::Eq] = "seq";
-    mipsName[BinaryOp::Ne] = "sne";
-    mipsName[BinaryOp::Lt] = "slt";
-    mipsName[BinaryOp::Le] = "sle";
-    mipsName[BinaryOp::Gt] = "sgt";
-    mipsName[BinaryOp::Ge] = "sge";
-    mipsName[BinaryOp::And] = "and";
-    mipsName[BinaryOp::Or] = "or";
     regs[zero] = (RegContents){false, NULL, "$zero", false};
     regs[at] = (RegContents){false, NULL, "$at", false};
     regs[v0] = (RegContents){false, NULL, "$v0", false};
@@ -442,10 +845,12 @@ Mips::Mips()
     regs[s3] = (RegContents){false, NULL, "$s3", true};
     regs[s4] = (RegContents){false, NULL, "$s4", true};
     regs[s5] = (RegContents){false, NULL, "$s5", true};
-    regs[s6] = (RegContents){false, NULL, "$s6", true};
-    regs[s7] = (RegContents){false, NULL, "$s7", true};
+    regs[s6] = (RegContents){false, NULL, "$s6", false};
+    regs[s7] = (RegContents){false, NULL, "$s7", false};
     rs = t0;
     rt = t1;
     rd = t2;
+    frs = f2;
+    frt = f4;
+    frd = f6;
 }
-const char *Mips::mipsName[BinaryOp::NumOps];
\ No newline at end of file
@@ -18,13 +18,19 @@
 #ifndef _H_mips
 #define _H_mips
 
+#include <stdarg.h>
+#include <stdio.h>
+#include <map>
+#include <string>
 #include "tac.h"
 #include "list.h"
+#include "target.h"
+#include "mipsenc.h"
 class Location;
 
-class Mips
+class Mips : public Target
 {
-private:
+protected:
   typedef enum
   {
     zero,
@@ -72,6 +78,21 @@ private:
 
   Register rs, rt, rd;
 
+  // doubles go through their own registers, $f0 holds a double result
+  typedef enum
+  {
+    f0,
+    f2,
+    f4,
+    f6,
+    NumFRegs
+  } FRegister;
+  FRegister frs, frt, frd;
+
+  // the pool of string literals: label by text, texts in first use order
+  std::map<std::string, const char *> stringLabels;
+  List<const char *> stringPool;
+
   typedef enum
   {
     ForRead,
@@ -80,11 +101,42 @@ private:
 
   void FillRegister(Location *src, Register reg);
   void SpillRegister(Location *dst, Register reg);
+  void FillRegister(Location *src, FRegister reg);
+  void SpillRegister(Location *dst, FRegister reg);
 
-  void EmitCallInstr(Location *dst, const char *fn, bool isL);
+  void EmitDoubleOp(BinaryOp::OpCode code, Location *dst,
+                    Location *op1, Location *op2);
 
-  static const char *mipsName[BinaryOp::NumOps];
-  static const char *NameForTac(BinaryOp::OpCode code);
+  void EmitCallResult(Location *result);
+
+  // Every instruction goes through Instr, InstrLabel or InstrDouble,
+  // with its operands in assembly order (an offset(base) operand is
+  // two) and a printf-style note for the comment after them. A note
+  // about a variable takes its Location, whose name stands for the
+  // first %s of the note: it is only looked up when the note is
+  // printed, as temps are only numbers until then. They hand it all
+  // to OutInstr, the output sink: here it prints a line of
+  // assembly, MipsElf (see mipself.h) encodes it. Data directives go
+  // through Directive and OutDirective the same way, and the lines of
+  // the runtime routines through Runtime and OutRuntime.
+  void Instr(MipsEncoder::Op op, int a, int b, int c, const char *note, ...);
+  void Instr(MipsEncoder::Op op, int a, int b, int c, const Location *var,
+             const char *note, ...);
+  void InstrLabel(MipsEncoder::Op op, const char *label, int a, int b,
+                  const char *note, ...);
+  void InstrLabel(MipsEncoder::Op op, const char *label, int a, int b,
+                  const Location *var, const char *note, ...);
+  void InstrDouble(int fd, double value, const char *note, ...);
+  void Directive(const char *fmt, ...);
+
+  virtual void OutInstr(MipsEncoder::Op op, int a, int b, int c, const char *label,
+                        double value, const Location *var, const char *note,
+                        va_list args);
+  virtual void OutDirective(const char *text) { Emit("%s", text); }
+  virtual void OutRuntime(const char *text) { fputs(text, stdout); }
+
+  static MipsEncoder::Op OpForTac(BinaryOp::OpCode code);
+  static int StringLength(const char *str);
 
 public:
   Mips();
@@ -92,6 +144,7 @@ public:
   static void Emit(const char *fmt, ...);
 
   void EmitLoadConstant(Location *dst, int val);
+  void EmitLoadConstant(Location *dst, double val);
   void EmitLoadStringConstant(Location *dst, const char *str);
   void EmitLoadLabel(Location *dst, const char *label);
 
@@ -105,9 +158,10 @@ public:
   void EmitLabel(const char *label);
   void EmitGoto(const char *label);
   void EmitIfZ(Location *test, const char *label);
+  void EmitIfNZ(Location *test, const char *label);
   void EmitReturn(Location *returnVal);
 
-  void EmitBeginFunction(int frameSize);
+  void EmitBeginFunction(int frameSize, List<int> *clearedSlots = NULL);
   void EmitEndFunction();
 
   void EmitParam(Location *arg);
@@ -115,9 +169,25 @@ public:
   void EmitACall(Location *result, Location *fnAddr);
   void EmitPopParams(int bytes);
 
-  void EmitVTable(const char *label, List<const char *> *methodLabels);
+  // $s7 is the heap pointer and $s6 the end of the chunk it bumps
+  // through, neither is handed out to hold variables.
+  void EmitHeapAlloc(Location *dst, Location *size, const char *descriptor = NULL);
+
+  void EmitVTable(const char *label, List<const char *> *methodLabels,
+                  List<const char *> *itableLabels = NULL, List<int> *gcMap = NULL);
 
   void EmitPreamble();
+  void EmitEnd();
+  bool ShowsTac() { return true; }
+  void EmitComment(const char *tac) { Emit("# %s", tac); }
+  void EmitLine(int line, const char *text);
+  void EmitStringPool();
+
+  // A line of the runtime routines, printf-style.
+  void Runtime(const char *fmt, ...);
 };
 
+// Emits the runtime routines the generated code calls (main.cc).
+void SysCallCodeGen(Mips *mips);
+
 #endif
@@ -0,0 +1,44 @@
+/* File: mipself.cc
+ * ----------------
+ * Implementation of the MipsElf class, the output sink of the Mips
+ * instruction selection (see mips.cc) that goes to the encoder.
+ */
+
+#include "mipself.h"
+#include <stdio.h>
+
+typedef MipsEncoder E;
+
+/* Method: OutInstr
+ * ----------------
+ * The encoding sink: the operands are in the order Emit takes them,
+ * and the note is left out, so no temp gets a name here.
+ */
+void MipsElf::OutInstr(E::Op op, int a, int b, int c, const char *label,
+                       double value, const Location *var, const char *note,
+                       va_list args)
+{
+    if (op == E::LiD)
+        encoder.EmitLoadDouble(a, value);
+    else if (!label)
+        encoder.Emit(op, a, b, c);
+    else if (E::Operands(op)[1] == 'l')
+        encoder.Emit(op, a, label);
+    else if (E::Operands(op)[0] == 'l')
+        encoder.Emit(op, label);
+    else
+        encoder.Emit(op, a, b, label);
+}
+
+/* Method: EmitEnd
+ * ---------------
+ * After the string literals and the runtime, as in the assembly, the
+ * image is written out.
+ */
+void MipsElf::EmitEnd()
+{
+    Mips::EmitEnd();
+    encoder.Finish();
+    encoder.Write(stdout);
+    fflush(stdout);
+}
@@ -0,0 +1,46 @@
+/* File: mipself.h
+ * ---------------
+ * The MipsElf class is the Mips target writing machine code instead
+ * of assembly, for -target=mips-elf: the same instructions, chosen
+ * by the same Mips methods, but the output sink encodes them straight
+ * into words by a MipsEncoder (see mipsenc.h), which writes the
+ * program and its runtime as an ELF32 image dsim runs
+ *
+ *     dcc -target=mips-elf < prog.decaf > prog.elf
+ *     dsim prog.elf
+ *
+ * Nothing is formatted or parsed again per instruction, which makes
+ * the output a fraction of the size and quicker to write. The data
+ * directives and the lines of the runtime routines SysCallCodeGen
+ * hands over go through the encoder's line assembler; there are few
+ * of them.
+ * The assembly target stays the one to read when debugging.
+ */
+
+#ifndef _H_mipself
+#define _H_mipself
+
+#include "mips.h"
+#include "mipsenc.h"
+
+class MipsElf : public Mips
+{
+private:
+  MipsEncoder encoder;
+
+  void OutInstr(MipsEncoder::Op op, int a, int b, int c, const char *label,
+                double value, const Location *var, const char *note,
+                va_list args);
+  void OutDirective(const char *text) { encoder.Assemble(text); }
+  void OutRuntime(const char *text) { encoder.Assemble(text); }
+
+public:
+  void EmitLabel(const char *label) { encoder.Label(label); }
+  void EmitPreamble() {}
+  void EmitEnd();
+  bool ShowsTac() { return false; }
+  void EmitComment(const char *tac) {}
+  void EmitLine(int line, const char *text) { encoder.Line(line, text); }
+};
+
+#endif
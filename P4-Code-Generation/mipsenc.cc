@@ -0,0 +1,894 @@
+/* File: mipsenc.cc
+ * ----------------
+ * Implementation of the MipsEncoder class. Each word is built as it
+ * is emitted, with zeros in the field a label goes in, and Finish
+ * patches the fields once every label has its address.
+ */
+
+#include "mipsenc.h"
+#include <ctype.h>
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utility.h"
+
+static const int Zero = 0, At = 1, Ra = 31;
+
+// the major opcodes
+enum
+{
+    Special = 0x00, RegImm = 0x01, OpJ = 0x02, OpJal = 0x03,
+    OpBeq = 0x04, OpBne = 0x05, OpBlez = 0x06, OpBgtz = 0x07,
+    OpAddi = 0x08, OpAddiu = 0x09, OpSlti = 0x0a, OpSltiu = 0x0b,
+    OpAndi = 0x0c, OpOri = 0x0d, OpXori = 0x0e, OpLui = 0x0f,
+    OpCop1 = 0x11, Special2 = 0x1c,
+    OpLb = 0x20, OpLh = 0x21, OpLw = 0x23, OpLbu = 0x24, OpLhu = 0x25,
+    OpSb = 0x28, OpSh = 0x29, OpSw = 0x2b, OpLwc1 = 0x31, OpSwc1 = 0x39
+};
+
+// the function field of the Special instructions
+enum
+{
+    FnSll = 0x00, FnSrl = 0x02, FnSra = 0x03, FnJr = 0x08, FnJalr = 0x09,
+    FnSyscall = 0x0c, FnBreak = 0x0d, FnMfhi = 0x10, FnMflo = 0x12,
+    FnMult = 0x18, FnMultu = 0x19, FnDiv = 0x1a, FnDivu = 0x1b,
+    FnAdd = 0x20, FnAddu = 0x21, FnSub = 0x22, FnSubu = 0x23,
+    FnAnd = 0x24, FnOr = 0x25, FnXor = 0x26, FnNor = 0x27,
+    FnSlt = 0x2a, FnSltu = 0x2b
+};
+
+// the fp formats, and the break code for a division by zero
+static const int FmtD = 0x11, FmtW = 0x14, DivideByZero = 7;
+
+// where li.d constants go, no label from the code generator starts
+// with a dot
+static const char *DoublePool = ".doubles";
+
+// Operand formats for Assemble, one letter per operand:
+//   d s t  integer registers     D S T  fp registers
+//   i      immediate             h      register or immediate
+//   m      offset(base)          l      label
+//   f      double
+static const struct
+{
+    const char *name;
+    const char *format;
+} opInfo[MipsEncoder::NumOps] = {
+    {"add", "dsh"}, {"addu", "dsh"}, {"sub", "dsh"}, {"subu", "dsh"},
+    {"and", "dsh"}, {"or", "dsh"}, {"xor", "dsh"}, {"nor", "dst"},
+    {"slt", "dsh"}, {"sltu", "dsh"}, {"mul", "dsh"}, {"div", "dsh"},
+    {"divu", "dsh"}, {"rem", "dsh"}, {"remu", "dsh"}, {"seq", "dsh"},
+    {"sne", "dsh"}, {"sle", "dsh"}, {"sgt", "dsh"}, {"sge", "dsh"},
+    {"sll", "dsi"}, {"srl", "dsi"}, {"sra", "dsi"}, {"addi", "dsi"},
+    {"addiu", "dsi"}, {"andi", "dsi"}, {"ori", "dsi"}, {"xori", "dsi"},
+    {"slti", "dsi"}, {"sltiu", "dsi"},
+    {"lui", "di"}, {"li", "di"},
+    {"move", "ds"}, {"negu", "ds"}, {"not", "ds"},
+    {"mult", "st"}, {"multu", "st"},
+    {"mfhi", "d"}, {"mflo", "d"},
+    {"lw", "tm"}, {"lb", "tm"}, {"lbu", "tm"}, {"lh", "tm"}, {"lhu", "tm"},
+    {"sw", "tm"}, {"sb", "tm"}, {"sh", "tm"}, {"lwc1", "Tm"}, {"swc1", "Tm"},
+    {"l.d", "Tm"}, {"s.d", "Tm"},
+    {"beq", "stl"}, {"bne", "stl"}, {"blt", "stl"}, {"bgt", "stl"},
+    {"ble", "stl"}, {"bge", "stl"}, {"bltu", "stl"}, {"bgtu", "stl"},
+    {"bleu", "stl"}, {"bgeu", "stl"},
+    {"beqz", "sl"}, {"bnez", "sl"}, {"bltz", "sl"}, {"bgez", "sl"},
+    {"blez", "sl"}, {"bgtz", "sl"},
+    {"b", "l"}, {"j", "l"}, {"jal", "l"}, {"bc1t", "l"}, {"bc1f", "l"},
+    {"la", "dl"},
+    {"jr", "s"}, {"jalr", "s"},
+    {"syscall", ""}, {"break", "i"},
+    {"add.d", "DST"}, {"sub.d", "DST"}, {"mul.d", "DST"}, {"div.d", "DST"},
+    {"neg.d", "DS"}, {"mov.d", "DS"}, {"abs.d", "DS"}, {"cvt.d.w", "DS"},
+    {"cvt.w.d", "DS"}, {"trunc.w.d", "DS"},
+    {"c.eq.d", "ST"}, {"c.lt.d", "ST"}, {"c.le.d", "ST"},
+    {"mtc1", "tS"}, {"mfc1", "tS"},
+    {"li.d", "Df"},
+};
+
+static const char *const regNames[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+
+static bool FitsSigned(int value)
+{
+    return value >= -32768 && value <= 32767;
+}
+
+static bool FitsUnsigned(int value)
+{
+    return value >= 0 && value <= 0xffff;
+}
+
+const char *MipsEncoder::Name(Op op)
+{
+    return opInfo[op].name;
+}
+
+const char *MipsEncoder::Operands(Op op)
+{
+    return opInfo[op].format;
+}
+
+MipsEncoder::MipsEncoder()
+{
+    section = Text;
+    finished = false;
+}
+
+void MipsEncoder::R(int funct, int d, int s, int t, int shamt)
+{
+    Put(s << 21 | t << 16 | d << 11 | shamt << 6 | funct);
+}
+
+void MipsEncoder::I(int op, int t, int s, int imm)
+{
+    Put(op << 26 | s << 21 | t << 16 | (imm & 0xffff));
+}
+
+void MipsEncoder::Cop1(int fmt, int ft, int fs, int fd, int funct)
+{
+    Put(OpCop1 << 26 | fmt << 21 | ft << 16 | fs << 11 | fd << 6 | funct);
+}
+
+// A fixup for the next word of the current section.
+void MipsEncoder::AddFixup(FixupKind kind, const char *label, int addend)
+{
+    Fixup f;
+    f.kind = kind;
+    f.at = kind == Word32 ? data.size() : 4 * text.size();
+    f.label = label;
+    f.addend = addend;
+    fixups.push_back(f);
+}
+
+// A load or store, through $at when the offset takes more than 16 bits.
+void MipsEncoder::Memory(int op, int t, int offset, int base)
+{
+    if (FitsSigned(offset))
+    {
+        I(op, t, base, offset);
+        return;
+    }
+    I(OpLui, At, Zero, (offset + 0x8000) >> 16);
+    R(FnAddu, At, At, base);
+    I(op, t, At, offset);
+}
+
+void MipsEncoder::BranchTo(int op, int s, int t, const char *label)
+{
+    AddFixup(Branch16, label);
+    I(op, t, s, 0);
+}
+
+/* Method: Emit
+ * ------------
+ * Encodes one instruction, or the several a pseudo-instruction
+ * expands to, at the end of the text.
+ */
+void MipsEncoder::Emit(Op op, int a, int b, int c)
+{
+    static const int aluFunct[] = {FnAdd, FnAddu, FnSub, FnSubu, FnAnd,
+                                   FnOr, FnXor, FnNor, FnSlt, FnSltu};
+    Assert(section == Text);
+    switch (op)
+    {
+    case Add: case Addu: case Sub: case Subu: case And:
+    case Or: case Xor: case Nor: case Slt: case Sltu:
+        R(aluFunct[op - Add], a, b, c);
+        break;
+    case Mul:
+        Put(Special2 << 26 | b << 21 | c << 16 | a << 11 | 0x02);
+        break;
+    case Div: case Divu: case Rem: case Remu:
+        // skip the break unless dividing by zero
+        I(OpBne, Zero, c, 1);
+        Put(DivideByZero << 16 | FnBreak);
+        R(op == Div || op == Rem ? FnDiv : FnDivu, 0, b, c);
+        R(op == Rem || op == Remu ? FnMfhi : FnMflo, a, 0, 0);
+        break;
+    case Seq:
+        R(FnXor, a, b, c);
+        I(OpSltiu, a, a, 1);
+        break;
+    case Sne:
+        R(FnXor, a, b, c);
+        R(FnSltu, a, Zero, a);
+        break;
+    case Sle:
+        R(FnSlt, a, c, b);
+        I(OpXori, a, a, 1);
+        break;
+    case Sgt:
+        R(FnSlt, a, c, b);
+        break;
+    case Sge:
+        R(FnSlt, a, b, c);
+        I(OpXori, a, a, 1);
+        break;
+    case Sll: R(FnSll, a, 0, b, c & 31); break;
+    case Srl: R(FnSrl, a, 0, b, c & 31); break;
+    case Sra: R(FnSra, a, 0, b, c & 31); break;
+    case Addi: case Addiu: case Slti: case Sltiu:
+        if (FitsSigned(c))
+            I(op == Addi ? OpAddi : op == Addiu ? OpAddiu : op == Slti ? OpSlti : OpSltiu, a, b, c);
+        else
+        {
+            Emit(Li, At, c);
+            R(op == Addi ? FnAdd : op == Addiu ? FnAddu : op == Slti ? FnSlt : FnSltu, a, b, At);
+        }
+        break;
+    case Andi: case Ori: case Xori:
+        if (FitsUnsigned(c))
+            I(op == Andi ? OpAndi : op == Ori ? OpOri : OpXori, a, b, c);
+        else
+        {
+            Emit(Li, At, c);
+            R(op == Andi ? FnAnd : op == Ori ? FnOr : FnXor, a, b, At);
+        }
+        break;
+    case Lui:
+        I(OpLui, a, Zero, b);
+        break;
+    case Li:
+        if (FitsSigned(b))
+            I(OpAddiu, a, Zero, b);
+        else if (FitsUnsigned(b))
+            I(OpOri, a, Zero, b);
+        else
+        {
+            I(OpLui, a, Zero, (uint32_t)b >> 16);
+            if (b & 0xffff)
+                I(OpOri, a, a, b);
+        }
+        break;
+    case Move: R(FnAddu, a, b, Zero); break;
+    case Negu: R(FnSubu, a, Zero, b); break;
+    case Not: R(FnNor, a, b, Zero); break;
+    case Mult: R(FnMult, 0, a, b); break;
+    case Multu: R(FnMultu, 0, a, b); break;
+    case Mfhi: R(FnMfhi, a, 0, 0); break;
+    case Mflo: R(FnMflo, a, 0, 0); break;
+    case Lw: Memory(OpLw, a, b, c); break;
+    case Lb: Memory(OpLb, a, b, c); break;
+    case Lbu: Memory(OpLbu, a, b, c); break;
+    case Lh: Memory(OpLh, a, b, c); break;
+    case Lhu: Memory(OpLhu, a, b, c); break;
+    case Sw: Memory(OpSw, a, b, c); break;
+    case Sb: Memory(OpSb, a, b, c); break;
+    case Sh: Memory(OpSh, a, b, c); break;
+    case Lwc1: Memory(OpLwc1, a, b, c); break;
+    case Swc1: Memory(OpSwc1, a, b, c); break;
+    // a double is the two words from the offset up, low word first
+    case LoadD:
+        Memory(OpLwc1, a, b, c);
+        Memory(OpLwc1, a + 1, b + 4, c);
+        break;
+    case StoreD:
+        Memory(OpSwc1, a, b, c);
+        Memory(OpSwc1, a + 1, b + 4, c);
+        break;
+    case Jr: R(FnJr, 0, a, 0); break;
+    case Jalr: R(FnJalr, Ra, a, 0); break;
+    case Syscall: R(FnSyscall, 0, 0, 0); break;
+    case Break: Put((a & 0x3ff) << 16 | FnBreak); break;
+    case AddD: Cop1(FmtD, c, b, a, 0x00); break;
+    case SubD: Cop1(FmtD, c, b, a, 0x01); break;
+    case MulD: Cop1(FmtD, c, b, a, 0x02); break;
+    case DivD: Cop1(FmtD, c, b, a, 0x03); break;
+    case AbsD: Cop1(FmtD, 0, b, a, 0x05); break;
+    case MovD: Cop1(FmtD, 0, b, a, 0x06); break;
+    case NegD: Cop1(FmtD, 0, b, a, 0x07); break;
+    case TruncWD: Cop1(FmtD, 0, b, a, 0x0d); break;
+    case CvtWD: Cop1(FmtD, 0, b, a, 0x24); break;
+    case CvtDW: Cop1(FmtW, 0, b, a, 0x21); break;
+    case CeqD: Cop1(FmtD, b, a, 0, 0x32); break;
+    case CltD: Cop1(FmtD, b, a, 0, 0x3c); break;
+    case CleD: Cop1(FmtD, b, a, 0, 0x3e); break;
+    case Mtc1: Put(OpCop1 << 26 | 4 << 21 | a << 16 | b << 11); break;
+    case Mfc1: Put(OpCop1 << 26 | 0 << 21 | a << 16 | b << 11); break;
+    default:
+        Failure("%s takes other operands", opInfo[op].name);
+    }
+}
+
+// The branches that compare two registers.
+void MipsEncoder::Emit(Op op, int a, int b, const char *label)
+{
+    Assert(section == Text);
+    switch (op)
+    {
+    case Beq: BranchTo(OpBeq, a, b, label); return;
+    case Bne: BranchTo(OpBne, a, b, label); return;
+    case Blt: case Bltu: case Bge: case Bgeu:
+        R(op == Blt || op == Bge ? FnSlt : FnSltu, At, a, b);
+        break;
+    case Bgt: case Bgtu: case Ble: case Bleu:
+        R(op == Bgt || op == Ble ? FnSlt : FnSltu, At, b, a);
+        break;
+    default:
+        Failure("%s takes other operands", opInfo[op].name);
+    }
+    bool taken = op == Blt || op == Bltu || op == Bgt || op == Bgtu;
+    BranchTo(taken ? OpBne : OpBeq, At, Zero, label);
+}
+
+// The branches that test one register, and la.
+void MipsEncoder::Emit(Op op, int a, const char *label)
+{
+    Assert(section == Text);
+    switch (op)
+    {
+    case Beqz: BranchTo(OpBeq, a, Zero, label); break;
+    case Bnez: BranchTo(OpBne, a, Zero, label); break;
+    case Bltz: BranchTo(RegImm, a, 0, label); break;
+    case Bgez: BranchTo(RegImm, a, 1, label); break;
+    case Blez: BranchTo(OpBlez, a, 0, label); break;
+    case Bgtz: BranchTo(OpBgtz, a, 0, label); break;
+    case La:
+        AddFixup(Hi16, label);
+        I(OpLui, a, Zero, 0);
+        AddFixup(Lo16, label);
+        I(OpOri, a, a, 0);
+        break;
+    default:
+        Failure("%s takes other operands", opInfo[op].name);
+    }
+}
+
+// The jumps and the branches that take only a label.
+void MipsEncoder::Emit(Op op, const char *label)
+{
+    Assert(section == Text);
+    switch (op)
+    {
+    case B:
+        BranchTo(OpBeq, Zero, Zero, label);
+        break;
+    case J:
+    case Jal:
+        AddFixup(Jump26, label);
+        Put((op == J ? OpJ : OpJal) << 26);
+        break;
+    case Bc1t:
+    case Bc1f:
+        AddFixup(Branch16, label);
+        Put(OpCop1 << 26 | 8 << 21 | (op == Bc1t) << 16);
+        break;
+    default:
+        Failure("%s takes other operands", opInfo[op].name);
+    }
+}
+
+/* Method: EmitLoadDouble
+ * ----------------------
+ * li.d loads the constant from a pool after the data, which is
+ * 8-aligned so both words are in reach of the one lui.
+ */
+void MipsEncoder::EmitLoadDouble(int fd, double value)
+{
+    Assert(section == Text);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    std::map<uint64_t, int>::iterator it = doubleIndex.find(bits);
+    if (it == doubleIndex.end())
+    {
+        it = doubleIndex.insert(std::make_pair(bits, (int)doubles.size())).first;
+        doubles.push_back(value);
+    }
+    int offset = 8 * it->second;
+    AddFixup(HiAdj16, DoublePool, offset);
+    I(OpLui, At, Zero, 0);
+    AddFixup(Lo16, DoublePool, offset);
+    I(OpLwc1, fd, At, 0);
+    AddFixup(Lo16, DoublePool, offset + 4);
+    I(OpLwc1, fd + 1, At, 0);
+}
+
+// The immediate forms of the three register instructions.
+void MipsEncoder::EmitImmediate(Op op, int d, int s, int imm)
+{
+    switch (op)
+    {
+    case Add: Emit(Addi, d, s, imm); break;
+    case Addu: Emit(Addiu, d, s, imm); break;
+    case Sub: Emit(Addi, d, s, -imm); break;
+    case Subu: Emit(Addiu, d, s, -imm); break;
+    case And: Emit(Andi, d, s, imm); break;
+    case Or: Emit(Ori, d, s, imm); break;
+    case Xor: Emit(Xori, d, s, imm); break;
+    case Slt: Emit(Slti, d, s, imm); break;
+    case Sltu: Emit(Sltiu, d, s, imm); break;
+    default:
+        Emit(Li, At, imm);
+        Emit(op, d, s, At);
+    }
+}
+
+void MipsEncoder::Define(const std::string &label, Section in, uint32_t offset)
+{
+    Symbol symbol = {in, offset};
+    std::pair<std::unordered_map<std::string, Symbol>::iterator, bool> added =
+        symbols.insert(std::make_pair(label, symbol));
+    if (!added.second)
+        Failure("label %s defined twice", label.c_str());
+    symbolOrder.push_back(&added.first->first);
+}
+
+void MipsEncoder::Label(const char *label)
+{
+    if (section == Text)
+        Define(label, Text, 4 * text.size());
+    else
+        pendingLabels.push_back(label);
+}
+
+// Aligns the data for the next item and gives the labels waiting for
+// it their address.
+void MipsEncoder::PlacePending(int alignment)
+{
+    while (data.size() % alignment)
+        data.push_back(0);
+    for (size_t i = 0; i < pendingLabels.size(); i++)
+        Define(pendingLabels[i], Data, data.size());
+    pendingLabels.clear();
+}
+
+void MipsEncoder::Align(int bytes)
+{
+    if (section == Data)
+        PlacePending(bytes);
+}
+
+void MipsEncoder::Word(uint32_t value)
+{
+    Assert(section == Data);
+    PlacePending(4);
+    for (int i = 0; i < 4; i++)
+        data.push_back(value >> 8 * i);
+}
+
+// A label's address, or a number as .word takes it (a vtable slot
+// with no method is 0).
+void MipsEncoder::Word(const char *label)
+{
+    if (isdigit((unsigned char)*label) || *label == '-')
+    {
+        char *end;
+        long value = strtol(label, &end, 0);
+        if (*end)
+            Failure("bad word %s", label);
+        Word((uint32_t)value);
+        return;
+    }
+    Assert(section == Data);
+    PlacePending(4);
+    AddFixup(Word32, label);
+    data.insert(data.end(), 4, 0);
+}
+
+void MipsEncoder::Space(int bytes)
+{
+    Assert(section == Data);
+    PlacePending(1);
+    data.insert(data.end(), bytes, 0);
+}
+
+void MipsEncoder::Ascii(const char *literal, bool terminate)
+{
+    Assert(section == Data && *literal == '"');
+    PlacePending(1);
+    const char *p;
+    for (p = literal + 1; *p && *p != '"'; p++)
+    {
+        char c = *p;
+        if (c == '\\' && p[1])
+        {
+            switch (*++p)
+            {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case '0': c = '\0'; break;
+            default: c = *p;
+            }
+        }
+        data.push_back(c);
+    }
+    if (*p != '"')
+        Failure("unterminated string %s", literal);
+    if (terminate)
+        data.push_back(0);
+}
+
+static char *Trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1]))
+        *--e = '\0';
+    return s;
+}
+
+static int Register(const char *s, bool fp, const char *line)
+{
+    int n = -1;
+    if (fp && s[0] == '$' && s[1] == 'f' && isdigit((unsigned char)s[2]))
+        n = atoi(s + 2);
+    else if (!fp && s[0] == '$' && isdigit((unsigned char)s[1]))
+        n = atoi(s + 1);
+    else if (!fp && s[0] == '$')
+        for (int i = 0; i < 32; i++)
+            if (!strcmp(s + 1, regNames[i]))
+                n = i;
+    if (n < 0 || n > 31)
+        Failure("bad register %s in: %s", s, line);
+    return n;
+}
+
+static int Immediate(const char *s, const char *line)
+{
+    char *end;
+    long value = strtol(s, &end, 0);
+    if (!*s || *end)
+        Failure("bad immediate %s in: %s", s, line);
+    return value;
+}
+
+/* Method: Assemble
+ * ----------------
+ * Reads one line: labels, then a directive or an instruction, then
+ * maybe a comment.
+ */
+void MipsEncoder::Assemble(const char *text)
+{
+    // a copy to cut up, string literals can be any length
+    std::vector<char> copy(text, text + strlen(text) + 1);
+    char *buf = copy.data();
+    bool inString = false;
+    for (char *p = buf; *p; p++)
+    {
+        if (*p == '\\' && inString && p[1])
+            p++;
+        else if (*p == '"')
+            inString = !inString;
+        else if (*p == '#' && !inString)
+        {
+            *p = '\0';
+            break;
+        }
+    }
+    char *s = Trim(buf);
+    for (;;)
+    {
+        char *colon = s;
+        while (isalnum((unsigned char)*colon) || *colon == '_' || *colon == '.')
+            colon++;
+        if (colon == s || *colon != ':')
+            break;
+        *colon = '\0';
+        Label(s);
+        s = Trim(colon + 1);
+    }
+    if (!*s)
+        return;
+
+    char *args = s;
+    while (*args && !isspace((unsigned char)*args))
+        args++;
+    if (*args)
+        *args++ = '\0';
+    args = Trim(args);
+
+    if (*s == '.')
+    {
+        if (!strcmp(s, ".text"))
+            SetSection(Text);
+        else if (!strcmp(s, ".data"))
+            SetSection(Data);
+        else if (!strcmp(s, ".globl"))
+            ;
+        else if (!strcmp(s, ".align"))
+            Align(1 << Immediate(args, text));
+        else if (!strcmp(s, ".asciiz") || !strcmp(s, ".ascii"))
+            Ascii(args, s[6] == 'z');
+        else if (!strcmp(s, ".space"))
+            Space(Immediate(args, text));
+        else if (!strcmp(s, ".word"))
+        {
+            for (char *item = strtok(args, ", \t"); item; item = strtok(NULL, ", \t"))
+                Word(item);
+        }
+        else
+            Failure("unknown directive in: %s", text);
+        return;
+    }
+
+    int op;
+    for (op = 0; op < NumOps; op++)
+        if (!strcmp(opInfo[op].name, s))
+            break;
+    if (op == NumOps)
+        Failure("unknown instruction in: %s", text);
+
+    const char *format = opInfo[op].format;
+    int values[3] = {0, 0, 0}, numValues = 0, imm = 0;
+    bool isImmediate = false;
+    const char *label = NULL;
+    double d = 0;
+    char *operand = strtok(args, ",");
+    for (const char *f = format; *f; f++, operand = strtok(NULL, ","))
+    {
+        if (!operand)
+            Failure("missing operand in: %s", text);
+        operand = Trim(operand);
+        switch (*f)
+        {
+        case 'd': case 's': case 't':
+            values[numValues++] = Register(operand, false, text);
+            break;
+        case 'D': case 'S': case 'T':
+            values[numValues++] = Register(operand, true, text);
+            break;
+        case 'h':
+            if (*operand == '$')
+                values[numValues++] = Register(operand, false, text);
+            else
+            {
+                imm = Immediate(operand, text);
+                isImmediate = true;
+            }
+            break;
+        case 'i':
+            values[numValues++] = Immediate(operand, text);
+            break;
+        case 'm':
+        {
+            char *paren = strchr(operand, '(');
+            char *close = paren ? strchr(paren, ')') : NULL;
+            if (!close)
+                Failure("bad memory operand in: %s", text);
+            *paren = *close = '\0';
+            char *offset = Trim(operand);
+            values[numValues++] = *offset ? Immediate(offset, text) : 0;
+            values[numValues++] = Register(Trim(paren + 1), false, text);
+            break;
+        }
+        case 'l':
+            label = operand;
+            break;
+        case 'f':
+            d = atof(operand);
+            break;
+        }
+    }
+    if (operand)
+        Failure("extra operands in: %s", text);
+
+    if (op == LiD)
+        EmitLoadDouble(values[0], d);
+    else if (isImmediate)
+        EmitImmediate((Op)op, values[0], values[1], imm);
+    else if (label && numValues == 2)
+        Emit((Op)op, values[0], values[1], label);
+    else if (label && numValues == 1)
+        Emit((Op)op, values[0], label);
+    else if (label)
+        Emit((Op)op, label);
+    else
+        Emit((Op)op, values[0], values[1], values[2]);
+}
+
+uint32_t MipsEncoder::Address(const Fixup &f)
+{
+    std::unordered_map<std::string, Symbol>::iterator it = symbols.find(f.label);
+    if (it == symbols.end())
+        Failure("undefined label %s", f.label.c_str());
+    if (f.kind == Branch16 && it->second.section != Text)
+        Failure("branch to data label %s", f.label.c_str());
+    return (it->second.section == Text ? TextBase : DataBase) + it->second.offset + f.addend;
+}
+
+void MipsEncoder::Line(int line, const char *text)
+{
+    char address[16];
+    sprintf(address, "%08x ", TextBase + 4 * (uint32_t)this->text.size());
+    lines.append(address);
+    lines.append(std::to_string(line));
+    if (line)
+        lines.append(": ").append(text ? text : "");
+    lines.push_back('\n');
+}
+
+/* Method: Finish
+ * --------------
+ * Lays the li.d constants out after the data and fills in the label
+ * fields of the words that refer to one.
+ */
+void MipsEncoder::Finish()
+{
+    Assert(!finished);
+    finished = true;
+    section = Data;
+    PlacePending(1);
+    if (!doubles.empty())
+    {
+        PlacePending(8);
+        Define(DoublePool, Data, data.size());
+        for (size_t i = 0; i < doubles.size(); i++)
+        {
+            uint64_t bits;
+            memcpy(&bits, &doubles[i], sizeof(bits));
+            for (int b = 0; b < 8; b++)
+                data.push_back(bits >> 8 * b);
+        }
+    }
+
+    for (size_t i = 0; i < fixups.size(); i++)
+    {
+        const Fixup &f = fixups[i];
+        uint32_t address = Address(f);
+        uint32_t *word = f.kind == Word32 ? NULL : &text[f.at / 4];
+        switch (f.kind)
+        {
+        case Branch16:
+        {
+            // counted in words from the next instruction
+            int offset = (int)(address - (TextBase + f.at + 4)) >> 2;
+            if (!FitsSigned(offset))
+                Failure("branch to %s is out of range", f.label.c_str());
+            *word |= offset & 0xffff;
+            break;
+        }
+        case Jump26:
+            *word |= address >> 2 & 0x3ffffff;
+            break;
+        case Hi16:
+            *word |= address >> 16;
+            break;
+        case HiAdj16:
+            *word |= (address + 0x8000) >> 16;
+            break;
+        case Lo16:
+            *word |= address & 0xffff;
+            break;
+        case Word32:
+            for (int b = 0; b < 4; b++)
+                data[f.at + b] = address >> 8 * b;
+            break;
+        }
+    }
+    fixups.clear();
+    if (!symbols.count("main"))
+        Failure("no main to start the program from");
+}
+
+static void Put16(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(value);
+    out.push_back(value >> 8);
+}
+
+static void Put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    Put16(out, value);
+    Put16(out, value >> 16);
+}
+
+static void Pad(std::vector<uint8_t> &out, size_t alignment)
+{
+    while (out.size() % alignment)
+        out.push_back(0);
+}
+
+static void SectionHeader(std::vector<uint8_t> &out, uint32_t name, uint32_t type,
+                          uint32_t flags, uint32_t addr, uint32_t offset, uint32_t size,
+                          uint32_t link, uint32_t info, uint32_t align, uint32_t entsize)
+{
+    uint32_t fields[] = {name, type, flags, addr, offset, size, link, info, align, entsize};
+    for (int i = 0; i < 10; i++)
+        Put32(out, fields[i]);
+}
+
+/* Method: Write
+ * -------------
+ * Writes the ELF32 image: the header, a loadable segment each for
+ * the text and the data, and the sections, with a symbol for every
+ * label so that tools can show where they are. main comes last, the
+ * only global symbol.
+ */
+void MipsEncoder::Write(FILE *fp)
+{
+    Assert(finished);
+    std::string strtab(1, '\0');
+    std::vector<uint8_t> symtab(16, 0);
+    const std::string *main = NULL;
+    for (size_t i = 0; i <= symbolOrder.size(); i++)
+    {
+        const std::string *name = i < symbolOrder.size() ? symbolOrder[i] : main;
+        if (i < symbolOrder.size() && *name == "main")
+        {
+            main = name;
+            continue;
+        }
+        const Symbol &symbol = symbols[*name];
+        Put32(symtab, strtab.size());
+        Put32(symtab, (symbol.section == Text ? TextBase : DataBase) + symbol.offset);
+        Put32(symtab, 0);
+        symtab.push_back(ELF32_ST_INFO(name == main ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE));
+        symtab.push_back(0);
+        Put16(symtab, symbol.section == Text ? 1 : 2);
+        strtab.append(*name);
+        strtab.push_back('\0');
+    }
+    static const char shstrtab[] = "\0.text\0.data\0.symtab\0.strtab\0.shstrtab\0.dcc.lines";
+    uint32_t firstGlobal = symtab.size() / 16 - 1;
+
+    uint32_t textOffset = 128, textSize = 4 * text.size();
+    uint32_t dataOffset = (textOffset + textSize + 15) & ~15;
+    uint32_t symtabOffset = (dataOffset + data.size() + 3) & ~3;
+    uint32_t strtabOffset = symtabOffset + symtab.size();
+    uint32_t shstrtabOffset = strtabOffset + strtab.size();
+    uint32_t linesOffset = shstrtabOffset + sizeof(shstrtab);
+    uint32_t headersOffset = (linesOffset + lines.size() + 3) & ~3;
+
+    std::vector<uint8_t> out;
+    static const uint8_t ident[EI_NIDENT] = {ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
+                                             ELFCLASS32, ELFDATA2LSB, EV_CURRENT};
+    out.insert(out.end(), ident, ident + EI_NIDENT);
+    Put16(out, ET_EXEC);
+    Put16(out, EM_MIPS);
+    Put32(out, EV_CURRENT);
+    Put32(out, TextBase + symbols["main"].offset);
+    Put32(out, 52);
+    Put32(out, headersOffset);
+    Put32(out, EF_MIPS_NOREORDER | EF_MIPS_ARCH_32);
+    Put16(out, 52);
+    Put16(out, 32);
+    Put16(out, 2);
+    Put16(out, 40);
+    Put16(out, lines.empty() ? 6 : 7);
+    Put16(out, 5);
+
+    uint32_t segments[2][4] = {{textOffset, TextBase, textSize, PF_R | PF_X},
+                               {dataOffset, DataBase, (uint32_t)data.size(), PF_R | PF_W}};
+    for (int i = 0; i < 2; i++)
+    {
+        Put32(out, PT_LOAD);
+        Put32(out, segments[i][0]);
+        Put32(out, segments[i][1]);
+        Put32(out, segments[i][1]);
+        Put32(out, segments[i][2]);
+        Put32(out, segments[i][2]);
+        Put32(out, segments[i][3]);
+        Put32(out, 16);
+    }
+
+    Pad(out, 16);
+    for (size_t i = 0; i < text.size(); i++)
+        Put32(out, text[i]);
+    Pad(out, 16);
+    out.insert(out.end(), data.begin(), data.end());
+    Pad(out, 4);
+    out.insert(out.end(), symtab.begin(), symtab.end());
+    out.insert(out.end(), strtab.begin(), strtab.end());
+    out.insert(out.end(), shstrtab, shstrtab + sizeof(shstrtab));
+    out.insert(out.end(), lines.begin(), lines.end());
+    Pad(out, 4);
+
+    SectionHeader(out, 0, SHT_NULL, 0, 0, 0, 0, 0, 0, 0, 0);
+    SectionHeader(out, 1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, TextBase,
+                  textOffset, textSize, 0, 0, 4, 0);
+    SectionHeader(out, 7, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, DataBase,
+                  dataOffset, data.size(), 0, 0, 8, 0);
+    SectionHeader(out, 13, SHT_SYMTAB, 0, 0, symtabOffset, symtab.size(),
+                  4, firstGlobal, 4, 16);
+    SectionHeader(out, 21, SHT_STRTAB, 0, 0, strtabOffset, strtab.size(), 0, 0, 1, 0);
+    SectionHeader(out, 29, SHT_STRTAB, 0, 0, shstrtabOffset, sizeof(shstrtab), 0, 0, 1, 0);
+    if (!lines.empty())
+        SectionHeader(out, 39, SHT_PROGBITS, 0, 0, linesOffset, lines.size(), 0, 0, 1, 0);
+    fwrite(&out[0], 1, out.size(), fp);
+}
@@ -0,0 +1,183 @@
+/* File: mipsenc.h
+ * ---------------
+ * The MipsEncoder class assembles MIPS instructions straight into
+ * 32-bit words for -target=mips-elf (see mipself.h). It lays out the
+ * text and data segments as they come, resolves the labels and branch
+ * offsets itself once everything is in, and writes the program out as
+ * an ELF32 executable, so no assembler has to parse it again.
+ *
+ * The code generator calls Emit with the operands already in hand.
+ * The runtime routines SysCallCodeGen hands over as text go through
+ * Assemble instead, which reads the part of the SPIM syntax they use.
+ *
+ * Pseudo-instructions expand the way SPIM expands them, through $at,
+ * and as in SPIM the machine has no branch delay slots. The image
+ * uses the SPIM memory layout (see simulator.h) and is little-endian,
+ * so dsim runs it just like the .s file.
+ */
+
+#ifndef _H_mipsenc
+#define _H_mipsenc
+
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class MipsEncoder
+{
+public:
+  // The instructions and pseudo-instructions Emit takes, by the
+  // operands they have in assembly order: d, s and t are registers,
+  // an m is an offset and a base register.
+  typedef enum
+  {
+    // d, s, t
+    Add, Addu, Sub, Subu, And, Or, Xor, Nor, Slt, Sltu, Mul,
+    Div, Divu, Rem, Remu, Seq, Sne, Sle, Sgt, Sge,
+    // d, s, immediate
+    Sll, Srl, Sra, Addi, Addiu, Andi, Ori, Xori, Slti, Sltiu,
+    // d, immediate
+    Lui, Li,
+    // d, s
+    Move, Negu, Not,
+    // s, t
+    Mult, Multu,
+    // d
+    Mfhi, Mflo,
+    // t, m (the fp ones take an even fp register)
+    Lw, Lb, Lbu, Lh, Lhu, Sw, Sb, Sh, Lwc1, Swc1, LoadD, StoreD,
+    // s, t, label
+    Beq, Bne, Blt, Bgt, Ble, Bge, Bltu, Bgtu, Bleu, Bgeu,
+    // s, label
+    Beqz, Bnez, Bltz, Bgez, Blez, Bgtz,
+    // label
+    B, J, Jal, Bc1t, Bc1f,
+    // d, label
+    La,
+    // s
+    Jr, Jalr,
+    // none, or the code
+    Syscall, Break,
+    // fd, fs, ft
+    AddD, SubD, MulD, DivD,
+    // fd, fs
+    NegD, MovD, AbsD, CvtDW, CvtWD, TruncWD,
+    // fs, ft
+    CeqD, CltD, CleD,
+    // t, fs
+    Mtc1, Mfc1,
+    // fd, double (EmitLoadDouble)
+    LiD,
+    NumOps
+  } Op;
+
+  typedef enum
+  {
+    Text,
+    Data
+  } Section;
+
+  // the SPIM layout, as in simulator.h
+  static const uint32_t TextBase = 0x00400000, DataBase = 0x10010000;
+
+private:
+  typedef enum
+  {
+    Branch16,
+    Jump26,
+    Hi16,
+    HiAdj16,
+    Lo16,
+    Word32
+  } FixupKind;
+
+  struct Fixup
+  {
+    FixupKind kind;
+    uint32_t at; // byte offset in its section
+    std::string label;
+    int addend;
+  };
+
+  struct Symbol
+  {
+    Section section;
+    uint32_t offset;
+  };
+
+  std::vector<uint32_t> text;
+  std::vector<uint8_t> data;
+  Section section;
+
+  std::unordered_map<std::string, Symbol> symbols;
+  std::vector<const std::string *> symbolOrder;
+  // data labels wait for the next item, which may need aligning
+  std::vector<std::string> pendingLabels;
+  std::vector<Fixup> fixups;
+
+  // li.d constants, placed after the data by Finish
+  std::map<uint64_t, int> doubleIndex;
+  std::vector<double> doubles;
+  bool finished;
+
+  // the .dcc.lines section, see Line
+  std::string lines;
+
+  void Put(uint32_t word) { text.push_back(word); }
+  void R(int funct, int d, int s, int t, int shamt = 0);
+  void I(int op, int t, int s, int imm);
+  void Cop1(int fmt, int ft, int fs, int fd, int funct);
+  void AddFixup(FixupKind kind, const char *label, int addend = 0);
+  void Memory(int op, int t, int offset, int base);
+  void BranchTo(int op, int s, int t, const char *label);
+  void EmitImmediate(Op op, int d, int s, int imm);
+  void Define(const std::string &label, Section in, uint32_t offset);
+  void PlacePending(int alignment);
+  uint32_t Address(const Fixup &f);
+
+public:
+  MipsEncoder();
+
+  void SetSection(Section s) { section = s; }
+
+  // Defines label at the current position of the current section.
+  void Label(const char *label);
+
+  void Emit(Op op, int a = 0, int b = 0, int c = 0);
+  void Emit(Op op, int a, int b, const char *label);
+  void Emit(Op op, int a, const char *label);
+  void Emit(Op op, const char *label);
+  void EmitLoadDouble(int fd, double value);
+
+  // The SPIM name of op and its operands in the letters Assemble
+  // reads, see opInfo in mipsenc.cc.
+  static const char *Name(Op op);
+  static const char *Operands(Op op);
+
+  // data directives
+  void Align(int bytes);
+  void Word(uint32_t value);
+  void Word(const char *labelOrNumber);
+  void Space(int bytes);
+  // literal is in quotes, with the escapes .asciiz takes
+  void Ascii(const char *literal, bool terminate);
+
+  // One line of SPIM assembly; reports what it can't read with Failure.
+  void Assemble(const char *line);
+
+  // The line table for -g: the text from here on was generated for
+  // source line number line (0 for none). It goes in a .dcc.lines
+  // section of "address line: text" records, the form Mips::EmitLine
+  // writes with the address of the first instruction added in front.
+  void Line(int line, const char *text);
+
+  // Places the constants and resolves the labels, then writes the
+  // image starting at main.
+  void Finish();
+  void Write(FILE *fp);
+};
+
+#endif
@@ -46,7 +46,7 @@ void yyerror(const char *msg); // standard error-handling routine
 %token   T_LessEqual T_GreaterEqual T_Equal T_NotEqual T_Dims
 %token   T_And T_Or T_Null T_Extends T_This T_Interface T_Implements
 %token   T_While T_For T_If T_Else T_Return T_Break
-%token   T_New T_NewArray T_Print T_ReadInteger T_ReadLine
+%token   T_New T_NewArray T_Print T_ReadInteger T_ReadLine T_ReadDouble
 
 %token   <identifier> T_Identifier
 %token   <stringConstant> T_StringConstant 
@@ -99,10 +99,14 @@ Program   :    DeclList            {
                                       @1; 
                                       Program *program = new Program($1);
                                       // if no errors, advance to next phase
-                                      if (ReportError::NumErrors() == 0) 
+                                      if (ReportError::NumErrors() == 0)
+                                      {
                                           program->GenerateST();
                                           program->Check();
-                                          program->Emit();
+                                          // no target gets code for an ill-typed program
+                                          if (ReportError::NumErrors() == 0)
+                                              program->Emit();
+                                      }
                                     }
           ;
 
@@ -211,7 +215,7 @@ Stmt      :    OptExpr ';'          { $$ = $1; }
           |    T_Return ';'      
                                     { $$ = new ReturnStmt(@1, new EmptyExpr()); }
           |    T_Print '(' ExprList ')' ';'  
-                                    { $$ = new PrintStmt($3); }
+                                    { $$ = new PrintStmt(@1, $3); }
           |    T_Break ';'          { $$ = new BreakStmt(@1); }
           ;
 
@@ -256,6 +260,7 @@ Expr      :    LValue               { $$ = $1; }
           |    T_ReadInteger '(' ')'   
                                     { $$ = new ReadIntegerExpr(Join(@1,@3)); }
           |    T_ReadLine '(' ')'   { $$ = new ReadLineExpr(Join(@1,@3)); }
+          |    T_ReadDouble '(' ')' { $$ = new ReadDoubleExpr(Join(@1,@3)); }
           |    T_New '(' T_Identifier ')' 
                                     { $$ = new NewExpr(Join(@1,@4),new NamedType(new Identifier(@3,$3))); }
           |    T_NewArray '(' Expr ',' Type ')' 
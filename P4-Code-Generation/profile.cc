@@ -0,0 +1,141 @@
+/* File: profile.cc
+ * ----------------
+ * Implementation of the Profile class: planting counters and reading
+ * back the counts they collected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "ast.h"
+#include "codegen.h"
+#include "utility.h"
+#include "target.h"
+#include "mips.h"
+
+Profile *profile = new Profile();
+
+static const char *ProfileHead = "#dcc-profile";
+static const char *ProfileTail = "#end";
+
+Profile::Profile()
+{
+    generating = false;
+    loaded = false;
+    counters = new List<const char *>;
+}
+
+void Profile::Init()
+{
+    generating = GetOption("fprofile-generate") != NULL;
+    // only the MIPS runtime has a routine to write the counters out
+    if (generating && strcmp(TargetName(), "mips") && strcmp(TargetName(), "mips-elf"))
+    {
+        fprintf(stderr, "Warning: -fprofile-generate is ignored for the %s target\n",
+                TargetName());
+        generating = false;
+    }
+    const char *file = GetOption("fprofile-use");
+    // like a stale profile, a missing one only costs the optimizations
+    if (file && !this->Load(file))
+        fprintf(stderr, "Warning: no profile data in %s, compiling without it\n", file);
+}
+
+// The dump may be mixed with the output of the program (and the
+// statistics of the simulator), only the last one in the file is read.
+bool Profile::Load(const char *file)
+{
+    FILE *fp = fopen(file, "r");
+    if (!fp)
+        return false;
+
+    char line[1024];
+    bool inDump = false, found = false;
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (strstr(line, ProfileHead))
+        {
+            counts.clear();
+            inDump = found = true;
+        }
+        else if (inDump && !strcmp(line, ProfileTail))
+            inDump = false;
+        else if (inDump)
+        {
+            char *key = strchr(line, ' ');
+            if (!key)
+                continue;
+            counts[key + 1] = (int)strtoul(line, NULL, 10);
+        }
+    }
+    fclose(fp);
+    loaded = found;
+    if (found)
+        PrintDebug("pgo", "read %d counters from %s", (int)counts.size(), file);
+    return found;
+}
+
+const char *Profile::Key(const char *kind, yyltype *loc, const char *extra)
+{
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf), "%s", kind);
+    if (loc)
+        n += snprintf(buf + n, sizeof(buf) - n, " %d:%d", loc->first_line, loc->first_column);
+    if (extra)
+        snprintf(buf + n, sizeof(buf) - n, " %s", extra);
+    return strdup(buf);
+}
+
+void Profile::GenIncrement(const char *key)
+{
+    int slot;
+    std::map<std::string, int>::iterator it = slots.find(key);
+    if (it != slots.end())
+        slot = it->second;
+    else
+    {
+        slot = counters->NumElements();
+        slots[key] = slot;
+        counters->Append(key);
+    }
+
+    Location *table = CodeGen->GenLoadLabel(Labels::Named("_prof_counts"));
+    Location *count = CodeGen->GenLoad(table, slot * CodeGenerator::VarSize);
+    Location *bumped = CodeGen->GenBinaryOp("+", count, CodeGen->GenLoadConstant(1));
+    CodeGen->GenStore(table, bumped, slot * CodeGenerator::VarSize);
+}
+
+bool Profile::GetCount(const char *key, int *count)
+{
+    if (!loaded)
+        return false;
+    std::map<std::string, int>::iterator it = counts.find(key);
+    if (it == counts.end())
+        return false;
+    *count = it->second;
+    return true;
+}
+
+void Profile::EmitData(Mips *mips)
+{
+    int n = counters->NumElements();
+    mips->Runtime("      .data\n");
+    mips->Runtime("      .align 2\n");
+    mips->Runtime("  _prof_counts:\n");
+    mips->Runtime("      .space %d\n", n * CodeGenerator::VarSize);
+    mips->Runtime("  _prof_num: .word %d\n", n);
+    // each key is written as " key\n" right after its count
+    mips->Runtime("  _prof_keys:\n");
+    for (int i = 0; i < n; i++)
+        mips->Runtime("      .word _prof_key%d, %d\n", i, (int)strlen(counters->Nth(i)) + 2);
+    for (int i = 0; i < n; i++)
+        mips->Runtime("  _prof_key%d: .asciiz \" %s\\n\"\n", i, counters->Nth(i));
+    mips->Runtime("  _prof_head: .asciiz \"%s\\n\"\n", ProfileHead);
+    mips->Runtime("  _prof_tail: .asciiz \"%s\\n\"\n", ProfileTail);
+    mips->Runtime("  _prof_buf: .space 12\n");
+    mips->Runtime("      .text\n");
+    mips->Runtime("\n");
+}
@@ -0,0 +1,71 @@
+/* File: profile.h
+ * ---------------
+ * Support for profile-guided optimization.
+ *
+ * With -fprofile-generate the compiler plants a counter on every
+ * function entry, both arms of each if, the entry and body of each
+ * loop, each call site and, at a call through a vtable, one counter
+ * per class the receiver may have. The counters live in the data
+ * segment and _ProfileDump writes them to stderr when the program
+ * halts or main returns, one "count key" line per counter between a
+ * "#dcc-profile" and an "#end" line. The key names the kind of
+ * counter and the source position it belongs to, so a profile stays
+ * valid across builds of the same source.
+ *
+ * With -fprofile-use=file the compiler reads such a dump back and
+ * the code generator asks for the count of a key where it has a
+ * layout or speculation decision to make.
+ */
+
+#ifndef _H_profile
+#define _H_profile
+
+#include <map>
+#include <string>
+#include "list.h"
+#include "location.h"
+
+class Mips;
+
+class Profile
+{
+protected:
+  bool generating;
+  bool loaded;
+  List<const char *> *counters;     // key of counter i, at _prof_counts+4*i
+  std::map<std::string, int> slots;  // key -> counter index
+  std::map<std::string, int> counts; // read from the -fprofile-use file
+
+  bool Load(const char *file);
+
+public:
+  // a call site run at least this often is hot
+  static const int HotCount = 50;
+
+  Profile();
+
+  // reads the compiler options, to be called after ParseCommandLine
+  void Init();
+
+  bool IsGenerating() { return generating; }
+  bool IsUsing() { return loaded; }
+
+  // Builds the key "kind line:column extra", loc and extra are optional.
+  static const char *Key(const char *kind, yyltype *loc, const char *extra = NULL);
+
+  // Generates the Tac instructions that bump the counter for key.
+  // Counters with the same key are shared.
+  void GenIncrement(const char *key);
+
+  // Looks key up in the loaded profile. Returns false if the profile
+  // has no such counter, *count is left alone then.
+  bool GetCount(const char *key, int *count);
+
+  // Emits the counters and the tables _ProfileDump walks with the
+  // runtime routines.
+  void EmitData(Mips *mips);
+};
+
+extern Profile *profile;
+
+#endif
@@ -0,0 +1,229 @@
+/* File: runtime.cc
+ * ----------------
+ * Implementation of the Runtime class, the Decaf runtime routines in
+ * C++.
+ */
+
+#include "runtime.h"
+#include "utility.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <vector>
+
+static const size_t AddressSpace = (size_t)1 << 32;
+static const uint32_t NullGuard = 0x10000;
+// below the address space, so that a null pointer with a negative
+// offset (the length of a null array) faults too
+static const size_t GuardBelow = 4096;
+
+Runtime::Runtime()
+{
+    mem = NULL;
+    heapStart = heap = heapLimit = 0;
+}
+
+void Runtime::Error(const char *fmt, ...)
+{
+    va_list args;
+    fflush(stdout);
+    fprintf(stderr, "Exception: ");
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void BadAccess(int sig)
+{
+    Runtime::Error("bad memory access (null pointer?)");
+}
+
+// The handler runs on a stack of its own, as the one the program
+// was on may be the one that overflowed.
+static void CatchBadAccess()
+{
+    static char altStack[1 << 16];
+    stack_t ss;
+    memset(&ss, 0, sizeof(ss));
+    ss.ss_sp = altStack;
+    ss.ss_size = sizeof(altStack);
+    if (sigaltstack(&ss, NULL))
+        Failure("cannot set up the signal stack");
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = BadAccess;
+    sa.sa_flags = SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+uint8_t *Runtime::ReserveMemory()
+{
+    // the 8 spare bytes let a double straddle the top of the space
+    size_t size = GuardBelow + AddressSpace + 8;
+    uint8_t *base = (uint8_t *)mmap(NULL, size, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+        Failure("cannot reserve memory for the program");
+    mem = base + GuardBelow;
+    if (mprotect(mem + NullGuard, AddressSpace - NullGuard + 8, PROT_READ | PROT_WRITE))
+        Failure("cannot reserve memory for the program");
+    CatchBadAccess();
+    return mem;
+}
+
+void Runtime::ReleaseMemory()
+{
+    if (mem)
+        munmap(mem - GuardBelow, GuardBelow + AddressSpace + 8);
+    mem = NULL;
+}
+
+void Runtime::SetHeap(uint32_t start, uint32_t limit)
+{
+    heapStart = heap = start;
+    heapLimit = limit;
+}
+
+uint32_t Runtime::Allocate(int32_t size)
+{
+    uint32_t bytes = ((uint32_t)size + 7) & ~7;
+    if (size < 0 || bytes > heapLimit - heap)
+        Error("out of heap memory");
+    uint32_t block = heap;
+    heap += bytes;
+    return block;
+}
+
+uint32_t Runtime::ReadLine()
+{
+    std::vector<char> line;
+    int c;
+    fflush(stdout);
+    while ((c = getc_unlocked(stdin)) != EOF && c != '\n')
+        line.push_back(c);
+    uint32_t s = Allocate(line.size() + 5);
+    *(int32_t *)(mem + s) = line.size();
+    if (!line.empty())
+        memcpy(mem + s + 4, &line[0], line.size());
+    mem[s + 4 + line.size()] = '\0';
+    return s + 4;
+}
+
+// blanks, a sign and digits, the rest of the line is ignored
+int32_t Runtime::ReadInteger()
+{
+    uint32_t value = 0;
+    bool negative = false;
+    int state = 0, c;
+    fflush(stdout);
+    while ((c = getc_unlocked(stdin)) != EOF && c != '\n')
+    {
+        if (state == 2)
+            continue;
+        if (c >= '0' && c <= '9')
+            value = value * 10 + (c - '0'), state = 1;
+        else if (state == 0 && (c == ' ' || c == '\t'))
+            continue;
+        else if (state == 0 && (c == '+' || c == '-'))
+            negative = c == '-', state = 1;
+        else
+            state = 2;
+    }
+    return negative ? -value : value;
+}
+
+// see _ReadDouble in main.cc for the states
+double Runtime::ReadDouble()
+{
+    double digits = 0;
+    bool negative = false, negExponent = false;
+    uint32_t afterPoint = 0, exponent = 0;
+    int state = 0, c;
+    fflush(stdout);
+    while ((c = getc_unlocked(stdin)) != EOF && c != '\n')
+    {
+        if (state == 3)
+            continue;
+        if (c >= '0' && c <= '9')
+        {
+            if (state >= 4)
+                exponent = exponent * 10 + (c - '0'), state = 5;
+            else
+            {
+                digits = digits * 10 + (c - '0');
+                if (state == 2)
+                    afterPoint++;
+                else
+                    state = 1;
+            }
+        }
+        else if (c == '.')
+            state = state < 2 ? 2 : 3;
+        else if (state == 0)
+        {
+            if (c == ' ' || c == '\t')
+                continue;
+            if (c == '+' || c == '-')
+                negative = c == '-', state = 1;
+            else
+                state = 3;
+        }
+        else if ((c | 32) == 'e')
+            state = state < 3 ? 4 : 3;
+        else if (state == 4 && (c == '+' || c == '-'))
+            negExponent = c == '-', state = 5;
+        else
+            state = 3;
+    }
+    int32_t power = (negExponent ? -exponent : exponent) - afterPoint;
+    double scale = 1.0;
+    for (uint32_t i = power < 0 ? -(uint32_t)power : power; i && !isinf(scale); i--)
+        scale *= 10.0;
+    digits = power < 0 ? digits / scale : digits * scale;
+    return negative ? -digits : digits;
+}
+
+bool Runtime::StringEqual(uint32_t a, uint32_t b)
+{
+    int32_t len = *(int32_t *)(mem + a - 4);
+    return len == *(int32_t *)(mem + b - 4) && !memcmp(mem + a, mem + b, len);
+}
+
+void Runtime::PrintInt(int32_t n)
+{
+    printf("%d", n);
+}
+
+void Runtime::PrintString(uint32_t s)
+{
+    fputs((const char *)mem + s, stdout);
+}
+
+void Runtime::PrintBool(int32_t b)
+{
+    fputs(b ? "true" : "false", stdout);
+}
+
+void Runtime::PrintDouble(double d)
+{
+    printf("%.*g", 16, d);
+}
+
+void Runtime::Halt()
+{
+    fflush(stdout);
+    exit(0);
+}
+
+void Runtime::OutFlush()
+{
+    fflush(stdout);
+}
@@ -0,0 +1,53 @@
+/* File: runtime.h
+ * ---------------
+ * The Runtime class implements the Decaf runtime routines (the ones
+ * SysCallCodeGen prints in MIPS) in C++, for the two ways of running
+ * a program without the MIPS runtime: dvm and the JIT (dcc -run).
+ *
+ * It works on the program's memory, a 4GB reservation addressed by
+ * the program's 32-bit pointers, so strings and arrays are laid out
+ * as in the MIPS code. Input is parsed exactly like the MIPS runtime
+ * does it, so a program prints the same however it is run.
+ */
+
+#ifndef _H_runtime
+#define _H_runtime
+
+#include <stdint.h>
+
+class Runtime
+{
+private:
+  uint8_t *mem;
+  uint32_t heapStart, heap, heapLimit;
+
+public:
+  Runtime();
+
+  // Reserves the address space (the low 64KB stay unmapped so null
+  // pointers fault). Reports errors with Failure.
+  uint8_t *ReserveMemory();
+  void ReleaseMemory();
+  void SetHeap(uint32_t start, uint32_t limit);
+  uint8_t *GetMemory() { return mem; }
+
+  // The heap is only ever bumped, there is no collector.
+  uint32_t Allocate(int32_t size);
+  uint32_t HeapUsed() { return heap - heapStart; }
+
+  uint32_t ReadLine();
+  int32_t ReadInteger();
+  double ReadDouble();
+  bool StringEqual(uint32_t a, uint32_t b);
+  void PrintInt(int32_t n);
+  void PrintString(uint32_t s);
+  void PrintBool(int32_t b);
+  void PrintDouble(double d);
+  void Halt();
+  void OutFlush();
+
+  // Reports an error of the running program and exits with status 1.
+  static void Error(const char *fmt, ...);
+};
+
+#endif
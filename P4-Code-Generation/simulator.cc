@@ -0,0 +1,1542 @@
+/* File: simulator.cc
+ * ------------------
+ * Implementation of the Simulator class: a two-pass loader for SPIM
+ * style assembly followed by a straightforward interpreter.
+ *
+ * Each source instruction is kept as one entry even when SPIM would
+ * expand it into several machine instructions (li of a large value,
+ * la, seq, blt, ...). The entry records how many real instructions
+ * the expansion takes so addresses, instruction counts and the
+ * instruction cache see the same footprint the real assembler
+ * would produce.
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <elf.h>
+#include <algorithm>
+#include "simulator.h"
+#include "utility.h"
+
+// Operand formats (one letter per operand):
+//   d s t  integer registers     D S T  floating point registers
+//   i      immediate             h      register or immediate
+//   m      memory operand        l      label
+//   f      floating point literal
+typedef enum
+{
+    OpAdd, OpAddu, OpSub, OpSubu, OpAnd, OpOr, OpXor, OpNor,
+    OpSlt, OpSltu, OpSllv, OpSrlv, OpSrav, OpSll, OpSrl, OpSra,
+    OpAddi, OpAddiu, OpAndi, OpOri, OpXori, OpSlti, OpSltiu, OpLui,
+    OpLi, OpLa, OpMove, OpNeg, OpNegu, OpNot, OpAbs,
+    OpSeq, OpSne, OpSle, OpSleu, OpSgt, OpSgtu, OpSge, OpSgeu, OpNop,
+    OpMul, OpMult, OpMultu, OpDiv, OpDivu, OpRem, OpRemu,
+    OpMfhi, OpMflo, OpMthi, OpMtlo,
+    OpLw, OpLb, OpLbu, OpLh, OpLhu, OpLwc1, OpLd,
+    OpSw, OpSb, OpSh, OpSwc1, OpSd,
+    OpBeq, OpBne, OpBeqz, OpBnez, OpBgez, OpBgtz, OpBlez, OpBltz,
+    OpBlt, OpBgt, OpBle, OpBge, OpBltu, OpBgtu, OpBleu, OpBgeu,
+    OpBc1t, OpBc1f,
+    OpB, OpJ, OpJal, OpJr, OpJalr,
+    OpSyscall, OpBreak,
+    OpAddD, OpSubD, OpMulD, OpDivD, OpNegD, OpAbsD, OpMovD,
+    OpCeqD, OpCltD, OpCleD, OpCvtDW, OpCvtWD, OpTruncWD,
+    OpMtc1, OpMfc1, OpLiD,
+    NumOps
+} SimOp;
+
+static const struct
+{
+    const char *name;
+    const char *format;
+    int size;
+    Simulator::OpClass cls;
+} opInfo[NumOps] = {
+    {"add", "dsh", 1, Simulator::ClassAlu},
+    {"addu", "dsh", 1, Simulator::ClassAlu},
+    {"sub", "dsh", 1, Simulator::ClassAlu},
+    {"subu", "dsh", 1, Simulator::ClassAlu},
+    {"and", "dsh", 1, Simulator::ClassAlu},
+    {"or", "dsh", 1, Simulator::ClassAlu},
+    {"xor", "dsh", 1, Simulator::ClassAlu},
+    {"nor", "dsh", 1, Simulator::ClassAlu},
+    {"slt", "dsh", 1, Simulator::ClassAlu},
+    {"sltu", "dsh", 1, Simulator::ClassAlu},
+    {"sllv", "dst", 1, Simulator::ClassAlu},
+    {"srlv", "dst", 1, Simulator::ClassAlu},
+    {"srav", "dst", 1, Simulator::ClassAlu},
+    {"sll", "dsi", 1, Simulator::ClassAlu},
+    {"srl", "dsi", 1, Simulator::ClassAlu},
+    {"sra", "dsi", 1, Simulator::ClassAlu},
+    {"addi", "dsi", 1, Simulator::ClassAlu},
+    {"addiu", "dsi", 1, Simulator::ClassAlu},
+    {"andi", "dsi", 1, Simulator::ClassAlu},
+    {"ori", "dsi", 1, Simulator::ClassAlu},
+    {"xori", "dsi", 1, Simulator::ClassAlu},
+    {"slti", "dsi", 1, Simulator::ClassAlu},
+    {"sltiu", "dsi", 1, Simulator::ClassAlu},
+    {"lui", "di", 1, Simulator::ClassAlu},
+    {"li", "di", 1, Simulator::ClassAlu},
+    {"la", "dl", 2, Simulator::ClassAlu},
+    {"move", "ds", 1, Simulator::ClassAlu},
+    {"neg", "ds", 1, Simulator::ClassAlu},
+    {"negu", "ds", 1, Simulator::ClassAlu},
+    {"not", "ds", 1, Simulator::ClassAlu},
+    {"abs", "ds", 3, Simulator::ClassAlu},
+    {"seq", "dsh", 3, Simulator::ClassAlu},
+    {"sne", "dsh", 2, Simulator::ClassAlu},
+    {"sle", "dsh", 3, Simulator::ClassAlu},
+    {"sleu", "dsh", 3, Simulator::ClassAlu},
+    {"sgt", "dsh", 1, Simulator::ClassAlu},
+    {"sgtu", "dsh", 1, Simulator::ClassAlu},
+    {"sge", "dsh", 3, Simulator::ClassAlu},
+    {"sgeu", "dsh", 3, Simulator::ClassAlu},
+    {"nop", "", 1, Simulator::ClassAlu},
+    {"mul", "dsh", 1, Simulator::ClassMulDiv},
+    {"mult", "st", 1, Simulator::ClassMulDiv},
+    {"multu", "st", 1, Simulator::ClassMulDiv},
+    {"div", "dsh", 4, Simulator::ClassMulDiv},
+    {"divu", "dsh", 4, Simulator::ClassMulDiv},
+    {"rem", "dsh", 4, Simulator::ClassMulDiv},
+    {"remu", "dsh", 4, Simulator::ClassMulDiv},
+    {"mfhi", "d", 1, Simulator::ClassMulDiv},
+    {"mflo", "d", 1, Simulator::ClassMulDiv},
+    {"mthi", "s", 1, Simulator::ClassMulDiv},
+    {"mtlo", "s", 1, Simulator::ClassMulDiv},
+    {"lw", "tm", 1, Simulator::ClassLoad},
+    {"lb", "tm", 1, Simulator::ClassLoad},
+    {"lbu", "tm", 1, Simulator::ClassLoad},
+    {"lh", "tm", 1, Simulator::ClassLoad},
+    {"lhu", "tm", 1, Simulator::ClassLoad},
+    {"lwc1", "Tm", 1, Simulator::ClassLoad},
+    {"l.d", "Tm", 2, Simulator::ClassLoad},
+    {"sw", "tm", 1, Simulator::ClassStore},
+    {"sb", "tm", 1, Simulator::ClassStore},
+    {"sh", "tm", 1, Simulator::ClassStore},
+    {"swc1", "Tm", 1, Simulator::ClassStore},
+    {"s.d", "Tm", 2, Simulator::ClassStore},
+    {"beq", "shl", 1, Simulator::ClassBranch},
+    {"bne", "shl", 1, Simulator::ClassBranch},
+    {"beqz", "sl", 1, Simulator::ClassBranch},
+    {"bnez", "sl", 1, Simulator::ClassBranch},
+    {"bgez", "sl", 1, Simulator::ClassBranch},
+    {"bgtz", "sl", 1, Simulator::ClassBranch},
+    {"blez", "sl", 1, Simulator::ClassBranch},
+    {"bltz", "sl", 1, Simulator::ClassBranch},
+    {"blt", "shl", 2, Simulator::ClassBranch},
+    {"bgt", "shl", 2, Simulator::ClassBranch},
+    {"ble", "shl", 2, Simulator::ClassBranch},
+    {"bge", "shl", 2, Simulator::ClassBranch},
+    {"bltu", "shl", 2, Simulator::ClassBranch},
+    {"bgtu", "shl", 2, Simulator::ClassBranch},
+    {"bleu", "shl", 2, Simulator::ClassBranch},
+    {"bgeu", "shl", 2, Simulator::ClassBranch},
+    {"bc1t", "l", 1, Simulator::ClassBranch},
+    {"bc1f", "l", 1, Simulator::ClassBranch},
+    {"b", "l", 1, Simulator::ClassJump},
+    {"j", "l", 1, Simulator::ClassJump},
+    {"jal", "l", 1, Simulator::ClassJump},
+    {"jr", "s", 1, Simulator::ClassJump},
+    {"jalr", "s", 1, Simulator::ClassJump},
+    {"syscall", "", 1, Simulator::ClassSyscall},
+    {"break", "i", 1, Simulator::ClassSyscall},
+    {"add.d", "DST", 1, Simulator::ClassFloat},
+    {"sub.d", "DST", 1, Simulator::ClassFloat},
+    {"mul.d", "DST", 1, Simulator::ClassFloat},
+    {"div.d", "DST", 1, Simulator::ClassFloat},
+    {"neg.d", "DS", 1, Simulator::ClassFloat},
+    {"abs.d", "DS", 1, Simulator::ClassFloat},
+    {"mov.d", "DS", 1, Simulator::ClassFloat},
+    {"c.eq.d", "ST", 1, Simulator::ClassFloat},
+    {"c.lt.d", "ST", 1, Simulator::ClassFloat},
+    {"c.le.d", "ST", 1, Simulator::ClassFloat},
+    {"cvt.d.w", "DS", 1, Simulator::ClassFloat},
+    {"cvt.w.d", "DS", 1, Simulator::ClassFloat},
+    {"trunc.w.d", "DS", 1, Simulator::ClassFloat},
+    {"mtc1", "tS", 1, Simulator::ClassFloat},
+    {"mfc1", "tS", 1, Simulator::ClassFloat},
+    {"li.d", "Df", 4, Simulator::ClassFloat},
+};
+
+// Extra cycles charged on top of one cycle per real instruction
+static const int MulLatency = 4, DivLatency = 34, FloatLatency = 3;
+
+static const char *const regNames[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+
+static const char *const className[Simulator::NumClasses] = {
+    "alu", "mul/div", "loads", "stores", "branches", "jumps", "syscalls", "float"};
+
+static char *Trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1]))
+        *--e = '\0';
+    return s;
+}
+
+Simulator::Simulator()
+{
+    icache = dcache = NULL;
+    missPenalty = 20;
+    instrLimit = 0;
+    realInstrs = extraCycles = 0;
+    for (int i = 0; i < NumClasses; i++)
+        classCounts[i] = 0;
+    lastPage = NULL;
+    lastPageNum = 0;
+    halted = false;
+    exitCode = 0;
+    fileName = "";
+    curLine = 0;
+    image = false;
+    curSourceLine = 0;
+    profiling = false;
+}
+
+void Simulator::LoadError(const char *fmt, ...)
+{
+    va_list args;
+    char buf[1024];
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (image)
+        Failure("%s: 0x%08x: %s", fileName, curLine, buf);
+    Failure("%s:%d: %s", fileName, curLine, buf);
+}
+
+void Simulator::RuntimeError(const char *fmt, ...)
+{
+    va_list args;
+    fflush(stdout);
+    if (image)
+        fprintf(stderr, "Exception at 0x%08x of %s: ", curLine, fileName);
+    else
+        fprintf(stderr, "Exception at line %d of %s: ", curLine, fileName);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    halted = true;
+    exitCode = 1;
+}
+
+/* Method: Load
+ * ------------
+ * First pass over the file: every line is parsed into text entries
+ * or static data bytes, and label addresses are recorded. Labels are
+ * resolved once the whole file has been seen.
+ */
+void Simulator::Load(FILE *fp, const char *name)
+{
+    char line[4096];
+    bool inText = true;
+    fileName = name;
+    curLine = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        curLine++;
+        ParseLine(line, &inText);
+    }
+    Resolve();
+}
+
+// A line table record, "n: text" or "0", makes n the source line of
+// the instructions that follow.
+void Simulator::ReadLineRecord(const char *record)
+{
+    char *rest;
+    curSourceLine = strtol(record, &rest, 10);
+    if (curSourceLine < 0 || (*rest != ':' && *rest != '\0' && !isspace((unsigned char)*rest)))
+        LoadError("bad line table record");
+    if (curSourceLine && *rest == ':' && !sourceText.count(curSourceLine))
+    {
+        std::string text(rest + 1 + (rest[1] == ' '));
+        text.erase(text.find_last_not_of("\r\n") + 1);
+        sourceText[curSourceLine] = text;
+    }
+}
+
+// Addresses of text entries are assigned as they are parsed
+static unsigned int nextTextAddr = Simulator::TextBase;
+// Data labels seen since the last data item, aligned with the next item
+static std::vector<std::string> pendingDataLabels;
+
+void Simulator::ParseLine(char *line, bool *inText)
+{
+    if (!strncmp(line, "#line ", 6))
+    {
+        ReadLineRecord(line + 6);
+        return;
+    }
+    // strip comment, respecting string literals
+    bool inString = false;
+    for (char *p = line; *p; p++)
+    {
+        if (*p == '\\' && inString && p[1])
+            p++;
+        else if (*p == '"')
+            inString = !inString;
+        else if (*p == '#' && !inString)
+        {
+            *p = '\0';
+            break;
+        }
+    }
+    char *s = Trim(line);
+
+    // any number of leading labels
+    for (;;)
+    {
+        char *colon = s;
+        while (*colon && (isalnum((unsigned char)*colon) || *colon == '_' || *colon == '.' || *colon == '$'))
+            colon++;
+        if (colon == s || *colon != ':')
+            break;
+        *colon = '\0';
+        std::string label(s);
+        if (symbols.count(label))
+            LoadError("label '%s' defined twice", s);
+        if (*inText)
+            symbols[label] = nextTextAddr;
+        else
+        {
+            symbols[label] = DataBase + data.size();
+            pendingDataLabels.push_back(label);
+        }
+        s = Trim(colon + 1);
+    }
+    if (*s == '\0')
+        return;
+
+    char *args = s;
+    while (*args && !isspace((unsigned char)*args))
+        args++;
+    if (*args)
+        *args++ = '\0';
+    args = Trim(args);
+
+    if (*s == '.')
+        ParseDirective(s, args, inText);
+    else if (!*inText)
+        LoadError("instruction '%s' in data segment", s);
+    else
+        ParseInstruction(s, args);
+}
+
+static void Align(std::vector<unsigned char> &data, int bytes)
+{
+    while (data.size() % bytes)
+        data.push_back(0);
+}
+
+static void AlignPending(std::vector<unsigned char> &data, int bytes,
+                         std::map<std::string, unsigned int> &symbols)
+{
+    Align(data, bytes);
+    for (size_t i = 0; i < pendingDataLabels.size(); i++)
+        symbols[pendingDataLabels[i]] = Simulator::DataBase + data.size();
+    pendingDataLabels.clear();
+}
+
+void Simulator::ParseDirective(char *dir, char *args, bool *inText)
+{
+    if (!strcmp(dir, ".text"))
+        *inText = true;
+    else if (!strcmp(dir, ".data"))
+        *inText = false;
+    else if (!strcmp(dir, ".globl") || !strcmp(dir, ".ent") || !strcmp(dir, ".end"))
+        ;
+    else if (!strcmp(dir, ".align"))
+    {
+        if (!*inText)
+            AlignPending(data, 1 << atoi(args), symbols);
+    }
+    else if (*inText)
+        LoadError("data directive '%s' in text segment", dir);
+    else if (!strcmp(dir, ".asciiz") || !strcmp(dir, ".ascii"))
+    {
+        AlignPending(data, 1, symbols);
+        char *p = args;
+        if (*p != '"')
+            LoadError("expected string literal after %s", dir);
+        for (p++; *p && *p != '"'; p++)
+        {
+            char c = *p;
+            if (c == '\\')
+            {
+                switch (*++p)
+                {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                case '\0': LoadError("unterminated string"); break;
+                default: c = *p;
+                }
+            }
+            data.push_back(c);
+        }
+        if (*p != '"')
+            LoadError("unterminated string");
+        if (!strcmp(dir, ".asciiz"))
+            data.push_back(0);
+    }
+    else if (!strcmp(dir, ".space"))
+    {
+        AlignPending(data, 1, symbols);
+        int n = atoi(args);
+        for (int i = 0; i < n; i++)
+            data.push_back(0);
+    }
+    else if (!strcmp(dir, ".word") || !strcmp(dir, ".half") || !strcmp(dir, ".byte"))
+    {
+        int size = dir[1] == 'w' ? 4 : dir[1] == 'h' ? 2 : 1;
+        AlignPending(data, size, symbols);
+        for (char *item = strtok(args, ", \t"); item; item = strtok(NULL, ", \t"))
+        {
+            unsigned int val = 0;
+            if (isdigit((unsigned char)*item) || *item == '-')
+                val = strtol(item, NULL, 0);
+            else
+            {
+                Fixup f = {(unsigned int)data.size(), item, curLine};
+                dataFixups.push_back(f);
+            }
+            for (int i = 0; i < size; i++)
+                data.push_back((val >> (8 * i)) & 0xff);
+        }
+    }
+    else if (!strcmp(dir, ".double"))
+    {
+        AlignPending(data, 8, symbols);
+        for (char *item = strtok(args, ", \t"); item; item = strtok(NULL, ", \t"))
+        {
+            double d = atof(item);
+            unsigned char bytes[8];
+            memcpy(bytes, &d, 8);
+            for (int i = 0; i < 8; i++)
+                data.push_back(bytes[i]);
+        }
+    }
+    else
+        LoadError("unknown directive '%s'", dir);
+}
+
+static int RegisterNumber(const char *s, bool fp)
+{
+    if (*s != '$')
+        return -1;
+    s++;
+    if (fp)
+    {
+        if (*s != 'f' || !isdigit((unsigned char)s[1]))
+            return -1;
+        int n = atoi(s + 1);
+        return n < 32 ? n : -1;
+    }
+    if (isdigit((unsigned char)*s))
+    {
+        int n = atoi(s);
+        return n < 32 ? n : -1;
+    }
+    if (!strcmp(s, "s8"))
+        return 30;
+    for (int i = 0; i < 32; i++)
+        if (!strcmp(s, regNames[i]))
+            return i;
+    return -1;
+}
+
+static bool ParseImmediate(const char *s, int *val)
+{
+    char *end;
+    if (!*s)
+        return false;
+    long v = strtol(s, &end, 0);
+    if (*end)
+        return false;
+    *val = (int)v;
+    return true;
+}
+
+void Simulator::ParseInstruction(char *mnemonic, char *args)
+{
+    int op;
+    for (op = 0; op < NumOps; op++)
+        if (!strcmp(opInfo[op].name, mnemonic))
+            break;
+    if (op == NumOps)
+    {
+        LoadError("unknown instruction '%s'", mnemonic);
+        return;
+    }
+
+    Instr in;
+    in.op = op;
+    in.rd = in.rs = in.rt = 0;
+    in.imm = 0;
+    in.fimm = 0;
+    in.hasImm = false;
+    in.target = -1;
+    in.size = opInfo[op].size;
+    in.srcLine = curLine;
+    in.line = curSourceLine;
+
+    std::vector<char *> operands;
+    for (char *p = strtok(args, ","); p; p = strtok(NULL, ","))
+        operands.push_back(Trim(p));
+
+    const char *format = opInfo[op].format;
+    // a few mnemonics have optional forms
+    if ((op == OpDiv || op == OpDivu) && operands.size() == 2)
+    {
+        format = "st";
+        in.size = 1;
+    }
+    if (op == OpJ && operands.size() == 1 && operands[0][0] == '$')
+    {
+        op = in.op = OpJr; // SPIM accepts "j $ra" for "jr $ra"
+        format = opInfo[op].format;
+    }
+    if (op == OpJalr && operands.size() == 2)
+        format = "ds";
+    if (op == OpJalr && operands.size() == 1)
+        in.rd = 31;
+
+    if (operands.size() != strlen(format))
+        LoadError("wrong number of operands for '%s'", mnemonic);
+
+    for (size_t i = 0; i < operands.size(); i++)
+    {
+        char *arg = operands[i];
+        int reg;
+        switch (format[i])
+        {
+        case 'd': case 's': case 't':
+        case 'D': case 'S': case 'T':
+            reg = RegisterNumber(arg, isupper(format[i]));
+            if (reg < 0)
+                LoadError("bad register '%s'", arg);
+            if (tolower(format[i]) == 'd')
+                in.rd = reg;
+            else if (tolower(format[i]) == 's')
+                in.rs = reg;
+            else
+                in.rt = reg;
+            break;
+        case 'h':
+            if ((reg = RegisterNumber(arg, false)) >= 0)
+                in.rt = reg;
+            else if (ParseImmediate(arg, &in.imm))
+                in.hasImm = true;
+            else
+                LoadError("bad operand '%s'", arg);
+            break;
+        case 'i':
+            if (!ParseImmediate(arg, &in.imm))
+                LoadError("bad immediate '%s'", arg);
+            in.hasImm = true;
+            break;
+        case 'f':
+            in.fimm = atof(arg);
+            break;
+        case 'l':
+            in.label = arg;
+            break;
+        case 'm':
+        {
+            // off($reg), ($reg), label or label+off
+            char *paren = strchr(arg, '(');
+            if (paren)
+            {
+                char *close = strchr(paren, ')');
+                if (!close)
+                    LoadError("bad memory operand '%s'", arg);
+                *close = '\0';
+                *paren = '\0';
+                reg = RegisterNumber(Trim(paren + 1), false);
+                if (reg < 0)
+                    LoadError("bad base register in '%s'", arg);
+                in.rs = reg;
+                char *off = Trim(arg);
+                if (*off && !ParseImmediate(off, &in.imm))
+                    LoadError("bad offset '%s'", off);
+            }
+            else
+            {
+                char *plus = strchr(arg, '+');
+                if (plus)
+                {
+                    *plus = '\0';
+                    if (!ParseImmediate(Trim(plus + 1), &in.imm))
+                        LoadError("bad offset in '%s'", arg);
+                }
+                in.label = Trim(arg);
+                in.size++; // needs lui to form the address
+            }
+            break;
+        }
+        }
+    }
+
+    if (op == OpLi && (in.imm < -32768 || in.imm > 65535))
+        in.size = 2;
+    if ((op == OpAddi || op == OpAddiu || op == OpAdd || op == OpAddu || op == OpSub || op == OpSubu) &&
+        in.hasImm && (in.imm < -32768 || in.imm > 32767))
+        in.size += 2;
+
+    in.addr = nextTextAddr;
+    nextTextAddr += 4 * in.size;
+    textIndex[in.addr] = text.size();
+    text.push_back(in);
+}
+
+void Simulator::Resolve()
+{
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        Instr &in = text[i];
+        curLine = in.srcLine;
+        if (in.label.empty())
+            continue;
+        std::map<std::string, unsigned int>::iterator it = symbols.find(in.label);
+        if (it == symbols.end())
+            LoadError("undefined label '%s'", in.label.c_str());
+        if (opInfo[in.op].cls == ClassBranch || opInfo[in.op].cls == ClassJump)
+        {
+            std::unordered_map<unsigned int, int>::iterator t = textIndex.find(it->second);
+            if (t == textIndex.end())
+            {
+                if (it->second != nextTextAddr)
+                    LoadError("branch to data label '%s'", in.label.c_str());
+                in.target = text.size(); // falls off the end of text
+            }
+            else
+                in.target = t->second;
+        }
+        else
+            in.imm += it->second;
+    }
+    for (size_t i = 0; i < dataFixups.size(); i++)
+    {
+        curLine = dataFixups[i].srcLine;
+        std::map<std::string, unsigned int>::iterator it = symbols.find(dataFixups[i].label);
+        if (it == symbols.end())
+            LoadError("undefined label '%s'", dataFixups[i].label.c_str());
+        for (int b = 0; b < 4; b++)
+            data[dataFixups[i].offset + b] = (it->second >> (8 * b)) & 0xff;
+    }
+}
+
+static unsigned int Get16(const std::vector<unsigned char> &file, unsigned int at)
+{
+    return file[at] | file[at + 1] << 8;
+}
+
+static unsigned int Get32(const std::vector<unsigned char> &file, unsigned int at)
+{
+    return Get16(file, at) | Get16(file, at + 2) << 16;
+}
+
+/* Method: LoadImage
+ * -----------------
+ * Loads a little-endian MIPS ELF32 executable. The executable segment
+ * is the text, decoded word by word, the other one the static data,
+ * and the symbol table names the labels. Branch targets are kept as
+ * addresses while decoding and turned into text indices at the end.
+ */
+void Simulator::LoadImage(FILE *fp, const char *name)
+{
+    fileName = name;
+    curLine = 0;
+    image = true;
+    std::vector<unsigned char> file;
+    unsigned char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        file.insert(file.end(), buf, buf + n);
+    if (file.size() < sizeof(Elf32_Ehdr) || memcmp(&file[0], ELFMAG, SELFMAG) ||
+        file[EI_CLASS] != ELFCLASS32 || file[EI_DATA] != ELFDATA2LSB ||
+        Get16(file, 18) != EM_MIPS)
+        LoadError("not a little-endian MIPS ELF32 image");
+
+    unsigned int phoff = Get32(file, 28), shoff = Get32(file, 32);
+    unsigned int phnum = Get16(file, 44), shnum = Get16(file, 48);
+    if (phoff + 32 * phnum > file.size() || shoff + 40 * shnum > file.size())
+        LoadError("headers past the end of the file");
+    for (unsigned int i = 0; i < phnum; i++)
+    {
+        unsigned int ph = phoff + 32 * i;
+        if (Get32(file, ph) != PT_LOAD)
+            continue;
+        unsigned int offset = Get32(file, ph + 4), vaddr = Get32(file, ph + 8);
+        unsigned int filesz = Get32(file, ph + 16), memsz = Get32(file, ph + 20);
+        if (offset + filesz > file.size() || filesz > memsz)
+            LoadError("bad segment");
+        if (Get32(file, ph + 24) & PF_X)
+        {
+            if (vaddr != TextBase || !text.empty())
+                LoadError("the text has to be one segment at 0x%08x", TextBase);
+            for (unsigned int at = 0; at + 4 <= filesz; at += 4)
+                Decode(Get32(file, offset + at), vaddr + at);
+        }
+        else
+        {
+            if (vaddr != DataBase || !data.empty())
+                LoadError("the data has to be one segment at 0x%08x", DataBase);
+            data.assign(file.begin() + offset, file.begin() + offset + filesz);
+            data.resize(memsz, 0);
+        }
+    }
+
+    unsigned int shstrndx = Get16(file, 50);
+    std::vector<std::string> lineRecords;
+    for (unsigned int i = 0; i < shnum; i++)
+    {
+        unsigned int sh = shoff + 40 * i;
+        if (Get32(file, sh + 4) == SHT_PROGBITS && shstrndx < shnum)
+        {
+            // the line table of dcc -g, "address n: text" per line
+            unsigned int names = Get32(file, shoff + 40 * shstrndx + 16);
+            unsigned int offset = Get32(file, sh + 16), size = Get32(file, sh + 20);
+            if (names + Get32(file, sh) + 11 > file.size() ||
+                strcmp((const char *)&file[names + Get32(file, sh)], ".dcc.lines"))
+                continue;
+            if (offset + size > file.size())
+                LoadError("bad line table");
+            std::string table(file.begin() + offset, file.begin() + offset + size);
+            for (size_t at = 0, end; at < table.size(); at = end + 1)
+            {
+                end = table.find('\n', at);
+                if (end == std::string::npos)
+                    end = table.size();
+                lineRecords.push_back(table.substr(at, end - at));
+            }
+            continue;
+        }
+        if (Get32(file, sh + 4) != SHT_SYMTAB)
+            continue;
+        unsigned int link = Get32(file, sh + 24);
+        if (link >= shnum)
+            LoadError("bad symbol table");
+        unsigned int strtab = Get32(file, shoff + 40 * link + 16);
+        unsigned int strsize = Get32(file, shoff + 40 * link + 20);
+        unsigned int offset = Get32(file, sh + 16), size = Get32(file, sh + 20);
+        if (offset + size > file.size() || strtab + strsize > file.size())
+            LoadError("bad symbol table");
+        for (unsigned int sym = offset + 16; sym + 16 <= offset + size; sym += 16)
+        {
+            unsigned int nameAt = Get32(file, sym);
+            if (nameAt == 0 || nameAt >= strsize)
+                continue;
+            const char *start = (const char *)&file[strtab + nameAt];
+            symbols[std::string(start, strnlen(start, strsize - nameAt))] = Get32(file, sym + 4);
+        }
+    }
+
+    size_t next = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        while (next < lineRecords.size() &&
+               strtoul(lineRecords[next].c_str(), NULL, 16) <= text[i].addr)
+        {
+            const char *record = lineRecords[next++].c_str();
+            ReadLineRecord(record + strcspn(record, " "));
+        }
+        text[i].line = curSourceLine;
+    }
+
+    unsigned int end = TextBase + 4 * text.size();
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        Instr &in = text[i];
+        OpClass cls = opInfo[in.op].cls;
+        if ((cls != ClassBranch && cls != ClassJump) || in.op == OpJr || in.op == OpJalr)
+            continue;
+        curLine = in.srcLine;
+        std::unordered_map<unsigned int, int>::iterator t = textIndex.find(in.imm);
+        if (t != textIndex.end())
+            in.target = t->second;
+        else if ((unsigned int)in.imm == end)
+            in.target = text.size(); // falls off the end of text
+        else
+            LoadError("branch to 0x%08x outside the text", in.imm);
+        in.imm = 0;
+    }
+}
+
+/* Method: Decode
+ * --------------
+ * Appends the text entry for one machine instruction, with the
+ * operands where Run expects them for the assembly form.
+ */
+void Simulator::Decode(unsigned int word, unsigned int addr)
+{
+    Instr in;
+    in.op = -1;
+    in.rd = in.rs = in.rt = 0;
+    in.imm = 0;
+    in.fimm = 0;
+    in.hasImm = false;
+    in.target = -1;
+    in.addr = addr;
+    in.size = 1;
+    in.srcLine = addr;
+    in.line = 0;
+    curLine = addr;
+
+    int opcode = word >> 26, rs = word >> 21 & 31, rt = word >> 16 & 31;
+    int rd = word >> 11 & 31, shamt = word >> 6 & 31, funct = word & 63;
+    int simm = (short)(word & 0xffff), uimm = word & 0xffff;
+    unsigned int branch = addr + 4 + 4 * simm;
+    switch (opcode)
+    {
+    case 0x00:
+        in.rd = rd;
+        in.rs = rs;
+        in.rt = rt;
+        switch (funct)
+        {
+        case 0x00: in.op = OpSll; break;
+        case 0x02: in.op = OpSrl; break;
+        case 0x03: in.op = OpSra; break;
+        case 0x04: in.op = OpSllv; break;
+        case 0x06: in.op = OpSrlv; break;
+        case 0x07: in.op = OpSrav; break;
+        case 0x08: in.op = OpJr; break;
+        case 0x09: in.op = OpJalr; break;
+        case 0x0c: in.op = OpSyscall; break;
+        case 0x0d: in.op = OpBreak; in.imm = word >> 16 & 0x3ff; break;
+        case 0x10: in.op = OpMfhi; break;
+        case 0x11: in.op = OpMthi; break;
+        case 0x12: in.op = OpMflo; break;
+        case 0x13: in.op = OpMtlo; break;
+        case 0x18: in.op = OpMult; break;
+        case 0x19: in.op = OpMultu; break;
+        case 0x1a: in.op = OpDiv; break;
+        case 0x1b: in.op = OpDivu; break;
+        case 0x20: in.op = OpAdd; break;
+        case 0x21: in.op = OpAddu; break;
+        case 0x22: in.op = OpSub; break;
+        case 0x23: in.op = OpSubu; break;
+        case 0x24: in.op = OpAnd; break;
+        case 0x25: in.op = OpOr; break;
+        case 0x26: in.op = OpXor; break;
+        case 0x27: in.op = OpNor; break;
+        case 0x2a: in.op = OpSlt; break;
+        case 0x2b: in.op = OpSltu; break;
+        }
+        // the shifts take the value in rt, and by a register the
+        // amount in rs
+        if (in.op == OpSll || in.op == OpSrl || in.op == OpSra)
+        {
+            in.rs = rt;
+            in.imm = shamt;
+        }
+        else if (in.op == OpSllv || in.op == OpSrlv || in.op == OpSrav)
+        {
+            in.rs = rt;
+            in.rt = rs;
+        }
+        break;
+    case 0x1c:
+        if (funct == 0x02)
+        {
+            in.op = OpMul;
+            in.rd = rd;
+            in.rs = rs;
+            in.rt = rt;
+        }
+        break;
+    case 0x01:
+        if (rt <= 1)
+            in.op = rt ? OpBgez : OpBltz;
+        in.rs = rs;
+        in.imm = branch;
+        break;
+    case 0x02:
+    case 0x03:
+        in.op = opcode == 0x02 ? OpJ : OpJal;
+        in.imm = ((addr + 4) & 0xf0000000) | (word & 0x3ffffff) << 2;
+        break;
+    case 0x04: case 0x05: case 0x06: case 0x07:
+        in.op = opcode == 0x04 ? OpBeq : opcode == 0x05 ? OpBne : opcode == 0x06 ? OpBlez : OpBgtz;
+        in.rs = rs;
+        in.rt = rt;
+        in.imm = branch;
+        break;
+    case 0x08: case 0x09: case 0x0a: case 0x0b:
+    case 0x0c: case 0x0d: case 0x0e: case 0x0f:
+    {
+        static const int immOps[] = {OpAddi, OpAddiu, OpSlti, OpSltiu, OpAndi, OpOri, OpXori, OpLui};
+        in.op = immOps[opcode - 0x08];
+        in.rd = rt;
+        in.rs = rs;
+        // the logical ones zero-extend
+        in.imm = opcode >= 0x0c ? uimm : simm;
+        in.hasImm = true;
+        break;
+    }
+    case 0x20: in.op = OpLb; break;
+    case 0x21: in.op = OpLh; break;
+    case 0x23: in.op = OpLw; break;
+    case 0x24: in.op = OpLbu; break;
+    case 0x25: in.op = OpLhu; break;
+    case 0x28: in.op = OpSb; break;
+    case 0x29: in.op = OpSh; break;
+    case 0x2b: in.op = OpSw; break;
+    case 0x31: in.op = OpLwc1; break;
+    case 0x39: in.op = OpSwc1; break;
+    case 0x11:
+        // fmt in rs, then ft, fs and fd
+        if (rs == 0x00 || rs == 0x04)
+        {
+            in.op = rs ? OpMtc1 : OpMfc1;
+            in.rt = rt;
+            in.rs = rd;
+        }
+        else if (rs == 0x08)
+        {
+            in.op = rt & 1 ? OpBc1t : OpBc1f;
+            in.imm = branch;
+        }
+        else if (rs == 0x11 || (rs == 0x14 && funct == 0x21))
+        {
+            in.rd = shamt;
+            in.rs = rd;
+            in.rt = rt;
+            switch (rs == 0x14 ? -1 : funct)
+            {
+            case -1: in.op = OpCvtDW; break;
+            case 0x00: in.op = OpAddD; break;
+            case 0x01: in.op = OpSubD; break;
+            case 0x02: in.op = OpMulD; break;
+            case 0x03: in.op = OpDivD; break;
+            case 0x05: in.op = OpAbsD; break;
+            case 0x06: in.op = OpMovD; break;
+            case 0x07: in.op = OpNegD; break;
+            case 0x0d: in.op = OpTruncWD; break;
+            case 0x24: in.op = OpCvtWD; break;
+            case 0x32: in.op = OpCeqD; break;
+            case 0x3c: in.op = OpCltD; break;
+            case 0x3e: in.op = OpCleD; break;
+            }
+        }
+        break;
+    }
+    if (opcode >= 0x20)
+    {
+        in.rt = rt;
+        in.rs = rs;
+        in.imm = simm;
+    }
+    if (in.op < 0)
+        LoadError("unknown instruction word 0x%08x", word);
+    textIndex[addr] = text.size();
+    text.push_back(in);
+}
+
+unsigned char *Simulator::PageFor(unsigned int addr)
+{
+    unsigned int num = addr >> 12;
+    if (lastPage && num == lastPageNum)
+        return lastPage;
+    std::unordered_map<unsigned int, unsigned char *>::iterator it = pages.find(num);
+    unsigned char *page;
+    if (it == pages.end())
+    {
+        page = (unsigned char *)calloc(4096, 1);
+        pages[num] = page;
+    }
+    else
+        page = it->second;
+    lastPage = page;
+    lastPageNum = num;
+    return page;
+}
+
+void Simulator::DataAccess(unsigned int addr)
+{
+    if (dcache && !dcache->Access(addr))
+        extraCycles += missPenalty;
+}
+
+unsigned int Simulator::ReadWord(unsigned int addr)
+{
+    unsigned char *p = PageFor(addr) + (addr & 0xfff);
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+void Simulator::WriteWord(unsigned int addr, unsigned int val)
+{
+    unsigned char *p = PageFor(addr) + (addr & 0xfff);
+    p[0] = val;
+    p[1] = val >> 8;
+    p[2] = val >> 16;
+    p[3] = val >> 24;
+}
+
+unsigned char Simulator::ReadByte(unsigned int addr)
+{
+    return PageFor(addr)[addr & 0xfff];
+}
+
+void Simulator::WriteByte(unsigned int addr, unsigned char val)
+{
+    PageFor(addr)[addr & 0xfff] = val;
+}
+
+double Simulator::GetDouble(int reg)
+{
+    unsigned long long bits = fregs[reg] | ((unsigned long long)fregs[reg + 1] << 32);
+    double d;
+    memcpy(&d, &bits, 8);
+    return d;
+}
+
+void Simulator::SetDouble(int reg, double d)
+{
+    unsigned long long bits;
+    memcpy(&bits, &d, 8);
+    fregs[reg] = (unsigned int)bits;
+    fregs[reg + 1] = (unsigned int)(bits >> 32);
+}
+
+void Simulator::LoadStaticData()
+{
+    for (size_t i = 0; i < data.size(); i++)
+        WriteByte(DataBase + i, data[i]);
+    heapEnd = (DataBase + data.size() + 4095) & ~4095u;
+}
+
+/* Method: DoSyscall
+ * -----------------
+ * Implements the SPIM syscalls. Input is read through stdio so that
+ * line-oriented reads (5, 8) and block reads (14) share one buffer.
+ */
+void Simulator::DoSyscall()
+{
+    int code = regs[2];
+    int a0 = regs[4], a1 = regs[5], a2 = regs[6];
+    char buf[64];
+    switch (code)
+    {
+    case 1: // print_int
+        printf("%d", a0);
+        break;
+    case 3: // print_double
+        printf("%.*g", 16, GetDouble(12));
+        break;
+    case 4: // print_string
+        for (unsigned int p = a0; ReadByte(p); p++)
+            putchar(ReadByte(p));
+        break;
+    case 5: // read_int
+        fflush(stdout);
+        regs[2] = fgets(buf, sizeof(buf), stdin) ? atoi(buf) : 0;
+        if (buf[0] && buf[strlen(buf) - 1] != '\n')
+        {
+            int c; // discard the rest of an overlong line
+            while ((c = getchar()) != EOF && c != '\n')
+                ;
+        }
+        break;
+    case 7: // read_double
+        fflush(stdout);
+        SetDouble(0, fgets(buf, sizeof(buf), stdin) ? atof(buf) : 0.0);
+        break;
+    case 8: // read_string
+    {
+        fflush(stdout);
+        int i = 0;
+        while (i < a1 - 1)
+        {
+            int c = getchar();
+            if (c == EOF)
+                break;
+            WriteByte(a0 + i++, c);
+            if (c == '\n')
+                break;
+        }
+        if (a1 > 0)
+            WriteByte(a0 + i, 0);
+        break;
+    }
+    case 9: // sbrk, fails when the heap would run into the stack
+    {
+        unsigned long long end = heapEnd + (((unsigned long long)(unsigned int)a0 + 3) & ~3ull);
+        if (end > (unsigned int)regs[29])
+        {
+            regs[2] = -1;
+            break;
+        }
+        regs[2] = heapEnd;
+        heapEnd = end;
+        break;
+    }
+    case 10: // exit
+        halted = true;
+        break;
+    case 11: // print_char
+        putchar(a0);
+        break;
+    case 12: // read_char
+    {
+        fflush(stdout);
+        int c = getchar();
+        regs[2] = c == EOF ? 0 : c;
+        break;
+    }
+    case 13: // open: only the standard streams are available
+        regs[2] = -1;
+        break;
+    case 14: // read, line at a time like a terminal
+    {
+        if (a0 != 0)
+        {
+            regs[2] = -1;
+            break;
+        }
+        fflush(stdout);
+        int i = 0;
+        while (i < a2)
+        {
+            int c = getchar();
+            if (c == EOF)
+                break;
+            WriteByte(a1 + i++, c);
+            if (c == '\n')
+                break;
+        }
+        regs[2] = i;
+        break;
+    }
+    case 15: // write
+    {
+        FILE *out = a0 == 1 ? stdout : a0 == 2 ? stderr : NULL;
+        if (!out)
+        {
+            regs[2] = -1;
+            break;
+        }
+        // the two share the console, what went to stdout comes first
+        if (out == stderr)
+            fflush(stdout);
+        for (int i = 0; i < a2; i++)
+            putc(ReadByte(a1 + i), out);
+        regs[2] = a2;
+        break;
+    }
+    case 16: // close
+        regs[2] = 0;
+        break;
+    case 17: // exit2
+        halted = true;
+        exitCode = a0;
+        break;
+    default:
+        RuntimeError("unknown syscall %d", code);
+    }
+}
+
+int Simulator::Run(const char *entry)
+{
+    std::map<std::string, unsigned int>::iterator it = symbols.find(entry);
+    if (it == symbols.end() || !textIndex.count(it->second))
+        Failure("%s: no text label '%s' to start from", fileName, entry);
+
+    LoadStaticData();
+    memset(regs, 0, sizeof(regs));
+    memset(fregs, 0, sizeof(fregs));
+    hi = lo = 0;
+    fpCond = false;
+    regs[28] = GlobalPointer;
+    regs[29] = StackTop;
+    regs[30] = StackTop;
+    regs[31] = 0; // returning to address 0 ends the program
+
+    int pc = textIndex[it->second];
+    long long executed = 0;
+    if (profiling)
+        profileCounts.assign(text.size(), 0);
+    while (!halted)
+    {
+        if (pc < 0 || pc >= (int)text.size())
+        {
+            RuntimeError("pc fell outside the text segment");
+            break;
+        }
+        Instr &in = text[pc];
+        curLine = in.srcLine;
+        int next = pc + 1;
+        OpClass cls = opInfo[in.op].cls;
+        classCounts[cls]++;
+        realInstrs += in.size;
+        if (profiling)
+            profileCounts[pc] += in.size;
+        if (icache)
+            for (int i = 0; i < in.size; i++)
+                if (!icache->Access(in.addr + 4 * i))
+                    extraCycles += missPenalty;
+        if (instrLimit && ++executed > instrLimit)
+        {
+            RuntimeError("instruction limit of %lld reached", instrLimit);
+            break;
+        }
+
+        int s = regs[in.rs];
+        int t = in.hasImm ? in.imm : regs[in.rt];
+        unsigned int us = s, ut = t;
+        int result = 0;
+        bool writes = true;
+        unsigned int addr = in.label.empty() || cls == ClassBranch || cls == ClassJump ? s + in.imm : in.imm;
+
+        switch (in.op)
+        {
+        case OpAdd: case OpAddu: case OpAddi: case OpAddiu: result = s + t; break;
+        case OpSub: case OpSubu: result = s - t; break;
+        case OpAnd: case OpAndi: result = s & t; break;
+        case OpOr: case OpOri: result = s | t; break;
+        case OpXor: case OpXori: result = s ^ t; break;
+        case OpNor: result = ~(s | t); break;
+        case OpSlt: case OpSlti: result = s < t; break;
+        case OpSltu: case OpSltiu: result = us < ut; break;
+        case OpSllv: result = regs[in.rs] << (regs[in.rt] & 31); break;
+        case OpSrlv: result = (unsigned int)regs[in.rs] >> (regs[in.rt] & 31); break;
+        case OpSrav: result = regs[in.rs] >> (regs[in.rt] & 31); break;
+        case OpSll: result = s << (in.imm & 31); break;
+        case OpSrl: result = us >> (in.imm & 31); break;
+        case OpSra: result = s >> (in.imm & 31); break;
+        case OpLui: result = in.imm << 16; break;
+        case OpLi: result = in.imm; break;
+        case OpLa: result = addr; break;
+        case OpMove: result = s; break;
+        case OpNeg: case OpNegu: result = -s; break;
+        case OpNot: result = ~s; break;
+        case OpAbs: result = s < 0 ? -s : s; break;
+        case OpSeq: result = s == t; break;
+        case OpSne: result = s != t; break;
+        case OpSle: result = s <= t; break;
+        case OpSleu: result = us <= ut; break;
+        case OpSgt: result = s > t; break;
+        case OpSgtu: result = us > ut; break;
+        case OpSge: result = s >= t; break;
+        case OpSgeu: result = us >= ut; break;
+        case OpNop: writes = false; break;
+        case OpMul:
+            result = s * t;
+            extraCycles += MulLatency;
+            break;
+        case OpMult: case OpMultu:
+        {
+            long long p = in.op == OpMult ? (long long)s * regs[in.rt]
+                                           : (long long)((unsigned long long)us * (unsigned int)regs[in.rt]);
+            lo = (int)p;
+            hi = (int)(p >> 32);
+            extraCycles += MulLatency;
+            writes = false;
+            break;
+        }
+        case OpDiv: case OpDivu: case OpRem: case OpRemu:
+            extraCycles += DivLatency;
+            if (t == 0)
+            {
+                RuntimeError("division by zero");
+                writes = false;
+                break;
+            }
+            if (in.op == OpDiv || in.op == OpRem)
+            {
+                // INT_MIN / -1 traps in C, wraps on MIPS
+                lo = (s == (int)0x80000000 && t == -1) ? s : s / t;
+                hi = (t == -1) ? 0 : s % t;
+            }
+            else
+            {
+                lo = us / ut;
+                hi = us % ut;
+            }
+            if (in.op == OpRem || in.op == OpRemu)
+                result = hi;
+            else if (in.size > 1) // three operand pseudo-instruction
+                result = lo;
+            else
+                writes = false;
+            break;
+        case OpMfhi: result = hi; break;
+        case OpMflo: result = lo; break;
+        case OpMthi: hi = s; writes = false; break;
+        case OpMtlo: lo = s; writes = false; break;
+        case OpLw: case OpLb: case OpLbu: case OpLh: case OpLhu:
+            if ((in.op == OpLw && (addr & 3)) || ((in.op == OpLh || in.op == OpLhu) && (addr & 1)))
+            {
+                RuntimeError("unaligned load from address 0x%08x", addr);
+                writes = false;
+                break;
+            }
+            DataAccess(addr);
+            if (in.op == OpLw)
+                result = ReadWord(addr);
+            else if (in.op == OpLb)
+                result = (signed char)ReadByte(addr);
+            else if (in.op == OpLbu)
+                result = ReadByte(addr);
+            else if (in.op == OpLh)
+                result = (short)(ReadByte(addr) | (ReadByte(addr + 1) << 8));
+            else
+                result = ReadByte(addr) | (ReadByte(addr + 1) << 8);
+            break;
+        case OpLwc1: case OpLd:
+            if (addr & 3)
+            {
+                RuntimeError("unaligned load from address 0x%08x", addr);
+                break;
+            }
+            DataAccess(addr);
+            fregs[in.rt] = ReadWord(addr);
+            if (in.op == OpLd)
+                fregs[in.rt + 1] = ReadWord(addr + 4);
+            writes = false;
+            break;
+        case OpSw: case OpSb: case OpSh: case OpSwc1: case OpSd:
+            writes = false;
+            if (((in.op == OpSw || in.op == OpSwc1 || in.op == OpSd) && (addr & 3)) ||
+                (in.op == OpSh && (addr & 1)))
+            {
+                RuntimeError("unaligned store to address 0x%08x", addr);
+                break;
+            }
+            DataAccess(addr);
+            if (in.op == OpSw)
+                WriteWord(addr, regs[in.rt]);
+            else if (in.op == OpSb)
+                WriteByte(addr, regs[in.rt]);
+            else if (in.op == OpSh)
+            {
+                WriteByte(addr, regs[in.rt]);
+                WriteByte(addr + 1, regs[in.rt] >> 8);
+            }
+            else
+            {
+                WriteWord(addr, fregs[in.rt]);
+                if (in.op == OpSd)
+                    WriteWord(addr + 4, fregs[in.rt + 1]);
+            }
+            break;
+        case OpBeq: if (s == t) next = in.target; writes = false; break;
+        case OpBne: if (s != t) next = in.target; writes = false; break;
+        case OpBeqz: if (s == 0) next = in.target; writes = false; break;
+        case OpBnez: if (s != 0) next = in.target; writes = false; break;
+        case OpBgez: if (s >= 0) next = in.target; writes = false; break;
+        case OpBgtz: if (s > 0) next = in.target; writes = false; break;
+        case OpBlez: if (s <= 0) next = in.target; writes = false; break;
+        case OpBltz: if (s < 0) next = in.target; writes = false; break;
+        case OpBlt: if (s < t) next = in.target; writes = false; break;
+        case OpBgt: if (s > t) next = in.target; writes = false; break;
+        case OpBle: if (s <= t) next = in.target; writes = false; break;
+        case OpBge: if (s >= t) next = in.target; writes = false; break;
+        case OpBltu: if (us < ut) next = in.target; writes = false; break;
+        case OpBgtu: if (us > ut) next = in.target; writes = false; break;
+        case OpBleu: if (us <= ut) next = in.target; writes = false; break;
+        case OpBgeu: if (us >= ut) next = in.target; writes = false; break;
+        case OpBc1t: if (fpCond) next = in.target; writes = false; break;
+        case OpBc1f: if (!fpCond) next = in.target; writes = false; break;
+        case OpB: case OpJ: next = in.target; writes = false; break;
+        case OpJal:
+            regs[31] = in.addr + 4 * in.size;
+            next = in.target;
+            writes = false;
+            break;
+        case OpJr: case OpJalr:
+        {
+            unsigned int dest = regs[in.rs];
+            if (in.op == OpJalr)
+                regs[in.rd] = in.addr + 4 * in.size;
+            writes = false;
+            if (dest == 0 && in.op == OpJr)
+            {
+                halted = true; // returned from the entry function
+                break;
+            }
+            std::unordered_map<unsigned int, int>::iterator t = textIndex.find(dest);
+            if (t == textIndex.end())
+                RuntimeError("jump to bad address 0x%08x", dest);
+            else
+                next = t->second;
+            break;
+        }
+        case OpSyscall:
+            writes = false;
+            DoSyscall();
+            break;
+        case OpBreak:
+            // 7 is the code for a division by zero
+            writes = false;
+            if (in.imm == 7)
+                RuntimeError("division by zero");
+            else
+                RuntimeError("break %d", in.imm);
+            break;
+        case OpAddD: case OpSubD: case OpMulD: case OpDivD:
+        {
+            double a = GetDouble(in.rs), b = GetDouble(in.rt), r;
+            if (in.op == OpAddD) r = a + b;
+            else if (in.op == OpSubD) r = a - b;
+            else if (in.op == OpMulD) r = a * b;
+            else r = a / b;
+            SetDouble(in.rd, r);
+            extraCycles += FloatLatency;
+            writes = false;
+            break;
+        }
+        case OpNegD: SetDouble(in.rd, -GetDouble(in.rs)); writes = false; break;
+        case OpAbsD: SetDouble(in.rd, fabs(GetDouble(in.rs))); writes = false; break;
+        case OpMovD: SetDouble(in.rd, GetDouble(in.rs)); writes = false; break;
+        case OpCeqD: fpCond = GetDouble(in.rs) == GetDouble(in.rt); writes = false; break;
+        case OpCltD: fpCond = GetDouble(in.rs) < GetDouble(in.rt); writes = false; break;
+        case OpCleD: fpCond = GetDouble(in.rs) <= GetDouble(in.rt); writes = false; break;
+        case OpCvtDW: SetDouble(in.rd, (double)(int)fregs[in.rs]); writes = false; break;
+        case OpCvtWD: fregs[in.rd] = (int)rint(GetDouble(in.rs)); writes = false; break;
+        case OpTruncWD: fregs[in.rd] = (int)GetDouble(in.rs); writes = false; break;
+        case OpMtc1: fregs[in.rs] = regs[in.rt]; writes = false; break;
+        case OpMfc1: regs[in.rt] = fregs[in.rs]; writes = false; break;
+        case OpLiD: SetDouble(in.rd, in.fimm); writes = false; break;
+        default:
+            RuntimeError("unimplemented instruction '%s'", opInfo[in.op].name);
+        }
+        int dest = cls == ClassLoad ? in.rt : in.rd;
+        if (writes && dest != 0)
+            regs[dest] = result;
+        pc = next;
+    }
+    fflush(stdout);
+    return exitCode;
+}
+
+void Simulator::PrintStats(FILE *fp)
+{
+    long long total = 0;
+    for (int i = 0; i < NumClasses; i++)
+        total += classCounts[i];
+    fprintf(fp, "\n--- dsim statistics ---\n");
+    fprintf(fp, "  instructions executed: %lld (%lld after pseudo-instruction expansion)\n",
+            total, realInstrs);
+    for (int i = 0; i < NumClasses; i++)
+        fprintf(fp, "    %-10s %12lld  %6.2f%%\n", className[i], classCounts[i],
+                total ? 100.0 * classCounts[i] / total : 0.0);
+    fprintf(fp, "  estimated cycles: %lld (CPI %.2f)\n", realInstrs + extraCycles,
+            realInstrs ? (double)(realInstrs + extraCycles) / realInstrs : 0.0);
+    if (icache)
+        icache->PrintStats(fp);
+    if (dcache)
+        dcache->PrintStats(fp);
+    fprintf(fp, "  heap used: %u bytes\n", heapEnd - ((DataBase + (unsigned int)data.size() + 4095) & ~4095u));
+}
+
+// Rows of a profile table, the hottest first.
+static std::vector<std::pair<long long, std::string> > Hottest(
+    const std::map<std::string, long long> &counts, size_t max)
+{
+    std::vector<std::pair<long long, std::string> > rows;
+    std::map<std::string, long long>::const_iterator it;
+    for (it = counts.begin(); it != counts.end(); ++it)
+        rows.push_back(std::make_pair(-it->second, it->first));
+    std::sort(rows.begin(), rows.end());
+    if (rows.size() > max)
+        rows.resize(max);
+    for (size_t i = 0; i < rows.size(); i++)
+        rows[i].first = -rows[i].first;
+    return rows;
+}
+
+/* Method: PrintProfile
+ * --------------------
+ * An instruction belongs to the function of the closest entry point
+ * before it: main, a jal target or a text address stored in the data
+ * (the vtables). Labels dcc makes up for branches (_L0, ...) only
+ * name a function when nothing else is at its address.
+ */
+void Simulator::PrintProfile(FILE *fp)
+{
+    static const size_t MaxRows = 15;
+    if (profileCounts.empty())
+        return;
+
+    std::vector<bool> entry(text.size(), false);
+    if (symbols.count("main") && textIndex.count(symbols["main"]))
+        entry[textIndex[symbols["main"]]] = true;
+    for (size_t i = 0; i < text.size(); i++)
+        if (text[i].op == OpJal && text[i].target >= 0 && text[i].target < (int)text.size())
+            entry[text[i].target] = true;
+    for (size_t at = 0; at + 4 <= data.size(); at += 4)
+    {
+        unsigned int word = data[at] | data[at + 1] << 8 | data[at + 2] << 16 | data[at + 3] << 24;
+        std::unordered_map<unsigned int, int>::iterator t = textIndex.find(word);
+        if (t != textIndex.end())
+            entry[t->second] = true;
+    }
+    std::map<unsigned int, std::string> names;
+    std::map<std::string, unsigned int>::iterator s;
+    for (s = symbols.begin(); s != symbols.end(); ++s)
+    {
+        bool local = s->first.size() > 2 && s->first[0] == '_' && s->first[1] == 'L' &&
+                     isdigit((unsigned char)s->first[2]);
+        if (!names.count(s->second) || !local)
+            names[s->second] = s->first;
+    }
+
+    std::map<std::string, long long> byFunction, byLine;
+    std::string function = "?";
+    bool haveLines = false;
+    char key[16];
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (entry[i])
+            function = names.count(text[i].addr) ? names[text[i].addr] : "?";
+        haveLines = haveLines || text[i].line;
+        if (!profileCounts[i])
+            continue;
+        byFunction[function] += profileCounts[i];
+        // sorts the lines by number where the counts are equal
+        sprintf(key, "%09d", text[i].line);
+        byLine[key] += profileCounts[i];
+    }
+
+    fprintf(fp, "\n--- dsim profile ---\n");
+    fprintf(fp, "  instructions by function:\n");
+    std::vector<std::pair<long long, std::string> > rows = Hottest(byFunction, MaxRows);
+    for (size_t i = 0; i < rows.size(); i++)
+        fprintf(fp, "    %12lld  %6.2f%%  %s\n", rows[i].first,
+                100.0 * rows[i].first / realInstrs, rows[i].second.c_str());
+    if (!haveLines)
+    {
+        fprintf(fp, "  no line table, compile with dcc -g for the counts by source line\n");
+        return;
+    }
+    fprintf(fp, "  instructions by source line:\n");
+    rows = Hottest(byLine, MaxRows);
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        int line = atoi(rows[i].second.c_str());
+        double percent = 100.0 * rows[i].first / realInstrs;
+        if (!line)
+        {
+            fprintf(fp, "    %12lld  %6.2f%%        (runtime, no source line)\n", rows[i].first, percent);
+            continue;
+        }
+        const char *source = sourceText.count(line) ? sourceText[line].c_str() : "";
+        while (isspace((unsigned char)*source))
+            source++;
+        fprintf(fp, "    %12lld  %6.2f%%  %5d  %s\n", rows[i].first, percent, line, source);
+    }
+}
@@ -0,0 +1,161 @@
+/* File: simulator.h
+ * -----------------
+ * The Simulator class loads the MIPS assembly emitted by dcc and
+ * executes it, playing the role SPIM plays for the course. It
+ * understands the subset of the SPIM assembler (directives and
+ * pseudo-instructions) that our code generator and the runtime
+ * printed by SysCallCodeGen use, and implements the SPIM syscalls.
+ *
+ * While running it counts the dynamic instruction mix by class and
+ * feeds every instruction fetch and data access through optional
+ * cache models, so that the effect of a backend change can be
+ * measured instead of judged by reading the .s file.
+ *
+ * Addresses follow the SPIM memory layout: text at 0x00400000,
+ * static data at 0x10010000 with $gp at 0x10008000, heap (sbrk)
+ * right after static data and the stack growing down from
+ * 0x7fffeffc.
+ *
+ * It also runs the ELF32 images dcc -target=mips-elf writes in that
+ * layout, decoding each machine word into an instruction of its own.
+ *
+ * With profiling on it counts the instructions run at each entry of
+ * the text. A function is where main, a jal or a vtable slot leads,
+ * and the line table dcc -g writes (see Mips::EmitLine) maps the
+ * entries back to the Decaf lines, with their text.
+ */
+
+#ifndef _H_simulator
+#define _H_simulator
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "cache.h"
+
+class Simulator
+{
+public:
+  // Classes used for the dynamic instruction mix report
+  typedef enum
+  {
+    ClassAlu,
+    ClassMulDiv,
+    ClassLoad,
+    ClassStore,
+    ClassBranch,
+    ClassJump,
+    ClassSyscall,
+    ClassFloat,
+    NumClasses
+  } OpClass;
+
+  static const unsigned int TextBase = 0x00400000,
+                            DataBase = 0x10010000,
+                            GlobalPointer = 0x10008000,
+                            StackTop = 0x7fffeffc;
+
+private:
+  struct Instr
+  {
+    int op;
+    int rd, rs, rt;   // register operands (fp registers share the fields)
+    int imm;          // immediate or memory offset
+    double fimm;      // for li.d
+    bool hasImm;      // third operand was an immediate
+    std::string label; // branch/jump target or address label
+    int target;       // resolved instruction index for branches
+    unsigned int addr;
+    int size;         // number of real instructions after expansion
+    int srcLine;      // line in the .s file, or address in an image
+    int line;         // Decaf source line from dcc -g, 0 if not known
+  };
+
+  std::vector<Instr> text;
+  std::unordered_map<unsigned int, int> textIndex; // address -> text index
+  std::map<std::string, unsigned int> symbols;
+  std::vector<unsigned char> data;
+  struct Fixup
+  {
+    unsigned int offset;
+    std::string label;
+    int srcLine;
+  };
+  std::vector<Fixup> dataFixups;
+
+  // machine state
+  int regs[32];
+  int hi, lo;
+  unsigned int fregs[32];
+  bool fpCond;
+  unsigned int heapEnd;
+  std::unordered_map<unsigned int, unsigned char *> pages;
+  unsigned char *lastPage;
+  unsigned int lastPageNum;
+
+  // measurement
+  Cache *icache, *dcache;
+  int missPenalty;
+  long long classCounts[NumClasses];
+  long long realInstrs, extraCycles;
+  long long instrLimit;
+  bool halted;
+  int exitCode;
+
+  const char *fileName;
+  int curLine;
+  bool image;
+
+  // the line table of dcc -g and the counts for the profile
+  int curSourceLine;
+  std::map<int, std::string> sourceText;
+  bool profiling;
+  std::vector<long long> profileCounts;
+
+  void ParseLine(char *line, bool *inText);
+  void ParseDirective(char *dir, char *args, bool *inText);
+  void ParseInstruction(char *mnemonic, char *args);
+  void Resolve();
+  void Decode(unsigned int word, unsigned int addr);
+  void ReadLineRecord(const char *record);
+  void LoadStaticData();
+
+  unsigned char *PageFor(unsigned int addr);
+  unsigned int ReadWord(unsigned int addr);
+  void WriteWord(unsigned int addr, unsigned int val);
+  unsigned char ReadByte(unsigned int addr);
+  void WriteByte(unsigned int addr, unsigned char val);
+  void DataAccess(unsigned int addr);
+  double GetDouble(int reg);
+  void SetDouble(int reg, double d);
+
+  void DoSyscall();
+  void RuntimeError(const char *fmt, ...);
+  void LoadError(const char *fmt, ...);
+
+public:
+  Simulator();
+
+  // Reads and assembles a whole .s file. Reports errors with Failure.
+  void Load(FILE *fp, const char *name);
+  // The same for an ELF32 image.
+  void LoadImage(FILE *fp, const char *name);
+
+  // Runs from the given label until exit. Returns the exit status.
+  int Run(const char *entry = "main");
+
+  void SetICache(Cache *c) { icache = c; }
+  void SetDCache(Cache *c) { dcache = c; }
+  void SetMissPenalty(int cycles) { missPenalty = cycles; }
+  void SetInstructionLimit(long long n) { instrLimit = n; }
+  void SetProfiling(bool on) { profiling = on; }
+
+  void PrintStats(FILE *fp);
+  // The instructions run by function and, for a program compiled
+  // with dcc -g, by source line, the hottest first.
+  void PrintProfile(FILE *fp);
+};
+
+#endif
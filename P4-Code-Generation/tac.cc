@@ -1,118 +1,151 @@
 /* File: tac.cc
  * ------------
- * Implementation of Location class and Instruction class/subclasses.
+ * Implementation of Location class and the TacCode class.
  */
 
 #include "tac.h"
-#include "mips.h"
+#include "target.h"
 #include <cstring>
+#include <string>
+#include <unordered_map>
 
-Location::Location(Segment s, int o, const char *name) : variableName(strdup(name)), segment(s), offset(o), base(NULL) {}
-
-Location::Location(Segment s, int o, const char *name, Location *b) : variableName(strdup(name)), segment(s), offset(o), base(b) {}
-
-void Location::Print()
+std::deque<Location> &Location::Pool()
 {
-    const char *s = (segment == fpRelative) ? "FP" : "GP";
-    const char *b = (base == NULL) ? "NIL" : base->GetName();
-    printf(" ~~[%s,%s,%d,%s]", variableName, s, offset, b);
+    static std::deque<Location> pool;
+    return pool;
 }
 
-void Instruction::Print()
+// The names of the variables and labels, each kept once. The tables
+// are made on first use, as Locations are made by static initializers.
+static std::vector<const char *> &Names()
 {
-    printf("\t%s ;\n", printed);
+    static std::vector<const char *> names;
+    return names;
 }
 
-void Instruction::Emit(Mips *mips)
+static int NameIndex(const char *name)
 {
-    // Mips::CurrentInstruction ci(*mips, this);
-    if (*printed)
-        mips->Emit("# %s", printed); // emit TAC as comment into assembly
-    EmitSpecific(mips);
+    static Arena text;
+    static std::unordered_map<std::string, int> index;
+    std::unordered_map<std::string, int>::iterator it = index.find(name);
+    if (it != index.end())
+        return it->second;
+    Names().push_back(text.Strdup(name));
+    return index[name] = Names().size() - 1;
 }
 
-LoadConstant::LoadConstant(Location *d, int v)
-    : dst(d), val(v)
+Location *Location::Add(Segment seg, int offset, int name, Location *base,
+                        bool isDouble)
 {
-    Assert(dst != NULL);
-    sprintf(printed, "%s = %d", dst->GetName(), val);
+    Location loc;
+    loc.id = Pool().size();
+    loc.offset = offset;
+    loc.base = IdOf(base);
+    loc.name = name;
+    loc.segment = seg;
+    loc.isDouble = isDouble;
+    Pool().push_back(loc);
+    return &Pool().back();
 }
 
-void LoadConstant::EmitSpecific(Mips *mips)
+// What a variable's Location is interned by, hashed like the names.
+struct LocationKey
 {
-    mips->EmitLoadConstant(dst, val);
-}
+    int name, offset, base;
+    int segmentAndDouble;
 
-LoadStringConstant::LoadStringConstant(Location *d, const char *s)
-    : dst(d)
-{
-    Assert(dst != NULL && s != NULL);
-    const char *quote = (*s == '"') ? "" : "\"";
-    str = new char[strlen(s) + 2 * strlen(quote) + 1];
-    sprintf(str, "%s%s%s", quote, s, quote);
-    quote = (strlen(str) > 50) ? "...\"" : "";
-    sprintf(printed, "%s = %.50s%s", dst->GetName(), str, quote);
-}
+    bool operator==(const LocationKey &other) const
+    {
+        return name == other.name && offset == other.offset && base == other.base &&
+               segmentAndDouble == other.segmentAndDouble;
+    }
+};
 
-void LoadStringConstant::EmitSpecific(Mips *mips)
+struct LocationKeyHash
 {
-    mips->EmitLoadStringConstant(dst, str);
-}
+    size_t operator()(const LocationKey &key) const
+    {
+        size_t h = key.name;
+        h = h * 31 + key.offset;
+        h = h * 31 + key.base;
+        return h * 31 + key.segmentAndDouble;
+    }
+};
 
-LoadLabel::LoadLabel(Location *d, const char *l)
-    : dst(d), label(strdup(l))
+Location *Location::Get(Segment seg, int offset, const char *name,
+                        Location *base, bool isDouble)
 {
-    Assert(dst != NULL && label != NULL);
-    sprintf(printed, "%s = %s", dst->GetName(), label);
+    static std::unordered_map<LocationKey, int, LocationKeyHash> interned;
+    Assert(name != NULL);
+    int n = NameIndex(name);
+    LocationKey key = {n, offset, IdOf(base), seg * 2 + isDouble};
+    std::unordered_map<LocationKey, int, LocationKeyHash>::iterator it = interned.find(key);
+    if (it != interned.end())
+        return WithId(it->second);
+    Location *loc = Add(seg, offset, n, base, isDouble);
+    interned[key] = loc->id;
+    return loc;
 }
 
-void LoadLabel::EmitSpecific(Mips *mips)
+Location *Location::NewTemp(int number, int offset, bool isDouble)
 {
-    mips->EmitLoadLabel(dst, label);
+    return Add(fpRelative, offset, -1 - number, NULL, isDouble);
 }
 
-Assign::Assign(Location *d, Location *s)
-    : dst(d), src(s)
+const char *Location::GetName() const
 {
-    Assert(dst != NULL && src != NULL);
-    sprintf(printed, "%s = %s", dst->GetName(), src->GetName());
+    if (name < 0)
+    {
+        char temp[32];
+        snprintf(temp, sizeof(temp), "_tmp%d", -1 - name);
+        name = NameIndex(temp);
+    }
+    return Names()[name];
 }
 
-void Assign::EmitSpecific(Mips *mips)
+std::vector<int> &Labels::Table()
 {
-    mips->EmitCopy(dst, src);
+    static std::vector<int> table;
+    return table;
 }
 
-Load::Load(Location *d, Location *s, int off)
-    : dst(d), src(s), offset(off)
+int Labels::New()
 {
-    Assert(dst != NULL && src != NULL);
-    if (offset)
-        sprintf(printed, "%s = *(%s + %d)", dst->GetName(), src->GetName(),
-                offset);
-    else
-        sprintf(printed, "%s = *(%s)", dst->GetName(), src->GetName());
+    static int nextLabelNum = 0;
+    Table().push_back(-1 - nextLabelNum++);
+    return Table().size() - 1;
 }
 
-void Load::EmitSpecific(Mips *mips)
+int Labels::Named(const char *name)
 {
-    mips->EmitLoad(dst, src, offset);
+    static std::unordered_map<int, int> labelOf; // name index -> label
+    int n = NameIndex(name);
+    std::unordered_map<int, int>::iterator it = labelOf.find(n);
+    if (it != labelOf.end())
+        return it->second;
+    Table().push_back(n);
+    return labelOf[n] = Table().size() - 1;
 }
 
-Store::Store(Location *d, Location *s, int off)
-    : dst(d), src(s), offset(off)
+const char *Labels::Name(int label)
 {
-    Assert(dst != NULL && src != NULL);
-    if (offset)
-        sprintf(printed, "*(%s + %d) = %s", dst->GetName(), offset,
-                src->GetName());
-    else
-        sprintf(printed, "*(%s) = %s", dst->GetName(), src->GetName());
+    if (label < 0)
+        return "0";
+    int &n = Table()[label];
+    if (n < 0)
+    {
+        char temp[32];
+        snprintf(temp, sizeof(temp), "_L%d", -1 - n);
+        n = NameIndex(temp);
+    }
+    return Names()[n];
 }
 
-void Store::EmitSpecific(Mips *mips)
+void Location::Print()
 {
-    mips->EmitStore(dst, src, offset);
+    const char *s = (segment == fpRelative) ? "FP" : "GP";
+    const char *b = (base < 0) ? "NIL" : GetBase()->GetName();
+    printf(" ~~[%s,%s,%d,%s]", GetName(), s, offset, b);
 }
 
 const char *const BinaryOp::opName[BinaryOp::NumOps] = {
@@ -129,159 +162,273 @@ BinaryOp::OpCode BinaryOp::OpCodeForName(const char *name)
     return Add; // can't get here, but compiler doesn't know that
 }
 
-BinaryOp::BinaryOp(OpCode c, Location *d, Location *o1, Location *o2)
-    : code(c), dst(d), op1(o1), op2(o2)
-{
-    Assert(dst != NULL && op1 != NULL && op2 != NULL);
-    Assert(code >= 0 && code < NumOps);
-    sprintf(printed, "%s = %s %s %s", dst->GetName(), op1->GetName(),
-            opName[code], op2->GetName());
-}
-
-void BinaryOp::EmitSpecific(Mips *mips)
-{
-    mips->EmitBinaryOp(code, dst, op1, op2);
-}
-
-Label::Label(const char *l) : label(strdup(l))
-{
-    Assert(label != NULL);
-    *printed = '\0';
-}
-
-void Label::Print()
-{
-    printf("%s:\n", label);
-}
-
-void Label::EmitSpecific(Mips *mips)
-{
-    mips->EmitLabel(label);
-}
-
-Goto::Goto(const char *l) : label(strdup(l))
-{
-    Assert(label != NULL);
-    sprintf(printed, "Goto %s", label);
-}
-
-void Goto::EmitSpecific(Mips *mips)
-{
-    mips->EmitGoto(label);
-}
-
-IfZ::IfZ(Location *te, const char *l)
-    : test(te), label(strdup(l))
-{
-    Assert(test != NULL && label != NULL);
-    sprintf(printed, "IfZ %s Goto %s", test->GetName(), label);
-}
-
-void IfZ::EmitSpecific(Mips *mips)
-{
-    mips->EmitIfZ(test, label);
-}
-
-BeginFunc::BeginFunc()
-{
-    sprintf(printed, "BeginFunc (unassigned)");
-    frameSize = -555; // used as sentinel to recognized unassigned value
-}
-
-void BeginFunc::SetFrameSize(int numBytesForAllLocalsAndTemps)
-{
-    frameSize = numBytesForAllLocalsAndTemps;
-    sprintf(printed, "BeginFunc %d", frameSize);
-}
-
-void BeginFunc::EmitSpecific(Mips *mips)
-{
-    mips->EmitBeginFunction(frameSize);
-}
-
-EndFunc::EndFunc() : Instruction()
-{
-    sprintf(printed, "EndFunc");
-}
-
-void EndFunc::EmitSpecific(Mips *mips)
-{
-    mips->EmitEndFunction();
-}
-
-Return::Return(Location *v) : val(v)
-{
-    sprintf(printed, "Return %s", val ? val->GetName() : "");
-}
-
-void Return::EmitSpecific(Mips *mips)
-{
-    mips->EmitReturn(val);
-}
-
-PushParam::PushParam(Location *p)
-    : param(p)
-{
-    Assert(param != NULL);
-    sprintf(printed, "PushParam %s", param->GetName());
-}
-
-void PushParam::EmitSpecific(Mips *mips)
-{
-    mips->EmitParam(param);
-}
-
-PopParams::PopParams(int nb)
-    : numBytes(nb)
-{
-    sprintf(printed, "PopParams %d", numBytes);
-}
-
-void PopParams::EmitSpecific(Mips *mips)
-{
-    mips->EmitPopParams(numBytes);
-}
-
-LCall::LCall(const char *l, Location *d)
-    : label(strdup(l)), dst(d)
-{
-    sprintf(printed, "%s%sLCall %s", dst ? dst->GetName() : "", dst ? " = " : "",
-            label);
-}
-
-void LCall::EmitSpecific(Mips *mips)
-{
-    mips->EmitLCall(dst, label);
-}
-
-ACall::ACall(Location *ma, Location *d)
-    : dst(d), methodAddr(ma)
-{
-    Assert(methodAddr != NULL);
-    sprintf(printed, "%s%sACall %s", dst ? dst->GetName() : "", dst ? " = " : "",
-            methodAddr->GetName());
-}
-void ACall::EmitSpecific(Mips *mips)
-{
-    mips->EmitACall(dst, methodAddr);
-}
-
-VTable::VTable(const char *l, List<const char *> *m)
-    : methodLabels(m), label(strdup(l))
-{
-    Assert(methodLabels != NULL && label != NULL);
-    sprintf(printed, "VTable for class %s", l);
-}
-
-void VTable::Print()
-{
-    printf("VTable %s =\n", label);
-    for (int i = 0; i < methodLabels->NumElements(); i++)
-        printf("\t%s,\n", methodLabels->Nth(i));
-    printf("; \n");
-}
-
-void VTable::EmitSpecific(Mips *mips)
-{
-    mips->EmitVTable(label, methodLabels);
+int TacCode::Add(Instruction::Op op, int line, int a, int b, int c, int opCode)
+{
+    Instruction in;
+    in.op = op;
+    in.code = opCode;
+    in.line = line;
+    in.a = a;
+    in.b = b;
+    in.c = c;
+    int index = code.size();
+    code.push_back(in);
+
+    if (op == Instruction::BeginFunc)
+    {
+        Range r = {index, -1};
+        functions.push_back(r);
+    }
+    else if (op == Instruction::EndFunc)
+    {
+        Assert(!functions.empty() && functions.back().end < 0);
+        functions.back().end = index + 1;
+    }
+    return index;
+}
+
+int TacCode::AddString(const char *s)
+{
+    Assert(s != NULL);
+    strings.push_back(text.Strdup(s));
+    return strings.size() - 1;
+}
+
+int TacCode::AddDouble(double d)
+{
+    doubles.push_back(d);
+    return doubles.size() - 1;
+}
+
+int TacCode::AddVTable(int label, List<int> *methodLabels, List<int> *itableLabels,
+                       List<int> *gcMap)
+{
+    Assert(methodLabels != NULL && label >= 0);
+    VTableEntry v = {label, methodLabels, itableLabels, gcMap};
+    vtables.push_back(v);
+    return vtables.size() - 1;
+}
+
+List<const char *> *TacCode::LabelNames(List<int> *labels)
+{
+    if (!labels)
+        return NULL;
+    List<const char *> *names = new List<const char *>;
+    for (int i = 0; i < labels->NumElements(); i++)
+        names->Append(Labels::Name(labels->Nth(i)));
+    return names;
+}
+
+void TacCode::SetFrameSize(int function, int numBytesForAllLocalsAndTemps)
+{
+    code[functions[function].begin].a = numBytesForAllLocalsAndTemps;
+}
+
+void TacCode::SetClearedSlots(int function, List<int> *offsets)
+{
+    slotLists.push_back(offsets);
+    code[functions[function].begin].b = slotLists.size() - 1;
+}
+
+void TacCode::Format(const Instruction &in, char *buf, int size)
+{
+    switch (in.op)
+    {
+    case Instruction::LoadConstant:
+        snprintf(buf, size, "%s = %d", Name(in.a), in.b);
+        break;
+    case Instruction::LoadDoubleConstant:
+        snprintf(buf, size, "%s = %.17g", Name(in.a), doubles[in.b]);
+        break;
+    case Instruction::LoadStringConstant:
+    {
+        const char *str = String(in.b);
+        snprintf(buf, size, "%s = %.50s%s", Name(in.a), str,
+                 (strlen(str) > 50) ? "...\"" : "");
+        break;
+    }
+    case Instruction::LoadLabel:
+        snprintf(buf, size, "%s = %s", Name(in.a), LabelName(in.b));
+        break;
+    case Instruction::Assign:
+        snprintf(buf, size, "%s = %s", Name(in.a), Name(in.b));
+        break;
+    case Instruction::Load:
+        if (in.c)
+            snprintf(buf, size, "%s = *(%s + %d)", Name(in.a), Name(in.b), in.c);
+        else
+            snprintf(buf, size, "%s = *(%s)", Name(in.a), Name(in.b));
+        break;
+    case Instruction::Store:
+        if (in.c)
+            snprintf(buf, size, "*(%s + %d) = %s", Name(in.a), in.c, Name(in.b));
+        else
+            snprintf(buf, size, "*(%s) = %s", Name(in.a), Name(in.b));
+        break;
+    case Instruction::Binary:
+        snprintf(buf, size, "%s = %s %s %s", Name(in.a), Name(in.b),
+                 BinaryOp::opName[in.code], Name(in.c));
+        break;
+    case Instruction::Label:
+        *buf = '\0';
+        break;
+    case Instruction::Goto:
+        snprintf(buf, size, "Goto %s", LabelName(in.a));
+        break;
+    case Instruction::IfZ:
+        snprintf(buf, size, "IfZ %s Goto %s", Name(in.a), LabelName(in.b));
+        break;
+    case Instruction::IfNZ:
+        snprintf(buf, size, "IfNZ %s Goto %s", Name(in.a), LabelName(in.b));
+        break;
+    case Instruction::BeginFunc:
+        if (in.a == -555) // the sentinel of an unassigned frame size
+            snprintf(buf, size, "BeginFunc (unassigned)");
+        else
+            snprintf(buf, size, "BeginFunc %d", in.a);
+        break;
+    case Instruction::EndFunc:
+        snprintf(buf, size, "EndFunc");
+        break;
+    case Instruction::Return:
+        snprintf(buf, size, "Return %s", in.a >= 0 ? Name(in.a) : "");
+        break;
+    case Instruction::PushParam:
+        snprintf(buf, size, "PushParam %s", Name(in.a));
+        break;
+    case Instruction::PopParams:
+        snprintf(buf, size, "PopParams %d", in.a);
+        break;
+    case Instruction::LCall:
+        snprintf(buf, size, "%s%sLCall %s", in.a >= 0 ? Name(in.a) : "",
+                 in.a >= 0 ? " = " : "", LabelName(in.b));
+        break;
+    case Instruction::ACall:
+        snprintf(buf, size, "%s%sACall %s", in.a >= 0 ? Name(in.a) : "",
+                 in.a >= 0 ? " = " : "", Name(in.b));
+        break;
+    case Instruction::HeapAlloc:
+        snprintf(buf, size, "%s = HeapAlloc %s%s%s", Name(in.a), Name(in.b),
+                 in.c >= 0 ? " " : "", in.c >= 0 ? LabelName(in.c) : "");
+        break;
+    case Instruction::VTable:
+        snprintf(buf, size, "VTable for class %s", LabelName(vtables[in.a].label));
+        break;
+    default:
+        Failure("Unknown Tac instruction %d", in.op);
+    }
+}
+
+void TacCode::Print(int i)
+{
+    const Instruction &in = code[i];
+    if (in.op == Instruction::Label)
+        printf("%s:\n", LabelName(in.a));
+    else if (in.op == Instruction::VTable)
+    {
+        VTableEntry &v = vtables[in.a];
+        printf("VTable %s =\n", LabelName(v.label));
+        for (int j = 0; j < v.methodLabels->NumElements(); j++)
+            printf("\t%s,\n", LabelName(v.methodLabels->Nth(j)));
+        printf("; \n");
+        if (v.itableLabels)
+        {
+            printf("ITable %s =\n", LabelName(v.label));
+            for (int j = 0; j < v.itableLabels->NumElements(); j++)
+                printf("\t%s,\n", LabelName(v.itableLabels->Nth(j)));
+            printf("; \n");
+        }
+    }
+    else
+    {
+        char printed[256];
+        Format(in, printed, sizeof(printed));
+        printf("\t%s ;\n", printed);
+    }
+}
+
+void TacCode::Emit(int i, Target *target)
+{
+    const Instruction &in = code[i];
+    if (target->ShowsTac() && in.op != Instruction::Label)
+    {
+        char printed[256];
+        Format(in, printed, sizeof(printed));
+        target->EmitComment(printed); // emit TAC as comment into assembly
+    }
+
+    switch (in.op)
+    {
+    case Instruction::LoadConstant:
+        target->EmitLoadConstant(Location::WithId(in.a), in.b);
+        break;
+    case Instruction::LoadDoubleConstant:
+        target->EmitLoadConstant(Location::WithId(in.a), doubles[in.b]);
+        break;
+    case Instruction::LoadStringConstant:
+        target->EmitLoadStringConstant(Location::WithId(in.a), String(in.b));
+        break;
+    case Instruction::LoadLabel:
+        target->EmitLoadLabel(Location::WithId(in.a), LabelName(in.b));
+        break;
+    case Instruction::Assign:
+        target->EmitCopy(Location::WithId(in.a), Location::WithId(in.b));
+        break;
+    case Instruction::Load:
+        target->EmitLoad(Location::WithId(in.a), Location::WithId(in.b), in.c);
+        break;
+    case Instruction::Store:
+        target->EmitStore(Location::WithId(in.a), Location::WithId(in.b), in.c);
+        break;
+    case Instruction::Binary:
+        target->EmitBinaryOp((BinaryOp::OpCode)in.code, Location::WithId(in.a),
+                             Location::WithId(in.b), Location::WithId(in.c));
+        break;
+    case Instruction::Label:
+        target->EmitLabel(LabelName(in.a));
+        break;
+    case Instruction::Goto:
+        target->EmitGoto(LabelName(in.a));
+        break;
+    case Instruction::IfZ:
+        target->EmitIfZ(Location::WithId(in.a), LabelName(in.b));
+        break;
+    case Instruction::IfNZ:
+        target->EmitIfNZ(Location::WithId(in.a), LabelName(in.b));
+        break;
+    case Instruction::BeginFunc:
+        target->EmitBeginFunction(in.a, in.b >= 0 ? slotLists[in.b] : NULL);
+        break;
+    case Instruction::EndFunc:
+        target->EmitEndFunction();
+        break;
+    case Instruction::Return:
+        target->EmitReturn(Location::WithId(in.a));
+        break;
+    case Instruction::PushParam:
+        target->EmitParam(Location::WithId(in.a));
+        break;
+    case Instruction::PopParams:
+        target->EmitPopParams(in.a);
+        break;
+    case Instruction::LCall:
+        target->EmitLCall(Location::WithId(in.a), LabelName(in.b));
+        break;
+    case Instruction::ACall:
+        target->EmitACall(Location::WithId(in.a), Location::WithId(in.b));
+        break;
+    case Instruction::HeapAlloc:
+        target->EmitHeapAlloc(Location::WithId(in.a), Location::WithId(in.b),
+                              in.c >= 0 ? LabelName(in.c) : NULL);
+        break;
+    case Instruction::VTable:
+    {
+        VTableEntry &v = vtables[in.a];
+        target->EmitVTable(LabelName(v.label), LabelNames(v.methodLabels),
+                           LabelNames(v.itableLabels), v.gcMap);
+        break;
+    }
+    default:
+        Failure("Unknown Tac instruction %d", in.op);
+    }
 }
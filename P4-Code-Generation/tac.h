@@ -1,14 +1,19 @@
 /* File: tac.h
  * -----------
- * This module contains the Instruction class (and its various
- * subclasses) that represent Tac instructions and the Location
- * class used for operands to those instructions.
+ * This module contains the Instruction record that represents Tac
+ * instructions, the TacCode class that stores the instructions of the
+ * program, and the Location class used for operands to those
+ * instructions.
  *
- * Each instruction is mostly just a little struct with a
- * few fields, but each responds polymorphically to the methods
- * Print and Emit, the first is used to print out the TAC form of
- * the instruction (helpful when debugging) and the second to
- * convert to the appropriate MIPS assembly.
+ * Each instruction is just a little fixed-size record: what kind of
+ * instruction it is and up to three operands, each a number. The
+ * TacCode keeps them all one after another in a single array and
+ * responds to the methods Print and Emit for each, the first is used
+ * to print out the TAC form of the instruction (helpful when
+ * debugging) and the second to convert to the appropriate MIPS
+ * assembly, or whatever else the target being compiled for wants
+ * (see target.h). The text of an instruction is only made up when it
+ * is printed.
  *
  * The operands to each instruction are of Location class.
  * A Location object is a simple representation of where a variable
@@ -23,9 +28,12 @@
 #ifndef _H_tac
 #define _H_tac
 
+#include <deque>
+#include <vector>
 #include "list.h" // for VTable
+#include "arena.h"
 
-class Mips;
+class Target;
 
 // A Location object is used to identify the operands to the
 // various TAC instructions. A Location is either fp or gp
@@ -34,6 +42,14 @@ class Mips;
 // For example, a declaration for integer num as the first local
 // variable in a function would be assigned a Location object
 // with name "num", segment fpRelative, and offset -8.
+// A double takes two words, its Location names the lower one.
+//
+// Locations are values kept in one pool and numbered by their id,
+// the number instructions refer to them by. A variable's Location is
+// interned: asking for the same name, segment, offset, base and type
+// again gives back the same one, so two Locations are the same
+// variable exactly when their ids are equal. A temp is only a number
+// until something asks for its name, "_tmp" and the number.
 
 typedef enum
 {
@@ -44,119 +60,67 @@ typedef enum
 class Location
 {
 protected:
-  const char *variableName;
-  Segment segment;
+  int id;
   int offset;
-  Location *base;
+  int base;         // id of the base Location, -1 for none
+  mutable int name; // index in the name table, -1 - n for temp n
+  unsigned char segment;
+  bool isDouble;
 
-public:
-  Location(Segment seg, int offset, const char *name);
-  Location(Segment seg, int offset, const char *name, Location *base);
+  // the pool, made on first use as Locations are made by static
+  // initializers too
+  static std::deque<Location> &Pool();
+  static Location *Add(Segment seg, int offset, int name, Location *base,
+                       bool isDouble);
 
-  const char *GetName() const { return variableName; }
-  Segment GetSegment() const { return segment; }
+public:
+  // The Location of a variable.
+  static Location *Get(Segment seg, int offset, const char *name,
+                       Location *base = NULL, bool isDouble = false);
+  // A new temp numbered number at offset in the frame.
+  static Location *NewTemp(int number, int offset, bool isDouble = false);
+
+  const char *GetName() const;
+  Segment GetSegment() const { return (Segment)segment; }
   int GetOffset() const { return offset; }
-  Location *GetBase() const { return base; }
+  Location *GetBase() const { return WithId(base); }
+  bool IsDouble() const { return isDouble; }
+  int GetId() const { return id; }
+  bool IsSameAs(const Location *other) const { return other && id == other->id; }
+
+  // the Location numbered id, NULL for -1
+  static Location *WithId(int id) { return id < 0 ? NULL : &Pool()[id]; }
+  static int IdOf(Location *loc) { return loc ? loc->id : -1; }
+  static int NumLocations() { return Pool().size(); }
 
   void Print();
 };
 
-// base class from which all Tac instructions derived
-// has the interface for the 2 polymorphic messages: Print & Emit
+// Labels are numbered like Locations, and an instruction refers to a
+// label by its number. A label made up for a branch is only a number
+// until its name, "_L" and the number, is needed to write it out. A
+// named label (a function, a vtable, a runtime routine or table) is
+// interned, so each name has one number however often it is used.
 
-class Instruction
+class Labels
 {
 protected:
-  char printed[128];
-
-public:
-  virtual void Print();
-  virtual void EmitSpecific(Mips *mips) = 0;
-  void Emit(Mips *mips);
-};
-
-// for convenience, the instruction classes are listed here.
-// the interfaces for the classes follows below
-
-class LoadConstant;
-class LoadStringConstant;
-class LoadLabel;
-class Assign;
-class Load;
-class Store;
-class BinaryOp;
-class Label;
-class Goto;
-class IfZ;
-class BeginFunc;
-class EndFunc;
-class Return;
-class PushParam;
-class PopParams;
-class LCall;
-class ACall;
-class VTable;
-
-class LoadConstant : public Instruction
-{
-  Location *dst;
-  int val;
-
-public:
-  LoadConstant(Location *dst, int val);
-  void EmitSpecific(Mips *mips);
-};
-
-class LoadStringConstant : public Instruction
-{
-  Location *dst;
-  char *str;
-
-public:
-  LoadStringConstant(Location *dst, const char *s);
-  void EmitSpecific(Mips *mips);
-};
-
-class LoadLabel : public Instruction
-{
-  Location *dst;
-  const char *label;
+  // the name index of each label, -1 - n for the branch label _Ln
+  static std::vector<int> &Table();
 
 public:
-  LoadLabel(Location *dst, const char *label);
-  void EmitSpecific(Mips *mips);
+  // a new branch label
+  static int New();
+  // the label of a name
+  static int Named(const char *name);
+  // The name of a label, made up the first time for a branch label.
+  // -1 is an empty slot of a vtable, which is written as 0.
+  static const char *Name(int label);
+  static int NumLabels() { return Table().size(); }
 };
 
-class Assign : public Instruction
-{
-  Location *dst, *src;
-
-public:
-  Assign(Location *dst, Location *src);
-  void EmitSpecific(Mips *mips);
-};
-
-class Load : public Instruction
-{
-  Location *dst, *src;
-  int offset;
-
-public:
-  Load(Location *dst, Location *src, int offset = 0);
-  void EmitSpecific(Mips *mips);
-};
-
-class Store : public Instruction
-{
-  Location *dst, *src;
-  int offset;
-
-public:
-  Store(Location *d, Location *s, int offset = 0);
-  void EmitSpecific(Mips *mips);
-};
-
-class BinaryOp : public Instruction
+// The operators of the BinaryOp instruction.
+class BinaryOp
 {
 public:
   typedef enum
@@ -178,121 +142,126 @@ public:
   } OpCode;
   static const char *const opName[NumOps];
   static OpCode OpCodeForName(const char *name);
-
-protected:
-  OpCode code;
-  Location *dst, *op1, *op2;
-
-public:
-  BinaryOp(OpCode c, Location *dst, Location *op1, Location *op2);
-  void EmitSpecific(Mips *mips);
-};
-
-class Label : public Instruction
-{
-  const char *label;
-
-public:
-  Label(const char *label);
-  void Print();
-  void EmitSpecific(Mips *mips);
-  const char *text() const { return label; }
 };
 
-class Goto : public Instruction
+// A Tac instruction. The operands a, b and c are Location ids, label
+// numbers (see Labels), plain numbers, or indices into the tables of
+// the TacCode, by op:
+//
+//   LoadConstant        a = b
+//   LoadDoubleConstant  a = double b
+//   LoadStringConstant  a = string b
+//   LoadLabel           a = label b
+//   Assign              a = b
+//   Load                a = *(b + c)
+//   Store               *(a + c) = b
+//   Binary              a = b code c
+//   Label, Goto         label a
+//   IfZ, IfNZ           test a, label b
+//   BeginFunc           frame size a, cleared slots b
+//   EndFunc
+//   Return              value a
+//   PushParam           param a
+//   PopParams           bytes a
+//   LCall               result a, label b
+//   ACall               result a, address b
+//   HeapAlloc           a = size b, descriptor label c
+//   VTable              vtable a
+//
+// where -1 is used for an operand that is left out.
+
+struct Instruction
 {
-  const char *label;
-
-public:
-  Goto(const char *label);
-  void EmitSpecific(Mips *mips);
-  const char *branch_label() const { return label; }
-};
-
-class IfZ : public Instruction
-{
-  Location *test;
-  const char *label;
-
-public:
-  IfZ(Location *test, const char *label);
-  void EmitSpecific(Mips *mips);
-  const char *branch_label() const { return label; }
-};
-
-class BeginFunc : public Instruction
-{
-  int frameSize;
-
-public:
-  BeginFunc();
-  // used to backpatch the instruction with frame size once known
-  void SetFrameSize(int numBytesForAllLocalsAndTemps);
-  void EmitSpecific(Mips *mips);
-};
-
-class EndFunc : public Instruction
-{
-public:
-  EndFunc();
-  void EmitSpecific(Mips *mips);
-};
-
-class Return : public Instruction
-{
-  Location *val;
-
-public:
-  Return(Location *val);
-  void EmitSpecific(Mips *mips);
-};
-
-class PushParam : public Instruction
-{
-  Location *param;
-
-public:
-  PushParam(Location *param);
-  void EmitSpecific(Mips *mips);
-};
-
-class PopParams : public Instruction
-{
-  int numBytes;
-
-public:
-  PopParams(int numBytesOfParamsToRemove);
-  void EmitSpecific(Mips *mips);
-};
-
-class LCall : public Instruction
-{
-  const char *label;
-  Location *dst;
-
-public:
-  LCall(const char *labe, Location *result);
-  void EmitSpecific(Mips *mips);
+  typedef enum
+  {
+    LoadConstant,
+    LoadDoubleConstant,
+    LoadStringConstant,
+    LoadLabel,
+    Assign,
+    Load,
+    Store,
+    Binary,
+    Label,
+    Goto,
+    IfZ,
+    IfNZ,
+    BeginFunc,
+    EndFunc,
+    Return,
+    PushParam,
+    PopParams,
+    LCall,
+    ACall,
+    HeapAlloc,
+    VTable
+  } Op;
+
+  unsigned char op;
+  unsigned char code; // the BinaryOp::OpCode of a Binary
+  int line;           // source line it was generated for, 0 if none
+  int a, b, c;
 };
 
-class ACall : public Instruction
-{
-  Location *dst, *methodAddr;
+// The instructions of the program in the order they were generated,
+// with the strings, doubles and vtables they refer to. The instructions
+// of each function, from its BeginFunc to its EndFunc, are a range in
+// the array, numbered in order, so the BeginFunc can be backpatched
+// once the function is done.
 
-public:
-  ACall(Location *meth, Location *result);
-  void EmitSpecific(Mips *mips);
-};
-
-class VTable : public Instruction
+class TacCode
 {
-  List<const char *> *methodLabels;
-  const char *label;
+protected:
+  struct VTableEntry
+  {
+    int label;
+    List<int> *methodLabels;
+    List<int> *itableLabels; // NULL for none
+    List<int> *gcMap;
+  };
+  struct Range
+  {
+    int begin, end;
+  };
+
+  std::vector<Instruction> code;
+  Arena text; // holds the string constants
+  std::vector<const char *> strings;
+  std::vector<double> doubles;
+  std::vector<VTableEntry> vtables;
+  std::vector<List<int> *> slotLists;
+  std::vector<Range> functions;
+
+  const char *String(int i) const { return strings[i]; }
+  const char *Name(int id) const { return Location::WithId(id)->GetName(); }
+  const char *LabelName(int label) const { return Labels::Name(label); }
+  // the names of a vtable's labels, for Target::EmitVTable
+  static List<const char *> *LabelNames(List<int> *labels);
+  // the text Print shows for an instruction, empty for a Label
+  void Format(const Instruction &in, char *buf, int size);
 
 public:
-  VTable(const char *labelForTable, List<const char *> *methodLabels);
-  void Print();
-  void EmitSpecific(Mips *mips);
+  // Appends an instruction and returns its index.
+  int Add(Instruction::Op op, int line, int a = -1, int b = -1, int c = -1,
+          int opCode = 0);
+  // Copies a quoted string literal into the arena and returns its
+  // index.
+  int AddString(const char *s);
+  int AddDouble(double d);
+  int AddVTable(int label, List<int> *methodLabels, List<int> *itableLabels,
+                List<int> *gcMap);
+
+  int NumInstructions() const { return code.size(); }
+  const Instruction &Nth(int i) const { return code[i]; }
+
+  // Functions are numbered as their BeginFunc is added.
+  int NumFunctions() const { return functions.size(); }
+  void SetFrameSize(int function, int numBytesForAllLocalsAndTemps);
+  // frame slots to zero on entry, for the garbage collector
+  void SetClearedSlots(int function, List<int> *offsets);
+
+  void Print(int i);
+  void Emit(int i, Target *target);
 };
 
 #endif
@@ -0,0 +1,82 @@
+/* File: target.h
+ * --------------
+ * The Target class is the interface each backend implements to
+ * translate the Tac instructions: TacCode::Emit calls one of its
+ * Emit methods per instruction. The backends are
+ *
+ *   Mips      MIPS assembly for spim or dsim (the default)
+ *   MipsElf   the same as an ELF32 image for dsim (-target=mips-elf)
+ *   X86       x86-64 assembly for gcc (-target=x86-64)
+ *   CSource   C for any C compiler (-target=c)
+ *   Bytecode  dvm bytecode (-emit-bc)
+ *   Jit       x86-64 machine code run in the compiler (-run)
+ *
+ * and NewTarget picks one from the command line.
+ */
+
+#ifndef _H_target
+#define _H_target
+
+#include "tac.h"
+#include "list.h"
+
+class Target
+{
+public:
+  virtual ~Target() {}
+
+  // Called before the first instruction and after the last one. EmitEnd
+  // writes out what the target has held back, or for the JIT runs it.
+  virtual void EmitPreamble() {}
+  virtual void EmitEnd() {}
+
+  // The Tac of the instruction about to be emitted, for the targets
+  // that write assembly to show it. The text is only made up for the
+  // targets whose ShowsTac is true.
+  virtual bool ShowsTac() { return false; }
+  virtual void EmitComment(const char *tac) {}
+
+  // With -g: the instructions that follow were generated for source
+  // line number line, whose text is given, up to the next call. Line
+  // 0 (text NULL) is code no line is known for. The MIPS targets keep
+  // a line table for dsim -profile, the others ignore it.
+  virtual void EmitLine(int line, const char *text) {}
+
+  virtual void EmitLoadConstant(Location *dst, int val) = 0;
+  virtual void EmitLoadConstant(Location *dst, double val) = 0;
+  virtual void EmitLoadStringConstant(Location *dst, const char *str) = 0;
+  virtual void EmitLoadLabel(Location *dst, const char *label) = 0;
+
+  virtual void EmitLoad(Location *dst, Location *reference, int offset) = 0;
+  virtual void EmitStore(Location *reference, Location *value, int offset) = 0;
+  virtual void EmitCopy(Location *dst, Location *src) = 0;
+
+  virtual void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                            Location *op1, Location *op2) = 0;
+
+  virtual void EmitLabel(const char *label) = 0;
+  virtual void EmitGoto(const char *label) = 0;
+  virtual void EmitIfZ(Location *test, const char *label) = 0;
+  virtual void EmitIfNZ(Location *test, const char *label) = 0;
+  virtual void EmitReturn(Location *returnVal) = 0;
+
+  virtual void EmitBeginFunction(int frameSize, List<int> *clearedSlots = NULL) = 0;
+  virtual void EmitEndFunction() = 0;
+
+  virtual void EmitParam(Location *arg) = 0;
+  virtual void EmitLCall(Location *result, const char *label) = 0;
+  virtual void EmitACall(Location *result, Location *fnAddr) = 0;
+  virtual void EmitPopParams(int bytes) = 0;
+
+  virtual void EmitHeapAlloc(Location *dst, Location *size, const char *descriptor = NULL) = 0;
+
+  virtual void EmitVTable(const char *label, List<const char *> *methodLabels,
+                          List<const char *> *itableLabels = NULL, List<int> *gcMap = NULL) = 0;
+};
+
+// The target the options ask for: "mips", "mips-elf", "x86-64", "c",
+// "bytecode" or "jit". NewTarget reports an unknown -target with Failure.
+const char *TargetName();
+Target *NewTarget();
+
+#endif
@@ -10,8 +10,27 @@
 #include "list.h"
 
 static List<const char *> debugKeys;
+static List<const char *> optionNames, optionValues;
 static const int BufferSize = 2048;
 
+// options the compiler understands, with whether they take a value
+static struct
+{
+  const char *name;
+  bool hasValue;
+} knownOptions[] = {
+    {"fprofile-generate", false},
+    {"fprofile-use", true},
+    {"fgc", false},
+    {"fno-buffered-output", false},
+    {"fheap-profile", false},
+    {"target", true},
+    {"emit-bc", false},
+    {"run", false},
+    {"input", true},
+    {"g", false},
+    {NULL, false}};
+
 void Failure(const char *format, ...)
 {
   va_list args;
@@ -61,17 +80,52 @@ void PrintDebug(const char *key, const char *format, ...)
   printf("+++ (%s): %s%s", key, buf, buf[strlen(buf) - 1] != '\n' ? "\n" : "");
 }
 
-void ParseCommandLine(int argc, char *argv[])
+const char *GetOption(const char *name)
+{
+  for (int i = 0; i < optionNames.NumElements(); i++)
+    if (!strcmp(optionNames.Nth(i), name))
+      return optionValues.Nth(i);
+  return NULL;
+}
+
+static void Usage()
 {
-  if (argc == 1)
+  printf("Usage:   [-fprofile-generate] [-fprofile-use=<file>] [-fgc] "
+         "[-fno-buffered-output] [-fheap-profile] [-target=<mips|mips-elf|x86-64|c>] [-emit-bc] "
+         "[-run [-input=<file>]] [-g] [-d <debug-key-1> <debug-key-2> ...] \n");
+  exit(2);
+}
+
+static void SetOption(const char *arg)
+{
+  const char *eq = strchr(arg, '=');
+  int len = eq ? eq - arg : strlen(arg);
+  for (int i = 0; knownOptions[i].name; i++)
+  {
+    if (strlen(knownOptions[i].name) != len || strncmp(knownOptions[i].name, arg, len))
+      continue;
+    if (knownOptions[i].hasValue != (eq != NULL))
+      Usage();
+    optionNames.Append(knownOptions[i].name);
+    optionValues.Append(eq ? eq + 1 : "");
     return;
+  }
+  Usage();
+}
 
-  if (strcmp(argv[1], "-d") != 0)
-  { // first arg is not -d
-    printf("Usage:   -d <debug-key-1> <debug-key-2> ... \n");
-    exit(2);
+void ParseCommandLine(int argc, char *argv[])
+{
+  int i = 1;
+  for (; i < argc && strcmp(argv[i], "-d") != 0; i++)
+  {
+    if (argv[i][0] != '-')
+      Usage();
+    SetOption(argv[i] + 1);
   }
 
-  for (int i = 2; i < argc; i++)
+  if (i == argc)
+    return;
+
+  for (i++; i < argc; i++)
     SetDebugForKey(argv[i], true);
 }
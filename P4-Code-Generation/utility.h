@@ -62,11 +62,23 @@ void SetDebugForKey(const char *key, bool val);
  */
 bool IsDebugOn(const char *key);
 
+/* Function: GetOption()
+ * Usage: const char *file = GetOption("fprofile-use");
+ * ----------------------------------------------------
+ * Returns the value given to a compiler option on the command line
+ * (the part after '=', or "" for a plain flag), or NULL if the
+ * option was not given.
+ */
+const char *GetOption(const char *name);
+
 /* Function: ParseCommandLine
  * --------------------------
- * Turn on the debugging flags from the command line.  Verifies that
- * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * Read the compiler options and then turn on the debugging flags from
+ * the command line: all the arguments following -d are flags to turn
+ * on. The options are the ones in the knownOptions table in
+ * utility.cc: -fprofile-generate, -fprofile-use=file, -fgc,
+ * -fno-buffered-output, -fheap-profile, -target=name, -emit-bc, -run,
+ * -input=file and -g.
  */
 void ParseCommandLine(int argc, char *argv[]);
 
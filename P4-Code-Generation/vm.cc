@@ -0,0 +1,376 @@
+/* File: vm.cc
+ * -----------
+ * Implementation of the VM class: loading a bytecode file, threading
+ * its code and the dispatch loop with the runtime routines.
+ */
+
+#include "vm.h"
+#include "utility.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+VM::VM()
+{
+    file = NULL;
+    fileSize = 0;
+    header = NULL;
+    code = NULL;
+    mem = NULL;
+    gp = 0;
+    result = 0;
+    resultD = 0;
+    executed = calls = 0;
+}
+
+VM::~VM()
+{
+    if (file)
+        munmap(file, fileSize);
+    rt.ReleaseMemory();
+}
+
+void VM::Load(const char *name)
+{
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+        Failure("cannot open %s", name);
+    fileSize = st.st_size;
+    if (fileSize < sizeof(BcHeader))
+        Failure("%s is not a bytecode file", name);
+    // private, so that threading the code doesn't write to the file
+    file = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        Failure("cannot map %s", name);
+
+    header = (const BcHeader *)file;
+    if (header->magic != BcMagic)
+        Failure("%s is not a bytecode file", name);
+    if (header->version != BcVersion)
+        Failure("%s is bytecode version %u, dvm runs version %u", name,
+                header->version, BcVersion);
+    if (sizeof(BcHeader) + 4 * (size_t)header->codeWords + header->dataBytes > fileSize ||
+        header->entry >= header->codeWords ||
+        BcDataBase + (uint64_t)header->dataBytes + header->globalBytes > StackTop - StackSize)
+        Failure("%s is truncated or corrupt", name);
+    code = (uint32_t *)(header + 1);
+
+    mem = rt.ReserveMemory();
+    memcpy(mem + BcDataBase, code + header->codeWords, header->dataBytes);
+    gp = (BcDataBase + header->dataBytes + 7) & ~7;
+    rt.SetHeap((gp + header->globalBytes + 4095) & ~4095, StackTop - StackSize);
+}
+
+/* Method: Thread
+ * --------------
+ * Checks the code and replaces each opcode by the offset of its
+ * handler from base. Branch and call targets have to be instructions,
+ * the targets of calls through a pointer are checked when they run.
+ */
+void VM::Thread(const char *base, const int32_t *handlers)
+{
+    uint32_t n = header->codeWords;
+    std::vector<bool> starts(n, false);
+    for (uint32_t pc = 0; pc < n; pc += 1 + BcOperands[code[pc]])
+    {
+        if (code[pc] >= NumBcOps || pc + BcOperands[code[pc]] >= n)
+            Failure("bad instruction at %u", pc);
+        starts[pc] = true;
+    }
+    if (!starts[header->entry])
+        Failure("bad entry point %u", header->entry);
+    for (uint32_t pc = 0, op; pc < n; pc += 1 + BcOperands[op])
+    {
+        op = code[pc];
+        int target = op == BcGoto || op == BcCall ? 1 : op == BcIfZ || op == BcIfNZ ? 2 : 0;
+        if (target && (code[pc + target] >= n || !starts[code[pc + target]]))
+            Failure("bad branch target at %u", pc);
+        if (op == BcBuiltIn && code[pc + 1] >= NumBcBuiltIns)
+            Failure("bad runtime routine at %u", pc);
+        code[pc] = handlers[op];
+    }
+}
+
+/* Method: CallBuiltIn
+ * -------------------
+ * The runtime routines, with their params read from above sp.
+ */
+void VM::CallBuiltIn(int id, uint32_t sp)
+{
+    int32_t arg = *(int32_t *)(mem + sp + 4);
+    switch (id)
+    {
+    case BcAllocFn:
+        result = rt.Allocate(arg);
+        break;
+    case BcReadLine:
+        result = rt.ReadLine();
+        break;
+    case BcReadInteger:
+        result = rt.ReadInteger();
+        break;
+    case BcReadDouble:
+        resultD = rt.ReadDouble();
+        break;
+    case BcStringEqual:
+        result = rt.StringEqual(arg, *(uint32_t *)(mem + sp + 8));
+        break;
+    case BcPrintInt:
+        rt.PrintInt(arg);
+        break;
+    case BcPrintString:
+        rt.PrintString(arg);
+        break;
+    case BcPrintBool:
+        rt.PrintBool(arg);
+        break;
+    case BcPrintDouble:
+    {
+        double d;
+        memcpy(&d, mem + sp + 4, sizeof(d));
+        rt.PrintDouble(d);
+        break;
+    }
+    case BcHalt:
+        rt.Halt();
+    case BcOutFlush:
+        rt.OutFlush();
+        break;
+    }
+}
+
+/* Method: Execute
+ * ---------------
+ * The dispatch loop. Every handler ends by jumping to the handler of
+ * the next instruction, whose offset from the first handler is the
+ * word at ip once the code is threaded. It is instantiated with and
+ * without the instruction count so the fast one pays nothing for it.
+ *
+ * fp and gp sit side by side so a slot operand picks its base with
+ * bit 0 instead of a branch.
+ */
+#define SLOT(e) (bases[(e) & 1] + ((e) & ~1u))
+#define I32(a) (*(int32_t *)(mem + (uint32_t)(a)))
+#define GETD(d, a) memcpy(&(d), mem + (uint32_t)(a), sizeof(double))
+#define SETD(a, d) memcpy(mem + (uint32_t)(a), &(d), sizeof(double))
+#define NEXT(n)                                 \
+    do                                          \
+    {                                           \
+        ip += (n);                              \
+        if (Counting)                           \
+            executed++;                         \
+        goto *(const void *)(base + (int32_t)*ip); \
+    } while (0)
+
+template <bool Counting>
+int VM::Execute()
+{
+    static const void *const labels[NumBcOps] = {
+        &&op_Exit, &&op_LoadConst, &&op_LoadDConst, &&op_LoadAddr,
+        &&op_Copy, &&op_CopyD, &&op_Load, &&op_LoadD, &&op_Store, &&op_StoreD,
+        &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Mod,
+        &&op_Eq, &&op_Ne, &&op_Lt, &&op_Le, &&op_Gt, &&op_Ge, &&op_And, &&op_Or,
+        &&op_DAdd, &&op_DSub, &&op_DMul, &&op_DDiv, &&op_DMod,
+        &&op_DEq, &&op_DNe, &&op_DLt, &&op_DLe, &&op_DGt, &&op_DGe,
+        &&op_Goto, &&op_IfZ, &&op_IfNZ, &&op_Enter, &&op_Return, &&op_ReturnVal,
+        &&op_ReturnD, &&op_Param, &&op_ParamD, &&op_PopParams, &&op_Call,
+        &&op_CallPtr, &&op_BuiltIn, &&op_Result, &&op_ResultD, &&op_Alloc};
+    const char *base = (const char *)&&op_Exit;
+    int32_t handlers[NumBcOps];
+    for (int i = 0; i < NumBcOps; i++)
+        handlers[i] = (const char *)labels[i] - base;
+    Thread(base, handlers);
+
+    uint32_t bases[2] = {StackTop, gp}; // fp, gp
+    uint32_t sp = StackTop, ra = 0;
+    const uint32_t *ip = code + header->entry;
+    double a, b;
+    NEXT(0);
+
+op_Exit:
+    return 0;
+op_LoadConst:
+op_LoadAddr:
+    I32(SLOT(ip[1])) = ip[2];
+    NEXT(3);
+op_LoadDConst:
+    memcpy(mem + SLOT(ip[1]), ip + 2, sizeof(double));
+    NEXT(4);
+op_Copy:
+    I32(SLOT(ip[1])) = I32(SLOT(ip[2]));
+    NEXT(3);
+op_CopyD:
+    memcpy(mem + SLOT(ip[1]), mem + SLOT(ip[2]), sizeof(double));
+    NEXT(3);
+op_Load:
+    I32(SLOT(ip[1])) = I32(I32(SLOT(ip[2])) + ip[3]);
+    NEXT(4);
+op_LoadD:
+    memcpy(mem + SLOT(ip[1]), mem + (uint32_t)(I32(SLOT(ip[2])) + ip[3]), sizeof(double));
+    NEXT(4);
+op_Store:
+    I32(I32(SLOT(ip[1])) + ip[3]) = I32(SLOT(ip[2]));
+    NEXT(4);
+op_StoreD:
+    memcpy(mem + (uint32_t)(I32(SLOT(ip[1])) + ip[3]), mem + SLOT(ip[2]), sizeof(double));
+    NEXT(4);
+
+#define INT_OP(name, expr)                                \
+    op_##name:                                            \
+    {                                                     \
+        int32_t x = I32(SLOT(ip[2])), y = I32(SLOT(ip[3])); \
+        I32(SLOT(ip[1])) = (expr);                        \
+        NEXT(4);                                          \
+    }
+    INT_OP(Add, (uint32_t)x + (uint32_t)y)
+    INT_OP(Sub, (uint32_t)x - (uint32_t)y)
+    INT_OP(Mul, (uint32_t)x * (uint32_t)y)
+    INT_OP(Eq, x == y)
+    INT_OP(Ne, x != y)
+    INT_OP(Lt, x < y)
+    INT_OP(Le, x <= y)
+    INT_OP(Gt, x > y)
+    INT_OP(Ge, x >= y)
+    INT_OP(And, x & y)
+    INT_OP(Or, x | y)
+    // INT_MIN / -1 traps in C, wraps on MIPS
+#define DIV_OP(name, expr)                                \
+    op_##name:                                            \
+    {                                                     \
+        int32_t x = I32(SLOT(ip[2])), y = I32(SLOT(ip[3])); \
+        if (y == 0)                                       \
+            Runtime::Error("division by zero");             \
+        I32(SLOT(ip[1])) = (expr);                        \
+        NEXT(4);                                          \
+    }
+    DIV_OP(Div, y == -1 ? -(uint32_t)x : x / y)
+    DIV_OP(Mod, y == -1 ? 0 : x % y)
+
+#define DOUBLE_OP(name, expr)          \
+    op_##name:                         \
+    {                                  \
+        GETD(a, SLOT(ip[2]));          \
+        GETD(b, SLOT(ip[3]));          \
+        double d = (expr);             \
+        SETD(SLOT(ip[1]), d);          \
+        NEXT(4);                       \
+    }
+#define DOUBLE_CMP(name, expr)         \
+    op_##name:                         \
+    {                                  \
+        GETD(a, SLOT(ip[2]));          \
+        GETD(b, SLOT(ip[3]));          \
+        I32(SLOT(ip[1])) = (expr);     \
+        NEXT(4);                       \
+    }
+    DOUBLE_OP(DAdd, a + b)
+    DOUBLE_OP(DSub, a - b)
+    DOUBLE_OP(DMul, a * b)
+    DOUBLE_OP(DDiv, a / b)
+    // like the MIPS code: the quotient truncated to a word, out of range
+    // quotients give INT_MIN as trunc.w.d does on the host
+    DOUBLE_OP(DMod, a - (fabs(a / b) < 2147483648.0 ? (double)(int32_t)(a / b) : -2147483648.0) * b)
+    DOUBLE_CMP(DEq, a == b)
+    DOUBLE_CMP(DNe, !(a == b))
+    DOUBLE_CMP(DLt, a < b)
+    DOUBLE_CMP(DLe, a <= b)
+    DOUBLE_CMP(DGt, b < a)
+    DOUBLE_CMP(DGe, b <= a)
+
+op_Goto:
+    ip = code + ip[1];
+    NEXT(0);
+op_IfZ:
+    if (I32(SLOT(ip[1])) == 0)
+    {
+        ip = code + ip[2];
+        NEXT(0);
+    }
+    NEXT(3);
+op_IfNZ:
+    if (I32(SLOT(ip[1])) != 0)
+    {
+        ip = code + ip[2];
+        NEXT(0);
+    }
+    NEXT(3);
+op_Enter:
+    I32(sp) = bases[0];
+    I32(sp - 4) = ra;
+    bases[0] = sp;
+    sp -= 8 + ip[1];
+    NEXT(2);
+op_ReturnVal:
+    result = I32(SLOT(ip[1]));
+    goto op_Return;
+op_ReturnD:
+    GETD(resultD, SLOT(ip[1]));
+op_Return:
+    sp = bases[0];
+    ip = code + I32(sp - 4);
+    bases[0] = I32(sp);
+    NEXT(0);
+op_Param:
+    I32(sp) = I32(SLOT(ip[1]));
+    sp -= 4;
+    NEXT(2);
+op_ParamD:
+    memcpy(mem + sp - 4, mem + SLOT(ip[1]), sizeof(double));
+    sp -= 8;
+    NEXT(2);
+op_PopParams:
+    sp += ip[1];
+    NEXT(2);
+op_Call:
+    ra = ip + 2 - code;
+    ip = code + ip[1];
+    calls++;
+    NEXT(0);
+op_CallPtr:
+{
+    uint32_t target = I32(SLOT(ip[1]));
+    if (target == 0 || target >= header->codeWords)
+        Runtime::Error("call through a bad function pointer");
+    ra = ip + 2 - code;
+    ip = code + target;
+    calls++;
+    NEXT(0);
+}
+op_BuiltIn:
+    CallBuiltIn(ip[1], sp);
+    NEXT(2);
+op_Result:
+    I32(SLOT(ip[1])) = result;
+    NEXT(2);
+op_ResultD:
+    SETD(SLOT(ip[1]), resultD);
+    NEXT(2);
+op_Alloc:
+    I32(SLOT(ip[1])) = rt.Allocate(I32(SLOT(ip[2])));
+    NEXT(3);
+}
+
+int VM::Run(bool counting)
+{
+    static char outBuf[1 << 16];
+    setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+    int status = counting ? Execute<true>() : Execute<false>();
+    fflush(stdout);
+    return status;
+}
+
+void VM::PrintStats(FILE *fp)
+{
+    fprintf(fp, "\n--- dvm statistics ---\n");
+    if (executed)
+        fprintf(fp, "  instructions executed: %lld\n", executed);
+    fprintf(fp, "  calls: %lld\n", calls);
+    fprintf(fp, "  heap used: %u bytes\n", rt.HeapUsed());
+}
@@ -0,0 +1,70 @@
+/* File: vm.h
+ * ----------
+ * The VM class runs the register bytecode dcc writes with -emit-bc
+ * (see bcformat.h). It is the fast way to run a Decaf program: where
+ * dsim decodes MIPS instructions and goes through the register file
+ * for every operand, a bytecode instruction does the work of a whole
+ * Tac instruction straight on the frame slots.
+ *
+ * The file is mapped copy-on-write and the code is direct threaded in
+ * place: when the program starts, each opcode word is replaced by the
+ * offset of its handler from the first handler, so dispatching is one
+ * indirect jump through the word at ip (a computed goto) rather than a
+ * switch on the opcode.
+ *
+ * The program's memory is a 4GB reservation, so a 32-bit address can
+ * be used as an offset into it without a bounds check. The data and
+ * globals come first, then the heap, which the allocator only ever
+ * bumps (dvm has no collector), and the stack grows down from the top.
+ * The runtime routines are the ones in runtime.h.
+ */
+
+#ifndef _H_vm
+#define _H_vm
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bcformat.h"
+#include "runtime.h"
+
+class VM
+{
+private:
+  static const uint32_t StackTop = 0xfffff000,
+                        StackSize = 64 << 20;
+
+  // the mapped file
+  void *file;
+  size_t fileSize;
+  const BcHeader *header;
+  uint32_t *code;
+
+  Runtime rt;
+  uint8_t *mem;
+  uint32_t gp;
+
+  // what the last call returned
+  int32_t result;
+  double resultD;
+
+  long long executed, calls;
+
+  template <bool Counting> int Execute();
+  void Thread(const char *base, const int32_t *handlers);
+  void CallBuiltIn(int id, uint32_t sp);
+
+public:
+  VM();
+  ~VM();
+
+  // Maps and checks a bytecode file. Reports errors with Failure.
+  void Load(const char *name);
+
+  // Runs main until the program ends. Returns the exit status.
+  // Counting the instructions executed slows the dispatch a little.
+  int Run(bool counting);
+
+  void PrintStats(FILE *fp);
+};
+
+#endif
@@ -0,0 +1,463 @@
+/* File: x86.cc
+ * ------------
+ * Implementation of the X86 class, which turns each Tac instruction
+ * into x86-64 assembly. Like the Mips class it goes through memory for
+ * every operand, with eax/ecx (rax/rcx for doubles) and xmm0-xmm2 as
+ * scratch registers.
+ */
+
+#include "x86.h"
+#include "utility.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+// the runtime routines the Tac calls, and the params they take: the
+// words at 0(%rsp), 4(%rsp) go in edi, esi, a double in xmm0
+static const struct
+{
+    const char *label;
+    int numWords;
+    bool takesDouble;
+} builtIns[] = {
+    {"_Alloc", 1, false},
+    {"_ReadLine", 0, false},
+    {"_ReadInteger", 0, false},
+    {"_ReadDouble", 0, false},
+    {"_StringEqual", 2, false},
+    {"_PrintInt", 1, false},
+    {"_PrintString", 1, false},
+    {"_PrintBool", 1, false},
+    {"_PrintDouble", 0, true},
+    {"_Halt", 0, false},
+    {"_OutFlush", 0, false},
+    {NULL, 0, false}};
+
+X86::X86()
+{
+    globalBytes = 0;
+    lastLabel = NULL;
+    inMain = false;
+}
+
+void X86::Emit(const char *fmt, ...)
+{
+    va_list args;
+    char buf[1024];
+
+    va_start(args, fmt);
+    vsprintf(buf, fmt, args);
+    va_end(args);
+    if (buf[strlen(buf) - 1] != ':')
+        printf("\t"); // don't tab in labels
+    if (buf[0] != '#')
+        printf("  "); // outdent comments a little
+    printf("%s", buf);
+    if (buf[strlen(buf) - 1] != '\n')
+        printf("\n"); // end with a newline
+}
+
+/* Method: Slot
+ * ------------
+ * The operand for a variable: off rbp, or off the globals label for a
+ * global. Params are 12 bytes further from rbp than from the MIPS fp
+ * (see x86.h). Returns a static buffer that the next call reuses.
+ */
+const char *X86::Slot(Location *loc)
+{
+    static char slots[2][32];
+    static int next;
+    char *slot = slots[next++ % 2];
+    int offset = loc->GetOffset();
+    if (loc->GetSegment() == gpRelative)
+    {
+        int end = offset + (loc->IsDouble() ? 8 : 4);
+        if (end > globalBytes)
+            globalBytes = end;
+        sprintf(slot, ".Lglobals+%d(%%rip)", offset);
+    }
+    else
+        sprintf(slot, "%d(%%rbp)", offset > 0 ? offset + 12 : offset);
+    return slot;
+}
+
+void X86::EmitLoadConstant(Location *dst, int val)
+{
+    Emit("movl $%d, %s\t# load constant value %d into %s", val, Slot(dst),
+         val, dst->GetName());
+}
+
+void X86::EmitLoadConstant(Location *dst, double val)
+{
+    long long bits;
+    memcpy(&bits, &val, sizeof(bits));
+    Emit("movabsq $%lld, %%rax\t# load constant value %g", bits, val);
+    Emit("movq %%rax, %s", Slot(dst));
+}
+
+/* Function: StringLength
+ * -----------------------
+ * Length of the string a literal (quotes included) assembles to.
+ */
+static int StringLength(const char *str)
+{
+    int length = 0;
+    for (const char *p = str + 1; *p && *p != '"'; p++, length++)
+        if (*p == '\\' && p[1])
+            p++;
+    return length;
+}
+
+// pooled as in the Mips class, so equal literals compare equal
+void X86::EmitLoadStringConstant(Location *dst, const char *str)
+{
+    std::map<std::string, const char *>::iterator it = stringLabels.find(str);
+    if (it == stringLabels.end())
+    {
+        char label[24];
+        sprintf(label, "_string%d", stringPool.NumElements() + 1);
+        it = stringLabels.insert(std::make_pair(std::string(str), strdup(label))).first;
+        stringPool.Append(strdup(str));
+    }
+    EmitLoadLabel(dst, it->second);
+}
+
+void X86::EmitLoadLabel(Location *dst, const char *label)
+{
+    Emit("movl $%s, %s\t# load label", label, Slot(dst));
+}
+
+void X86::EmitCopy(Location *dst, Location *src)
+{
+    if (src->IsDouble())
+    {
+        Emit("movq %s, %%rax", Slot(src));
+        Emit("movq %%rax, %s\t# copy to %s", Slot(dst), dst->GetName());
+        return;
+    }
+    Emit("movl %s, %%eax", Slot(src));
+    Emit("movl %%eax, %s\t# copy to %s", Slot(dst), dst->GetName());
+}
+
+void X86::EmitLoad(Location *dst, Location *reference, int offset)
+{
+    Emit("movl %s, %%eax", Slot(reference));
+    if (dst->IsDouble())
+    {
+        Emit("movq %d(%%rax), %%rcx\t# load with offset", offset);
+        Emit("movq %%rcx, %s", Slot(dst));
+        return;
+    }
+    Emit("movl %d(%%rax), %%eax\t# load with offset", offset);
+    Emit("movl %%eax, %s", Slot(dst));
+}
+
+void X86::EmitStore(Location *reference, Location *value, int offset)
+{
+    Emit("movl %s, %%eax", Slot(reference));
+    if (value->IsDouble())
+    {
+        Emit("movq %s, %%rcx", Slot(value));
+        Emit("movq %%rcx, %d(%%rax)\t# store with offset", offset);
+        return;
+    }
+    Emit("movl %s, %%ecx", Slot(value));
+    Emit("movl %%ecx, %d(%%rax)\t# store with offset", offset);
+}
+
+/* Method: EmitDivide
+ * ------------------
+ * idiv faults on a zero divisor and on INT_MIN / -1, which MIPS lets
+ * wrap, so both are tested first. The numeric labels are local to the
+ * sequence (1f is the next 1: forward).
+ */
+void X86::EmitDivide(BinaryOp::OpCode code, Location *dst,
+                     Location *op1, Location *op2)
+{
+    Emit("movl %s, %%eax", Slot(op1));
+    Emit("movl %s, %%ecx", Slot(op2));
+    Emit("testl %%ecx, %%ecx");
+    Emit("jnz 1f");
+    EmitCallRuntime("_DivideByZero");
+    Emit("1:");
+    Emit("cmpl $-1, %%ecx");
+    Emit("je 2f");
+    Emit("cltd");
+    Emit("idivl %%ecx");
+    if (code == BinaryOp::Mod)
+        Emit("movl %%edx, %%eax");
+    Emit("jmp 3f");
+    Emit("2:");
+    Emit(code == BinaryOp::Div ? "negl %%eax" : "xorl %%eax, %%eax");
+    Emit("3:");
+    Emit("movl %%eax, %s", Slot(dst));
+}
+
+void X86::EmitDoubleOp(BinaryOp::OpCode code, Location *dst,
+                       Location *op1, Location *op2)
+{
+    static const char *arith[] = {"addsd", "subsd", "mulsd", "divsd"};
+
+    Emit("movsd %s, %%xmm0", Slot(op1));
+    Emit("movsd %s, %%xmm1", Slot(op2));
+    if (code <= BinaryOp::Div)
+    {
+        Emit("%s %%xmm1, %%xmm0", arith[code]);
+        Emit("movsd %%xmm0, %s", Slot(dst));
+        return;
+    }
+    if (code == BinaryOp::Mod)
+    {
+        // the quotient truncated to a word, as trunc.w.d does on MIPS
+        Emit("movapd %%xmm0, %%xmm2");
+        Emit("divsd %%xmm1, %%xmm2");
+        Emit("cvttsd2si %%xmm2, %%eax");
+        Emit("cvtsi2sd %%eax, %%xmm2");
+        Emit("mulsd %%xmm1, %%xmm2");
+        Emit("subsd %%xmm2, %%xmm0\t# remainder");
+        Emit("movsd %%xmm0, %s", Slot(dst));
+        return;
+    }
+
+    // ucomisd sets ZF, PF and CF when the operands are unordered, so
+    // seta/setae (with the operands swapped for < and <=) are false on
+    // NaN and == needs PF clear as well
+    switch (code)
+    {
+    case BinaryOp::Eq:
+    case BinaryOp::Ne:
+        Emit("ucomisd %%xmm1, %%xmm0");
+        Emit(code == BinaryOp::Eq ? "sete %%al" : "setne %%al");
+        Emit(code == BinaryOp::Eq ? "setnp %%cl" : "setp %%cl");
+        Emit(code == BinaryOp::Eq ? "andb %%cl, %%al" : "orb %%cl, %%al");
+        break;
+    case BinaryOp::Lt:
+    case BinaryOp::Le:
+        Emit("ucomisd %%xmm0, %%xmm1");
+        Emit(code == BinaryOp::Lt ? "seta %%al" : "setae %%al");
+        break;
+    default:
+        Emit("ucomisd %%xmm1, %%xmm0");
+        Emit(code == BinaryOp::Gt ? "seta %%al" : "setae %%al");
+        break;
+    }
+    Emit("movzbl %%al, %%eax");
+    Emit("movl %%eax, %s", Slot(dst));
+}
+
+void X86::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                       Location *op1, Location *op2)
+{
+    static const char *arith[] = {"addl", "subl", "imull"};
+    static const char *setcc[] = {"sete", "setne", "setl", "setle", "setg", "setge"};
+
+    if (op1->IsDouble())
+    {
+        EmitDoubleOp(code, dst, op1, op2);
+        return;
+    }
+    if (code == BinaryOp::Div || code == BinaryOp::Mod)
+    {
+        EmitDivide(code, dst, op1, op2);
+        return;
+    }
+    Emit("movl %s, %%eax", Slot(op1));
+    switch (code)
+    {
+    case BinaryOp::Add:
+    case BinaryOp::Sub:
+    case BinaryOp::Mul:
+        Emit("%s %s, %%eax", arith[code], Slot(op2));
+        break;
+    case BinaryOp::And:
+        Emit("andl %s, %%eax", Slot(op2));
+        break;
+    case BinaryOp::Or:
+        Emit("orl %s, %%eax", Slot(op2));
+        break;
+    default:
+        Emit("cmpl %s, %%eax", Slot(op2));
+        Emit("%s %%al", setcc[code - BinaryOp::Eq]);
+        Emit("movzbl %%al, %%eax");
+        break;
+    }
+    Emit("movl %%eax, %s", Slot(dst));
+}
+
+void X86::EmitLabel(const char *label)
+{
+    Emit("%s:", label);
+    lastLabel = label;
+}
+
+void X86::EmitGoto(const char *label)
+{
+    Emit("jmp %s\t\t# unconditional branch", label);
+}
+
+void X86::EmitIfZ(Location *test, const char *label)
+{
+    Emit("cmpl $0, %s", Slot(test));
+    Emit("je %s\t\t# branch if %s is zero", label, test->GetName());
+}
+
+void X86::EmitIfNZ(Location *test, const char *label)
+{
+    Emit("cmpl $0, %s", Slot(test));
+    Emit("jne %s\t\t# branch if %s is not zero", label, test->GetName());
+}
+
+// main returns to the C library, which wants its exit status in eax
+void X86::EmitReturn(Location *returnVal)
+{
+    if (returnVal != NULL && returnVal->IsDouble())
+        Emit("movsd %s, %%xmm0\t# return value", Slot(returnVal));
+    else if (returnVal != NULL)
+        Emit("movl %s, %%eax\t# return value", Slot(returnVal));
+    else if (inMain)
+        Emit("xorl %%eax, %%eax");
+    Emit("leave\t\t\t# pop the frame, restore rbp");
+    Emit("ret");
+}
+
+void X86::EmitBeginFunction(int frameSize, List<int> *clearedSlots)
+{
+    Assert(frameSize >= 0);
+    inMain = lastLabel && !strcmp(lastLabel, "main");
+    Emit("pushq %%rbp\t\t# save fp");
+    Emit("movq %%rsp, %%rbp");
+    // the two words MIPS keeps for fp and ra stay, unused
+    Emit("subq $%d, %%rsp\t# make space for locals and temps", frameSize + 8);
+}
+
+void X86::EmitEndFunction()
+{
+    Emit("# (below handles reaching end of fn body with no explicit return)");
+    EmitReturn(NULL);
+}
+
+void X86::EmitParam(Location *arg)
+{
+    if (arg->IsDouble())
+    {
+        Emit("movq %s, %%rax", Slot(arg));
+        Emit("subq $8, %%rsp\t\t# make space for param");
+        Emit("movq %%rax, (%%rsp)");
+        return;
+    }
+    Emit("movl %s, %%eax", Slot(arg));
+    Emit("subq $4, %%rsp\t\t# make space for param");
+    Emit("movl %%eax, (%%rsp)");
+}
+
+/* Method: EmitCallRuntime
+ * -----------------------
+ * Calls a C routine with rsp 16-byte aligned. The old rsp is pushed
+ * twice so that it is on top of the aligned stack either way.
+ */
+void X86::EmitCallRuntime(const char *fn)
+{
+    Emit("movq %%rsp, %%rax");
+    Emit("andq $-16, %%rsp");
+    Emit("pushq %%rax");
+    Emit("pushq %%rax");
+    Emit("call %s", fn);
+    Emit("movq (%%rsp), %%rsp");
+}
+
+void X86::EmitStoreResult(Location *result)
+{
+    if (result != NULL && result->IsDouble())
+        Emit("movsd %%xmm0, %s\t# copy function return value", Slot(result));
+    else if (result != NULL)
+        Emit("movl %%eax, %s\t# copy function return value", Slot(result));
+}
+
+void X86::EmitLCall(Location *result, const char *label)
+{
+    int i = 0;
+    while (builtIns[i].label && strcmp(builtIns[i].label, label))
+        i++;
+    if (builtIns[i].label)
+    {
+        static const char *argRegs[] = {"edi", "esi"};
+        for (int w = 0; w < builtIns[i].numWords; w++)
+            Emit("movl %d(%%rsp), %%%s", 4 * w, argRegs[w]);
+        if (builtIns[i].takesDouble)
+            Emit("movsd (%%rsp), %%xmm0");
+        EmitCallRuntime(label);
+    }
+    else
+        Emit("call %-15s\t# jump to function", label);
+    EmitStoreResult(result);
+}
+
+void X86::EmitACall(Location *result, Location *fnAddr)
+{
+    Emit("movl %s, %%eax", Slot(fnAddr));
+    Emit("call *%%rax\t\t# jump to function");
+    EmitStoreResult(result);
+}
+
+void X86::EmitPopParams(int bytes)
+{
+    if (bytes != 0)
+        Emit("addq $%d, %%rsp\t\t# pop params off stack", bytes);
+}
+
+void X86::EmitHeapAlloc(Location *dst, Location *size, const char *descriptor)
+{
+    Emit("movl %s, %%edi", Slot(size));
+    EmitCallRuntime("_Alloc");
+    Emit("movl %%eax, %s", Slot(dst));
+}
+
+/* Method: EmitVTable
+ * ------------------
+ * As on MIPS: the method labels from the class label up, and the
+ * interface tables (if any) in the words just below it.
+ */
+void X86::EmitVTable(const char *label, List<const char *> *methodLabels,
+                     List<const char *> *itableLabels, List<int> *gcMap)
+{
+    Emit(".data");
+    Emit(".align 4");
+    for (int i = itableLabels ? itableLabels->NumElements() - 1 : -1; i >= 0; i--)
+        Emit(".long %s", itableLabels->Nth(i));
+    Emit("%s:\t\t# label for class %s vtable", label, label);
+    for (int i = 0; i < methodLabels->NumElements(); i++)
+        Emit(".long %s", methodLabels->Nth(i));
+    Emit(".text");
+}
+
+void X86::EmitPreamble()
+{
+    Emit("# standard Decaf preamble ");
+    Emit(".text");
+    Emit(".globl main");
+}
+
+/* Method: EmitEnd
+ * ---------------
+ * The string pool and the globals, which are only known once all the
+ * code is out. The word before each string holds its length.
+ */
+void X86::EmitEnd()
+{
+    if (stringPool.NumElements() != 0)
+    {
+        Emit(".section .rodata\t# string constants");
+        for (int i = 0; i < stringPool.NumElements(); i++)
+        {
+            const char *str = stringPool.Nth(i);
+            Emit(".align 4");
+            Emit(".long %d\t\t# length", StringLength(str));
+            Emit("%s: .asciz %s", stringLabels[str], str);
+        }
+    }
+    Emit(".bss");
+    Emit(".align 8");
+    Emit(".Lglobals:");
+    Emit(".zero %d", globalBytes ? globalBytes : 4);
+    Emit(".section .note.GNU-stack,\"\",@progbits");
+}
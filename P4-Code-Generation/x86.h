@@ -0,0 +1,96 @@
+/* File: x86.h
+ * -----------
+ * The X86 class translates the Tac instructions to x86-64 assembly for
+ * the GNU assembler (AT&T syntax), for -target=x86-64. The runtime
+ * routines are the C ones in x86runtime.c, so a program is built with
+ *
+ *     dcc -target=x86-64 < prog.decaf > prog.s
+ *     gcc -no-pie -o prog prog.s x86runtime.c
+ *
+ * Decaf pointers stay 32 bits, as the Tac lays out objects and arrays
+ * in words. That holds natively as long as everything a pointer can
+ * point at is in the low 2GB: the code and data of a non-PIE
+ * executable are, and the runtime maps the heap there (MAP_32BIT).
+ *
+ * Frames are on the machine stack with rbp as fp, laid out as in the
+ * MIPS code except that call and push %rbp take two 8-byte words where
+ * MIPS has the saved fp and ra, so the params start at 16(%rbp) rather
+ * than fp+4. Params are pushed a word at a time as on MIPS, which is
+ * why calls to the runtime realign the stack as the System V ABI
+ * wants it and pass the params in registers. Values are returned in
+ * eax, or xmm0 for a double, and no registers are kept across Tac
+ * instructions, so there are no callee-saved registers to worry about.
+ */
+
+#ifndef _H_x86
+#define _H_x86
+
+#include <map>
+#include <string>
+#include "tac.h"
+#include "list.h"
+#include "target.h"
+
+class X86 : public Target
+{
+private:
+  // the pool of string literals: label by text, texts in first use order
+  std::map<std::string, const char *> stringLabels;
+  List<const char *> stringPool;
+
+  int globalBytes;
+  const char *lastLabel;
+  bool inMain;
+
+  static void Emit(const char *fmt, ...);
+
+  const char *Slot(Location *loc);
+  void EmitCallRuntime(const char *fn);
+  void EmitStoreResult(Location *result);
+  void EmitDoubleOp(BinaryOp::OpCode code, Location *dst,
+                    Location *op1, Location *op2);
+  void EmitDivide(BinaryOp::OpCode code, Location *dst,
+                  Location *op1, Location *op2);
+
+public:
+  X86();
+
+  void EmitPreamble();
+  void EmitEnd();
+  bool ShowsTac() { return true; }
+  void EmitComment(const char *tac) { Emit("# %s", tac); }
+
+  void EmitLoadConstant(Location *dst, int val);
+  void EmitLoadConstant(Location *dst, double val);
+  void EmitLoadStringConstant(Location *dst, const char *str);
+  void EmitLoadLabel(Location *dst, const char *label);
+
+  void EmitLoad(Location *dst, Location *reference, int offset);
+  void EmitStore(Location *reference, Location *value, int offset);
+  void EmitCopy(Location *dst, Location *src);
+
+  void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                    Location *op1, Location *op2);
+
+  void EmitLabel(const char *label);
+  void EmitGoto(const char *label);
+  void EmitIfZ(Location *test, const char *label);
+  void EmitIfNZ(Location *test, const char *label);
+  void EmitReturn(Location *returnVal);
+
+  void EmitBeginFunction(int frameSize, List<int> *clearedSlots = NULL);
+  void EmitEndFunction();
+
+  void EmitParam(Location *arg);
+  void EmitLCall(Location *result, const char *label);
+  void EmitACall(Location *result, Location *fnAddr);
+  void EmitPopParams(int bytes);
+
+  // the runtime has no collector, the descriptor is dropped
+  void EmitHeapAlloc(Location *dst, Location *size, const char *descriptor = NULL);
+
+  void EmitVTable(const char *label, List<const char *> *methodLabels,
+                  List<const char *> *itableLabels = NULL, List<int> *gcMap = NULL);
+};
+
+#endif
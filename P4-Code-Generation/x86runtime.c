@@ -0,0 +1,209 @@
+/* File: x86runtime.c
+ * ------------------
+ * The Decaf runtime routines for programs compiled with
+ * -target=x86-64 (see x86.h), linked in with
+ *
+ *     gcc -no-pie -o prog prog.s x86runtime.c
+ *
+ * These are the routines SysCallCodeGen prints in MIPS, and behave the
+ * same: strings and arrays have their length in the word before them,
+ * input is parsed like the MIPS runtime does it and errors print an
+ * "Exception:" line. Decaf pointers are 32 bits, so the heap is mapped
+ * in the low 2GB and only ever bumped; there is no collector.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+// MAP_32BIT picks from a 1GB window, leave room for other mappings
+static const size_t HeapSize = (size_t)512 << 20;
+
+static char *heap, *heapLimit;
+
+static void Error(const char *message)
+{
+    fflush(stdout);
+    fprintf(stderr, "Exception: %s\n", message);
+    exit(1);
+}
+
+static void BadAccess(int sig)
+{
+    Error("bad memory access (null pointer?)");
+}
+
+// The handler runs on a stack of its own, so a stack overflow is
+// reported like a null pointer instead of killing the program.
+__attribute__((constructor)) static void Init(void)
+{
+    static char altStack[1 << 16];
+    stack_t ss;
+    struct sigaction sa;
+    memset(&ss, 0, sizeof(ss));
+    ss.ss_sp = altStack;
+    ss.ss_size = sizeof(altStack);
+    sigaltstack(&ss, NULL);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = BadAccess;
+    sa.sa_flags = SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+void _DivideByZero(void)
+{
+    Error("division by zero");
+}
+
+void *_Alloc(int32_t size)
+{
+    size_t bytes = ((size_t)size + 7) & ~(size_t)7;
+    if (heap == NULL)
+    {
+        heap = mmap(NULL, HeapSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT | MAP_NORESERVE, -1, 0);
+        if (heap == MAP_FAILED)
+            Error("cannot map the heap");
+        heapLimit = heap + HeapSize;
+    }
+    if (size < 0 || bytes > (size_t)(heapLimit - heap))
+        Error("out of heap memory");
+    char *block = heap;
+    heap += bytes;
+    return block;
+}
+
+char *_ReadLine(void)
+{
+    size_t length = 0, capacity = 64;
+    char *line = malloc(capacity);
+    int c;
+    fflush(stdout);
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (length == capacity)
+            line = realloc(line, capacity *= 2);
+        line[length++] = c;
+    }
+    char *s = _Alloc(length + 5);
+    *(int32_t *)s = length;
+    memcpy(s + 4, line, length);
+    s[4 + length] = '\0';
+    free(line);
+    return s + 4;
+}
+
+// blanks, a sign and digits, the rest of the line is ignored
+int32_t _ReadInteger(void)
+{
+    uint32_t value = 0;
+    int negative = 0, state = 0, c;
+    fflush(stdout);
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (state == 2)
+            continue;
+        if (c >= '0' && c <= '9')
+            value = value * 10 + (c - '0'), state = 1;
+        else if (state == 0 && (c == ' ' || c == '\t'))
+            continue;
+        else if (state == 0 && (c == '+' || c == '-'))
+            negative = c == '-', state = 1;
+        else
+            state = 2;
+    }
+    return negative ? -value : value;
+}
+
+// see _ReadDouble in main.cc for the states
+double _ReadDouble(void)
+{
+    double digits = 0;
+    int negative = 0, negExponent = 0, state = 0, c;
+    uint32_t afterPoint = 0, exponent = 0;
+    fflush(stdout);
+    while ((c = getchar()) != EOF && c != '\n')
+    {
+        if (state == 3)
+            continue;
+        if (c >= '0' && c <= '9')
+        {
+            if (state >= 4)
+                exponent = exponent * 10 + (c - '0'), state = 5;
+            else
+            {
+                digits = digits * 10 + (c - '0');
+                if (state == 2)
+                    afterPoint++;
+                else
+                    state = 1;
+            }
+        }
+        else if (c == '.')
+            state = state < 2 ? 2 : 3;
+        else if (state == 0)
+        {
+            if (c == ' ' || c == '\t')
+                continue;
+            if (c == '+' || c == '-')
+                negative = c == '-', state = 1;
+            else
+                state = 3;
+        }
+        else if ((c | 32) == 'e')
+            state = state < 3 ? 4 : 3;
+        else if (state == 4 && (c == '+' || c == '-'))
+            negExponent = c == '-', state = 5;
+        else
+            state = 3;
+    }
+    int32_t power = (negExponent ? -exponent : exponent) - afterPoint;
+    double scale = 1.0;
+    for (uint32_t i = power < 0 ? -(uint32_t)power : power; i && !isinf(scale); i--)
+        scale *= 10.0;
+    digits = power < 0 ? digits / scale : digits * scale;
+    return negative ? -digits : digits;
+}
+
+int32_t _StringEqual(const char *a, const char *b)
+{
+    int32_t length = ((const int32_t *)a)[-1];
+    return length == ((const int32_t *)b)[-1] && !memcmp(a, b, length);
+}
+
+void _PrintInt(int32_t n)
+{
+    printf("%d", n);
+}
+
+void _PrintString(const char *s)
+{
+    fputs(s, stdout);
+}
+
+void _PrintBool(int32_t b)
+{
+    fputs(b ? "true" : "false", stdout);
+}
+
+void _PrintDouble(double d)
+{
+    printf("%.*g", 16, d);
+}
+
+void _Halt(void)
+{
+    exit(0);
+}
+
+void _OutFlush(void)
+{
+    fflush(stdout);
+}